@@ -0,0 +1,425 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cache.h"
+#include "histogram.h"
+
+/*
+ * streamcache_bench drives streamcache::Cache directly from N client threads
+ * and reports throughput and per-operation latency percentiles, plus the
+ * eviction lag observed by the shards. Passing several shard counts runs the
+ * same workload once per count, which shows where lock contention stops
+ * scaling.
+ */
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct BenchConfig {
+        size_t threads {4};
+        double durationSec {5.0};
+        std::vector<size_t> shardCounts {4};
+        size_t evictionThreads {streamcache::EvictionScheduler::DEFAULT_WORKERS};
+        size_t maxMemoryMiB {0};
+        streamcache::EvictionPolicy policy {streamcache::EvictionPolicy::WTINYLFU};
+        size_t keys {100000};
+        double readRatio {0.9};
+        double zipfTheta {0.99};
+        size_t valueSize {64};
+        double ttlFraction {0.0};
+        int64_t ttlMs {1000};
+        double replayRatio {0.0};
+        size_t batch {1};
+        size_t batchThreads {0};
+        streamcache::ExecutionMode mode {streamcache::ExecutionMode::SHARED};
+        bool prefill {true};
+    };
+
+    enum class Op {
+        GET,
+        SET,
+        REPLAY,
+        MGET,
+        MSET,
+        COUNT
+    };
+
+    const char* opName(Op op) {
+        switch (op) {
+            case Op::GET: return "GET";
+            case Op::SET: return "SET";
+            case Op::REPLAY: return "REPLAY";
+            case Op::MGET: return "MGET";
+            case Op::MSET: return "MSET";
+            default: return "?";
+        }
+    }
+
+    /*
+    * Zipfian rank generator (Gray et al., "Quickly Generating Billion-Record
+    * Synthetic Databases"), as used by YCSB. theta = 0 degenerates to uniform.
+    */
+    class ZipfGenerator {
+        public:
+            ZipfGenerator(uint64_t n, double theta) : m_n(n), m_theta(theta) {
+                if (m_theta <= 0.0) {
+                    return;
+                }
+
+                double zeta2 {0.0};
+                for (uint64_t i {1}; i <= m_n; ++i) {
+                    m_zetan += 1.0 / std::pow(static_cast<double>(i), m_theta);
+                    if (i == 2) {
+                        zeta2 = m_zetan;
+                    }
+                }
+                m_alpha = 1.0 / (1.0 - m_theta);
+                m_eta = (1.0 - std::pow(2.0 / static_cast<double>(m_n), 1.0 - m_theta)) / (1.0 - zeta2 / m_zetan);
+            }
+
+            template <typename Rng>
+            uint64_t next(Rng& rng) const {
+                std::uniform_real_distribution<double> dist(0.0, 1.0);
+                const double u {dist(rng)};
+
+                if (m_theta <= 0.0) {
+                    return static_cast<uint64_t>(u * static_cast<double>(m_n)) % m_n;
+                }
+
+                const double uz {u * m_zetan};
+                if (uz < 1.0) {
+                    return 0;
+                }
+                if (uz < 1.0 + std::pow(0.5, m_theta)) {
+                    return 1;
+                }
+                return static_cast<uint64_t>(static_cast<double>(m_n) * std::pow(m_eta * u - m_eta + 1.0, m_alpha)) % m_n;
+            }
+
+        private:
+            uint64_t m_n {1};
+            double m_theta {0.0};
+            double m_zetan {0.0};
+            double m_alpha {0.0};
+            double m_eta {0.0};
+    };
+
+    /*
+    * Spreads Zipf ranks over the key space so the hottest keys do not all land
+    * next to each other (and on the same shard).
+    */
+    uint64_t scramble(uint64_t rank, uint64_t n) {
+        uint64_t h {rank * 0x9E3779B97F4A7C15ull};
+        h ^= h >> 29;
+        return h % n;
+    }
+
+    std::string keyFor(uint64_t idx) {
+        return "key:" + std::to_string(idx);
+    }
+
+    streamcache::CacheEntry makeEntry(const std::string& value, bool withTtl, int64_t ttlMs) {
+        streamcache::CacheEntry entry {};
+        entry.value = value;
+        entry.timeSet = Clock::now();
+        if (withTtl) {
+            entry.expiration = entry.timeSet + std::chrono::milliseconds(ttlMs);
+        }
+        return entry;
+    }
+
+    struct ThreadResult {
+        std::vector<streamcache::HistogramSnapshot> latency {};
+        uint64_t hits {0};
+        uint64_t misses {0};
+    };
+
+    void printRow(const std::string& label, const streamcache::HistogramSnapshot& h, double unitNs) {
+        std::cout << "  " << std::left << std::setw(14) << label << std::right
+                  << std::setw(12) << h.total
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(11) << static_cast<double>(h.percentile(50)) / unitNs
+                  << std::setw(11) << static_cast<double>(h.percentile(99)) / unitNs
+                  << std::setw(11) << static_cast<double>(h.percentile(99.9)) / unitNs
+                  << std::setw(12) << static_cast<double>(h.max) / unitNs << "\n";
+    }
+
+    void runOnce(const BenchConfig& config, size_t numShards) {
+        streamcache::Cache cache(numShards, config.evictionThreads, config.mode);
+        const std::string value(config.valueSize, 'x');
+
+        if (config.maxMemoryMiB > 0) {
+            cache.setMemoryLimit(config.maxMemoryMiB << 20, config.policy);
+        }
+        cache.setBatchWorkers(config.batchThreads);
+
+        if (config.prefill) {
+            for (uint64_t i {0}; i < config.keys; ++i) {
+                cache.set(keyFor(i), makeEntry(value, false, 0));
+            }
+        }
+
+        const ZipfGenerator zipf(config.keys, config.zipfTheta);
+        std::vector<ThreadResult> results(config.threads);
+        std::atomic<bool> go {false};
+        std::atomic<bool> stop {false};
+        std::vector<std::thread> workers {};
+
+        for (size_t t {0}; t < config.threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::mt19937_64 rng {0xC0FFEE + t};
+                std::uniform_real_distribution<double> coin(0.0, 1.0);
+
+                std::vector<streamcache::LatencyHistogram> latency(static_cast<size_t>(Op::COUNT));
+                uint64_t hits {0};
+                uint64_t misses {0};
+
+                while (!go.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+
+                // With --batch, GET and SET become MGET/MSET of that many keys.
+                std::vector<std::string> batchKeys(config.batch);
+                std::vector<std::string_view> batchViews(config.batch);
+
+                while (!stop.load(std::memory_order_relaxed)) {
+                    const std::string key {keyFor(scramble(zipf.next(rng), config.keys))};
+                    const double dice {coin(rng)};
+
+                    Op op {Op::SET};
+                    if (dice < config.replayRatio) {
+                        op = Op::REPLAY;
+                    } else if (dice < config.replayRatio + config.readRatio * (1.0 - config.replayRatio)) {
+                        op = Op::GET;
+                    }
+
+                    if (config.batch > 1 && op != Op::REPLAY) {
+                        op = op == Op::GET ? Op::MGET : Op::MSET;
+                        batchKeys[0] = key;
+                        for (size_t i {1}; i < config.batch; ++i) {
+                            batchKeys[i] = keyFor(scramble(zipf.next(rng), config.keys));
+                        }
+                        for (size_t i {0}; i < config.batch; ++i) {
+                            batchViews[i] = batchKeys[i];
+                        }
+                    }
+
+                    const auto start {Clock::now()};
+                    switch (op) {
+                        case Op::GET: {
+                            auto result {cache.get(key)};
+                            result ? ++hits : ++misses;
+                            break;
+                        }
+                        case Op::SET:
+                            cache.set(key, makeEntry(value, coin(rng) < config.ttlFraction, config.ttlMs));
+                            break;
+                        case Op::REPLAY:
+                            cache.getReplay(key);
+                            break;
+                        case Op::MGET:
+                            for (const auto& result : cache.multiGet(batchViews)) {
+                                result ? ++hits : ++misses;
+                            }
+                            break;
+                        case Op::MSET: {
+                            std::vector<streamcache::CacheEntry> entries {};
+                            entries.reserve(config.batch);
+                            for (size_t i {0}; i < config.batch; ++i) {
+                                entries.push_back(makeEntry(value, coin(rng) < config.ttlFraction, config.ttlMs));
+                            }
+                            cache.multiSet(batchViews, std::move(entries));
+                            break;
+                        }
+                        default:
+                            break;
+                    }
+                    const auto elapsed {Clock::now() - start};
+
+                    latency[static_cast<size_t>(op)].record(static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+                }
+
+                for (const auto& h : latency) {
+                    results[t].latency.push_back(h.snapshot());
+                }
+                results[t].hits = hits;
+                results[t].misses = misses;
+            });
+        }
+
+        const auto begin {Clock::now()};
+        go.store(true, std::memory_order_release);
+        std::this_thread::sleep_for(std::chrono::duration<double>(config.durationSec));
+        stop.store(true, std::memory_order_relaxed);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        const double elapsedSec {std::chrono::duration<double>(Clock::now() - begin).count()};
+
+        std::vector<streamcache::HistogramSnapshot> perOp(static_cast<size_t>(Op::COUNT));
+        uint64_t hits {0};
+        uint64_t misses {0};
+        for (const auto& result : results) {
+            for (size_t i {0}; i < perOp.size(); ++i) {
+                perOp[i].merge(result.latency[i]);
+            }
+            hits += result.hits;
+            misses += result.misses;
+        }
+
+        uint64_t totalOps {0};
+        for (const auto& h : perOp) {
+            totalOps += h.total;
+        }
+
+        std::cout << "shards=" << numShards << " threads=" << config.threads
+                  << (config.mode == streamcache::ExecutionMode::THREAD_PER_CORE ? " mode=thread-per-core" : "")
+                  << " ops=" << totalOps
+                  << std::fixed << std::setprecision(3)
+                  << " throughput=" << static_cast<double>(totalOps) / elapsedSec / 1e6 << " Mops/s"
+                  << " hit-ratio=" << (hits + misses ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0);
+        if (config.maxMemoryMiB > 0) {
+            std::cout << " policy=" << streamcache::evictionPolicyName(config.policy)
+                      << " evicted=" << cache.memoryEvictions();
+        }
+        std::cout << "\n";
+
+        std::cout << "  " << std::left << std::setw(14) << "op (us)" << std::right
+                  << std::setw(12) << "count" << std::setw(11) << "p50" << std::setw(11) << "p99"
+                  << std::setw(11) << "p999" << std::setw(12) << "max" << "\n";
+
+        for (size_t i {0}; i < perOp.size(); ++i) {
+            if (perOp[i].total > 0) {
+                printRow(opName(static_cast<Op>(i)), perOp[i], 1e3);
+            }
+        }
+
+        const auto memory {cache.memoryStats()};
+        std::cout << std::fixed << std::setprecision(1)
+                  << "  memory: " << static_cast<double>(memory.allocated) / (1 << 20) << " MiB allocated, "
+                  << static_cast<double>(memory.reserved) / (1 << 20) << " MiB reserved\n";
+
+        const auto lag {cache.evictionLag()};
+        if (lag.total > 0) {
+            printRow("evict-lag(ms)", lag, 1e6);
+        } else if (config.ttlFraction > 0.0) {
+            std::cout << "  evict-lag(ms)  no evictions observed\n";
+        }
+        std::cout << "\n";
+    }
+
+    std::vector<size_t> parseList(const std::string& s) {
+        std::vector<size_t> values {};
+        std::stringstream ss(s);
+        std::string item {};
+        while (std::getline(ss, item, ',')) {
+            values.push_back(std::stoul(item));
+        }
+        return values;
+    }
+
+    void printUsage() {
+        std::cout << "Usage: streamcache_bench [options]\n"
+                  << "  --threads <n>          client threads (default 4)\n"
+                  << "  --duration <sec>       run time per shard count (default 5)\n"
+                  << "  --shards <n[,n...]>    shard counts to sweep (default 4)\n"
+                  << "  --eviction-threads <n> eviction scheduler workers (default 1)\n"
+                  << "  --keys <n>             key-space size (default 100000)\n"
+                  << "  --read-ratio <0..1>    fraction of GETs among GET/SET (default 0.9)\n"
+                  << "  --zipf <theta>         Zipfian skew in [0, 1); 0 = uniform (default 0.99)\n"
+                  << "  --value-size <bytes>   value size (default 64)\n"
+                  << "  --ttl-fraction <0..1>  fraction of SETs carrying a TTL (default 0)\n"
+                  << "  --ttl-ms <ms>          TTL for those SETs (default 1000)\n"
+                  << "  --replay-ratio <0..1>  fraction of operations that are REPLAY (default 0)\n"
+                  << "  --maxmemory <MiB>      memory limit for the whole cache; 0 = unlimited (default 0)\n"
+                  << "  --policy <name>        eviction policy under --maxmemory: lru, lfu, wtinylfu (default wtinylfu)\n"
+                  << "  --batch <n>            keys per MGET/MSET; 1 = single-key GET/SET (default 1)\n"
+                  << "  --batch-threads <n>    workers for parallel MGET/MSET fan-out; 0 = off (default 0)\n"
+                  << "  --thread-per-core      one core-pinned owner thread per shard; clients queue operations to it\n"
+                  << "  --no-prefill           start from an empty cache\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config {};
+
+    for (int i {1}; i < argc; ++i) {
+        const std::string arg {argv[i]};
+        const bool hasValue {i + 1 < argc};
+
+        try {
+            if (arg == "--threads" && hasValue) {
+                config.threads = std::stoul(argv[++i]);
+            } else if (arg == "--duration" && hasValue) {
+                config.durationSec = std::stod(argv[++i]);
+            } else if (arg == "--shards" && hasValue) {
+                config.shardCounts = parseList(argv[++i]);
+            } else if (arg == "--eviction-threads" && hasValue) {
+                config.evictionThreads = std::stoul(argv[++i]);
+            } else if (arg == "--keys" && hasValue) {
+                config.keys = std::stoul(argv[++i]);
+            } else if (arg == "--read-ratio" && hasValue) {
+                config.readRatio = std::stod(argv[++i]);
+            } else if (arg == "--zipf" && hasValue) {
+                config.zipfTheta = std::stod(argv[++i]);
+            } else if (arg == "--value-size" && hasValue) {
+                config.valueSize = std::stoul(argv[++i]);
+            } else if (arg == "--ttl-fraction" && hasValue) {
+                config.ttlFraction = std::stod(argv[++i]);
+            } else if (arg == "--ttl-ms" && hasValue) {
+                config.ttlMs = std::stoll(argv[++i]);
+            } else if (arg == "--replay-ratio" && hasValue) {
+                config.replayRatio = std::stod(argv[++i]);
+            } else if (arg == "--maxmemory" && hasValue) {
+                config.maxMemoryMiB = std::stoul(argv[++i]);
+            } else if (arg == "--policy" && hasValue) {
+                auto policy {streamcache::parseEvictionPolicy(argv[++i])};
+                if (!policy) {
+                    printUsage();
+                    return 1;
+                }
+                config.policy = *policy;
+            } else if (arg == "--batch" && hasValue) {
+                config.batch = std::stoul(argv[++i]);
+            } else if (arg == "--batch-threads" && hasValue) {
+                config.batchThreads = std::stoul(argv[++i]);
+            } else if (arg == "--thread-per-core") {
+                config.mode = streamcache::ExecutionMode::THREAD_PER_CORE;
+            } else if (arg == "--no-prefill") {
+                config.prefill = false;
+            } else {
+                printUsage();
+                return arg == "--help" ? 0 : 1;
+            }
+        } catch (const std::exception&) {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (config.threads == 0 || config.keys == 0 || config.evictionThreads == 0 || config.batch == 0 || config.shardCounts.empty()
+        || config.zipfTheta < 0.0 || config.zipfTheta >= 1.0) {
+        printUsage();
+        return 1;
+    }
+
+    for (size_t numShards : config.shardCounts) {
+        if (numShards == 0) {
+            printUsage();
+            return 1;
+        }
+        runOnce(config, numShards);
+    }
+
+    return 0;
+}
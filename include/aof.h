@@ -0,0 +1,179 @@
+#pragma once
+#include <string>
+#include <optional>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include "shard.h"
+
+namespace streamcache {
+
+    /*
+    * When the AOF writer forces written batches to stable storage.
+    *   ALWAYS   - fsync after every group-committed batch.
+    *   EVERYSEC - fsync at most once per second (at most ~1s of writes lost on power failure).
+    *   NO       - never fsync; leave flushing to the operating system.
+    */
+    enum class FsyncPolicy {
+        ALWAYS,
+        EVERYSEC,
+        NO
+    };
+
+    /**
+     * Parses "always" / "everysec" / "no".
+     *
+     * @return The policy, or nullopt for an unknown name.
+     */
+    std::optional<FsyncPolicy> parseFsyncPolicy(const std::string& name);
+
+    /*
+    * Persistence configuration. Each shard appends to <dir>/shard-<index>.<generation>.aof.
+    * The generation advances with every snapshot, which makes older files redundant.
+    */
+    struct AofConfig {
+        std::string dir {};
+        FsyncPolicy fsync {FsyncPolicy::EVERYSEC};
+    };
+
+    /**
+     * Returns the AOF path for a shard: <dir>/shard-<index>.<generation>.aof.
+     */
+    std::string aofPathFor(const std::string& dir, size_t shardIdx, uint64_t generation);
+
+    /**
+     * Parses an AOF file name produced by aofPathFor().
+     *
+     * @return true if the name is an AOF file name.
+     */
+    bool parseAofFileName(const std::string& name, size_t& shardIdx, uint64_t& generation);
+
+    /*
+    * Operation types stored in the AOF. A ZADD record's value is one sorted-set
+    * member update, "<score> <member>" (see encodeMemberUpdate()).
+    */
+    enum class AofOp : uint8_t {
+        SET = 1,
+        ZADD = 2
+    };
+
+    /*
+    * A decoded AOF record. Times have already been converted back from
+    * wall-clock to this process's steady_clock.
+    */
+    struct AofRecord {
+        AofOp op {AofOp::SET};
+        std::string key {};
+        CacheEntry entry {};
+    };
+
+    /**
+     * Encodes the payload of a record (what follows the record header), the
+     * form writes take in the AOF and on the replication stream.
+     */
+    void encodeAofRecord(std::string& payload, AofOp op, std::string_view key, std::string_view value,
+                         Timestamp timeSet, std::optional<Timestamp> expiration);
+
+    /**
+     * Decodes a payload produced by encodeAofRecord().
+     *
+     * @return false if the payload is malformed.
+     */
+    bool decodeAofRecord(std::string_view payload, AofRecord& record);
+
+    /**
+    * @class AofWriter
+    * @brief Background, group-committing writer for one shard's append-only file.
+    *
+    * append() only encodes the record into an in-memory buffer and, if the buffer
+    * was empty, wakes the writer thread; it never touches the disk. The writer
+    * swaps the whole buffer out, issues one write() for the batch and then
+    * applies the fsync policy, so a burst of set() calls costs one syscall
+    * rather than one per key.
+    *
+    * Record layout: [u32 payload length][u32 checksum][payload], where payload is
+    * [u8 op][i64 timeSet epoch-us][i64 expiration epoch-us, 0 = none][key][value]
+    * with varint-length-prefixed strings. Times are wall-clock so they stay
+    * meaningful across restarts.
+    *
+    * Lifecycle:
+    * - The constructor opens (or creates) the file and starts the writer thread.
+    *   Throws std::system_error if the file cannot be opened.
+    * - rotate() moves appends to a new file at a precise point (used by snapshots).
+    * - stop() (or the destructor) writes out anything still buffered, fsyncs
+    *   unless the policy is NO, and joins the thread.
+    */
+    class AofWriter {
+        public:
+            AofWriter(std::string path, FsyncPolicy policy);
+            ~AofWriter();
+
+            AofWriter(const AofWriter&) = delete;
+            AofWriter& operator=(const AofWriter&) = delete;
+
+            /**
+            * Queues a SET record. The entry must carry the final expiration and timeSet.
+            */
+            void appendSet(std::string_view key, const CacheEntry& entry);
+
+            /**
+            * Queues a ZADD record for one member update, with the key's
+            * expiration as of that write.
+            */
+            void appendMember(std::string_view key, std::string_view update, Timestamp timeSet,
+                              std::optional<Timestamp> expiration);
+
+            /**
+            * Switches to a new file. Records queued before the call still go to the
+            * old file, which is then synced and closed by the writer thread; records
+            * queued afterwards go to the new one. The caller must make sure no
+            * append runs concurrently (the shard appends under its lock).
+            * Throws std::system_error if the new file cannot be opened.
+            *
+            * @param path The file subsequent records are appended to.
+            */
+            void rotate(const std::string& path);
+
+            void stop();
+
+        private:
+            std::string m_path {};
+            FsyncPolicy m_policy {};
+            int m_fd {-1};
+
+            std::string m_pending {};
+            std::vector<std::pair<int, std::string>> m_retired {};
+            std::mutex m_mutex {};
+            std::condition_variable m_cv {};
+            bool m_running {false};
+            std::thread m_thread {};
+
+            /**
+            * Writer loop: waits for pending records, writes them as one batch and fsyncs per policy.
+            */
+            void runLoop();
+
+            /**
+            * Frames an encoded payload into the pending batch.
+            */
+            void append(const std::string& payload);
+
+            void writeAll(int fd, const std::string& batch);
+    };
+
+    /**
+     * Reads every intact record from an AOF file in order and hands it to the callback.
+     * A torn or corrupt tail (e.g. from a crash mid-write) is truncated away so that
+     * new appends start from a clean record boundary.
+     *
+     * @param path The AOF file to read.
+     * @param apply Called once per record, in file order.
+     * @return The number of records applied.
+     */
+    size_t replayAof(const std::string& path, const std::function<void(AofRecord&)>& apply);
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "cache.h"
+#include "mpsc_queue.h"
+
+namespace streamcache {
+
+    /*
+    * Counters of an AsyncClient; submitted / batches is the average batch size.
+    */
+    struct AsyncClientStats {
+        uint64_t submitted {0};     // operations queued so far
+        uint64_t completed {0};     // operations applied and called back
+        uint64_t batches {0};       // segments applied, each with one multiSet() and/or multiGet()
+    };
+
+    /**
+    * @class AsyncClient
+    * @brief In-process asynchronous front end that batches single-key operations.
+    *
+    * get() and set() may be called from any number of threads; they queue the
+    * operation on a bounded lock-free MPSC queue and return at once. A
+    * dispatcher thread drains the queue and applies whatever has piled up since
+    * its last pass with one Cache::multiSet() and one Cache::multiGet(), which
+    * group the keys by shard: one lock acquisition (or one owner-thread
+    * hand-off in thread-per-core mode) per shard and batch instead of one per
+    * operation. Under light load a batch is a single operation and costs one
+    * queue hop over a direct call; under heavy load batches grow on their own
+    * while the previous one is being applied.
+    *
+    * A batch's writes are applied before its reads, except that it is split
+    * where a write would overtake an earlier read of the same key; so every
+    * operation sees all operations submitted before it from the same thread,
+    * and a read never sees a later write. Callbacks run on the dispatcher
+    * thread in queue order: they must be short, must not throw and must not
+    * wait on this client. A full queue makes submitters yield until there is
+    * room.
+    */
+    class AsyncClient {
+        public:
+            /*
+            * Operations the queue holds before submitters have to wait.
+            */
+            static constexpr size_t QUEUE_CAPACITY = 8192;
+
+            /*
+            * Default cap on the operations applied per dispatcher pass.
+            */
+            static constexpr size_t DEFAULT_MAX_BATCH = 512;
+
+            /**
+            * Starts the dispatcher thread.
+            *
+            * @param cache The cache to serve from; it must outlive the client.
+            * @param maxBatch Most operations taken off the queue per pass.
+            */
+            explicit AsyncClient(Cache& cache, size_t maxBatch = DEFAULT_MAX_BATCH);
+
+            /**
+            * Applies and calls back every operation already queued, then stops
+            * the dispatcher. No get() or set() may be running.
+            */
+            ~AsyncClient();
+
+            AsyncClient(const AsyncClient&) = delete;
+            AsyncClient& operator=(const AsyncClient&) = delete;
+
+            /**
+            * Queues a lookup; done receives the value, as from Cache::getRef().
+            */
+            void get(std::string_view key, std::function<void(std::optional<ValueRef>)> done);
+
+            /**
+            * Like get() with a callback, but the result is delivered through a future.
+            */
+            std::future<std::optional<ValueRef>> get(std::string_view key);
+
+            /**
+            * Queues a write; done is called once it is applied, unless empty.
+            */
+            void set(std::string_view key, CacheEntry entry, std::function<void()> done);
+
+            /**
+            * Like set() with a callback, but completion is signaled through a future.
+            */
+            std::future<void> set(std::string_view key, CacheEntry entry);
+
+            AsyncClientStats stats() const;
+
+        private:
+            /*
+            * One queued operation, owned by the queue until the dispatcher applies it.
+            */
+            struct Operation {
+                bool write {false};
+                std::string key {};
+                CacheEntry entry {};
+                std::function<void(std::optional<ValueRef>)> onGet {};
+                std::function<void()> onSet {};
+            };
+
+            Cache& m_cache;
+            const size_t m_maxBatch;
+            MpscQueue<Operation*> m_queue {QUEUE_CAPACITY};
+
+            std::atomic<uint64_t> m_submitted {0};
+            std::atomic<uint64_t> m_completed {0};
+            std::atomic<uint64_t> m_batches {0};
+
+            // Sleep/wake hand-shake with submitters, as in ShardExecutor.
+            std::atomic<bool> m_sleeping {false};
+            std::mutex m_mutex {};
+            std::condition_variable m_cv {};
+            bool m_stopping {false};
+
+            std::thread m_thread {};
+
+            void push(Operation* op);
+
+            /**
+            * Main loop of the dispatcher thread.
+            */
+            void run();
+
+            /**
+            * Applies a batch segment, writes first, then calls its operations
+            * back and frees them.
+            */
+            void apply(Operation* const* ops, size_t count);
+
+            /**
+            * Sleeps until an operation is queued.
+            *
+            * @return false once the client is stopping and the queue is drained.
+            */
+            bool waitForWork();
+    };
+}
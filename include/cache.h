@@ -1,16 +1,78 @@
 #pragma once
 #include "shard.h"
+#include "aof.h"
+#include "eviction_scheduler.h"
+#include "shard_executor.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 
 namespace streamcache {
 
+    class SnapshotWriter;
+
+    /*
+    * How operations reach the shards.
+    */
+    enum class ExecutionMode {
+        SHARED,             // any calling thread works on any shard, under the shard's lock
+        THREAD_PER_CORE     // each shard is owned by one core-pinned thread that runs all its operations
+    };
+
+    /*
+    * One step of Cache::scan(): the cursor to continue from (0 when the scan is
+    * complete) and the keys found in this step.
+    */
+    struct ScanResult {
+        uint64_t cursor {0};
+        std::vector<std::string> keys {};
+    };
+
     /**
      * Cache = top-level router that distributes keys across multiple shards.
      * Each shard is a self-contained mini-cache with its own index, logs,
-     * eviction queue, and synchronization primitives.
+     * expiry index, and synchronization primitives. Expired keys of all shards
+     * are removed by one shared EvictionScheduler.
+     *
+     * Keys are routed with jump consistent hashing, so the shard count can grow
+     * online (reshard()): only the keys that belong to the new shards move, and a
+     * background thread migrates them in short batches while traffic continues.
+     * During a migration a moving key is served from its old shard for as long
+     * as it is there, and from its new shard afterwards.
+     *
+     * In ExecutionMode::THREAD_PER_CORE every shard belongs to a ShardExecutor:
+     * calls are queued to the owner thread of the key's shard and the shard runs
+     * without locks, so writers to different shards never touch a shared cache
+     * line and writers to the same shard never wait on each other's lock. The
+     * synchronous API waits for the result; getAsync()/setAsync() return a
+     * future or run a callback instead. Resharding is not available in this mode.
      */
     class Cache {
         public:
-            explicit Cache(size_t numShards);
+            /*
+            * Upper bound on the shard count; slots for this many shards are
+            * reserved up front so growing never moves a shard.
+            */
+            static constexpr size_t MAX_SHARDS = 1024;
+
+            /**
+             * One shard per hardware thread (at least one).
+             */
+            static size_t defaultShardCount();
+
+            /**
+             * @param numShards Number of shards the keyspace is split across (1..MAX_SHARDS).
+             * @param evictionWorkers Threads in the shared eviction scheduler, independent of numShards
+             *                        (unused in thread-per-core mode, where each owner evicts its own shard).
+             * @param mode Whether calling threads work on the shards directly or hand
+             *             operations to one owner thread per shard.
+             */
+            explicit Cache(size_t numShards, size_t evictionWorkers = EvictionScheduler::DEFAULT_WORKERS,
+                           ExecutionMode mode = ExecutionMode::SHARED);
             ~Cache();
 
             /**
@@ -18,18 +80,593 @@ namespace streamcache {
              * These methods route to the appropriate shard based on the key.
              */
 
-            void set(const std::string& key, CacheEntry entry);
+            void set(std::string_view key, CacheEntry entry);
+
+            std::optional<std::string> get(std::string_view key);
+
+            /**
+             * Like get(), but returns a reference to the stored buffer instead of a
+             * copy; the bytes stay valid after the shard lock is released and even
+             * if the key is overwritten or evicted. See ValueRef.
+             *
+             * @param wrongType If given, set to true when the key holds a sorted
+             *                  set, which has no value and reads as nullopt.
+             */
+            std::optional<ValueRef> getRef(std::string_view key, bool* wrongType = nullptr);
+
+            /**
+             * Looks a key up without waiting for the result. In thread-per-core mode
+             * the callback runs on the shard's owner thread, so it must be short, must
+             * not throw, and must not call back into the cache synchronously;
+             * otherwise it runs before getAsync() returns.
+             *
+             * @param key The key to look up.
+             * @param done Receives the value, as from getRef().
+             */
+            void getAsync(std::string_view key, std::function<void(std::optional<ValueRef>)> done);
+
+            /**
+             * Like getAsync() with a callback, but the result is delivered through a future.
+             */
+            std::future<std::optional<ValueRef>> getAsync(std::string_view key);
+
+            /**
+             * Writes a key without waiting for the write to be applied; the callback
+             * (if any) runs once it is, with the same rules as getAsync()'s. Writes
+             * to one key submitted from one thread are applied in submission order.
+             *
+             * @param key The key to write.
+             * @param entry The value + metadata, as for set().
+             * @param done Called once the write is applied, or empty.
+             */
+            void setAsync(std::string_view key, CacheEntry entry, std::function<void()> done);
 
-            std::optional<std::string> get(const std::string& key);
+            /**
+             * Like setAsync() with a callback, but completion is signaled through a future.
+             */
+            std::future<void> setAsync(std::string_view key, CacheEntry entry);
 
-            void replay(const std::string& key);
+            /**
+             * Atomically adds delta to the integer stored at key (INCR, INCRBY,
+             * DECRBY): one read-modify-write on the key's shard, so concurrent
+             * increments are never lost. A missing key starts at 0; an existing
+             * key keeps its TTL. See Shard::incrBy().
+             */
+            IncrementResult incrBy(std::string_view key, int64_t delta);
+
+            /**
+             * Atomically adds delta to the number stored at key (INCRBYFLOAT).
+             * See Shard::incrByFloat().
+             */
+            IncrementResult incrByFloat(std::string_view key, double delta);
+
+            /**
+             * Adds members to the sorted set at key or updates their scores
+             * (ZADD), as one write on the key's shard. See Shard::zadd().
+             */
+            SortedSetResult zadd(std::string_view key, const std::vector<ScoredMember>& members,
+                                 const ZAddOptions& options = {});
+
+            /**
+             * Atomically adds delta to a member's score (ZINCRBY). See Shard::zincrBy().
+             */
+            SortedSetResult zincrBy(std::string_view key, std::string_view member, double delta);
+
+            /*
+            * Sorted-set reads. A missing key reads as an empty set; a key holding
+            * a string value gives WRONG_TYPE and leaves the output untouched.
+            */
+
+            /**
+             * The member's score (ZSCORE), or nullopt if it is not a member.
+             */
+            SortedSetStatus zscore(std::string_view key, std::string_view member, std::optional<double>& score);
+
+            /**
+             * The member's 0-based rank by ascending score (ZRANK), or nullopt
+             * if it is not a member. O(log n).
+             */
+            SortedSetStatus zrank(std::string_view key, std::string_view member, std::optional<size_t>& rank);
+
+            /**
+             * The number of members (ZCARD).
+             */
+            SortedSetStatus zcard(std::string_view key, size_t& count);
+
+            /**
+             * The members ranked start..stop, inclusive, by ascending score
+             * (ZRANGE). Negative positions count from the end: -1 is the last
+             * member. O(log n) plus the members returned.
+             */
+            SortedSetStatus zrange(std::string_view key, int64_t start, int64_t stop,
+                                   std::vector<ScoredMember>& members);
+
+            /**
+             * The members with min <= score <= max, highest score first
+             * (ZREVRANGEBYSCORE), after skipping `offset` of them and at most
+             * `count`. O(log n) plus the members visited.
+             */
+            SortedSetStatus zrevrangeByScore(std::string_view key, ScoreBound max, ScoreBound min, size_t offset,
+                                             size_t count, std::vector<ScoredMember>& members);
+
+            ExecutionMode executionMode() const {
+                return m_executors.empty() ? ExecutionMode::SHARED : ExecutionMode::THREAD_PER_CORE;
+            }
+
+            /**
+             * Looks up many keys at once. Keys are grouped by shard and each shard's
+             * group is served under a single epoch pin; with batch workers enabled,
+             * large batches spanning several shards are served in parallel. While a
+             * reshard is migrating keys, batches are served key by key. In
+             * thread-per-core mode every shard's group is handed to its owner thread
+             * at once and the groups run in parallel.
+             *
+             * @param keys The keys to look up.
+             * @param wrongType If given, set to true when any of the keys holds a
+             *                  sorted set (whose result is nullopt).
+             * @return One result per key, in request order.
+             */
+            std::vector<std::optional<ValueRef>> multiGet(const std::vector<std::string_view>& keys,
+                                                          bool* wrongType = nullptr);
+
+            /**
+             * Writes many keys at once, grouped by shard like multiGet(), with a
+             * single exclusive lock and at most one eviction-scheduler notification
+             * per shard. Writes to the same key are applied in request order.
+             *
+             * @param keys The keys to write.
+             * @param entries The value + metadata for each key, parallel to keys.
+             */
+            void multiSet(const std::vector<std::string_view>& keys, std::vector<CacheEntry> entries);
+
+            /**
+             * Enables parallel fan-out of multiGet()/multiSet() across a pool of
+             * worker threads (the calling thread works too). 0 disables it. Call
+             * before the cache serves traffic.
+             */
+            void setBatchWorkers(size_t workers);
+
+            /*
+             * Smallest batch that is fanned out to the batch workers; below it the
+             * hand-off costs more than the lock round trips it saves.
+             */
+            static constexpr size_t PARALLEL_BATCH_MIN = 256;
+
+            void replay(std::string_view key);
+
+            std::optional<std::deque<LogEntry>> getReplay(std::string_view key) const;
+
+            /**
+             * Returns the records of a key's log in `range` (see ReplayRange),
+             * oldest first, or nullopt if the key does not exist. The values are
+             * shared with the log rather than copied.
+             */
+            std::optional<std::vector<ReplayRecord>> replay(std::string_view key, const ReplayRange& range);
+
+            /**
+             * Streams the records of a key's log in `range` to `visit`, oldest first,
+             * without collecting them. `visit` runs under the shard's shared lock (on
+             * the owner thread in thread-per-core mode), so it should be quick and
+             * must not call into the cache.
+             *
+             * @return false if the key does not exist.
+             */
+            bool replay(std::string_view key, const ReplayRange& range, const std::function<void(const LogRecordView&)>& visit);
+
+            /**
+             * The value a key had at time `at` (see Shard::getAsOf()), or nullopt.
+             */
+            std::optional<ValueRef> getAsOf(std::string_view key, Timestamp at);
 
             void pruneAllLogs(Timestamp cutoff);
 
+            /*
+            * Keys a scan step visits by default, as in Redis.
+            */
+            static constexpr size_t DEFAULT_SCAN_COUNT = 10;
+
+            /**
+             * One step of an incremental keyspace scan. Shards are walked in index
+             * order, each through its index groups in reverse-binary order (see
+             * FlatIndex::scan()), holding one shard's shared lock for about `count`
+             * keys per step. A key present from the first step to the last is
+             * returned at least once even if shards rehash or a reshard() runs in
+             * between: migrating keys only move to higher shard indexes, and arrive
+             * there before they leave. Keys may be returned more than once.
+             *
+             * @param cursor 0 to start, then the cursor returned by the previous step.
+             * @param count Roughly how many keys to visit; fewer or more may be returned.
+             * @param pattern Optional glob (see util::globMatch()) keys must match.
+             *                Applied after the visit, so a step may return no keys.
+             */
+            ScanResult scan(uint64_t cursor, size_t count = DEFAULT_SCAN_COUNT, std::string_view pattern = {});
+
+            /**
+             * Opens a change subscription positioned at the end of every shard's
+             * change ring, so it sees the writes made from now on. Shards publish
+             * their writes only while a subscription is open.
+             */
+            std::unique_ptr<ChangeSubscription> subscribeChanges();
+
+            /**
+             * Opens a change subscription positioned at the given per-shard ring
+             * sequence numbers, e.g. the heads recorded by exportSnapshot().
+             */
+            std::unique_ptr<ChangeSubscription> subscribeChanges(std::vector<uint64_t> cursors);
+
+            /**
+             * Visits up to `max` writes the subscription has not seen yet, reading
+             * the shards' change rings lock-free and never holding up a writer.
+             * Writes to one key arrive in the order they were applied (a reshard
+             * aside); writes on different shards are interleaved in no particular
+             * order. Writes overwritten before the subscription got to them are
+             * skipped and counted in its lost().
+             *
+             * `visit` runs while the thread is pinned in the EpochDomain, so it
+             * should only copy or reference the event, and must not call back
+             * into the cache. One thread at a time per subscription.
+             *
+             * @return The number of events visited.
+             */
+            size_t readChanges(ChangeSubscription& subscription, size_t max,
+                               const std::function<void(const ChangeEvent&)>& visit);
+
+            /**
+             * Writes published to the change rings so far, over all shards.
+             */
+            uint64_t changesPublished() const;
+
+            /**
+             * Writes published but not yet read (or skipped) by the subscription.
+             */
+            uint64_t changeLag(const ChangeSubscription& subscription) const;
+
+            /**
+             * The feed consumers arm to be woken by the next write.
+             */
+            ChangeFeed& changeFeed() { return m_changeFeed; }
+
+            /**
+             * Eviction lag (expiry time to actual removal, in nanoseconds) merged across all shards.
+             */
+            HistogramSnapshot evictionLag() const;
+
+            /**
+             * Memory held by all shards (see Shard::memoryStats()), summed.
+             */
+            MemoryStats memoryStats() const;
+
+            /**
+             * Sets a maxmemory limit for the whole cache. Each shard enforces an equal
+             * share of it independently, evicting with the given policy, so no global
+             * coordination is needed on the write path. Call before loading data to
+             * bound recovery as well. 0 removes the limit.
+             *
+             * @param maxBytes The cache's memory budget in bytes, or 0 for unlimited.
+             * @param policy How each shard picks victims.
+             */
+            void setMemoryLimit(size_t maxBytes, EvictionPolicy policy);
+
+            /**
+             * Number of keys evicted to stay within the memory limit, summed over all shards.
+             */
+            uint64_t memoryEvictions() const;
+
+            /**
+             * Bounds every key's log to maxRecords records (LogRing::DEFAULT_MAX_RECORDS
+             * by default); the oldest records are retired as new ones are written.
+             */
+            void setMaxLogRecords(size_t maxRecords);
+
+            /**
+             * Grows the cache to numShards shards without blocking traffic. The new
+             * shards are created and take every write for keys routed to them at
+             * once; a background thread then moves the existing records of those keys
+             * (value, TTL, log and replacement-policy history) over in batches of
+             * Shard::MIGRATE_BATCH slots, holding one source shard's lock per batch.
+             * The memory limit is split over the new count: new shards get their
+             * share at once, old shards when the migration is done (until then the
+             * cache may exceed the limit by the new shards' shares).
+             *
+             * @param numShards The new shard count; larger than shardCount(), at most MAX_SHARDS.
+             * @return false if the count is invalid, a migration is still running, or
+             *         the cache runs in thread-per-core mode.
+             */
+            bool reshard(size_t numShards);
+
+            /**
+             * Number of shards keys are routed to (including any being filled by a migration).
+             */
+            size_t shardCount() const;
+
+            /**
+             * True while a reshard() is still migrating keys.
+             */
+            bool resharding() const;
+
+            /**
+             * Number of records moved by migrations since startup.
+             */
+            uint64_t migratedKeys() const { return m_migratedKeys.load(std::memory_order_relaxed); }
+
+            /**
+             * Snapshot of the operation counters and of every shard's gauges and
+             * histograms, for INFO and the Prometheus exporter. Counters are read
+             * without stopping traffic, so the figures are consistent per shard
+             * but not across shards. In thread-per-core mode each shard is read on
+             * its owner thread.
+             */
+            CacheMetrics metrics() const;
+
+            /**
+             * Operations (and background maintenance batches) slower than its
+             * threshold. Tracing is off until a threshold is set. Each entry splits
+             * the time into waiting for shard locks and holding them; in
+             * thread-per-core mode, into waiting in the owner's queue and running
+             * on the owner thread.
+             */
+            SlowLog& slowLog() { return m_slowLog; }
+
+            /**
+             * Loads a snapshot written by snapshot(). The file is memory-mapped and its
+             * per-shard sections are decoded in parallel. Does nothing if the file does
+             * not exist. Call at startup, before enableAof(), or on an empty cache
+             * after clear(), as a replica does.
+             *
+             * @param path The snapshot file.
+             * @return The number of entries loaded.
+             */
+            size_t loadSnapshot(const std::string& path);
+
+            /**
+             * Turns on AOF persistence. Existing AOF files in config.dir that are not
+             * already covered by the loaded snapshot are replayed first, one thread per
+             * shard file set, and then every shard gets a background writer appending
+             * to its own file. Call once at startup, before the cache serves traffic.
+             *
+             * @param config Directory and fsync policy.
+             * @return The number of records recovered.
+             */
+            size_t enableAof(const AofConfig& config);
+
+            /**
+             * Writes a snapshot of every shard to path. Shards are exported one at a
+             * time, in steps of Shard::SNAPSHOT_BATCH index groups under their shared
+             * lock, so a writer waits for at most one step; each section is written
+             * to disk with no shard lock held, so memory grows by one section, not
+             * one shard. With AOF enabled, each shard's AOF is rotated to a new
+             * generation where its export starts and the files made redundant by the
+             * snapshot are deleted once it is safely on disk. Writes made during a
+             * shard's export may be in the file too; they are also in the new AOF,
+             * and applying them twice is harmless (see Shard::exportSnapshot()).
+             * Throws std::system_error on I/O failures.
+             *
+             * @param path The snapshot file to (atomically) replace.
+             */
+            void snapshot(const std::string& path);
+
+            /**
+             * Writes a snapshot for shipping to a replica: like snapshot(), but the
+             * AOF and its generations are left alone, and changeHeads receives each
+             * shard's change-ring head where its export starts. A subscription opened
+             * at those heads then sees exactly the writes the file lacks, provided
+             * one was already open when the export started (so shards published).
+             * Throws std::system_error on I/O failures.
+             *
+             * @param path The snapshot file to (atomically) replace.
+             * @param changeHeads Receives one head per shard.
+             */
+            void exportSnapshot(const std::string& path, std::vector<uint64_t>& changeHeads);
+
+            /**
+             * Applies a write made elsewhere (a replicated or recovered record):
+             * the entry's timeSet is kept, and writes to a key are applied
+             * last-writer-wins by it. Not for use while a reshard is migrating.
+             */
+            void restore(std::string_view key, CacheEntry entry);
+
+            /**
+             * Like restore(), for one sorted-set member update. See Shard::restoreMember().
+             */
+            void restoreMember(std::string_view key, CacheEntry entry);
+
+            /**
+             * Removes every key and its history, shard by shard.
+             */
+            void clear();
+
         private:
-            std::vector<Shard> m_shards {};
-            size_t m_numShards {};
+            /*
+            * Where a key lives: `target` is its shard under the current count; while
+            * a migration runs, `source` is its shard under the old count (equal to
+            * target if the key does not move).
+            */
+            struct Route {
+                size_t source;
+                size_t target;
+            };
+
+            /*
+            * Keeps the shard layout an operation routed with valid until it is done:
+            * reshard() waits for every guard taken before it switched layouts.
+            * Pins the EpochDomain, or takes m_routingMutex shared if no epoch slot is free.
+            */
+            struct RoutingGuard {
+                EpochDomain::Guard pin;
+                std::shared_lock<std::shared_mutex> lock;
+
+                explicit RoutingGuard(std::shared_mutex& routingMutex);
+            };
+
+            // Declared first: shards and their maintenance threads record into it until they are gone.
+            // Mutable because const readers (getReplay) are traced too.
+            mutable SlowLog m_slowLog {};
+
+            // Declared before the shards, which publish through it.
+            ChangeFeed m_changeFeed {};
+
+            // MAX_SHARDS slots; [0, shardCount()) are populated and never move.
+            std::vector<std::unique_ptr<Shard>> m_shards {};
+
+            // One per shard in thread-per-core mode, empty otherwise; stopped before the shards go away.
+            std::vector<std::unique_ptr<ShardExecutor>> m_executors {};
+
+            // Old count in the low half, current count in the high half; equal halves when no migration runs.
+            std::atomic<uint64_t> m_layout {0};
+            mutable std::shared_mutex m_routingMutex {};
+
+            // Declared after m_shards so its workers are joined before the shards go away.
+            EvictionScheduler m_evictionScheduler;
+
+            std::unique_ptr<WorkerPool> m_batchPool {};
+
+            std::mutex m_snapshotMutex {};
+            std::string m_aofDir {};
+            FsyncPolicy m_aofFsync {};
+            uint64_t m_generation {0};
+
+            // Settings applied to shards created by reshard(); guarded by m_configMutex.
+            std::mutex m_configMutex {};
+            size_t m_maxMemory {0};
+            EvictionPolicy m_evictionPolicy {EvictionPolicy::WTINYLFU};
+            size_t m_maxLogRecords {LogRing::DEFAULT_MAX_RECORDS};
 
-            size_t shardFor(const std::string& key) const;
+            std::thread m_migrator {};
+            std::atomic<bool> m_stopMigration {false};
+            std::atomic<uint64_t> m_migratedKeys {0};
+
+            // Bumped by const readers too (getReplay).
+            mutable OpCounters m_opCounters {};
+            const Timestamp m_startedAt {std::chrono::steady_clock::now()};
+
+            static uint64_t packLayout(size_t from, size_t to) { return static_cast<uint64_t>(to) << 32 | from; }
+
+            // A scan cursor holds the shard index in its low bits and the shard's own cursor above.
+            static constexpr unsigned SCAN_SHARD_BITS = 10;
+            static_assert(MAX_SHARDS <= size_t{1} << SCAN_SHARD_BITS);
+
+            bool threadPerCore() const { return !m_executors.empty(); }
+
+            /**
+             * Runs fn(shard) on shard `index`: on its owner thread in thread-per-core
+             * mode (waiting for the result), on the calling thread otherwise.
+             */
+            template <typename F>
+            auto onShard(size_t index, F&& fn) -> std::invoke_result_t<F&, Shard&> {
+                if (!threadPerCore()) {
+                    return fn(*m_shards[index]);
+                }
+
+                LockTrace* trace {LockTrace::current()};
+                if (!trace) {
+                    return m_executors[index]->call(fn);
+                }
+
+                // A traced operation: its queueing counts as lock wait, its run as lock hold.
+                const auto queuedAt {std::chrono::steady_clock::now()};
+                return m_executors[index]->call([&](Shard& shard) {
+                    QueuedSpan span(*trace, queuedAt);
+                    return fn(shard);
+                });
+            }
+
+            /**
+             * The time an operation is queued to an owner thread, if tracing is on.
+             */
+            std::optional<Timestamp> queueTimeIfTracing() const;
+
+            /**
+             * Returns once every task queued to the owner threads so far has run.
+             */
+            void drainExecutors();
+
+            /**
+             * Exports every shard into writer step by step, ending a section when
+             * it fills up and after each shard. Shard i's AOF is rotated to
+             * aofGeneration if given, and its change-ring head stored in
+             * (*changeHeads)[i] if changeHeads is set. Call with m_snapshotMutex held.
+             */
+            void exportShards(SnapshotWriter& writer, std::optional<uint64_t> aofGeneration,
+                              std::vector<uint64_t>* changeHeads);
+
+            /**
+             * Routes a key hash under the current layout. Call with a RoutingGuard held.
+             */
+            Route route(uint64_t hash) const;
+
+            /**
+             * Writes a routed key: to its old shard if a migration has not taken it
+             * from there yet, otherwise to its shard. Call with a RoutingGuard held.
+             */
+            void store(std::string_view key, uint64_t hash, CacheEntry entry, const Route& route);
+
+            /**
+             * Applies an increment to the shard that holds the key, like store():
+             * apply(shard, ifPresent) runs on the old shard first while a
+             * migration has not taken the key from there yet.
+             */
+            IncrementResult increment(uint64_t hash, const std::function<IncrementResult(Shard&, bool)>& apply);
+
+            /**
+             * Like increment(), for sorted-set writes.
+             */
+            SortedSetResult updateSortedSet(uint64_t hash, const std::function<SortedSetResult(Shard&, bool)>& apply);
+
+            /**
+             * Passes the sorted set at key to visit on the shard that holds it
+             * (the old shard first while a migration has not taken the key).
+             *
+             * @return MISSING if no shard holds the key; see Shard::readSortedSet().
+             */
+            SortedSetStatus readSortedSet(std::string_view key, uint64_t hash,
+                                          const std::function<void(const SortedSet&)>& visit);
+
+            /**
+             * get() without the metrics.
+             */
+            std::optional<std::string> lookup(std::string_view key);
+
+            /**
+             * Looks a routed key up, in its old shard first. Call with a RoutingGuard
+             * held. A key is in one shard at a time, so a sorted set found in the
+             * old shard ends the lookup (setting *wrongType, if given).
+             */
+            std::optional<ValueRef> lookupRef(std::string_view key, uint64_t hash, const Route& route,
+                                              bool* wrongType = nullptr);
+
+            /**
+             * The shard a key is read from or written to when no migration runs.
+             * Call with a RoutingGuard held.
+             */
+            size_t shardFor(uint64_t hash) const;
+
+            /**
+             * Body of the migration thread: drains every old shard of the keys that
+             * route elsewhere, then ends the migration.
+             */
+            void migrate(size_t from, size_t to);
+
+            /**
+             * The shard count while no migration runs, or 0 during one, from a
+             * single load of the layout. A batch must check and group with the
+             * same value: a reshard published between two loads would send the
+             * whole batch to the new shards, past keys still in their old ones.
+             */
+            size_t settledShardCount() const;
+
+            /**
+             * Hashes the keys and sorts them by shard among numShards (stably, so
+             * request order is kept within a shard). Shard s's keys end up in
+             * batch[offsets[s], offsets[s + 1]).
+             */
+            void groupByShard(const std::vector<std::string_view>& keys, size_t numShards,
+                              std::vector<BatchKey>& batch, std::vector<size_t>& offsets) const;
+
+            /**
+             * Calls run(shard, keys, count) once per shard that has keys in the batch,
+             * in parallel if the batch qualifies for the batch workers.
+             */
+            void forEachShardGroup(const std::vector<BatchKey>& batch, const std::vector<size_t>& offsets,
+                                   const std::function<void(Shard&, const BatchKey*, size_t)>& run);
     };
 }
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "value.h"
+
+namespace streamcache {
+
+    /*
+    * What a change event writes: a key's string value, or one member of the
+    * sorted set at the key, whose value is then the "<score> <member>" update.
+    */
+    enum class ChangeKind : uint8_t {
+        SET,
+        ZADD
+    };
+
+    /*
+    * One write, as seen by change-stream subscribers. Immutable once published;
+    * the value is shared with the store, not copied.
+    */
+    struct ChangeEvent {
+        uint64_t sequence {0};      // position in its shard's ring
+        std::chrono::steady_clock::time_point timestamp {};
+        std::string key {};
+        ValueRef value {};
+        std::optional<std::chrono::steady_clock::time_point> expiration {};
+        ChangeKind kind {ChangeKind::SET};
+    };
+
+    /**
+    * @class ChangeRing
+    * @brief A shard's bounded broadcast ring of its most recent writes.
+    *
+    * One producer (the writer holding the shard's exclusive lock, or its owner
+    * thread) publishes; any number of readers follow it lock-free, each at its
+    * own position. A slot holds a pointer to an immutable ChangeEvent, so
+    * publishing is one allocation and one pointer exchange, and never waits for
+    * a reader: a reader that falls CAPACITY events behind has the oldest ones
+    * overwritten under it, and is told how many it lost instead of holding the
+    * writer back.
+    *
+    * Overwritten events are retired through the EpochDomain, since a reader may
+    * still be looking at one; readers must be pinned while they read.
+    */
+    class ChangeRing {
+        public:
+            using Timestamp = std::chrono::steady_clock::time_point;
+
+            static constexpr size_t CAPACITY = 4096;
+
+            ChangeRing();
+            ~ChangeRing();
+
+            ChangeRing(const ChangeRing&) = delete;
+            ChangeRing& operator=(const ChangeRing&) = delete;
+
+            /**
+            * Publishes a write. Producer only.
+            */
+            void publish(std::string_view key, const Value& value, std::optional<Timestamp> expiration,
+                         Timestamp timestamp, ChangeKind kind = ChangeKind::SET);
+
+            /**
+            * Sequence number the next event will get, i.e. the number published so far.
+            */
+            uint64_t head() const { return m_head.load(std::memory_order_acquire); }
+
+            /**
+            * Visits up to `max` events from `cursor` on, oldest first, and advances
+            * the cursor past them. Events overwritten before they could be read are
+            * skipped and added to `lost`. The caller must be pinned in the EpochDomain.
+            *
+            * @return The number of events visited.
+            */
+            size_t read(uint64_t& cursor, size_t max, uint64_t& lost,
+                        const std::function<void(const ChangeEvent&)>& visit) const;
+
+        private:
+            /*
+            * Overwritten events kept before the producer pays for a safeEpoch() scan.
+            */
+            static constexpr size_t RECLAIM_BATCH = 64;
+
+            std::unique_ptr<std::atomic<ChangeEvent*>[]> m_slots;
+            std::atomic<uint64_t> m_head {0};
+            std::deque<std::pair<uint64_t, ChangeEvent*>> m_retired {};     // retire stamp, event; producer only
+
+            /*
+            * Frees the retired events no pinned reader can still reach.
+            */
+            void reclaim();
+    };
+
+    class ChangeSubscription;
+
+    /*
+    * Point-in-time view of the change streams, for metrics.
+    */
+    struct ChangeStreamMetrics {
+        size_t subscribers {0};
+        uint64_t published {0};     // events published by all shards
+        uint64_t lost {0};          // events overwritten before a subscriber read them, all subscribers
+        uint64_t maxLag {0};        // events the furthest-behind subscriber has yet to read
+    };
+
+    /**
+    * @class ChangeFeed
+    * @brief The cache-wide side of the change streams: who listens, and how to wake them.
+    *
+    * Shards only publish while at least one subscription is open, so a cache
+    * nobody subscribes to pays one relaxed load per write. Consumers that sleep
+    * arm() the feed before their last read; the next publish then calls the
+    * listener once (on the writer's thread, under its shard lock) and disarms
+    * it, so a stream of writes costs at most one wakeup per consumer pass.
+    */
+    class ChangeFeed {
+        public:
+            bool active() const { return m_subscriberCount.load(std::memory_order_relaxed) > 0; }
+
+            /**
+            * Sets the function that wakes consumers; it must be cheap and must
+            * not call into the cache. nullptr removes it.
+            */
+            void setListener(std::function<void()> listener);
+
+            /**
+            * Requests a listener call for the next publish. Call before reading,
+            * so a write that the read misses still wakes the consumer.
+            */
+            void arm() {
+                // Pairs with the fence in published(): the publish sees the flag, or the read sees the event.
+                m_armed.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+
+            /**
+            * Called by a shard after it published; runs the listener if armed.
+            */
+            void published() {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (m_armed.load(std::memory_order_relaxed) && m_armed.exchange(false)) {
+                    notify();
+                }
+            }
+
+            /**
+            * Number of open subscriptions.
+            */
+            size_t subscribers() const { return m_subscriberCount.load(std::memory_order_relaxed); }
+
+            /**
+            * Fills in the subscriber figures of `metrics` given the events
+            * published so far (metrics.published).
+            */
+            void collect(ChangeStreamMetrics& metrics) const;
+
+        private:
+            friend class ChangeSubscription;
+
+            mutable std::mutex m_mutex {};
+            std::vector<const ChangeSubscription*> m_subscriptions {};
+            uint64_t m_closedLost {0};      // lost by subscriptions already closed
+            std::atomic<size_t> m_subscriberCount {0};
+            std::atomic<bool> m_armed {false};
+
+            std::mutex m_listenerMutex {};
+            std::function<void()> m_listener {};
+
+            void notify();
+    };
+
+    /**
+    * @class ChangeSubscription
+    * @brief One consumer's position in every shard's change ring.
+    *
+    * Created by Cache::subscribeChanges() and read with Cache::readChanges() by
+    * one thread at a time; lag and lost counts may be read from any thread.
+    */
+    class ChangeSubscription {
+        public:
+            /**
+            * Registers with the feed, positioned at `cursors` (one per shard).
+            */
+            ChangeSubscription(ChangeFeed& feed, std::vector<uint64_t> cursors);
+            ~ChangeSubscription();
+
+            ChangeSubscription(const ChangeSubscription&) = delete;
+            ChangeSubscription& operator=(const ChangeSubscription&) = delete;
+
+            /**
+            * Events read or skipped so far, summed over the shards' sequence numbers.
+            */
+            uint64_t position() const { return m_position.load(std::memory_order_relaxed); }
+
+            /**
+            * Events overwritten before this subscription could read them.
+            */
+            uint64_t lost() const { return m_lost.load(std::memory_order_relaxed); }
+
+        private:
+            friend class Cache;
+
+            ChangeFeed& m_feed;
+            std::vector<uint64_t> m_cursors {};     // per shard; shards added later start at 0
+            size_t m_nextShard {0};                 // where the next read starts, for fairness
+            std::atomic<uint64_t> m_position {0};
+            std::atomic<uint64_t> m_lost {0};
+    };
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+
+namespace util {
+
+    /*
+    * Little helpers for the on-disk formats (AOF, snapshots). Fixed-width
+    * integers are written in host byte order; files are not meant to be moved
+    * between machines of different endianness.
+    */
+
+    inline void appendFixed32(std::string& out, uint32_t v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    inline void appendFixed64(std::string& out, uint64_t v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    inline void appendVarint(std::string& out, uint64_t v) {
+        while (v >= 0x80) {
+            out += static_cast<char>((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        out += static_cast<char>(v);
+    }
+
+    /**
+     * Zigzag-encodes a signed value so small magnitudes of either sign stay short.
+     */
+    inline void appendSignedVarint(std::string& out, int64_t v) {
+        appendVarint(out, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+    }
+
+    inline void appendLengthPrefixed(std::string& out, std::string_view s) {
+        appendVarint(out, s.size());
+        out.append(s.data(), s.size());
+    }
+
+    /**
+     * 32-bit FNV-1a, used to detect torn or corrupted records.
+     */
+    inline uint32_t checksum(std::string_view data) {
+        uint32_t h {2166136261u};
+        for (unsigned char c : data) {
+            h ^= c;
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    /*
+    * Bounds-checked cursor over an encoded buffer. Every read returns false
+    * instead of running past the end, so truncated input is detected rather
+    * than misread.
+    */
+    struct ByteReader {
+        std::string_view data {};
+        size_t pos {0};
+
+        size_t remaining() const { return data.size() - pos; }
+
+        bool readFixed32(uint32_t& v) {
+            if (remaining() < sizeof(v)) {
+                return false;
+            }
+            std::memcpy(&v, data.data() + pos, sizeof(v));
+            pos += sizeof(v);
+            return true;
+        }
+
+        bool readFixed64(uint64_t& v) {
+            if (remaining() < sizeof(v)) {
+                return false;
+            }
+            std::memcpy(&v, data.data() + pos, sizeof(v));
+            pos += sizeof(v);
+            return true;
+        }
+
+        bool readVarint(uint64_t& v) {
+            v = 0;
+            for (int shift {0}; shift < 64; shift += 7) {
+                if (remaining() == 0) {
+                    return false;
+                }
+                auto byte {static_cast<unsigned char>(data[pos++])};
+                v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool readSignedVarint(int64_t& v) {
+            uint64_t raw {0};
+            if (!readVarint(raw)) {
+                return false;
+            }
+            v = static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+            return true;
+        }
+
+        bool readBytes(size_t n, std::string_view& out) {
+            if (remaining() < n) {
+                return false;
+            }
+            out = data.substr(pos, n);
+            pos += n;
+            return true;
+        }
+
+        bool readLengthPrefixed(std::string_view& out) {
+            uint64_t n {0};
+            return readVarint(n) && readBytes(static_cast<size_t>(n), out);
+        }
+    };
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace streamcache {
+
+    /**
+    * @class EpochDomain
+    * @brief Epoch-based reclamation for the lock-free read path.
+    *
+    * Readers that walk shard memory without the shard lock pin() the domain for
+    * the duration of the walk. Pinning copies the global epoch into a slot the
+    * thread owns (its own cache line), so readers never write to memory another
+    * core is reading; there is no reader count to bounce.
+    *
+    * Writers unlink an object first (so no new reader can reach it), then stamp
+    * it with retireStamp() and keep it until safeEpoch() exceeds that stamp,
+    * i.e. until every reader that might still hold a pointer to it has unpinned.
+    *
+    * There is one process-wide domain with MAX_READERS slots, claimed by a thread
+    * on its first pin() and released when it exits. If all slots are taken, pin()
+    * fails and the caller falls back to the shard lock. Pins nest.
+    */
+    class EpochDomain {
+        public:
+            static constexpr size_t MAX_READERS = 512;
+
+            /*
+            * Keeps the calling thread pinned until it goes out of scope.
+            */
+            class Guard {
+                public:
+                    Guard(Guard&& other) noexcept : m_domain(other.m_domain) { other.m_domain = nullptr; }
+                    Guard(const Guard&) = delete;
+                    Guard& operator=(const Guard&) = delete;
+                    Guard& operator=(Guard&&) = delete;
+
+                    ~Guard() {
+                        if (m_domain) {
+                            m_domain->unpin();
+                        }
+                    }
+
+                    /**
+                    * False if no reader slot was available; the caller must take the lock.
+                    */
+                    explicit operator bool() const { return m_domain != nullptr; }
+
+                private:
+                    friend class EpochDomain;
+                    explicit Guard(EpochDomain* domain) : m_domain(domain) {
+                    }
+
+                    EpochDomain* m_domain;
+            };
+
+            static EpochDomain& global();
+
+            Guard pin();
+
+            /**
+            * Stamp for an object that has just been unlinked. Call after the
+            * unlinking stores.
+            */
+            uint64_t retireStamp();
+
+            /**
+            * Advances the epoch and returns the oldest epoch any reader is still
+            * pinned at. Objects stamped below the result can be freed.
+            */
+            uint64_t safeEpoch();
+
+            /**
+            * Blocks until every thread that was pinned when this was called has
+            * unpinned, i.e. until no reader can still act on state it read before.
+            * Must not be called while pinned.
+            */
+            void synchronize();
+
+        private:
+            static constexpr uint64_t IDLE = ~uint64_t{0};
+
+            struct alignas(64) Slot {
+                std::atomic<uint64_t> epoch {IDLE};
+                std::atomic<bool> owned {false};
+            };
+
+            std::atomic<uint64_t> m_epoch {1};
+            std::atomic<size_t> m_highWater {0};    // slots at or above this were never claimed
+            std::array<Slot, MAX_READERS> m_slots {};
+
+            // The calling thread's slot and pin depth (defined in epoch.cpp).
+            struct ThreadState;
+            static ThreadState& threadState();
+
+            EpochDomain() = default;
+
+            Slot* claimSlot();
+            void releaseSlot(Slot* slot);
+            void unpin();
+    };
+}
@@ -0,0 +1,188 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace streamcache {
+
+    /*
+    * How a shard picks victims once it is over its memory limit.
+    */
+    enum class EvictionPolicy {
+        LRU,        // least recently used
+        LFU,        // least frequently used (saturating per-key counter)
+        WTINYLFU    // window LRU + segmented LRU main area, admission by a count-min sketch
+    };
+
+    /**
+    * Parses "lru", "lfu" or "wtinylfu" (case-insensitive).
+    */
+    std::optional<EvictionPolicy> parseEvictionPolicy(const std::string& name);
+
+    const char* evictionPolicyName(EvictionPolicy policy);
+
+    /*
+    * Intrusive hook for the replacement policies, embedded in every stored record
+    * next to its TimerNode. All list operations are O(1) and never allocate.
+    */
+    struct PolicyNode {
+        PolicyNode* prev {nullptr};
+        PolicyNode* next {nullptr};
+        uint8_t list {UNLINKED};    // which of the policy's lists the node is on
+        uint8_t frequency {0};      // LFU counter
+
+        static constexpr uint8_t UNLINKED = 0xFF;
+
+        PolicyNode() = default;
+        PolicyNode(const PolicyNode&) = delete;
+        PolicyNode& operator=(const PolicyNode&) = delete;
+    };
+
+    /*
+    * Doubly-linked list of PolicyNodes; front is the most recently inserted.
+    */
+    class PolicyList {
+        public:
+            void pushFront(PolicyNode& node, uint8_t id);
+            void remove(PolicyNode& node);
+            void moveToFront(PolicyNode& node);
+
+            PolicyNode* front() const { return m_head; }
+            PolicyNode* back() const { return m_tail; }
+            size_t size() const { return m_size; }
+            bool empty() const { return m_size == 0; }
+
+        private:
+            PolicyNode* m_head {nullptr};
+            PolicyNode* m_tail {nullptr};
+            size_t m_size {0};
+    };
+
+    /**
+    * @class CountMinSketch
+    * @brief Approximate access frequencies in 4-bit counters, as used by TinyLFU.
+    *
+    * Four rows of counters packed sixteen to a 64-bit word. Once the number of
+    * increments reaches ten times the width, every counter is halved, so the
+    * sketch tracks recent popularity instead of all-time popularity.
+    */
+    class CountMinSketch {
+        public:
+            /**
+            * Grows the sketch (and clears it) if it has fewer counters per row than `entries`.
+            */
+            void ensureCapacity(size_t entries);
+
+            void increment(uint64_t hash);
+
+            /**
+            * Estimated frequency, 0..15.
+            */
+            uint32_t estimate(uint64_t hash) const;
+
+        private:
+            static constexpr size_t ROWS = 4;
+
+            std::vector<uint64_t> m_table {};
+            size_t m_width {0};         // counters per row, a power of two
+            size_t m_additions {0};
+            size_t m_sampleSize {0};
+
+            size_t indexOf(uint64_t hash, size_t row) const;
+            void halve();
+    };
+
+    /**
+    * @class ReplacementPolicy
+    * @brief Victim selection for a memory-bounded shard.
+    *
+    * The shard reports every insert, access and removal, and asks for a victim
+    * while it is over its limit. All methods run under the shard's exclusive lock
+    * and are O(1) (amortized for W-TinyLFU). victim() only chooses; the shard then
+    * removes the record and calls onRemove().
+    */
+    class ReplacementPolicy {
+        public:
+            /*
+            * Returns the key hash of the record that embeds a node.
+            */
+            using HashOf = uint64_t (*)(const PolicyNode&);
+
+            virtual ~ReplacementPolicy() = default;
+
+            virtual void onInsert(PolicyNode& node) = 0;
+            virtual void onAccess(PolicyNode& node) = 0;
+            virtual void onRemove(PolicyNode& node) = 0;
+
+            /**
+            * Chooses the next record to evict, never `keep`. Returns nullptr if
+            * there is nothing else to evict.
+            */
+            virtual PolicyNode* victim(const PolicyNode* keep) = 0;
+
+            /**
+            * How often the record was used, in a form another instance of the same
+            * policy can take over with onAdopt() when the record moves to another
+            * shard. 0 if the policy keeps no frequency.
+            */
+            virtual uint8_t frequencyOf(const PolicyNode& node) const {
+                (void)node;
+                return 0;
+            }
+
+            /**
+            * Inserts a record that arrives from another shard with the given
+            * frequencyOf() there, instead of as a brand-new record.
+            */
+            virtual void onAdopt(PolicyNode& node, uint8_t frequency) {
+                (void)frequency;
+                onInsert(node);
+            }
+
+            static std::unique_ptr<ReplacementPolicy> create(EvictionPolicy policy, HashOf hashOf);
+    };
+
+    /**
+    * @class AccessBuffer
+    * @brief Lossy buffer of read accesses, so GET can feed the policy without the lock.
+    *
+    * Readers publish the hash of the key they hit into one of a few striped
+    * rings with one fetch_add and one store; if a ring wraps before it is
+    * drained, the oldest accesses are simply dropped, which only makes the policy
+    * slightly less precise. Hashes rather than node pointers are buffered
+    * because lock-free readers can still be publishing while the shard frees
+    * records: the drain resolves each hash through the index, so an access to a
+    * record that is gone by then is simply ignored.
+    */
+    class AccessBuffer {
+        public:
+            static constexpr size_t STRIPES = 4;
+            static constexpr size_t SLOTS = 64;
+
+            /**
+            * Records an access to the key with the given hash. Safe from any thread.
+            */
+            void record(uint64_t hash);
+
+            /**
+            * Hands every buffered access whose hash resolve() maps to a live node to
+            * the policy. Requires the exclusive lock.
+            */
+            void drain(ReplacementPolicy& policy, const std::function<PolicyNode*(uint64_t)>& resolve);
+
+        private:
+            struct alignas(64) Stripe {
+                std::array<std::atomic<uint64_t>, SLOTS> slots {};
+                std::atomic<size_t> writes {0};
+                size_t drained {0};     // writes already handed to the policy
+            };
+
+            std::array<Stripe, STRIPES> m_stripes {};
+    };
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace streamcache {
+
+    // Foward declaration to avoid circular dependency
+    class Shard;
+
+    /**
+    * @class EvictionScheduler
+    * @brief Shared timer service that evicts expired keys for every shard of a cache.
+    *
+    * A small, fixed pool of workers (one by default) serves all shards, so the
+    * number of background threads no longer grows with the shard count. The
+    * scheduler keeps one global deadline queue keyed by shard index; each shard
+    * has at most one live deadline in it, the earlier of its next expiry and its
+    * next log-pruning pass.
+    *
+    * Shards feed the queue through Shard::notifyNewExpiry() whenever their
+    * earliest deadline moves earlier. A worker sleeps until the head of the queue
+    * is due (or an earlier deadline arrives), then claims that shard, evicts
+    * everything due in bounded slices, prunes its logs if the prune interval has
+    * elapsed, and re-arms the shard from peekNextExpiry(). Pruning runs in
+    * lock-released batches for at most PRUNE_BUDGET per visit; an unfinished
+    * pass is re-queued as due immediately (behind shards that are already due)
+    * and resumes from the shard's cursor. A claimed shard is
+    * never handed to a second worker; deadlines reported meanwhile are merged
+    * when it is re-armed.
+    *
+    * Lifecycle:
+    * - attach() every shard, then start() once. Shards added later (resharding)
+    *   can be attached while the workers run.
+    * - stop() (or the destructor) wakes and joins the workers. Idempotent.
+    *   Shards must outlive the scheduler's workers.
+    *
+    * Thread safety:
+    * - Like the per-shard eviction threads it replaces, the scheduler only calls
+    *   public, lock-aware methods on the Shard (peekNextExpiry, evictExpired,
+    *   pruneLogs), and never while holding its own mutex.
+    */
+    class EvictionScheduler {
+        public:
+            using Timestamp = std::chrono::steady_clock::time_point;
+
+            static constexpr size_t DEFAULT_WORKERS = 1;
+
+            /*
+            * Fixed log retention duration for all keys.
+            */
+            static constexpr std::chrono::hours LOG_RETENTION {1};
+
+            /*
+            * How often each shard's logs are pruned to the retention window.
+            */
+            static constexpr std::chrono::seconds PRUNE_INTERVAL {1};
+
+            /*
+            * Longest a worker spends pruning one shard before moving on.
+            */
+            static constexpr std::chrono::milliseconds PRUNE_BUDGET {2};
+
+            /**
+            * @param workers Number of worker threads serving all shards (at least one).
+            */
+            explicit EvictionScheduler(size_t workers = DEFAULT_WORKERS);
+
+            EvictionScheduler(const EvictionScheduler&) = delete;
+            EvictionScheduler& operator=(const EvictionScheduler&) = delete;
+
+            /**
+            * Stops the workers if stop() has not been called.
+            */
+            ~EvictionScheduler();
+
+            /**
+            * Registers a shard and hooks its expiry notifications into the queue.
+            * Safe while the workers run.
+            */
+            void attach(Shard& shard);
+
+            /**
+            * Launches the worker threads.
+            */
+            void start();
+
+            /**
+            * Signals the workers to exit, wakes them, and joins them.
+            */
+            void stop();
+
+            size_t workerCount() const { return m_workerCount; }
+
+            /**
+            * Entries in the deadline queue, including stale ones that have been
+            * superseded by an earlier deadline for the same shard.
+            */
+            size_t queueSize() const;
+
+        private:
+            struct ShardState {
+                Shard* shard {nullptr};
+                std::optional<Timestamp> scheduled {};  // the shard's live entry in m_queue
+                std::optional<Timestamp> deferred {};   // earliest deadline reported while claimed
+                Timestamp nextPrune {};
+                bool claimed {false};
+            };
+
+            using QueueEntry = std::pair<Timestamp, size_t>;
+
+            std::deque<ShardState> m_shards {};     // a deque, so workers' references survive attach()
+            std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> m_queue {};
+            mutable std::mutex m_mutex {};
+            std::condition_variable m_cv {};
+            bool m_running {false};
+            size_t m_workerCount {};
+            std::vector<std::thread> m_workers {};
+
+            /**
+            * Called (via the shard's notify hook) when shard `index` has a new earlier deadline.
+            */
+            void notify(size_t index, Timestamp deadline);
+
+            /**
+            * Puts the shard's deadline into the queue unless an earlier one is already there.
+            * Requires m_mutex.
+            */
+            void scheduleLocked(size_t index, Timestamp deadline);
+
+            /**
+            * Main loop of each worker.
+            */
+            void runWorker();
+    };
+}
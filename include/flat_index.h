@@ -0,0 +1,487 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "epoch.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace streamcache {
+
+    /**
+    * @class FlatIndex
+    * @brief Open-addressing (Swiss-table style) hash index from key to record.
+    *
+    * Slots are grouped sixteen at a time. Each slot has a one-byte control word:
+    * EMPTY, DELETED, or the low 7 bits of the key's hash (its "tag") when full.
+    * A lookup loads a whole group of control bytes and compares all sixteen tags
+    * with one SSE2 instruction, so a probe touches one control cache line and then
+    * usually only the record that actually matches; there are no per-key nodes or
+    * bucket chains to chase. Groups are probed triangularly, which visits every
+    * group of the power-of-two table.
+    *
+    * The index stores pointers and does not own the records. T must expose
+    * `key` (comparable with std::string_view) and the precomputed `hash`; the hash
+    * is what the caller already used for shard routing, so a key is hashed once per
+    * operation and never again on rehash.
+    *
+    * The maximum load (including tombstones) is 7/8; erasing from a group that
+    * has never been full frees the slot outright instead of leaving a tombstone.
+    *
+    * One writer at a time (the owning shard serializes writers with its lock),
+    * but find() may run concurrently with it from readers pinned in the
+    * EpochDomain. Control bytes and slots are atomics: an insert stores the slot
+    * before its control byte, so a reader that sees the tag finds the record.
+    * A rehash builds a new table, publishes it with one pointer store and
+    * retires the old one, which is freed by reclaimRetired() once no reader
+    * pinned before the swap remains. A reader can therefore see a record that
+    * has just been erased; the shard marks retired records as expired before
+    * erasing them, and frees them through the same epochs.
+    */
+    template <typename T>
+    class FlatIndex {
+        public:
+            static constexpr size_t GROUP_WIDTH = 16;
+
+            FlatIndex() = default;
+            FlatIndex(const FlatIndex&) = delete;
+            FlatIndex& operator=(const FlatIndex&) = delete;
+
+            ~FlatIndex() {
+                delete m_table.load(std::memory_order_relaxed);
+                for (const Retired& retired : m_retired) {
+                    delete retired.table;
+                }
+            }
+
+            /**
+            * Returns the record stored under key, or nullptr. Safe without the lock
+            * while pinned in the EpochDomain.
+            */
+            T* find(std::string_view key, uint64_t hash) const {
+                const Table* table {m_table.load(std::memory_order_acquire)};
+                if (!table) {
+                    return nullptr;
+                }
+                return probe(*table, hash, [key, hash](const T& record) {
+                    return record.hash == hash && record.key == key;
+                });
+            }
+
+            /**
+            * Returns a record with the given hash, or nullptr. Used to resolve hashes
+            * recorded earlier back to records; with 64-bit hashes a collision is only
+            * an imprecision for the caller.
+            */
+            T* findByHash(uint64_t hash) const {
+                const Table* table {m_table.load(std::memory_order_relaxed)};
+                if (!table) {
+                    return nullptr;
+                }
+                return probe(*table, hash, [hash](const T& record) { return record.hash == hash; });
+            }
+
+            /**
+            * Adds a record whose key is not in the index yet.
+            */
+            void insert(T* record) {
+                if (capacity() == 0) {
+                    rehash(GROUP_WIDTH);
+                }
+
+                size_t index {findInsertSlot(*current(), record->hash)};
+                if (current()->ctrl(index) == EMPTY && m_growthLeft == 0) {
+                    rehash(m_size * 2 < maxLoad(capacity()) ? capacity() : capacity() * 2);
+                    index = findInsertSlot(*current(), record->hash);
+                }
+
+                Table& table {*current()};
+                if (table.ctrl(index) == EMPTY) {
+                    --m_growthLeft;
+                }
+                table.slots[index].store(record, std::memory_order_release);
+                table.setCtrl(index, tagOf(record->hash));
+                ++m_size;
+            }
+
+            /**
+            * Removes the record stored under key and returns it, or nullptr if absent.
+            */
+            T* erase(std::string_view key, uint64_t hash) {
+                Table* table {current()};
+                const size_t index {table ? findIndex(*table, key, hash) : NOT_FOUND};
+                if (index == NOT_FOUND) {
+                    return nullptr;
+                }
+
+                T* record {table->slots[index].load(std::memory_order_relaxed)};
+                --m_size;
+
+                /*
+                * A group that still has an empty slot has never been full, so no probe
+                * sequence continues past it and the slot can be freed outright.
+                */
+                const size_t groupStart {index & ~(GROUP_WIDTH - 1)};
+                if (table->group(groupStart).matchEmpty() != 0) {
+                    table->setCtrl(index, EMPTY);
+                    ++m_growthLeft;
+                } else {
+                    table->setCtrl(index, DELETED);
+                }
+                table->slots[index].store(nullptr, std::memory_order_release);
+
+                return record;
+            }
+
+            size_t size() const { return m_size; }
+            bool empty() const { return m_size == 0; }
+
+            /**
+            * Number of slots. Together with at() this allows iterating the table by
+            * slot position.
+            */
+            size_t capacity() const {
+                const Table* table {m_table.load(std::memory_order_relaxed)};
+                return table ? table->capacity : 0;
+            }
+
+            /**
+            * Bytes held by the control and slot arrays, including retired tables
+            * that readers may still be using.
+            */
+            size_t memoryBytes() const {
+                size_t bytes {tableBytes(capacity())};
+                for (const Retired& retired : m_retired) {
+                    bytes += tableBytes(retired.table->capacity);
+                }
+                return bytes;
+            }
+
+            /**
+            * Returns the record in slot i, or nullptr if the slot is not full.
+            * Writer side only.
+            */
+            T* at(size_t i) const {
+                const Table& table {*m_table.load(std::memory_order_relaxed)};
+                return table.ctrl(i) >= 0 ? table.slots[i].load(std::memory_order_relaxed) : nullptr;
+            }
+
+            /**
+            * Calls fn(T&) for every record, in slot order. Writer side only.
+            */
+            template <typename Fn>
+            void forEach(Fn&& fn) const {
+                const size_t n {capacity()};
+                for (size_t i {0}; i < n; ++i) {
+                    if (T* record {at(i)}) {
+                        fn(*record);
+                    }
+                }
+            }
+
+            /**
+            * One step of a resumable scan: calls fn(T&) for every record whose home
+            * group (the first group its probe visits) is one of the next `groups`
+            * groups after `cursor`, and returns the cursor to pass next time, or 0
+            * once every group has been visited. Start with cursor 0. Writer side only;
+            * the table may be rehashed between steps.
+            *
+            * Home groups are walked in reverse-binary order, like the buckets of
+            * Redis' SCAN: when the table doubles or is rebuilt between steps, a
+            * group's records land in groups that share its low bits, which the
+            * cursor has either fully visited or not reached yet. So every record
+            * present for the whole scan is visited at least once; a record may be
+            * visited twice if the table grew meanwhile.
+            */
+            template <typename Fn>
+            size_t scan(size_t cursor, size_t groups, Fn&& fn) const {
+                const Table* table {current()};
+                if (!table) {
+                    return 0;
+                }
+
+                const size_t mask {table->groupMask()};
+                if (groups == 0) {
+                    groups = 1;
+                }
+                do {
+                    visitHome(*table, cursor & mask, fn);
+
+                    // Increment the reversed cursor: the bits above the mask carry out.
+                    cursor |= ~mask;
+                    cursor = reverseBits(reverseBits(cursor) + 1);
+                } while (cursor != 0 && --groups > 0);
+                return cursor;
+            }
+
+            /**
+            * Frees the tables replaced by earlier rehashes that no reader can still
+            * be probing. Writer side only.
+            */
+            void reclaimRetired() {
+                if (m_retired.empty()) {
+                    return;
+                }
+
+                const uint64_t safe {EpochDomain::global().safeEpoch()};
+                size_t kept {0};
+                for (const Retired& retired : m_retired) {
+                    if (retired.stamp < safe) {
+                        delete retired.table;
+                    } else {
+                        m_retired[kept++] = retired;
+                    }
+                }
+                m_retired.resize(kept);
+            }
+
+        private:
+            static constexpr int8_t EMPTY = -128;   // 0x80
+            static constexpr int8_t DELETED = -2;   // 0xFE
+            static constexpr size_t NOT_FOUND = ~size_t{0};
+            static constexpr uint64_t EMPTY_WORD = 0x8080808080808080ull;
+
+            /*
+            * Sixteen control bytes compared at once, loaded as two words. Bit i of
+            * every mask refers to slot i of the group.
+            */
+            struct Group {
+#ifdef __SSE2__
+                __m128i ctrl;
+
+                Group(uint64_t low, uint64_t high)
+                    : ctrl(_mm_set_epi64x(static_cast<long long>(high), static_cast<long long>(low))) {
+                }
+
+                uint32_t match(int8_t tag) const {
+                    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), ctrl)));
+                }
+
+                // EMPTY and DELETED are the only control bytes with the sign bit set.
+                uint32_t matchEmptyOrDeleted() const {
+                    return static_cast<uint32_t>(_mm_movemask_epi8(ctrl));
+                }
+#else
+                uint64_t words[2];
+
+                Group(uint64_t low, uint64_t high) : words{low, high} {
+                }
+
+                int8_t byte(size_t i) const { return static_cast<int8_t>(words[i / 8] >> (i % 8 * 8)); }
+
+                uint32_t match(int8_t tag) const {
+                    uint32_t mask {0};
+                    for (size_t i {0}; i < GROUP_WIDTH; ++i) {
+                        mask |= static_cast<uint32_t>(byte(i) == tag) << i;
+                    }
+                    return mask;
+                }
+
+                uint32_t matchEmptyOrDeleted() const {
+                    uint32_t mask {0};
+                    for (size_t i {0}; i < GROUP_WIDTH; ++i) {
+                        mask |= static_cast<uint32_t>(byte(i) < 0) << i;
+                    }
+                    return mask;
+                }
+#endif
+                uint32_t matchEmpty() const { return match(EMPTY); }
+            };
+
+            /*
+            * Control bytes are packed little-endian into atomic words, eight per word,
+            * so readers load them with plain atomic loads while the writer updates
+            * single bytes.
+            */
+            struct Table {
+                size_t capacity;
+                std::unique_ptr<std::atomic<uint64_t>[]> ctrlWords;
+                std::unique_ptr<std::atomic<T*>[]> slots;
+
+                explicit Table(size_t n)
+                    : capacity(n),
+                      ctrlWords(new std::atomic<uint64_t>[n / 8]),
+                      slots(new std::atomic<T*>[n]) {
+                    for (size_t i {0}; i < n / 8; ++i) {
+                        ctrlWords[i].store(EMPTY_WORD, std::memory_order_relaxed);
+                    }
+                    for (size_t i {0}; i < n; ++i) {
+                        slots[i].store(nullptr, std::memory_order_relaxed);
+                    }
+                }
+
+                int8_t ctrl(size_t i) const {
+                    return static_cast<int8_t>(ctrlWords[i / 8].load(std::memory_order_relaxed) >> (i % 8 * 8));
+                }
+
+                // Writer only: there is never a concurrent store to the same word.
+                void setCtrl(size_t i, int8_t value) {
+                    std::atomic<uint64_t>& word {ctrlWords[i / 8]};
+                    const unsigned shift {static_cast<unsigned>(i % 8 * 8)};
+                    const uint64_t cleared {word.load(std::memory_order_relaxed) & ~(uint64_t{0xFF} << shift)};
+                    word.store(cleared | (uint64_t{static_cast<uint8_t>(value)} << shift), std::memory_order_release);
+                }
+
+                Group group(size_t base) const {
+                    return Group(ctrlWords[base / 8].load(std::memory_order_acquire),
+                                 ctrlWords[base / 8 + 1].load(std::memory_order_acquire));
+                }
+
+                size_t groupMask() const { return capacity / GROUP_WIDTH - 1; }
+            };
+
+            struct Retired {
+                Table* table;
+                uint64_t stamp;
+            };
+
+            std::atomic<Table*> m_table {nullptr};
+            std::vector<Retired> m_retired {};
+            size_t m_size {0};
+            size_t m_growthLeft {0};
+
+            static int8_t tagOf(uint64_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+            static size_t maxLoad(size_t capacity) { return capacity - capacity / 8; }
+            static size_t tableBytes(size_t capacity) { return capacity + capacity * sizeof(T*); }
+
+            Table* current() const { return m_table.load(std::memory_order_relaxed); }
+
+            /*
+            * Triangular probing over groups: g, g+1, g+3, g+6, ...
+            */
+            static size_t firstGroup(const Table& table, uint64_t hash) {
+                return static_cast<size_t>(hash >> 7) & table.groupMask();
+            }
+
+            /*
+            * Probes for the first record accepted by matches(). A slot may be seen
+            * with its tag but already cleared by a concurrent erase; it is skipped.
+            */
+            template <typename Matches>
+            static T* probe(const Table& table, uint64_t hash, Matches&& matches) {
+                const int8_t tag {tagOf(hash)};
+                size_t group {firstGroup(table, hash)};
+                for (size_t step {1}; step <= table.capacity / GROUP_WIDTH; ++step) {
+                    const size_t base {group * GROUP_WIDTH};
+                    const Group g {table.group(base)};
+
+                    for (uint32_t mask {g.match(tag)}; mask != 0; mask &= mask - 1) {
+                        const size_t index {base + static_cast<size_t>(__builtin_ctz(mask))};
+                        T* record {table.slots[index].load(std::memory_order_acquire)};
+                        if (record && matches(*record)) {
+                            return record;
+                        }
+                    }
+
+                    if (g.matchEmpty() != 0) {
+                        return nullptr;
+                    }
+                    group = (group + step) & table.groupMask();
+                }
+                return nullptr;
+            }
+
+            /*
+            * Calls fn for the records whose home group is `home`. They all lie on
+            * the probe path from it before the first group with an empty slot:
+            * inserts only pass full groups, and a group that was once full keeps
+            * tombstones instead of empty slots until the next rehash.
+            */
+            template <typename Fn>
+            static void visitHome(const Table& table, size_t home, Fn& fn) {
+                size_t group {home};
+                for (size_t step {1}; step <= table.capacity / GROUP_WIDTH; ++step) {
+                    const size_t base {group * GROUP_WIDTH};
+                    const Group g {table.group(base)};
+
+                    const uint32_t full {~g.matchEmptyOrDeleted() & ((1u << GROUP_WIDTH) - 1)};
+                    for (uint32_t mask {full}; mask != 0; mask &= mask - 1) {
+                        T* record {table.slots[base + static_cast<size_t>(__builtin_ctz(mask))].load(std::memory_order_relaxed)};
+                        if (firstGroup(table, record->hash) == home) {
+                            fn(*record);
+                        }
+                    }
+
+                    if (g.matchEmpty() != 0) {
+                        return;
+                    }
+                    group = (group + step) & table.groupMask();
+                }
+            }
+
+            static size_t reverseBits(size_t v) {
+                static_assert(sizeof(size_t) == 8);
+                v = ((v >> 1) & 0x5555555555555555ull) | ((v & 0x5555555555555555ull) << 1);
+                v = ((v >> 2) & 0x3333333333333333ull) | ((v & 0x3333333333333333ull) << 2);
+                v = ((v >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((v & 0x0F0F0F0F0F0F0F0Full) << 4);
+                return __builtin_bswap64(v);
+            }
+
+            size_t findIndex(const Table& table, std::string_view key, uint64_t hash) const {
+                if (m_size == 0) {
+                    return NOT_FOUND;
+                }
+
+                const int8_t tag {tagOf(hash)};
+                size_t group {firstGroup(table, hash)};
+                for (size_t step {1}; ; ++step) {
+                    const size_t base {group * GROUP_WIDTH};
+                    const Group g {table.group(base)};
+
+                    for (uint32_t mask {g.match(tag)}; mask != 0; mask &= mask - 1) {
+                        const size_t index {base + static_cast<size_t>(__builtin_ctz(mask))};
+                        const T* record {table.slots[index].load(std::memory_order_relaxed)};
+                        if (record->hash == hash && record->key == key) {
+                            return index;
+                        }
+                    }
+
+                    if (g.matchEmpty() != 0) {
+                        return NOT_FOUND;
+                    }
+                    group = (group + step) & table.groupMask();
+                }
+            }
+
+            static size_t findInsertSlot(const Table& table, uint64_t hash) {
+                size_t group {firstGroup(table, hash)};
+                for (size_t step {1}; ; ++step) {
+                    const size_t base {group * GROUP_WIDTH};
+                    const uint32_t mask {table.group(base).matchEmptyOrDeleted()};
+                    if (mask != 0) {
+                        return base + static_cast<size_t>(__builtin_ctz(mask));
+                    }
+                    group = (group + step) & table.groupMask();
+                }
+            }
+
+            void rehash(size_t newCapacity) {
+                Table* oldTable {current()};
+                auto* table {new Table(newCapacity)};
+                m_growthLeft = maxLoad(newCapacity) - m_size;
+
+                if (oldTable) {
+                    for (size_t i {0}; i < oldTable->capacity; ++i) {
+                        const int8_t tag {oldTable->ctrl(i)};
+                        if (tag >= 0) {
+                            T* record {oldTable->slots[i].load(std::memory_order_relaxed)};
+                            const size_t index {findInsertSlot(*table, record->hash)};
+                            table->slots[index].store(record, std::memory_order_relaxed);
+                            table->setCtrl(index, tag);
+                        }
+                    }
+                }
+
+                // Readers pick up either table; the old one is freed once none can hold it.
+                m_table.store(table, std::memory_order_release);
+                if (oldTable) {
+                    m_retired.push_back({oldTable, EpochDomain::global().retireStamp()});
+                }
+                reclaimRetired();
+            }
+    };
+}
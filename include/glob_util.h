@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <utility>
+
+namespace util {
+
+    /**
+     * Matches text against a Redis-style glob pattern: `*` matches any run of
+     * characters, `?` any single character, `[abc]`, `[a-z]` and `[^abc]` one
+     * character from (or not from) a set, and `\` escapes the next character.
+     * Runs in O(pattern * text): a mismatch backtracks only to the last `*`.
+     *
+     * @param pattern The glob pattern.
+     * @param text The string to test.
+     * @return true if the whole text matches.
+     */
+    inline bool globMatch(std::string_view pattern, std::string_view text) {
+        /*
+        * Matches the single-character token at pattern[p] against c and sets
+        * `next` to the position after the token.
+        */
+        const auto matchOne = [&pattern](size_t p, char c, size_t& next) {
+            if (pattern[p] == '?') {
+                next = p + 1;
+                return true;
+            }
+
+            if (pattern[p] == '\\' && p + 1 < pattern.size()) {
+                next = p + 2;
+                return pattern[p + 1] == c;
+            }
+
+            if (pattern[p] != '[') {
+                next = p + 1;
+                return pattern[p] == c;
+            }
+
+            size_t i {p + 1};
+            const bool negate {i < pattern.size() && pattern[i] == '^'};
+            if (negate) {
+                ++i;
+            }
+
+            bool matched {false};
+            for (; i < pattern.size() && pattern[i] != ']'; ++i) {
+                if (pattern[i] == '\\' && i + 1 < pattern.size()) {
+                    matched |= pattern[++i] == c;
+                } else if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+                    char low {pattern[i]};
+                    char high {pattern[i + 2]};
+                    if (low > high) {
+                        std::swap(low, high);
+                    }
+                    matched |= c >= low && c <= high;
+                    i += 2;
+                } else {
+                    matched |= pattern[i] == c;
+                }
+            }
+
+            // An unterminated class runs to the end of the pattern, as in Redis.
+            next = i < pattern.size() ? i + 1 : i;
+            return matched != negate;
+        };
+
+        size_t p {0};
+        size_t t {0};
+        size_t starP {std::string_view::npos};
+        size_t starT {0};
+
+        while (t < text.size()) {
+            size_t next {0};
+            if (p < pattern.size() && pattern[p] == '*') {
+                starP = ++p;
+                starT = t;
+            } else if (p < pattern.size() && matchOne(p, text[t], next)) {
+                p = next;
+                ++t;
+            } else if (starP != std::string_view::npos) {
+                // Let the last star swallow one more character and retry from there.
+                p = starP;
+                t = ++starT;
+            } else {
+                return false;
+            }
+        }
+
+        while (p < pattern.size() && pattern[p] == '*') {
+            ++p;
+        }
+        return p == pattern.size();
+    }
+}
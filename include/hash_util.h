@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+namespace util {
+
+    /**
+     * Hashes a key once for both shard routing and the shard's flat index.
+     *
+     * @param key The key to hash.
+     * @return A 64-bit hash of the key.
+     */
+    inline uint64_t hashKey(std::string_view key) {
+        return static_cast<uint64_t>(std::hash<std::string_view>{}(key));
+    }
+
+    /**
+     * Jump consistent hash (Lamping and Veach): maps a key hash onto [0, n) such
+     * that growing n to m moves only about (m - n) / m of the keys, all of them
+     * into the new buckets [n, m). Runs the hash through its own generator, so
+     * the result does not correlate with the bits the flat index probes with.
+     * O(log n) steps, no memory.
+     *
+     * @param hash A hash from hashKey().
+     * @param n The number of buckets (at least 1).
+     * @return The bucket index.
+     */
+    inline size_t jumpHash(uint64_t hash, size_t n) {
+        int64_t bucket {-1};
+        int64_t next {0};
+        while (next < static_cast<int64_t>(n)) {
+            bucket = next;
+            hash = hash * 2862933555777941757ULL + 1;
+            next = static_cast<int64_t>(static_cast<double>(bucket + 1)
+                                        * (static_cast<double>(int64_t{1} << 31) / static_cast<double>((hash >> 33) + 1)));
+        }
+        return static_cast<size_t>(bucket);
+    }
+}
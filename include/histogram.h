@@ -0,0 +1,73 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace streamcache {
+
+    /*
+    * Plain (non-atomic) copy of a histogram's state, used for reporting and for
+    * merging histograms recorded on different threads or shards.
+    */
+    struct HistogramSnapshot {
+        std::vector<uint64_t> counts {};
+        uint64_t total {0};
+        uint64_t sum {0};
+        uint64_t max {0};
+
+        /**
+        * Adds another snapshot's samples to this one.
+        */
+        void merge(const HistogramSnapshot& other);
+
+        /**
+        * Returns the value at the given percentile (0-100). The result is the upper
+        * bound of the bucket holding that sample, so it overestimates by at most
+        * one bucket width (~6%).
+        */
+        uint64_t percentile(double p) const;
+
+        double mean() const { return total ? static_cast<double>(sum) / static_cast<double>(total) : 0.0; }
+    };
+
+    /**
+    * @class LatencyHistogram
+    * @brief Fixed-size log-linear histogram of non-negative values (typically nanoseconds).
+    *
+    * Each power of two is split into 16 linear sub-buckets, giving ~6% relative
+    * precision from 1ns up to ~18 minutes in 608 buckets. record() is a couple of
+    * relaxed atomic increments and never allocates, so it is cheap enough for hot
+    * paths; snapshot() may run concurrently with record().
+    */
+    class LatencyHistogram {
+        public:
+            static constexpr size_t SUB_BUCKET_BITS = 4;
+            static constexpr size_t SUB_BUCKETS = size_t{1} << SUB_BUCKET_BITS;
+            static constexpr size_t MAX_EXPONENT = 40;
+            static constexpr size_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+            LatencyHistogram() = default;
+
+            LatencyHistogram(const LatencyHistogram&) = delete;
+            LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+            void record(uint64_t value);
+
+            HistogramSnapshot snapshot() const;
+
+            void reset();
+
+            /**
+            * Maps a value to its bucket, and a bucket back to the largest value it holds.
+            */
+            static size_t bucketFor(uint64_t value);
+            static uint64_t bucketUpperBound(size_t bucket);
+
+        private:
+            std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_counts {};
+            std::atomic<uint64_t> m_sum {0};
+            std::atomic<uint64_t> m_max {0};
+    };
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "encoding.h"
+#include "slab_allocator.h"
+
+namespace streamcache {
+
+    /**
+    * @class LogBlock
+    * @brief A sealed run of a key's log records, compressed into one slab block.
+    *
+    * The header is followed by two sections. The timestamps section holds each
+    * record's distance from the previous one (the first from `first`) as a
+    * varint, so a time search decodes no value bytes. The values section encodes
+    * every value against one of the REFERENCE_WINDOW values before it in the
+    * block: which one, the lengths of the prefix and suffix the two share, and
+    * the bytes in between. A value that is an integer, like the one before it,
+    * is instead stored as the difference between the two (NUMERIC_DELTA and a
+    * zigzag varint) when that is shorter. A repeated value costs two to four
+    * bytes and a counter increment two, against sizeof(LogRecord) plus the
+    * value for a hot record, which is what makes an hour of history of a
+    * frequently rewritten key affordable.
+    *
+    * Blocks never change once built; Reader decodes one front to back. Like the
+    * ring they belong to, they are only touched under the shard's lock.
+    */
+    struct LogBlock {
+        using Timestamp = std::chrono::steady_clock::time_point;
+
+        /*
+        * Earlier values in the block a value can be encoded against.
+        */
+        static constexpr size_t REFERENCE_WINDOW = 8;
+
+        /*
+        * Reference index that marks a value stored as the numeric difference
+        * from the previous one.
+        */
+        static constexpr size_t NUMERIC_DELTA = REFERENCE_WINDOW;
+
+        Timestamp first {};
+        Timestamp last {};
+        uint32_t count {0};
+        uint32_t timesBytes {0};
+        uint32_t valuesBytes {0};
+
+        const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+
+        /**
+        * Size of the slab block holding the header and both sections.
+        */
+        size_t allocationBytes() const { return sizeof(LogBlock) + timesBytes + valuesBytes; }
+
+        /**
+        * Number of records with timestamp < t.
+        */
+        size_t lowerBound(Timestamp t) const;
+
+        /**
+        * Number of records with timestamp <= t.
+        */
+        size_t upperBound(Timestamp t) const;
+
+        /**
+        * Returns the block to the allocator it was built from.
+        */
+        static void destroy(LogBlock* block, SlabAllocator& slab);
+
+        /*
+        * Encodes time-ordered records into a block. The values passed to add()
+        * must stay valid until build().
+        */
+        class Builder {
+            public:
+                void add(Timestamp timestamp, std::string_view value);
+
+                size_t size() const { return m_count; }
+
+                /**
+                * Allocates the block from slab and resets the builder.
+                */
+                LogBlock* build(SlabAllocator& slab);
+
+            private:
+                std::string m_times {};
+                std::string m_values {};
+                std::array<std::string_view, REFERENCE_WINDOW> m_window {};
+                Timestamp m_first {};
+                Timestamp m_last {};
+                uint32_t m_count {0};
+        };
+
+        /*
+        * Decodes a block's records oldest first.
+        */
+        class Reader {
+            public:
+                explicit Reader(const LogBlock& block);
+
+                /**
+                * Decodes the next record. The value stays valid until the next call.
+                *
+                * @return false after the last record.
+                */
+                bool next(Timestamp& timestamp, std::string_view& value);
+
+            private:
+                /**
+                * Decodes the rest of the next value's encoding into m_scratch.
+                * @return false if it is malformed.
+                */
+                bool decodeValue(uint64_t back);
+
+                util::ByteReader m_times {};
+                util::ByteReader m_values {};
+                std::array<std::string, REFERENCE_WINDOW> m_window {};
+                std::string m_scratch {};
+                Timestamp m_timestamp {};
+                uint32_t m_remaining {0};
+                uint32_t m_index {0};
+        };
+    };
+}
@@ -0,0 +1,253 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include "log_block.h"
+#include "slab_allocator.h"
+#include "value.h"
+
+namespace streamcache {
+
+    /*
+    * Log record as stored in a shard. The value is a handle, so the newest record
+    * shares its buffer with the key's current value.
+    */
+    struct LogRecord {
+        std::chrono::steady_clock::time_point timestamp {};
+        Value value {};
+    };
+
+    /*
+    * A log record as handed to readers: a hot record's stored handle, or the
+    * decoded bytes of a sealed one, which are only valid during the visit.
+    */
+    struct LogRecordView {
+        std::chrono::steady_clock::time_point timestamp {};
+        std::string_view value {};
+        const Value* stored {nullptr};      // nullptr for a sealed record
+
+        /**
+        * A reference that outlives the visit: shares a hot record's buffer,
+        * copies a sealed record's bytes.
+        */
+        ValueRef ref() const { return stored ? ValueRef(*stored) : ValueRef::copyOf(value); }
+    };
+
+    /*
+    * Running totals over every log of a shard, for metrics: the number of
+    * records, and their bytes (ring buffers plus the value bytes each record
+    * refers to, counting a buffer shared with the current value in full, plus
+    * sealed blocks). The sealed counters are the part of those in LogBlocks.
+    * Maintained by the rings under the shard's exclusive lock.
+    */
+    struct LogStats {
+        size_t records {0};
+        size_t bytes {0};
+        size_t sealedRecords {0};
+        size_t sealedBytes {0};
+    };
+
+    /**
+    * @class LogRing
+    * @brief A key's log: time-ordered records in one contiguous slab-allocated
+    *        ring, with older history sealed into compressed blocks.
+    *
+    * Records are appended at the back and retired from the front, so the ring is
+    * always sorted by timestamp and any time bound can be found by binary search.
+    * Pruning to a retention cutoff is a single search plus a head advance instead
+    * of one pop per record.
+    *
+    * Capacity starts at one record and doubles up to the smallest power of two
+    * that holds maxRecords; once a key holds maxRecords records, every append
+    * retires the oldest one, so a heavily written key never grows past that bound.
+    * The buffer shrinks again when pruning leaves it three-quarters empty.
+    *
+    * seal(), run by the shard's log-pruning pass, moves the oldest records
+    * beyond the newest HOT_RECORDS into LogBlocks of BLOCK_RECORDS each, which
+    * precede the ring in time. Appends only ever touch the uncompressed ring;
+    * readers decode blocks on the fly, and the oldest sealed records are retired
+    * by counting them off the front block until all of it can be freed. Keys
+    * that never collect that many records pay one null pointer for the tier.
+    *
+    * Not thread-safe; the owning shard serializes access with its lock, and the
+    * records' Value handles must be released under its exclusive lock.
+    */
+    class LogRing {
+        public:
+            using Timestamp = std::chrono::steady_clock::time_point;
+
+            /*
+            * Default bound on the number of records kept per key.
+            */
+            static constexpr size_t DEFAULT_MAX_RECORDS = 1024;
+
+            /*
+            * Newest records seal() always leaves uncompressed.
+            */
+            static constexpr size_t HOT_RECORDS = 64;
+
+            /*
+            * Records per sealed block.
+            */
+            static constexpr size_t BLOCK_RECORDS = 64;
+
+            LogRing(SlabAllocator& slab, LogStats& stats) : m_slab(&slab), m_stats(&stats) {
+            }
+
+            ~LogRing();
+
+            LogRing(const LogRing&) = delete;
+            LogRing& operator=(const LogRing&) = delete;
+
+            /**
+            * Appends a record that is not older than back(), retiring the oldest record
+            * if the ring already holds maxRecords.
+            */
+            void pushBack(LogRecord record, size_t maxRecords);
+
+            /**
+            * Inserts a record at its time position (after any records with the same
+            * timestamp). Used by recovery, where records can arrive out of order. If
+            * the ring is full, the oldest record is retired, which may be the new one.
+            * A record not newer than the newest sealed one unseals the log first.
+            * A record equal to one already held (same timestamp and value) is
+            * dropped, so replaying a write the log already has is harmless.
+            */
+            void insert(LogRecord record, size_t maxRecords);
+
+            /**
+            * Removes every record older than cutoff.
+            *
+            * @return The number of records removed.
+            */
+            size_t truncateBefore(Timestamp cutoff);
+
+            /**
+            * Seals the oldest records into blocks, BLOCK_RECORDS at a time, while
+            * more than HOT_RECORDS would stay uncompressed.
+            *
+            * @return The number of records sealed.
+            */
+            size_t seal();
+
+            void clear();
+
+            /**
+            * Visits the records written in [from, to], oldest first, at most
+            * `limit` of them. Sealed blocks entirely outside the range are skipped
+            * without decoding.
+            */
+            void forEach(Timestamp from, Timestamp to, size_t limit,
+                         const std::function<void(const LogRecordView&)>& visit) const;
+
+            /**
+            * Visits every record, oldest first.
+            */
+            void forEach(const std::function<void(const LogRecordView&)>& visit) const {
+                forEach(Timestamp::min(), Timestamp::max(), SIZE_MAX, visit);
+            }
+
+            /**
+            * The value of the newest record written at or before `at`, or nullopt.
+            */
+            std::optional<ValueRef> valueAt(Timestamp at) const;
+
+            size_t size() const { return m_size + sealedSize(); }
+            bool empty() const { return size() == 0; }
+
+            /**
+            * Records held in sealed blocks.
+            */
+            size_t sealedSize() const { return m_sealed ? m_sealed->size : 0; }
+
+            /**
+            * Bytes held by the ring buffer itself (value buffers and blocks are accounted separately).
+            */
+            size_t memoryBytes() const { return m_capacity * sizeof(LogRecord); }
+
+        private:
+            /*
+            * The sealed tier, allocated once the first block is sealed.
+            */
+            struct Sealed {
+                std::vector<LogBlock*, SlabStdAllocator<LogBlock*>> blocks;
+                size_t skip {0};    // retired records at the front of blocks.front()
+                size_t size {0};    // live sealed records
+
+                explicit Sealed(SlabAllocator& slab) : blocks(SlabStdAllocator<LogBlock*>(slab)) {
+                }
+            };
+
+            SlabAllocator* m_slab;
+            LogStats* m_stats;
+            LogRecord* m_records {nullptr};
+            Sealed* m_sealed {nullptr};
+            uint32_t m_capacity {0};    // zero or a power of two
+            uint32_t m_head {0};
+            uint32_t m_size {0};
+
+            /*
+            * The i-th oldest record of the ring.
+            */
+            const LogRecord& operator[](size_t i) const { return m_records[(m_head + i) & (m_capacity - 1)]; }
+            LogRecord& at(size_t i) { return m_records[(m_head + i) & (m_capacity - 1)]; }
+
+            /*
+            * Ring index of the first record with timestamp >= t (m_size if none).
+            */
+            size_t lowerBound(Timestamp t) const;
+
+            /*
+            * Ring index of the first record with timestamp > t (m_size if none).
+            */
+            size_t upperBound(Timestamp t) const;
+
+            void popFront();
+
+            /*
+            * Retires the oldest record, sealed or not.
+            */
+            void popOldest();
+
+            /*
+            * Retires the n oldest sealed records, at most those left in the front
+            * block, and frees the block once none are left in it.
+            */
+            void retireSealed(size_t n);
+
+            /*
+            * Frees every sealed block and the tier itself.
+            */
+            void releaseSealed();
+
+            /*
+            * Decodes the sealed records back into the ring.
+            */
+            void unseal();
+
+            /*
+            * Halves the buffer while it is at most a quarter full.
+            */
+            void shrinkIfSparse();
+
+            /*
+            * Constructs a record in the free slot at index m_size and counts it.
+            */
+            void emplaceBack(LogRecord record);
+
+            /*
+            * Doubles the buffer if it is full. Callers retire records first when the
+            * ring is at maxRecords, so this never grows past maxRecords' power of two.
+            */
+            void growIfFull();
+
+            /*
+            * Moves the records into a new buffer of the given capacity, oldest at index 0.
+            */
+            void reallocate(size_t capacity);
+    };
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "change_stream.h"
+#include "histogram.h"
+#include "slab_allocator.h"
+
+namespace streamcache {
+
+    /*
+    * Cache operations counted for metrics, one per public entry point.
+    */
+    enum class MetricOp {
+        GET,
+        SET,
+        MGET,
+        MSET,
+        REPLAY,
+        SCAN,
+        INCR,
+        ZADD,       // sorted-set writes: ZADD, ZINCRBY
+        ZRANGE,     // sorted-set reads: ZRANGE, ZREVRANGEBYSCORE, ZRANK, ZSCORE, ZCARD
+        COUNT
+    };
+
+    /*
+    * Lower-case command name of an operation ("get", "mset", ...).
+    */
+    const char* metricOpName(MetricOp op);
+
+    constexpr size_t METRIC_OP_COUNT = static_cast<size_t>(MetricOp::COUNT);
+
+    /*
+    * Plain copy of the operation counters.
+    */
+    struct OpTotals {
+        std::array<uint64_t, METRIC_OP_COUNT> calls {};
+        uint64_t hits {0};
+        uint64_t misses {0};
+
+        uint64_t totalCalls() const;
+    };
+
+    /**
+    * @class OpCounters
+    * @brief Call and hit/miss counters that threads bump without sharing a cache line.
+    *
+    * Each thread increments a stripe picked by its thread id (like
+    * AccessBuffer), so concurrent callers almost never touch the same line and
+    * an increment is one uncontended relaxed add. totals() sums the stripes and
+    * may run concurrently with the adds.
+    */
+    class OpCounters {
+        public:
+            void recordCall(MetricOp op) {
+                stripe().calls[static_cast<size_t>(op)].fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void recordLookups(uint64_t hits, uint64_t misses) {
+                Stripe& s {stripe()};
+                if (hits) {
+                    s.hits.fetch_add(hits, std::memory_order_relaxed);
+                }
+                if (misses) {
+                    s.misses.fetch_add(misses, std::memory_order_relaxed);
+                }
+            }
+
+            OpTotals totals() const;
+
+        private:
+            static constexpr size_t STRIPES = 16;
+
+            struct alignas(64) Stripe {
+                std::array<std::atomic<uint64_t>, METRIC_OP_COUNT> calls {};
+                std::atomic<uint64_t> hits {0};
+                std::atomic<uint64_t> misses {0};
+            };
+
+            std::array<Stripe, STRIPES> m_stripes {};
+
+            Stripe& stripe();
+    };
+
+    /*
+    * Point-in-time view of one shard.
+    */
+    struct ShardMetrics {
+        size_t keys {0};
+        size_t expiryTimers {0};            // keys scheduled in the timing wheel (it keeps no stale entries)
+        size_t logRecords {0};
+        size_t logBytes {0};                // see LogStats
+        size_t logSealedRecords {0};        // the part of the above in compressed blocks
+        size_t logSealedBytes {0};
+        MemoryStats memory {};
+        uint64_t memoryEvictions {0};
+        HistogramSnapshot evictionLag {};   // expiry to removal, ns; its total is the number of expired keys removed
+        HistogramSnapshot pruneTime {};     // per log-pruning batch, ns
+        HistogramSnapshot exclusiveWaits {};    // contended shard lock acquisitions, ns
+        HistogramSnapshot sharedWaits {};
+    };
+
+    /*
+    * Point-in-time view of a whole cache, from Cache::metrics().
+    */
+    struct CacheMetrics {
+        std::chrono::steady_clock::time_point takenAt {};
+        std::chrono::steady_clock::duration uptime {};
+        bool threadPerCore {false};
+        OpTotals ops {};
+        uint64_t migratedKeys {0};
+        size_t evictionQueueEntries {0};    // scheduler deadline heap, stale entries included
+        ChangeStreamMetrics changes {};
+        std::vector<ShardMetrics> shards {};
+    };
+
+    /**
+    * Renders metrics as INFO text: "# Section" headers followed by "name:value"
+    * lines, with one line per shard. Rates are computed against `previous`
+    * (an earlier snapshot of the same cache) if given, else over the uptime.
+    */
+    std::string formatInfo(const CacheMetrics& metrics, const CacheMetrics* previous);
+
+    /**
+    * Renders metrics in the Prometheus text exposition format (version 0.0.4).
+    * Histograms are exported as summaries in seconds, per shard.
+    */
+    std::string formatPrometheus(const CacheMetrics& metrics);
+}
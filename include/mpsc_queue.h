@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace streamcache {
+
+    /**
+    * @class MpscQueue
+    * @brief Bounded lock-free queue with many producers and a single consumer.
+    *
+    * A ring of cells, each with a sequence number that says whose turn it is
+    * (Vyukov's bounded queue): a producer claims a position with one CAS on the
+    * tail and publishes its item by advancing the cell's sequence; the consumer
+    * owns the head outright and takes items without any read-modify-write.
+    * Producers only contend with each other on the tail, never with the
+    * consumer, and the consumer touches no cache line a producer writes except
+    * the cells themselves.
+    *
+    * T must be trivially copyable and cheap to copy (a few words).
+    */
+    template <typename T>
+    class MpscQueue {
+        public:
+            /**
+            * @param capacity Number of items the queue holds; rounded up to a power of two.
+            */
+            explicit MpscQueue(size_t capacity) {
+                size_t size {2};
+                while (size < capacity) {
+                    size <<= 1;
+                }
+                m_mask = size - 1;
+                m_cells = std::make_unique<Cell[]>(size);
+                for (size_t i {0}; i < size; ++i) {
+                    m_cells[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            MpscQueue(const MpscQueue&) = delete;
+            MpscQueue& operator=(const MpscQueue&) = delete;
+
+            /**
+            * Appends an item. Safe from any number of threads.
+            *
+            * @return false if the queue is full.
+            */
+            bool tryPush(const T& item) {
+                size_t position {m_tail.load(std::memory_order_relaxed)};
+                for (;;) {
+                    Cell& cell {m_cells[position & m_mask]};
+                    const size_t sequence {cell.sequence.load(std::memory_order_acquire)};
+                    const auto lag {static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position)};
+
+                    if (lag == 0) {
+                        if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                            cell.item = item;
+                            cell.sequence.store(position + 1, std::memory_order_release);
+                            return true;
+                        }
+                    } else if (lag < 0) {
+                        // The consumer has not freed this cell from the previous lap yet.
+                        return false;
+                    } else {
+                        position = m_tail.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            /**
+            * Takes the oldest item. Consumer thread only.
+            *
+            * @return false if the queue is empty.
+            */
+            bool tryPop(T& item) {
+                Cell& cell {m_cells[m_head & m_mask]};
+                if (cell.sequence.load(std::memory_order_acquire) != m_head + 1) {
+                    return false;
+                }
+
+                item = cell.item;
+                cell.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+                ++m_head;
+                return true;
+            }
+
+            /**
+            * True if there is nothing to pop. Consumer thread only.
+            */
+            bool empty() const {
+                return m_cells[m_head & m_mask].sequence.load(std::memory_order_acquire) != m_head + 1;
+            }
+
+        private:
+            struct Cell {
+                std::atomic<size_t> sequence {0};
+                T item {};
+            };
+
+            std::unique_ptr<Cell[]> m_cells {};
+            size_t m_mask {0};
+            alignas(64) std::atomic<size_t> m_tail {0};     // next position producers claim
+            alignas(64) size_t m_head {0};                  // next position the consumer reads
+    };
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace util {
+
+    /**
+     * Parses a value written the way formatInteger() writes it: an optional
+     * '-' and decimal digits without leading zeros, in int64 range. Anything
+     * else (spaces, '+', "007", "-0") is not a number, so a stored counter and
+     * its text always convert back and forth exactly.
+     *
+     * @param text The stored value.
+     * @param value Receives the number.
+     * @return false if text is not a canonical integer.
+     */
+    inline bool parseInteger(std::string_view text, int64_t& value) {
+        if (text.empty() || text.size() > 20) {
+            return false;
+        }
+        const size_t digits {text[0] == '-' ? size_t{1} : size_t{0}};
+        if (digits == text.size() || (text[digits] == '0' && (digits > 0 || text.size() > 1))) {
+            return false;
+        }
+
+        const char* end {text.data() + text.size()};
+        const auto [ptr, ec] {std::from_chars(text.data(), end, value)};
+        return ec == std::errc() && ptr == end;
+    }
+
+    inline std::string formatInteger(int64_t value) {
+        char buf[24];
+        const auto [ptr, ec] {std::to_chars(buf, buf + sizeof(buf), value)};
+        (void)ec;
+        return std::string(buf, ptr);
+    }
+
+    /**
+     * Parses a finite floating-point number spanning all of text (decimal or
+     * exponent notation, no surrounding spaces).
+     */
+    inline bool parseDouble(std::string_view text, double& value) {
+        if (text.empty()) {
+            return false;
+        }
+        const char* end {text.data() + text.size()};
+        const auto [ptr, ec] {std::from_chars(text.data(), end, value)};
+        return ec == std::errc() && ptr == end && std::isfinite(value);
+    }
+
+    /**
+     * Writes a finite double in fixed notation with the fewest digits that
+     * parse back to the same value: 10.5 + 0.1 is "10.6", and a whole number
+     * has no fraction, so it stays usable as an integer.
+     */
+    inline std::string formatDouble(double value) {
+        // Fixed notation of the largest doubles runs to 309 digits.
+        char buf[340];
+        const auto [ptr, ec] {std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed)};
+        (void)ec;
+        std::string text(buf, ptr);
+        return text == "-0" ? "0" : text;
+    }
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "cache.h"
+
+namespace streamcache {
+
+    /*
+    * Replication stream, primary to replica, after the replica has sent SYNC:
+    *
+    *   +FULLRESYNC <offset>\r\n $<length>\r\n <snapshot file> \r\n
+    *   *2 SET <AOF SET payload>                 (one per write, in shard order)
+    *   *2 ZADD <AOF ZADD payload>               (one per sorted-set member written)
+    *   *3 OFFSET <writes sent> <writes published>
+    *
+    * Offsets count writes: the sum over the primary's shards of their change-ring
+    * sequence numbers. The snapshot covers everything before <offset>; the SET
+    * records that follow are the writes after it. A FULLRESYNC may come again at
+    * any time, when the replica fell so far behind that the primary's rings no
+    * longer hold the writes it is missing.
+    */
+    namespace replication {
+
+        /**
+        * Appends a write to the stream: ["SET", payload] with an AOF SET payload,
+        * or ["ZADD", payload] with an AOF ZADD payload for a sorted-set member.
+        */
+        void appendWrite(std::string& out, const ChangeEvent& event);
+
+        /**
+        * Appends ["OFFSET", sent, published].
+        */
+        void appendOffset(std::string& out, uint64_t sent, uint64_t published);
+
+        /**
+        * Appends the full-resync header; the snapshot's bytes and "\r\n" follow.
+        */
+        void appendFullResync(std::string& out, uint64_t offset, size_t snapshotBytes);
+    }
+
+    /*
+    * Where a replica connects: host and port, or a Unix socket path.
+    */
+    struct ReplicationSource {
+        std::string host {};
+        uint16_t port {0};
+        std::string unixSocket {};
+
+        /**
+        * Parses "host:port", or a path (containing a '/') for a Unix socket.
+        */
+        static std::optional<ReplicationSource> parse(const std::string& text);
+
+        std::string toString() const;
+    };
+
+    /*
+    * Point-in-time view of a replica's link to its primary.
+    */
+    struct ReplicaStatus {
+        std::string primary {};
+        bool linkUp {false};
+        bool syncing {false};               // waiting for or loading a snapshot
+        uint64_t offset {0};                // primary writes applied
+        uint64_t primaryOffset {0};         // writes the primary had published when it last reported
+        uint64_t fullSyncs {0};
+        uint64_t writesApplied {0};         // streamed writes applied since startup
+        std::optional<std::chrono::steady_clock::duration> sinceLastIo {};
+    };
+
+    /**
+    * @class ReplicaLink
+    * @brief The replica side of replication: follows a primary and applies its writes.
+    *
+    * A background thread connects to the primary, sends SYNC and applies what
+    * comes back: the snapshot replaces the cache's contents (Cache::clear(),
+    * then Cache::loadSnapshot()), and every streamed write is applied with
+    * Cache::restore() (Cache::restoreMember() for sorted-set members), which
+    * keeps the primary's timestamps so REPLAY and GET ... AS OF answer as they
+    * would there. Reads are served throughout;
+    * while a snapshot loads they see the keys loaded so far. A lost link is
+    * retried with a growing delay and starts over with a full sync.
+    *
+    * Writes reach a replica only through the link: the server rejects write
+    * commands while a link is configured.
+    */
+    class ReplicaLink {
+        public:
+            /*
+            * Delays between reconnection attempts, doubling from the first to the last.
+            */
+            static constexpr std::chrono::milliseconds MIN_RETRY_DELAY {100};
+            static constexpr std::chrono::milliseconds MAX_RETRY_DELAY {5000};
+
+            /**
+            * @param cache The cache to replicate into; it must outlive the link.
+            * @param source The primary.
+            * @param spoolDir Where received snapshots are written before loading.
+            */
+            ReplicaLink(Cache& cache, ReplicationSource source, std::string spoolDir);
+
+            /**
+            * Stops the link.
+            */
+            ~ReplicaLink();
+
+            ReplicaLink(const ReplicaLink&) = delete;
+            ReplicaLink& operator=(const ReplicaLink&) = delete;
+
+            void start();
+
+            /**
+            * Closes the connection and joins the thread; a snapshot being
+            * loaded is finished first.
+            */
+            void stop();
+
+            ReplicaStatus status() const;
+
+        private:
+            Cache& m_cache;
+            const ReplicationSource m_source;
+            const std::string m_spoolPath;
+
+            std::mutex m_mutex {};
+            std::condition_variable m_cv {};
+            bool m_stopping {false};
+            int m_fd {-1};          // guarded by m_mutex, so stop() can shut it down
+            std::thread m_thread {};
+
+            std::atomic<bool> m_linkUp {false};
+            std::atomic<bool> m_syncing {false};
+            std::atomic<uint64_t> m_offset {0};
+            std::atomic<uint64_t> m_primaryOffset {0};
+            std::atomic<uint64_t> m_fullSyncs {0};
+            std::atomic<uint64_t> m_writesApplied {0};
+            std::atomic<int64_t> m_lastIo {0};      // steady_clock ticks, 0 before the first
+
+            void run();
+
+            /**
+            * Connects and sends SYNC.
+            * @return The socket, or -1.
+            */
+            int connectToPrimary();
+
+            /**
+            * Applies the stream until the connection fails or stop() is called.
+            */
+            void follow(int fd);
+
+            /**
+            * Parses and applies the complete messages at the front of buf.
+            *
+            * @return The number of bytes consumed, or nullopt on a protocol error.
+            */
+            std::optional<size_t> apply(std::string_view buf);
+
+            /**
+            * Replaces the cache's contents with a snapshot received from the primary.
+            * @return false if it could not be spooled or loaded.
+            */
+            bool loadSnapshot(std::string_view bytes, uint64_t offset);
+
+            /**
+            * Sleeps for delay unless stop() is called first.
+            * @return false if stopping.
+            */
+            bool waitToRetry(std::chrono::milliseconds delay);
+    };
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace streamcache::resp {
+
+    /*
+    * Outcome of trying to parse one command out of a connection's input buffer.
+    */
+    enum class ParseStatus {
+        OK,
+        INCOMPLETE,
+        ERROR
+    };
+
+    /*
+    * Protocol limits. Anything larger is treated as a protocol error so a
+    * misbehaving client cannot make the server buffer unbounded input.
+    */
+    const size_t MAX_BULK_LENGTH = 512 * 1024 * 1024;
+    const size_t MAX_ARRAY_LENGTH = 1024 * 1024;
+    const size_t MAX_INLINE_LENGTH = 64 * 1024;
+
+    /**
+     * Parses a single command from the front of the buffer. Accepts both RESP
+     * arrays of bulk strings (what client libraries send) and inline commands
+     * (a whitespace separated line, e.g. from telnet/nc).
+     *
+     * @param buf The unconsumed bytes received from the client.
+     * @param consumed Set to the number of bytes making up the parsed command on OK.
+     * @param args Receives the command name and its arguments on OK.
+     * @param error Receives a description of the problem on ERROR.
+     * @return OK if a full command was parsed, INCOMPLETE if more bytes are needed,
+     *         ERROR if the input is malformed.
+     */
+    ParseStatus parseCommand(std::string_view buf, size_t& consumed,
+                             std::vector<std::string>& args, std::string& error);
+
+    /*
+    * Reply encoders. Each appends one RESP value to the output buffer so
+    * pipelined replies can be batched into a single write.
+    */
+    void appendSimpleString(std::string& out, std::string_view s);
+    void appendError(std::string& out, std::string_view msg);
+    void appendInteger(std::string& out, int64_t v);
+    void appendBulkString(std::string& out, std::string_view s);
+
+    /*
+    * Just the "$<len>\r\n" prefix of a bulk string, for callers that send the
+    * payload (and its trailing "\r\n") from a buffer of their own.
+    */
+    void appendBulkHeader(std::string& out, size_t len);
+    void appendNull(std::string& out);
+    void appendArrayHeader(std::string& out, size_t n);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace streamcache {
+
+    /**
+    * @class SeqLock
+    * @brief Version counter that lets readers copy data a single writer may be changing.
+    *
+    * The writer (already serialized by the shard's exclusive lock) makes the
+    * version odd, stores the data with storeWords(), and makes it even again.
+    * A reader takes readBegin(), copies the data with loadWords(), and keeps the
+    * copy only if validate() confirms the version did not move in between.
+    * Readers never write, so any number of them share the cache line without
+    * invalidating it.
+    *
+    * The protected data is accessed exclusively through word-sized relaxed
+    * atomics, so concurrent readers and the writer never race in the C++ sense;
+    * it must be 8-byte aligned and a multiple of 8 bytes long.
+    */
+    class SeqLock {
+        public:
+            void beginWrite() {
+                m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+            }
+
+            void endWrite() {
+                m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            /**
+            * Waits out a write in progress and returns the (even) version.
+            */
+            uint32_t readBegin() const {
+                uint32_t version {m_version.load(std::memory_order_acquire)};
+                while (version & 1) {
+                    version = m_version.load(std::memory_order_acquire);
+                }
+                return version;
+            }
+
+            /**
+            * True if nothing was written since readBegin() returned `version`.
+            */
+            bool validate(uint32_t version) const {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return m_version.load(std::memory_order_relaxed) == version;
+            }
+
+            static void storeWords(void* dst, const void* src, size_t bytes) {
+                auto* to {static_cast<uint64_t*>(dst)};
+                const auto* from {static_cast<const uint64_t*>(src)};
+                for (size_t i {0}; i < bytes / 8; ++i) {
+                    __atomic_store_n(&to[i], from[i], __ATOMIC_RELAXED);
+                }
+            }
+
+            static void loadWords(void* dst, const void* src, size_t bytes) {
+                auto* to {static_cast<uint64_t*>(dst)};
+                const auto* from {static_cast<const uint64_t*>(src)};
+                for (size_t i {0}; i < bytes / 8; ++i) {
+                    to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+                }
+            }
+
+        private:
+            std::atomic<uint32_t> m_version {0};
+    };
+}
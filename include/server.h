@@ -0,0 +1,345 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <cstdint>
+#include "cache.h"
+#include "replication.h"
+
+namespace streamcache {
+
+    /*
+    * Listener and threading configuration for the network server.
+    */
+    struct ServerConfig {
+        std::string bindAddress {"127.0.0.1"};
+        uint16_t port {6380};           // 0 disables the TCP listener
+        std::string unixSocket {};      // empty disables the Unix socket listener
+        size_t ioThreads {2};
+        int backlog {511};
+        std::string snapshotPath {};    // empty disables SNAPSHOT
+        std::string metricsFile {};     // Prometheus text file rewritten every metricsInterval; empty disables it
+        std::chrono::seconds metricsInterval {10};
+        std::string replicaOf {};       // primary to follow ("host:port" or a Unix socket path); empty for a primary
+    };
+
+    /**
+    * @class Server
+    * @brief Serves a Cache over TCP and/or Unix sockets using a RESP-compatible protocol.
+    *
+    * The server runs a small, fixed set of I/O threads. Each thread owns an epoll
+    * instance and the connections it accepted; the listening sockets are shared
+    * between all threads with EPOLLEXCLUSIVE so a new connection wakes exactly
+    * one of them. A connection is never touched by more than one thread.
+    *
+    * Pipelining: each readable event drains the socket into the connection's
+    * input buffer, every complete command in it is executed in order, and all
+    * replies are appended to one output buffer that is flushed with a single
+    * write. Clients can therefore batch hundreds of commands per syscall.
+    *
+    * Zero-copy replies: GET takes a ValueRef to the stored buffer instead of a
+    * copy. Values of at least ZERO_COPY_MIN bytes are queued by reference between
+    * owned segments and go out with one gather write (sendmsg with an iovec), so
+    * a large payload is never memcpy'd by the server at all.
+    *
+    * Change streams: SUBSCRIBE and PSUBSCRIBE put a connection in subscribed
+    * mode, backed by a ChangeSubscription. Its I/O thread pulls the writes from
+    * the shards' change rings whenever a write wakes it (see ChangeFeed) and
+    * the connection's output is drained, so a subscriber that does not read
+    * only stops being fed: writers never wait for it, and once it catches up
+    * it is told how many writes it lost. PUBSUB LAG reports how far behind it is.
+    *
+    * Replication: a connection that sends SYNC becomes a replica feed. A sync
+    * worker thread exports a snapshot, recording each shard's change-ring head
+    * where its export starts, and the feed then streams every write after those
+    * heads from the rings, the way subscribers are fed; a replica that falls
+    * further behind than the rings reach gets a new snapshot. With replicaOf
+    * set, the server is a replica instead: a ReplicaLink follows the primary,
+    * write commands are answered with -READONLY, and reads are served locally.
+    *
+    * Metrics: INFO replies with Cache::metrics() as INFO text, METRICS with the
+    * same figures in the Prometheus text format. If a metrics file is configured,
+    * a background thread rewrites it atomically (write, then rename) every
+    * metricsInterval, for a node exporter's textfile collector to pick up.
+    *
+    * Lifecycle:
+    * - start() binds the listeners and launches the I/O threads. Throws
+    *   std::system_error if a listener cannot be set up.
+    * - stop() (or the destructor) wakes and joins the threads and closes all sockets.
+    */
+    class Server {
+        public:
+            Server(Cache& cache, ServerConfig config);
+            ~Server();
+
+            Server(const Server&) = delete;
+            Server& operator=(const Server&) = delete;
+
+            void start();
+
+            void stop();
+
+        private:
+            /*
+            * A piece of output queued ahead of Connection::out: either owned bytes
+            * or a stored value sent straight from its buffer.
+            */
+            struct OutSegment {
+                std::string bytes {};
+                std::optional<ValueRef> value {};
+
+                std::string_view view() const { return value ? value->view() : std::string_view(bytes); }
+            };
+
+            /*
+            * A connection's change-stream subscription and what it asked for.
+            */
+            struct Subscriber {
+                std::unique_ptr<ChangeSubscription> subscription {};
+                std::unordered_set<std::string> keys {};
+                std::vector<std::string> patterns {};
+                uint64_t reportedLost {0};      // lost writes the client has been told about
+
+                size_t count() const { return keys.size() + patterns.size(); }
+            };
+
+            /*
+            * A connection that sent SYNC: the primary's side of a replica's stream.
+            * The atomics are read by INFO on other threads.
+            */
+            struct ReplicaFeed {
+                std::unique_ptr<ChangeSubscription> subscription {};
+                uint64_t syncId {0};                // the sync in progress or last finished; 0 before the first
+                std::atomic<bool> syncing {false};  // waiting for its snapshot
+                std::atomic<uint64_t> offset {0};   // writes sent, snapshot included
+                std::atomic<uint64_t> fullSyncs {0};
+            };
+
+            struct IoThread;
+
+            /*
+            * A snapshot requested for a replica feed, and the export that answers it.
+            */
+            struct SyncRequest {
+                IoThread* io {nullptr};
+                int fd {-1};
+                uint64_t syncId {0};
+            };
+
+            struct SyncResult {
+                int fd {-1};
+                uint64_t syncId {0};
+                std::shared_ptr<const std::string> snapshot {};     // null if the export failed
+                std::vector<uint64_t> changeHeads {};
+            };
+
+            struct Connection {
+                int fd {-1};
+                std::string in {};
+                size_t inPos {0};
+                std::deque<OutSegment> queued {};   // sent before `out`
+                std::string out {};
+                size_t outPos {0};                  // offset into the first unsent segment (or `out`)
+                bool wantWrite {false};
+                bool closeAfterWrite {false};
+                std::unique_ptr<Subscriber> subscriber {};     // set in subscribed mode
+                std::unique_ptr<ReplicaFeed> replica {};       // set once the connection sent SYNC
+            };
+
+            struct IoThread {
+                int epollFd {-1};
+                int wakeFd {-1};
+                std::thread thread {};
+                std::unordered_map<int, std::unique_ptr<Connection>> connections {};
+                std::unordered_set<int> subscribers {};     // connections in subscribed mode, and replica feeds
+                bool changesReady {false};                  // woken by a write, or a connection subscribed
+                bool deliveryPending {false};               // a subscriber has more to read than one pass takes
+
+                std::mutex syncMutex {};
+                std::vector<SyncResult> syncDone {};        // finished exports, posted by the sync worker
+            };
+
+            Cache& m_cache;
+            ServerConfig m_config {};
+            std::vector<int> m_listenFds {};
+            std::vector<std::unique_ptr<IoThread>> m_ioThreads {};
+            std::atomic<bool> m_running {false};
+
+            std::mutex m_snapshotMutex {};
+            std::thread m_snapshotThread {};
+            std::atomic<bool> m_snapshotRunning {false};
+
+            // The snapshot INFO's rates are computed against.
+            std::mutex m_infoMutex {};
+            std::optional<CacheMetrics> m_lastInfo {};
+
+            std::thread m_metricsThread {};
+            std::mutex m_metricsMutex {};
+            std::condition_variable m_metricsCv {};
+            bool m_metricsStopping {false};
+
+            // Primary: exports snapshots for replicas, one at a time.
+            std::thread m_syncThread {};
+            std::mutex m_syncMutex {};
+            std::condition_variable m_syncCv {};
+            std::vector<SyncRequest> m_syncRequests {};
+            bool m_syncStopping {false};
+            std::atomic<uint64_t> m_nextSyncId {1};
+
+            // Replica feeds of all I/O threads, for INFO.
+            std::mutex m_replicasMutex {};
+            std::vector<const ReplicaFeed*> m_replicas {};
+
+            // Replica: the link to the primary.
+            std::unique_ptr<ReplicaLink> m_replicaLink {};
+
+            /**
+            * Event loop for a single I/O thread.
+            */
+            void runLoop(IoThread& io);
+
+            void openListeners();
+            void acceptConnections(IoThread& io, int listenFd);
+
+            /**
+            * Reads what is available, then runs processInput().
+            * @return false if the connection should be closed.
+            */
+            bool handleReadable(IoThread& io, Connection& conn);
+
+            /**
+            * Executes the complete commands in conn.in and flushes the replies,
+            * stopping early while the socket does not take more output.
+            * @return false if the connection should be closed.
+            */
+            bool processInput(IoThread& io, Connection& conn);
+
+            /**
+            * Writes as much pending output as the socket accepts. If anything is
+            * left over, waits for EPOLLOUT alone, so the connection is not read
+            * until its output drains.
+            * @return false if the connection should be closed.
+            */
+            bool flush(IoThread& io, Connection& conn);
+
+            void closeConnection(IoThread& io, int fd);
+
+            /**
+            * Appends a bulk-string reply for a stored value: copied into the output
+            * buffer if small, otherwise queued by reference.
+            */
+            void appendValue(Connection& conn, ValueRef value);
+
+            /**
+            * Executes a single parsed command and appends its reply to the connection's output.
+            */
+            void execute(std::vector<std::string>& args, Connection& conn);
+
+            /**
+            * Starts a snapshot on a background thread so the calling I/O thread keeps serving.
+            * @return false if a snapshot is already running.
+            */
+            bool startSnapshot();
+
+            /**
+            * GET key AS OF <epoch-ms>: the value the key had at that time.
+            */
+            void executeGetAsOf(std::vector<std::string>& args, Connection& conn);
+
+            /**
+            * INCR / DECR key, INCRBY / DECRBY key n, INCRBYFLOAT key x.
+            */
+            void executeIncrement(std::vector<std::string>& args, Connection& conn);
+
+            /**
+            * ZADD key [EX seconds] [NX|XX] [GT|LT] [CH] score member [score member ...],
+            * ZINCRBY key delta member, ZSCORE / ZRANK key member, ZCARD key,
+            * ZRANGE key start stop [WITHSCORES],
+            * ZREVRANGEBYSCORE key max min [WITHSCORES] [LIMIT offset count].
+            */
+            void executeSortedSet(std::vector<std::string>& args, Connection& conn);
+
+            /**
+            * REPLAY key [FROM ms] [TO ms] [LIMIT n]; without FROM, the records
+            * within the key's TTL window.
+            */
+            void executeReplay(std::vector<std::string>& args, Connection& conn);
+
+            /**
+            * SUBSCRIBE / PSUBSCRIBE / UNSUBSCRIBE / PUNSUBSCRIBE.
+            */
+            void executeSubscribe(std::vector<std::string>& args, Connection& conn);
+
+            /**
+            * Appends the messages a write produces for a subscribed connection:
+            * one for an exact key, one per matching pattern.
+            */
+            void appendChange(Connection& conn, const ChangeEvent& event);
+
+            /**
+            * Arms the change feed and feeds every subscriber of the thread.
+            */
+            void deliverChanges(IoThread& io);
+
+            /**
+            * Reads pending writes for one subscriber and flushes them, while its
+            * output keeps draining.
+            * @return false if the connection should be closed.
+            */
+            bool deliverChanges(IoThread& io, Connection& conn);
+
+            /**
+            * Queues a snapshot for a replica feed. The feed's new subscription is
+            * opened first, so the shards keep every write the export may miss.
+            */
+            void startSync(IoThread& io, Connection& conn);
+
+            /**
+            * Body of the sync worker thread: answers queued requests, several
+            * at once with one export, until stop().
+            */
+            void runSyncs();
+
+            /**
+            * Sends the snapshots the sync worker finished for this thread's
+            * feeds and repositions the feeds at the snapshots' heads.
+            */
+            void finishSyncs(IoThread& io);
+
+            /**
+            * Streams pending writes to a replica, while its output keeps
+            * draining; starts a new sync if the rings overran it.
+            * @return false if the connection should be closed.
+            */
+            bool deliverReplication(IoThread& io, Connection& conn);
+
+            /**
+            * The "# Replication" section of INFO.
+            */
+            std::string replicationInfo();
+
+            /**
+            * SLOWLOG GET [count] | LEN | RESET.
+            */
+            void executeSlowLog(std::vector<std::string>& args, std::string& out);
+
+            /**
+            * INFO text for the current metrics, with rates since the previous INFO.
+            */
+            std::string info();
+
+            /**
+            * Body of the metrics file thread: rewrites the file every interval until stop().
+            */
+            void dumpMetrics();
+    };
+}
@@ -1,20 +1,33 @@
 #pragma once
 #include <string>
-#include <unordered_map>
-#include <queue>
+#include <string_view>
 #include <deque>
 #include <vector>
 #include <optional>
 #include <chrono>
-#include <shared_mutex>
 #include <atomic>
 #include <memory>
+#include <functional>
+#include "change_stream.h"
+#include "epoch.h"
+#include "histogram.h"
+#include "metrics.h"
+#include "seqlock.h"
+#include "shard_mutex.h"
+#include "slowlog.h"
+#include "timing_wheel.h"
+#include "flat_index.h"
+#include "slab_allocator.h"
+#include "value.h"
+#include "log_ring.h"
+#include "sorted_set.h"
+#include "eviction_policy.h"
 
 namespace streamcache {
     using Timestamp = std::chrono::steady_clock::time_point;
 
-    // Forward declaration to avoid circular dependency
-    class EvictionThread;
+    // Forward declarations to avoid circular dependencies
+    class AofWriter;
 
     /*
     * Entry structure containing a value and relevant metadata.
@@ -23,6 +36,61 @@ namespace streamcache {
         std::string value {};
         std::optional<Timestamp> expiration {};
         Timestamp timeSet {};
+        std::optional<std::vector<ScoredMember>> members {};   // set for a sorted set, whose value is empty
+    };
+
+    /*
+    * Outcome of an increment (INCRBY, INCRBYFLOAT).
+    */
+    enum class IncrementStatus {
+        OK,
+        NOT_A_NUMBER,       // the stored value is not an integer (or, for a float increment, a number)
+        WRONG_TYPE,         // the key holds a sorted set
+        OUT_OF_RANGE,       // the result would overflow int64, or would not be finite
+        MISSING             // only-if-present was asked for and the shard does not hold the key
+    };
+
+    /*
+    * An increment's status and, if it was applied, the value it stored.
+    */
+    struct IncrementResult {
+        IncrementStatus status {IncrementStatus::OK};
+        std::string value {};       // the new value as stored
+        int64_t integer {0};        // the new value, for integer increments
+    };
+
+    /*
+    * Outcome of a sorted-set command.
+    */
+    enum class SortedSetStatus {
+        OK,
+        WRONG_TYPE,         // the key holds a string value
+        NOT_FINITE,         // an increment would make the score infinite or NaN
+        MISSING             // only-if-present was asked for and the shard does not hold the key
+    };
+
+    /*
+    * ZADD's flags. NX only adds new members and XX only updates existing ones;
+    * GT and LT only update a member if its new score is greater (less) than the
+    * current one. An expiration (re)sets the key's TTL; without one the key
+    * keeps its TTL, or has none if ZADD creates it.
+    */
+    struct ZAddOptions {
+        bool nx {false};
+        bool xx {false};
+        bool gt {false};
+        bool lt {false};
+        std::optional<Timestamp> expiration {};
+    };
+
+    /*
+    * A sorted-set write's status and what it did.
+    */
+    struct SortedSetResult {
+        SortedSetStatus status {SortedSetStatus::OK};
+        size_t added {0};           // members that were new
+        size_t updated {0};         // existing members whose score changed
+        double score {0};           // for an increment, the member's new score
     };
 
     /*
@@ -34,23 +102,158 @@ namespace streamcache {
     };
 
     /*
-    * Custom comparator for the eviction queue. Makes sure that keys with earlier
-    * expiration times are prioritized for removal.
+    * Which records of a key's log to replay: those written in [from, to], oldest
+    * first, at most `limit` of them. Without `from` the range starts at the
+    * beginning of the key's TTL window (now minus its original TTL), or at its
+    * oldest retained record if it has no TTL; without `to` it runs to the newest.
+    */
+    struct ReplayRange {
+        std::optional<Timestamp> from {};
+        std::optional<Timestamp> to {};
+        size_t limit {SIZE_MAX};
+    };
+
+    /*
+    * One replayed log record; the value is shared with the log, not copied.
+    */
+    struct ReplayRecord {
+        Timestamp timestamp {};
+        ValueRef value {};
+    };
+
+    /*
+    * What the shard actually stores per key: the key and its hash, the current
+    * value and its metadata, the key's log, and its hooks in the expiry index
+    * and the replacement policy.
+    * A record and its key bytes are one slab block (the key follows the struct),
+    * and records never move, so the flat index and the timing wheel both point at
+    * the record itself instead of holding copies of the key.
+    *
+    * Lock-free readers only look at key, hash, value, expiration and the sorted
+    * flag; key and hash never change, the others change together through
+    * publish() and are read with read(). Everything else belongs to the shard lock.
+    *
+    * A sorted set keeps its members in zset and publishes an empty value with
+    * the sorted flag set, so lock-free readers see it as a key without a string
+    * value. Its log records the member updates, one "<score> <member>" record
+    * (see encodeMemberUpdate()) per member written.
     */
-    struct EvictionComparator {
-        bool operator()(const std::pair<Timestamp, std::string>& a,
-                        const std::pair<Timestamp, std::string>& b) const {
-            return a.first > b.first; // earlier expiration => higher priority
+    struct StoredEntry : TimerNode, PolicyNode {
+        std::string_view key {};    // points just past the record
+        uint64_t hash {0};
+        SeqLock seqlock {};
+        Value value {};
+        std::optional<Timestamp> expiration {};
+        uint64_t sortedSet {0};     // a word, so the seqlock can copy it
+        Timestamp timeSet {};
+        LogRing log;
+        std::unique_ptr<SortedSet> zset {};
+
+        StoredEntry(SlabAllocator& slab, LogStats& logStats) : log(slab, logStats) {
+        }
+
+        /**
+        * Replaces value, expiration and the sorted flag as one write lock-free
+        * readers can observe. Requires the exclusive lock.
+        */
+        void publish(Value next, std::optional<Timestamp> nextExpiration, bool nextSortedSet = false) {
+            const uint64_t flag {nextSortedSet ? uint64_t{1} : uint64_t{0}};
+            seqlock.beginWrite();
+            Value previous {Value::publish(value, std::move(next))};
+            SeqLock::storeWords(&expiration, &nextExpiration, sizeof(expiration));
+            SeqLock::storeWords(&sortedSet, &flag, sizeof(sortedSet));
+            seqlock.endWrite();
+        }
+
+        /**
+        * Copies value, expiration and the sorted flag as left by one publish().
+        * Safe without the lock while pinned in the EpochDomain.
+        */
+        void read(ValueSnapshot& snapshot, std::optional<Timestamp>& snapshotExpiration,
+                  bool& snapshotSortedSet) const {
+            uint64_t flag {0};
+            for (;;) {
+                const uint32_t version {seqlock.readBegin()};
+                snapshot = ValueSnapshot(value);
+                SeqLock::loadWords(&snapshotExpiration, &expiration, sizeof(expiration));
+                SeqLock::loadWords(&flag, &sortedSet, sizeof(sortedSet));
+                if (seqlock.validate(version)) {
+                    snapshotSortedSet = flag != 0;
+                    return;
+                }
+            }
+        }
+
+        /**
+        * Copies the record's value and metadata, and a sorted set's members, out
+        * into a CacheEntry.
+        */
+        CacheEntry toCacheEntry() const {
+            CacheEntry entry {std::string(value.view()), expiration, timeSet};
+            if (zset) {
+                entry.members.emplace();
+                entry.members->reserve(zset->size());
+                zset->forEach([&entry](std::string_view member, double score) {
+                    entry.members->push_back({std::string(member), score});
+                });
+            }
+            return entry;
         }
     };
 
+    /*
+    * One key of a multi-key batch, already routed to its shard: the key, its
+    * hash, and its position in the caller's request (where its result goes).
+    */
+    struct BatchKey {
+        std::string_view key {};
+        uint64_t hash {0};
+        size_t index {0};
+    };
+
+    /*
+    * A record on its way to another shard during resharding: its value and
+    * metadata, its log, and its replacement-policy frequency.
+    */
+    struct MigratedRecord {
+        CacheEntry entry {};
+        std::deque<LogEntry> logs {};
+        uint8_t frequency {0};
+    };
+
+    /*
+    * Callback used to export a shard's contents: one call per record, which
+    * carries the key, the current value and the key's retained log.
+    */
+    using SnapshotVisitor = std::function<void(const StoredEntry&)>;
+
     /*
     * A Shard is a self-contained mini-cache with its own index, logs,
-    * eviction queue, and synchronization primitives.
+    * expiry index (a hierarchical timing wheel), and synchronization primitives.
+    *
+    * Every keyed method takes the key's hash from util::hashKey() alongside the
+    * key; the cache computes it once for shard routing and the shard reuses it
+    * to probe its flat index.
+    *
+    * A shard either serves any thread under its lock, or belongs to one owner
+    * thread (thread-per-core mode, see ShardExecutor) that makes every call on
+    * it. An owned shard takes no locks and serves reads directly instead of
+    * through the epoch-pinned lock-free path.
     */
     class Shard {
     public:
-        Shard();
+        /**
+        * @param owned True if only one thread will ever call into the shard
+        *              (apart from the lock-free statistics getters).
+        * @param slowLog Where slow maintenance batches (expiry slices, log pruning,
+        *                migration) are recorded, or nullptr.
+        * @param index The shard's index, which names it in the slow log.
+        * @param changeFeed The feed whose subscribers the shard publishes its
+        *                   writes for, or nullptr.
+        */
+        explicit Shard(bool owned = false, SlowLog* slowLog = nullptr, size_t index = 0,
+                       ChangeFeed* changeFeed = nullptr);
+
         ~Shard();
 
         /*
@@ -63,44 +266,361 @@ namespace streamcache {
 
         /**
         * Adds or updates an entry in the shard.
-        * If the entry has an expiration time, it is added to the eviction heap.
+        * If the entry has an expiration time, it is (re)scheduled in the expiry
+        * wheel in O(1); an overwrite moves the key's existing timer rather than
+        * leaving a stale one behind.
         * Appends the value to the key's log and prunes old log entries.
         *
         * @param key The key for the shard entry.
+        * @param hash The key's hash.
         * @param entry The value + metadata to be stored in the shard.
         *              Passed by value so it can be safely modified without affecting
         *              the caller's original object.
         */
-        void set(const std::string& key, CacheEntry entry);
+        void set(std::string_view key, uint64_t hash, CacheEntry entry);
 
         /**
-        * Retrieves a value from the cache.
+        * Like set(), but only if the shard holds the key (live or expired). Used
+        * during resharding, when a key's old shard keeps serving it until it has
+        * been migrated.
+        *
+        * @param key The key for the shard entry.
+        * @param hash The key's hash.
+        * @param entry The value + metadata; left untouched if the key is absent.
+        * @return false if the key is not in the shard.
+        */
+        bool setExisting(std::string_view key, uint64_t hash, CacheEntry& entry);
+
+        /**
+        * Adds delta to the integer stored at key, as one read-modify-write under
+        * a single exclusive lock acquisition, so concurrent increments are never
+        * lost. A missing or expired key counts as 0 and is created without a
+        * TTL; an existing key keeps its TTL. The result is stored as its decimal
+        * text, which for counters below 10^16 fits the inline Value and needs
+        * no allocation, and is written like set(): logged, published to the
+        * change ring and appended to the AOF.
+        *
+        * @param key The key for the shard entry.
+        * @param hash The key's hash.
+        * @param delta The amount to add.
+        * @param ifPresent Only if the shard holds the key (used during resharding,
+        *                  like setExisting()); MISSING otherwise.
+        * @return The new value, or why the stored one could not be incremented.
+        */
+        IncrementResult incrBy(std::string_view key, uint64_t hash, int64_t delta, bool ifPresent = false);
+
+        /**
+        * Like incrBy(), for floating-point numbers: the stored value may be any
+        * finite number, and the sum is stored in fixed notation with the fewest
+        * digits that read back as the same double.
+        */
+        IncrementResult incrByFloat(std::string_view key, uint64_t hash, double delta, bool ifPresent = false);
+
+        /**
+        * Adds members to the sorted set at key, or moves existing ones to their
+        * new scores, as one write under the exclusive lock. A missing or expired
+        * key becomes a new sorted set on the first member actually written, so a
+        * ZADD that writes nothing creates nothing. Every member written appends
+        * its own record to the key's log, change ring and AOF (see
+        * encodeMemberUpdate()); members listed twice are applied in order.
+        *
+        * @param key The key for the shard entry.
+        * @param hash The key's hash.
+        * @param members The members and their scores, which must be finite.
+        * @param options NX/XX/GT/LT and the key's new expiration, applied if a
+        *                member is written.
+        * @param ifPresent Only if the shard holds the key (see incrBy()); MISSING otherwise.
+        * @return WRONG_TYPE if the key holds a string value, otherwise the
+        *         number of members added and updated.
+        */
+        SortedSetResult zadd(std::string_view key, uint64_t hash, const std::vector<ScoredMember>& members,
+                             const ZAddOptions& options, bool ifPresent = false);
+
+        /**
+        * Adds delta to member's score (a missing member counts as 0), like zadd()
+        * for a single member.
+        *
+        * @return The new score, NOT_FINITE if it would not be finite, or WRONG_TYPE.
+        */
+        SortedSetResult zincrBy(std::string_view key, uint64_t hash, std::string_view member, double delta,
+                                bool ifPresent = false);
+
+        /**
+        * Passes the sorted set at key to visit under the shard's shared lock,
+        * for rank, score and range queries. Like replay(), visit should only
+        * copy what it needs and must not call back into the cache.
+        *
+        * @return OK if visit was called, MISSING if the key does not exist (or
+        *         has expired), WRONG_TYPE if it holds a string value.
+        */
+        SortedSetStatus readSortedSet(std::string_view key, uint64_t hash,
+                                      const std::function<void(const SortedSet&)>& visit);
+
+        /**
+        * Retrieves a value from the cache without taking the shard lock: the reader
+        * pins the EpochDomain, finds the record, and copies the value under the
+        * record's seqlock. Falls back to the shared lock if no epoch slot is free.
+        * A sorted set has no string value and reads as not found.
         *
         * @param key The key for the cache entry.
+        * @param hash The key's hash.
         * @return The value associated with the key, or NULL if not found.
         */
-        std::optional<std::string> get(const std::string& key);
+        std::optional<std::string> get(std::string_view key, uint64_t hash);
+
+        /**
+        * Retrieves a reference to a key's current value buffer without copying it.
+        * Lock-free like get(); taking the reference costs one refcount increment
+        * for values that are not inline.
+        *
+        * @param key The key for the cache entry.
+        * @param hash The key's hash.
+        * @param wrongType If given, set to true when the key holds a sorted set
+        *                  (which has no value, so the result is nullopt).
+        * @return A reference that outlives the lock, or nullopt if not found.
+        */
+        std::optional<ValueRef> getRef(std::string_view key, uint64_t hash, bool* wrongType = nullptr);
+
+        /**
+        * Looks up a batch of keys lock-free under a single epoch pin.
+        *
+        * @param keys The keys routed to this shard.
+        * @param count Number of keys.
+        * @param results Request-ordered result array; the result for keys[i] is
+        *                stored at results[keys[i].index].
+        * @param wrongTypes If given, a request-ordered array like results, where
+        *                   wrongTypes[keys[i].index] is set to true if keys[i]
+        *                   holds a sorted set.
+        */
+        void multiGet(const BatchKey* keys, size_t count, std::optional<ValueRef>* results,
+                      bool* wrongTypes = nullptr);
+
+        /**
+        * Applies a batch of writes under a single exclusive lock, in the given order,
+        * with the same semantics as set() for each of them. The eviction scheduler
+        * is notified at most once, with the earliest new deadline of the batch.
+        *
+        * @param keys The keys routed to this shard.
+        * @param count Number of keys.
+        * @param entries Request-ordered entries; keys[i] is written with
+        *                entries[keys[i].index], which may be modified.
+        */
+        void multiSet(const BatchKey* keys, size_t count, CacheEntry* entries);
+
+        /**
+        * Inserts an entry recovered from persistent storage. Unlike set(), the
+        * entry's own timeSet is kept and used as the log timestamp, and nothing is
+        * written to the AOF. Entries are applied last-writer-wins by timeSet, so
+        * records may be restored in any order.
+        *
+        * @param key The key for the shard entry.
+        * @param hash The key's hash.
+        * @param entry The recovered value + metadata.
+        */
+        void restore(std::string_view key, uint64_t hash, CacheEntry entry);
+
+        /**
+        * Applies one member update recovered from the AOF or received from a
+        * primary; entry.value is the update as encodeMemberUpdate() wrote it.
+        * The key's timeSet and expiration follow its newest write, and its log
+        * gets the update at its timestamp. A key that held a string value
+        * written after the update is left alone; one written before it, or a
+        * set that had already expired, is replaced by a new set.
+        *
+        * @param key The key for the shard entry.
+        * @param hash The key's hash.
+        * @param entry The update + metadata.
+        */
+        void restoreMember(std::string_view key, uint64_t hash, CacheEntry entry);
+
+        /**
+        * Inserts an entry recovered from a snapshot together with its log history.
+        * The history is merged into any log the key already has.
+        *
+        * @param key The key for the shard entry.
+        * @param hash The key's hash.
+        * @param entry The recovered value + metadata.
+        * @param logs The key's recovered log, in chronological order.
+        */
+        void restore(std::string_view key, uint64_t hash, CacheEntry entry, std::deque<LogEntry> logs);
+
+        /**
+        * Takes over a record migrated from another shard: like restore() with a
+        * log, but the record keeps its replacement-policy history, and its value
+        * replaces any the key already has here regardless of timestamps.
+        *
+        * @param key The key for the shard entry.
+        * @param hash The key's hash.
+        * @param record The migrated value, metadata, log and frequency.
+        */
+        void adopt(std::string_view key, uint64_t hash, MigratedRecord record);
+
+        /**
+        * Moves the records of the next MIGRATE_BATCH index slots whose keys now
+        * belong to another shard into that shard, under one short exclusive lock
+        * (the destination locks in turn inside adopt()). A record is added to its
+        * destination before it is removed here, so lock-free readers that look
+        * here first and then at the destination always find it. Expired records
+        * are dropped instead of moved. The cursor persists across calls like
+        * pruneLogs()'s. Slow batches are recorded in the slow log as MIGRATE.
+        *
+        * @param destinationOf Returns the shard a key hash moves to, or nullptr if it stays.
+        * @param moved Incremented by the number of records moved.
+        * @return true if the pass is unfinished, false once the cursor has wrapped.
+        */
+        bool migrateOut(const std::function<Shard*(uint64_t)>& destinationOf, size_t& moved);
+
+        /*
+        * Number of index slots visited per migrateOut() call.
+        */
+        static constexpr size_t MIGRATE_BATCH = 256;
+
+        /*
+        * Index groups exported per exportSnapshot() step.
+        */
+        static constexpr size_t SNAPSHOT_BATCH = 16;
+
+        /**
+        * Marks the point a snapshot export starts from, under the shared lock. If
+        * an AOF is attached and nextAofPath is non-empty, the AOF is rotated to
+        * that path, and changeHead (if given) receives the change ring's head:
+        * every write from here on goes to the new AOF file and the ring after
+        * the head, so loading the export and then replaying those misses nothing.
+        *
+        * @param nextAofPath The file this shard's AOF continues in, or empty.
+        * @param changeHead Receives changes().head(), or nullptr.
+        */
+        void markSnapshot(const std::string& nextAofPath, uint64_t* changeHead = nullptr);
+
+        /**
+        * One step of a snapshot export: passes the entries of the next
+        * SNAPSHOT_BATCH index groups after cursor, with their logs, to the
+        * visitor under a shared lock, and returns the cursor for the next step,
+        * or 0 once the shard is done (start with 0, after markSnapshot()).
+        * Writers only wait for one step, and the caller can write each step
+        * out before taking the next. Every entry that exists for the whole
+        * export is visited (see FlatIndex::scan()). Entries written after the
+        * mark may be visited in their newer state, and one may be visited twice
+        * if the index grew in between; restore() treats those as repeated
+        * writes, so replaying the AOF or change stream on top still converges.
+        *
+        * @param cursor 0, or the value returned by the previous step.
+        * @param visit Called once per entry visited.
+        */
+        size_t exportSnapshot(size_t cursor, const SnapshotVisitor& visit) const;
+
+        /**
+        * Removes every key and its log, as a replica does before loading a
+        * fresh snapshot of its primary.
+        */
+        void clear();
+
+        /**
+        * Attaches an append-only file writer. Every subsequent set() is queued to it.
+        * Must be called before the shard serves traffic.
+        *
+        * @param aof The writer for this shard's AOF.
+        */
+        void attachAof(std::unique_ptr<AofWriter> aof);
 
         /**
         * Displays a key's recent values within its TTL window.
         * 
         * @param key The key for which the log should be displayed.
+        * @param hash The key's hash.
         */
-        void replay(const std::string& key);
+        void replay(std::string_view key, uint64_t hash);
+
+        /**
+        * Returns a key's recent values within its TTL window without printing them.
+        * Used by callers that render the history themselves (e.g. the network server).
+        *
+        * @param key The key whose log should be returned.
+        * @param hash The key's hash.
+        * @return The replay window in chronological order, or nullopt if the key is not found.
+        */
+        std::optional<std::deque<LogEntry>> getReplay(std::string_view key, uint64_t hash) const;
+
+        /**
+        * Streams the records of a key's log that fall in `range` to `visit`, in
+        * time order. Both ends are found by binary search over the time-ordered
+        * log, so the cost is O(log n) plus the records visited. `visit` runs
+        * under the shard's shared lock: it should only copy or reference the
+        * record, and must not call back into the cache.
+        *
+        * @return false if the key does not exist (or has expired).
+        */
+        bool replay(std::string_view key, uint64_t hash, const ReplayRange& range,
+                    const std::function<void(const LogRecordView&)>& visit) const;
+
+        /**
+        * Point-in-time lookup: the value the key had at time `at`, i.e. the value
+        * of its newest log record written at or before `at`. Returns nullopt if
+        * the key does not exist now (or holds a sorted set), or if no retained
+        * record is that old.
+        */
+        std::optional<ValueRef> getAsOf(std::string_view key, uint64_t hash, Timestamp at) const;
+
+        /**
+        * One step of a key scan (see FlatIndex::scan()): appends the live keys
+        * homed in the next `groups` index groups, under one short shared lock.
+        * Writers may insert, erase and rehash between steps.
+        *
+        * @param cursor 0 to start, then the value returned by the previous step.
+        * @param groups Index groups to visit (each holds about a dozen keys).
+        * @param keys Receives the keys.
+        * @return The cursor of the next step, or 0 once the whole shard was visited.
+        */
+        size_t scanKeys(size_t cursor, size_t groups, std::vector<std::string>& keys) const;
+
+        /**
+        * The shard's recent writes, published while its change feed has
+        * subscribers. Readable from any thread without the lock.
+        */
+        const ChangeRing& changes() const { return m_changes; }
 
         /**
         * Prunes log entries for all keys that are older than the cutoff timestamp.
         * This cutoff is calculated by (now - log retention duration).
         * The log retention duration is a fixed value of 1 hour. This means that
         * logs older than 1 hour will be removed, regardless of the individual key's TTL.
+        * Runs pruneLogs() until a full pass is done, releasing the lock between batches.
         * 
         * @param cutoff The timestamp before which all log entries should be removed.
         */
         void pruneAllLogs(Timestamp cutoff);
 
         /**
-        * Called by the eviction thread to check when the next eviction should occur.
-        * Requires a shared lock to safely read the eviction heap without blocking
+        * Prunes the logs of the next PRUNE_BATCH index slots, starting where the
+        * previous call stopped, under one short exclusive lock. Each key's log is
+        * truncated by binary search, and its older records are then sealed into
+        * compressed blocks (see LogRing::seal()). The cursor persists across calls, so a pass
+        * that is interrupted resumes with the keys it has not reached yet instead
+        * of starting over. Each batch's duration is recorded for metrics(), and
+        * a slow one in the slow log as PRUNE.
+        *
+        * @param cutoff The timestamp before which log entries are removed.
+        * @return true if the pass is unfinished, false once the cursor has wrapped
+        *         around the whole index.
+        */
+        bool pruneLogs(Timestamp cutoff);
+
+        /*
+        * Number of index slots visited per pruneLogs() call.
+        */
+        static constexpr size_t PRUNE_BATCH = 1024;
+
+        /**
+        * Bounds each key's log to maxRecords records; older records are retired as
+        * new ones arrive. Longer logs shrink on their next write.
+        *
+        * @param maxRecords The per-key record limit (at least 1).
+        */
+        void setMaxLogRecords(size_t maxRecords);
+
+        /**
+        * Called by the eviction scheduler to check when the next eviction should occur.
+        * Requires a shared lock to safely read the expiry wheel without blocking
         * other readers.
         * 
         * @return The timestamp of the next scheduled eviction, or nullopt if no evictions are scheduled.
@@ -108,48 +628,204 @@ namespace streamcache {
         std::optional<Timestamp> peekNextExpiry() const;
 
         /**
-        * Removes all keys from the cache whose expiry time is <= @param now.
-        * Called by the eviction thread when it wakes up.
-        * Requires an exclusive lock to safely modify the cache and eviction heap.
+        * Removes keys whose expiry time is <= @param now, at most EVICTION_SLICE of
+        * them per call, so the exclusive lock is only ever held for a short slice.
+        * Called by the eviction scheduler when the shard's deadline is due; it keeps
+        * calling while this returns true, releasing the lock between slices.
         * 
+        * Slow slices are recorded in the slow log as EVICT.
+        *
         * @param now The cutoff timestamp.
-        * 
+        * @return true if the slice limit was hit and more keys may be due.
         */
-        void evictExpired(Timestamp now);
+        bool evictExpired(Timestamp now);
 
         /**
-        * Compares the new expiry time against the current earliest expiry in the heap.
-        * If the new time is earlier (or if there were no expiring keys before), signals
-        * the eviction thread to recalculate its wakeup deadline.
-        * Uses minimal locking; never blocks on the eviction thread.
+        * Feeds the eviction scheduler's deadline queue when the earliest deadline in
+        * the expiry wheel moved earlier.
+        * Called after the shard lock is released; never blocks on eviction work.
         * 
         * @param t The new earliest expiry time.
         */
         void notifyNewExpiry(Timestamp t);
 
+        /*
+        * Maximum number of keys evicted per evictExpired() call.
+        */
+        static constexpr size_t EVICTION_SLICE = 512;
+
         /**
-        * Gives the eviction thread a way to register the wakeup function.
+        * Gives the eviction scheduler a way to register the wakeup function.
+        * Must be set before the shard serves traffic.
         * 
-        * @param cb The callback to call when the eviction thread needs to wake up.
+        * @param cb Called with the shard's new earliest expiry time.
         */
-        void setNotifyWakeup(std::function<void()> cb) { m_notifyWakeup = std::move(cb); }
+        void setNotifyWakeup(std::function<void(Timestamp)> cb) { m_notifyWakeup = std::move(cb); }
+
+        /**
+        * Distribution of eviction lag: how long after its expiry time each key was
+        * actually removed by evictExpired(), in nanoseconds.
+        */
+        HistogramSnapshot evictionLag() const { return m_evictionLag.snapshot(); }
+
+        /**
+        * Exact memory held by this shard: slab bytes for records, keys, values,
+        * logs and sorted-set nodes, plus the slot arrays of the flat index and of
+        * the sorted sets' member indexes. Lock-free; safe to call any time.
+        */
+        MemoryStats memoryStats() const;
+
+        /**
+        * Bounds the shard's memory (as reported by memoryStats().allocated). Once a
+        * write or restore pushes the shard over maxBytes, records chosen by the
+        * policy are evicted, together with their logs, until it fits again; the
+        * record just written is never the victim. 0 removes the limit.
+        * A new policy starts with every existing record; if the policy stays the
+        * same, only the budget changes and the records keep their history.
+        *
+        * @param maxBytes The shard's memory budget in bytes, or 0 for unlimited.
+        * @param policy How victims are chosen.
+        */
+        void setMemoryLimit(size_t maxBytes, EvictionPolicy policy);
+
+        /**
+        * Number of records evicted to stay within the memory limit.
+        */
+        uint64_t memoryEvictions() const { return m_memoryEvictions.load(std::memory_order_relaxed); }
+
+        /**
+        * Key, timer and log counts (read under a brief shared lock), plus the
+        * shard's memory, eviction, pruning and lock-wait statistics.
+        */
+        ShardMetrics metrics() const;
        
         
     private:
-        std::unordered_map<std::string, CacheEntry> m_cache {};
-        std::priority_queue<
-            std::pair<Timestamp, std::string>,
-            std::vector<std::pair<Timestamp, std::string>>,
-            EvictionComparator
-        > m_evictionHeap {};
-        std::unordered_map<std::string, std::deque<LogEntry>> m_logs {};
-        std::function<void()> m_notifyWakeup {};
-        mutable std::shared_mutex m_mutex {};
-        std::unique_ptr<EvictionThread> m_evictionThread;
+        SlabAllocator m_slab {};
+        FlatIndex<StoredEntry> m_cache {};
+        std::atomic<size_t> m_indexBytes {0};
+        std::atomic<size_t> m_sortedSetIndexBytes {0};     // kept up to date by the sets themselves
+        TimingWheel m_expiryWheel {};
+        std::function<void(Timestamp)> m_notifyWakeup {};
+        mutable ShardMutex m_mutex;
+        std::unique_ptr<AofWriter> m_aof {};
+        LatencyHistogram m_evictionLag {};
+        LatencyHistogram m_pruneTime {};
+        LogStats m_logStats {};
+        SlowLog* m_slowLog;
+        const std::string m_traceName;     // "shard <index>", the slow log key of maintenance batches
+        ChangeFeed* m_changeFeed;
+        ChangeRing m_changes {};            // after m_slab: its events hold value buffers
+
+        // Memory limit; m_policy is null while the shard is unbounded.
+        size_t m_maxMemory {0};
+        EvictionPolicy m_policyKind {};
+        std::unique_ptr<ReplacementPolicy> m_policy {};
+        AccessBuffer m_accessBuffer {};
+        std::atomic<bool> m_trackAccess {false};    // m_policy is set; readable without the lock
+        std::atomic<uint64_t> m_memoryEvictions {0};
+
+        // Log bounds and the resumable pruning cursor (an index slot position).
+        size_t m_maxLogRecords {LogRing::DEFAULT_MAX_RECORDS};
+        size_t m_pruneCursor {0};
+        size_t m_migrateCursor {0};
+
+        /**
+        * Body of set(). Requires the exclusive lock.
+        *
+        * @return The new earliest wheel deadline if it moved earlier, otherwise nullopt.
+        */
+        std::optional<Timestamp> setLocked(std::string_view key, uint64_t hash, CacheEntry& entry, Timestamp now);
+
+        /**
+        * Body of incrBy() and incrByFloat(): under the exclusive lock, passes the
+        * key's current value (nullopt if absent or expired) to compute, which
+        * fills in the result, and stores result.value if it returns OK.
+        */
+        template <typename Compute>
+        IncrementResult increment(std::string_view key, uint64_t hash, bool ifPresent, Compute compute);
+
+        /**
+        * Body of zadd() and zincrBy(): under the exclusive lock, calls
+        * apply(score, write), where score(member) looks up a member's current
+        * score and write(member, score) stores one, creating the key on the
+        * first write and recording each write in the log, the change ring and
+        * the AOF. The key's timeSet and expiration are updated once a member
+        * has been written.
+        */
+        template <typename Apply>
+        SortedSetResult updateSortedSet(std::string_view key, uint64_t hash, bool ifPresent,
+                                        std::optional<Timestamp> expiration, Apply apply);
+
+        /**
+        * Body of getRef(). Requires at least the shared lock; on an owned shard
+        * (where nothing else runs) it also updates the policy directly.
+        */
+        std::optional<ValueRef> getLocked(std::string_view key, uint64_t hash, Timestamp now,
+                                          bool* wrongType = nullptr);
+
+        /**
+        * Lock-free body of getRef(). Requires an EpochDomain pin.
+        */
+        std::optional<ValueRef> getPinned(std::string_view key, uint64_t hash, Timestamp now,
+                                          bool* wrongType = nullptr);
+
+        /**
+        * Finds a live record and snapshots its value without the lock. Requires an
+        * EpochDomain pin, which keeps the snapshot's buffer readable.
+        *
+        * @return false if the key is missing, expired or a sorted set (which also
+        *         sets *wrongType, if given).
+        */
+        bool readPinned(std::string_view key, uint64_t hash, Timestamp now, ValueSnapshot& snapshot,
+                        bool* wrongType = nullptr);
+
+        /**
+        * Hands buffered reads to the policy. Requires the exclusive lock and a policy.
+        */
+        void drainAccesses();
+
+        /**
+        * Returns the key's record, or a new empty one if the key is absent. A new
+        * record is not indexed yet: the caller publishes its first value and then
+        * passes it to linkRecord(), so lock-free readers never see it empty.
+        * Requires the exclusive lock.
+        */
+        StoredEntry& recordFor(std::string_view key, uint64_t hash, bool& created);
 
         /**
-        * Returns the logs needed for REPLAY for a given key.
+        * Adds a record from recordFor() to the index and the policy; with a
+        * frequency, the policy adopts it with that history. Requires the exclusive lock.
+        */
+        void linkRecord(StoredEntry& stored, std::optional<uint8_t> frequency = std::nullopt);
+
+        /**
+        * Body of restore() with a log, and of adopt(). Requires the exclusive lock.
+        *
+        * @return The new earliest wheel deadline if it moved earlier, otherwise nullopt.
+        */
+        std::optional<Timestamp> restoreLocked(std::string_view key, uint64_t hash, CacheEntry& entry,
+                                               std::deque<LogEntry>& logs, std::optional<uint8_t> frequency);
+
+        /**
+        * Unlinks a record from the index and the policy, releases its value and log,
+        * and hands its memory to the slab once lock-free readers are done with it.
+        * Requires the exclusive lock; the record must not be scheduled in the wheel.
+        */
+        void destroyRecord(StoredEntry* stored);
+
+        /**
+        * Evicts policy victims other than `keep` until the shard is within its limit.
+        * Requires the exclusive lock.
+        */
+        void enforceMemoryLimit(const StoredEntry* keep);
+
+        /**
+        * Points the record's expiry timer at its entry's expiration (or cancels it).
+        * Requires the exclusive lock.
+        *
+        * @return The new earliest wheel deadline if it moved earlier, otherwise nullopt.
         */
-        std::deque<LogEntry> getLogsForReplay(const std::string& key, Timestamp cutoff) const;
+        std::optional<Timestamp> updateExpiry(StoredEntry& stored);
     };
 }
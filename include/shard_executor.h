@@ -0,0 +1,190 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include "mpsc_queue.h"
+
+namespace streamcache {
+
+    class Shard;
+
+    /**
+    * @class Completion
+    * @brief Countdown a caller waits on until the tasks it submitted have run.
+    *
+    * Lives on the caller's stack. wait() spins briefly and then yields, which
+    * keeps the hand-off latency of a synchronous call in the low microseconds
+    * without a futex round trip; it is meant for short tasks only.
+    */
+    class Completion {
+        public:
+            explicit Completion(size_t count) : m_pending(count) {
+            }
+
+            void countDown() { m_pending.fetch_sub(1, std::memory_order_release); }
+
+            void wait() const;
+
+        private:
+            std::atomic<size_t> m_pending;
+    };
+
+    /**
+    * @class ShardExecutor
+    * @brief The owner thread of one shard in thread-per-core mode.
+    *
+    * Every operation on the shard is a task run by this thread, so the shard's
+    * data structures are never shared and the shard takes no locks (see
+    * ShardMutex). Other threads hand tasks over through a bounded lock-free
+    * MPSC queue; a full queue makes them yield until there is room.
+    *
+    * The thread is pinned to one CPU where the platform allows it. Between task
+    * batches it does the shard's own housekeeping, which the shared
+    * EvictionScheduler does for unowned shards: it evicts expired keys one
+    * Shard::EVICTION_SLICE at a time and prunes logs every
+    * EvictionScheduler::PRUNE_INTERVAL. When idle it spins for a moment and then
+    * sleeps until work arrives or the next deadline is due.
+    *
+    * Tasks must not block on work queued to their own executor, and callbacks
+    * run on the owner thread must not make synchronous calls into the cache.
+    */
+    class ShardExecutor {
+        public:
+            using Timestamp = std::chrono::steady_clock::time_point;
+
+            /*
+            * Tasks the queue holds before submitters have to wait.
+            */
+            static constexpr size_t QUEUE_CAPACITY = 4096;
+
+            /*
+            * Tasks run between two checks of the housekeeping deadline.
+            */
+            static constexpr size_t TASK_BATCH = 256;
+
+            /**
+            * Starts the owner thread. Takes over the shard's expiry notifications.
+            *
+            * @param shard A shard constructed as owned; it must outlive the executor.
+            * @param cpu The CPU to pin the thread to, or nullopt to leave it unpinned.
+            */
+            ShardExecutor(Shard& shard, std::optional<size_t> cpu);
+
+            /**
+            * Runs the tasks still queued, then stops and joins the thread.
+            */
+            ~ShardExecutor();
+
+            ShardExecutor(const ShardExecutor&) = delete;
+            ShardExecutor& operator=(const ShardExecutor&) = delete;
+
+            /**
+            * Queues fn(shard) and counts `done` down once it has run. fn and done
+            * must stay alive until then; nothing is allocated.
+            */
+            template <typename F>
+            void execute(F& fn, Completion& done) {
+                push({[](void* task, Shard& shard) { (*static_cast<F*>(task))(shard); }, &fn, &done});
+            }
+
+            /**
+            * Runs fn(shard) on the owner thread and returns its result. Exceptions
+            * thrown by fn are rethrown here.
+            */
+            template <typename F>
+            auto call(F&& fn) -> std::invoke_result_t<F&, Shard&> {
+                using Result = std::invoke_result_t<F&, Shard&>;
+                std::exception_ptr error {};
+                [[maybe_unused]] std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>> result {};
+
+                auto task {[&](Shard& shard) {
+                    try {
+                        if constexpr (std::is_void_v<Result>) {
+                            fn(shard);
+                        } else {
+                            result.emplace(fn(shard));
+                        }
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                }};
+
+                Completion done {1};
+                execute(task, done);
+                done.wait();
+
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                if constexpr (!std::is_void_v<Result>) {
+                    return std::move(*result);
+                }
+            }
+
+            /**
+            * Queues fn(shard) without waiting for it. fn is moved to the heap and
+            * must not throw.
+            */
+            template <typename F>
+            void post(F&& fn) {
+                using Fn = std::decay_t<F>;
+                auto* task {new Fn(std::forward<F>(fn))};
+                push({[](void* owned, Shard& shard) {
+                    std::unique_ptr<Fn> run {static_cast<Fn*>(owned)};
+                    (*run)(shard);
+                }, task, nullptr});
+            }
+
+        private:
+            /*
+            * One queued task: run(context, shard), then done->countDown() if set.
+            */
+            struct Task {
+                void (*run)(void*, Shard&) {nullptr};
+                void* context {nullptr};
+                Completion* done {nullptr};
+            };
+
+            Shard& m_shard;
+            MpscQueue<Task> m_queue {QUEUE_CAPACITY};
+
+            // Owner thread only.
+            Timestamp m_nextDeadline {};
+            Timestamp m_nextPrune {};
+
+            // Sleep/wake hand-shake with submitters.
+            std::atomic<bool> m_sleeping {false};
+            std::mutex m_mutex {};
+            std::condition_variable m_cv {};
+            bool m_stopping {false};
+
+            std::thread m_thread {};
+
+            void push(Task task);
+
+            /**
+            * Main loop of the owner thread.
+            */
+            void run(std::optional<size_t> cpu);
+
+            /**
+            * Evicts one slice of expired keys or prunes one batch of logs if
+            * either is due, and sets the next deadline.
+            */
+            void housekeep(Timestamp now);
+
+            /**
+            * Spins, then sleeps until a task arrives or the next deadline.
+            *
+            * @return false once the executor is stopping and the queue is drained.
+            */
+            bool waitForWork();
+    };
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <shared_mutex>
+#include "histogram.h"
+#include "slowlog.h"
+
+namespace streamcache {
+
+    /**
+    * @class ShardMutex
+    * @brief A shard's reader-writer lock, which compiles away at run time when
+    *        a single thread owns the shard.
+    *
+    * In the default mode any thread may call into any shard, and this is a
+    * plain std::shared_mutex. In thread-per-core mode (see ShardExecutor) every
+    * operation on the shard runs on its owner thread, so there is nothing to
+    * exclude: lock and unlock do nothing, and the only cost left is one
+    * well-predicted branch. Meets the Lockable and SharedLockable requirements,
+    * so it works with std::unique_lock and std::shared_lock.
+    *
+    * Acquisitions that have to wait are timed into one histogram per side (in
+    * nanoseconds); an uncontended acquisition is a single try-lock and reads no
+    * clock. While the thread traces an operation for the SlowLog, acquisitions
+    * and releases also report to its LockTrace.
+    */
+    class ShardMutex {
+        public:
+            explicit ShardMutex(bool owned = false) : m_owned(owned) {
+            }
+
+            void lock() {
+                if (m_owned) {
+                    return;
+                }
+                if (m_mutex.try_lock()) {
+                    traceAcquired();
+                    return;
+                }
+                const auto start {std::chrono::steady_clock::now()};
+                m_mutex.lock();
+                traceWaited(start, m_exclusiveWaits);
+            }
+
+            bool try_lock() {
+                if (m_owned) {
+                    return true;
+                }
+                if (!m_mutex.try_lock()) {
+                    return false;
+                }
+                traceAcquired();
+                return true;
+            }
+
+            void unlock() {
+                if (!m_owned) {
+                    m_mutex.unlock();
+                    traceReleased();
+                }
+            }
+
+            void lock_shared() {
+                if (m_owned) {
+                    return;
+                }
+                if (m_mutex.try_lock_shared()) {
+                    traceAcquired();
+                    return;
+                }
+                const auto start {std::chrono::steady_clock::now()};
+                m_mutex.lock_shared();
+                traceWaited(start, m_sharedWaits);
+            }
+
+            bool try_lock_shared() {
+                if (m_owned) {
+                    return true;
+                }
+                if (!m_mutex.try_lock_shared()) {
+                    return false;
+                }
+                traceAcquired();
+                return true;
+            }
+
+            void unlock_shared() {
+                if (!m_owned) {
+                    m_mutex.unlock_shared();
+                    traceReleased();
+                }
+            }
+
+            /**
+            * True if one thread owns the shard and locking is skipped.
+            */
+            bool owned() const { return m_owned; }
+
+            /**
+            * How long contended exclusive / shared acquisitions waited.
+            */
+            HistogramSnapshot exclusiveWaits() const { return m_exclusiveWaits.snapshot(); }
+            HistogramSnapshot sharedWaits() const { return m_sharedWaits.snapshot(); }
+
+        private:
+            std::shared_mutex m_mutex {};
+            const bool m_owned;
+            LatencyHistogram m_exclusiveWaits {};
+            LatencyHistogram m_sharedWaits {};
+
+            /*
+            * Records a contended acquisition that started waiting at `start`.
+            */
+            static void traceWaited(std::chrono::steady_clock::time_point start, LatencyHistogram& waits) {
+                const auto now {std::chrono::steady_clock::now()};
+                waits.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count()));
+                if (LockTrace* trace {LockTrace::current()}) {
+                    trace->waited(now - start);
+                    trace->acquired(now);
+                }
+            }
+
+            static void traceAcquired() {
+                if (LockTrace* trace {LockTrace::current()}) {
+                    trace->acquired(std::chrono::steady_clock::now());
+                }
+            }
+
+            static void traceReleased() {
+                if (LockTrace* trace {LockTrace::current()}) {
+                    trace->released(std::chrono::steady_clock::now());
+                }
+            }
+    };
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace streamcache {
+
+    /*
+    * Point-in-time memory figures for one allocator (or a sum of several).
+    */
+    struct MemoryStats {
+        size_t allocated {0};   // bytes handed out, rounded up to their size class
+        size_t reserved {0};    // bytes obtained from the system: slabs plus large blocks
+    };
+
+    /**
+    * @class SlabAllocator
+    * @brief Per-shard size-class allocator for records, values and log storage.
+    *
+    * Requests up to MAX_SMALL_SIZE bytes are rounded up to one of CLASS_COUNT size
+    * classes (16-byte steps up to 128, then four classes per power of two) and
+    * carved out of SLAB_SIZE slabs dedicated to that class. Freed blocks go on the
+    * class's free list and are reused before the slab is extended, so a steady
+    * write load recycles the same memory instead of fragmenting the global heap.
+    * Slabs are kept for the lifetime of the allocator. Larger requests go
+    * straight to operator new.
+    *
+    * The byte counters are exact and can be read from any thread without a lock;
+    * allocate() and deallocate() themselves are not thread-safe and are called
+    * under the owning shard's exclusive lock.
+    *
+    * Blocks that lock-free readers may still be looking at (records and value
+    * buffers) go through deallocateDeferred() instead, which is also safe from
+    * threads that do not hold the lock (the last owner of a ValueRef). They are
+    * stamped with the EpochDomain and only recycled, by a later allocate() or
+    * reclaimDeferred(), once no reader pinned before their release remains.
+    */
+    class SlabAllocator {
+        public:
+            static constexpr size_t SLAB_SIZE = 64 * 1024;
+            static constexpr size_t MAX_SMALL_SIZE = 4096;
+            static constexpr size_t CLASS_COUNT = 28;
+
+            SlabAllocator() = default;
+            ~SlabAllocator();
+
+            SlabAllocator(const SlabAllocator&) = delete;
+            SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+            /**
+            * Returns a 16-byte aligned block of at least `bytes` bytes.
+            */
+            void* allocate(size_t bytes);
+
+            /**
+            * Returns a block to the allocator. `bytes` must be the size passed to allocate().
+            */
+            void deallocate(void* p, size_t bytes);
+
+            /**
+            * Lock-free, thread-safe variant of deallocate(): queues the block and leaves
+            * the actual free until it is safe from lock-free readers. The block stays
+            * counted as allocated until then. `bytes` must be at least 24; the
+            * block's first 8 bytes are left untouched (a reader may still check a
+            * refcount there), the next 16 are overwritten.
+            */
+            void deallocateDeferred(void* p, size_t bytes);
+
+            /**
+            * Frees the deferred blocks that no pinned reader can still reach. Same
+            * locking as deallocate().
+            */
+            void reclaimDeferred();
+
+            /**
+            * Bytes released with deallocateDeferred() but not freed yet.
+            */
+            size_t deferredBytes() const { return m_deferredBytes.load(std::memory_order_relaxed); }
+
+            MemoryStats stats() const {
+                return {m_allocated.load(std::memory_order_relaxed), m_reserved.load(std::memory_order_relaxed)};
+            }
+
+            /**
+            * Size class index for a request of `bytes` (<= MAX_SMALL_SIZE).
+            */
+            static size_t classFor(size_t bytes);
+
+            /**
+            * Block size of a size class.
+            */
+            static size_t classSize(size_t index);
+
+        private:
+            struct FreeBlock {
+                FreeBlock* next;
+            };
+
+            // Overlaid on bytes 8..24 of a block queued by deallocateDeferred().
+            struct DeferredBlock {
+                void* next;
+                size_t bytes;
+            };
+
+            // A deferred block taken off the queue and stamped, waiting for readers to move on.
+            struct PendingBlock {
+                void* p;
+                size_t bytes;
+                uint64_t stamp;
+            };
+
+            // Deferred blocks accumulated before allocate() pays for a reclaim scan.
+            static constexpr size_t RECLAIM_BATCH = 64;
+
+            struct SizeClass {
+                FreeBlock* freeList {nullptr};
+                char* cursor {nullptr};     // next uncarved block in the class's newest slab
+                char* end {nullptr};
+            };
+
+            std::array<SizeClass, CLASS_COUNT> m_classes {};
+            std::vector<std::unique_ptr<char[]>> m_slabs {};
+            std::atomic<void*> m_deferred {nullptr};
+            std::atomic<size_t> m_deferredCount {0};
+            std::atomic<size_t> m_deferredBytes {0};
+            size_t m_reclaimAt {RECLAIM_BATCH};
+            std::deque<PendingBlock> m_pending {};
+
+            static DeferredBlock* deferredHeader(void* p) {
+                return reinterpret_cast<DeferredBlock*>(static_cast<char*>(p) + 8);
+            }
+
+            static size_t blockSize(size_t bytes) {
+                return bytes > MAX_SMALL_SIZE ? bytes : classSize(classFor(bytes));
+            }
+
+            void freeDeferred(void* p, size_t bytes);
+            std::atomic<size_t> m_allocated {0};
+            std::atomic<size_t> m_reserved {0};
+
+            void add(std::atomic<size_t>& counter, size_t bytes) {
+                counter.store(counter.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+            }
+
+            void sub(std::atomic<size_t>& counter, size_t bytes) {
+                counter.store(counter.load(std::memory_order_relaxed) - bytes, std::memory_order_relaxed);
+            }
+    };
+
+    /**
+    * Standard-library allocator adaptor, so containers owned by a shard (such as
+    * per-key logs) draw their storage from the shard's SlabAllocator.
+    */
+    template <typename T>
+    class SlabStdAllocator {
+        public:
+            using value_type = T;
+
+            explicit SlabStdAllocator(SlabAllocator& slab) noexcept : m_slab(&slab) {
+            }
+
+            template <typename U>
+            SlabStdAllocator(const SlabStdAllocator<U>& other) noexcept : m_slab(other.slab()) {
+            }
+
+            T* allocate(size_t n) {
+                return static_cast<T*>(m_slab->allocate(n * sizeof(T)));
+            }
+
+            void deallocate(T* p, size_t n) noexcept {
+                m_slab->deallocate(p, n * sizeof(T));
+            }
+
+            SlabAllocator* slab() const noexcept { return m_slab; }
+
+            template <typename U>
+            bool operator==(const SlabStdAllocator<U>& other) const noexcept { return m_slab == other.slab(); }
+
+            template <typename U>
+            bool operator!=(const SlabStdAllocator<U>& other) const noexcept { return m_slab != other.slab(); }
+
+        private:
+            SlabAllocator* m_slab;
+    };
+}
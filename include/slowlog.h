@@ -0,0 +1,265 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "seqlock.h"
+
+namespace streamcache {
+
+    /**
+    * @struct LockTrace
+    * @brief Lock time of the operation the current thread is tracing.
+    *
+    * While a SlowLogScope is open, ShardMutex reports every acquisition on the
+    * thread to it: how long the acquisition waited, and how long the thread then
+    * held at least one shard lock. With no scope open the mutex only checks the
+    * thread-local pointer and reads no clock.
+    */
+    struct LockTrace {
+        using Timestamp = std::chrono::steady_clock::time_point;
+
+        uint64_t waitNs {0};
+        uint64_t holdNs {0};
+        size_t depth {0};           // shard locks currently held
+        Timestamp heldSince {};
+
+        void waited(std::chrono::steady_clock::duration d) {
+            waitNs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+        }
+
+        void acquired(Timestamp now) {
+            if (depth++ == 0) {
+                heldSince = now;
+            }
+        }
+
+        void released(Timestamp now) {
+            // A lock taken before the scope opened is not counted.
+            if (depth > 0 && --depth == 0) {
+                holdNs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - heldSince).count());
+            }
+        }
+
+        void merge(const LockTrace& other) {
+            waitNs += other.waitNs;
+            holdNs += other.holdNs;
+        }
+
+        /**
+        * The calling thread's open trace, or nullptr.
+        */
+        static LockTrace*& current() {
+            static thread_local LockTrace* trace {nullptr};
+            return trace;
+        }
+    };
+
+    /*
+    * Makes `trace` the calling thread's LockTrace::current() for a scope, for
+    * work done on another thread on behalf of a traced operation.
+    */
+    class LockTraceBinding {
+        public:
+            explicit LockTraceBinding(LockTrace* trace) : m_previous(LockTrace::current()) {
+                LockTrace::current() = trace;
+            }
+
+            ~LockTraceBinding() { LockTrace::current() = m_previous; }
+
+            LockTraceBinding(const LockTraceBinding&) = delete;
+            LockTraceBinding& operator=(const LockTraceBinding&) = delete;
+
+        private:
+            LockTrace* m_previous;
+    };
+
+    /*
+    * Work a traced operation handed to another thread's queue (thread-per-core
+    * mode): the time since it was queued counts as lock wait, the span itself
+    * as lock hold. The submitting thread must wait for the span to end.
+    */
+    class QueuedSpan {
+        public:
+            QueuedSpan(LockTrace& trace, LockTrace::Timestamp queuedAt) : m_trace(trace) {
+                const auto now {std::chrono::steady_clock::now()};
+                m_trace.waited(now - queuedAt);
+                m_trace.acquired(now);
+            }
+
+            ~QueuedSpan() { m_trace.released(std::chrono::steady_clock::now()); }
+
+            QueuedSpan(const QueuedSpan&) = delete;
+            QueuedSpan& operator=(const QueuedSpan&) = delete;
+
+        private:
+            LockTrace& m_trace;
+    };
+
+    /*
+    * One slow operation, as returned by SlowLog::entries().
+    */
+    struct SlowLogEntry {
+        uint64_t id {0};
+        std::chrono::system_clock::time_point startedAt {};
+        std::chrono::nanoseconds duration {};
+        std::chrono::nanoseconds lockWait {};      // waiting for shard locks (or, in thread-per-core mode, in the owner's queue)
+        std::chrono::nanoseconds lockHold {};      // holding shard locks (or running on the owner thread)
+        std::string command {};
+        std::string key {};                         // first key (truncated), or the shard of a maintenance task
+        size_t keyCount {0};
+    };
+
+    /**
+    * @class SlowLog
+    * @brief Bounded, lock-free record of operations slower than a threshold.
+    *
+    * Writers claim a slot with one fetch_add on the entry counter and fill it
+    * under the slot's SeqLock, so recording never blocks and never allocates;
+    * the ring holds the last CAPACITY entries, of which the newest maxLen() are
+    * visible. A writer that laps a slot still being written by another drops its
+    * entry. Readers copy slots optimistically and skip any that changed meanwhile.
+    *
+    * Client operations are recorded by Cache, background maintenance (expiry
+    * slices, log-pruning and migration batches) by the shard, with command
+    * names EVICT, PRUNE and MIGRATE and the shard as key, so tail latency can be
+    * attributed to the maintenance that held a lock at the time.
+    */
+    class SlowLog {
+        public:
+            static constexpr size_t CAPACITY = 1024;
+            static constexpr size_t DEFAULT_MAX_LEN = 128;
+            static constexpr size_t MAX_KEY_BYTES = 128;
+
+            SlowLog();
+
+            SlowLog(const SlowLog&) = delete;
+            SlowLog& operator=(const SlowLog&) = delete;
+
+            /**
+            * Operations taking at least `threshold` are recorded; a negative
+            * threshold (the default) turns tracing off entirely.
+            */
+            void setThreshold(std::chrono::nanoseconds threshold) {
+                m_thresholdNs.store(threshold.count(), std::memory_order_relaxed);
+            }
+
+            std::chrono::nanoseconds threshold() const {
+                return std::chrono::nanoseconds(m_thresholdNs.load(std::memory_order_relaxed));
+            }
+
+            bool enabled() const { return m_thresholdNs.load(std::memory_order_relaxed) >= 0; }
+
+            /**
+            * Number of newest entries kept visible, at most CAPACITY.
+            */
+            void setMaxLen(size_t maxLen);
+
+            size_t maxLen() const { return m_maxLen.load(std::memory_order_relaxed); }
+
+            /**
+            * Records one operation if it reached the threshold.
+            *
+            * @param command A string literal naming the operation.
+            * @param key The operation's (first) key; stored truncated to MAX_KEY_BYTES.
+            * @param keyCount Keys the operation touched.
+            */
+            void record(const char* command, std::string_view key, size_t keyCount,
+                        std::chrono::nanoseconds duration, const LockTrace& locks);
+
+            /**
+            * Up to `count` visible entries, newest first.
+            */
+            std::vector<SlowLogEntry> entries(size_t count) const;
+
+            size_t size() const;
+
+            /**
+            * Hides every entry recorded so far.
+            */
+            void reset();
+
+        private:
+            static constexpr size_t COMMAND_BYTES = 16;
+
+            /*
+            * Slot payload, copied word by word under the slot's SeqLock.
+            */
+            struct Record {
+                uint64_t stamp;         // entry id + 1; 0 for a never-written slot
+                int64_t startedAtMicros;
+                uint64_t durationNs;
+                uint64_t lockWaitNs;
+                uint64_t lockHoldNs;
+                uint64_t keyCount;
+                uint64_t keyLength;
+                char command[COMMAND_BYTES];
+                char key[MAX_KEY_BYTES];
+            };
+            static_assert(sizeof(Record) % 8 == 0);
+
+            struct alignas(64) Slot {
+                SeqLock lock {};
+                std::atomic<bool> writing {false};
+                alignas(8) Record record {};
+            };
+
+            std::unique_ptr<Slot[]> m_slots;
+            std::atomic<uint64_t> m_next {0};
+            std::atomic<uint64_t> m_resetAt {0};
+            std::atomic<int64_t> m_thresholdNs {-1};
+            std::atomic<size_t> m_maxLen {DEFAULT_MAX_LEN};
+    };
+
+    /**
+    * @class SlowLogScope
+    * @brief Times one operation and records it in a SlowLog if it was slow.
+    *
+    * Opening a scope with tracing off costs one relaxed load. Otherwise it reads
+    * the clock at both ends and installs a LockTrace for ShardMutex to report
+    * to; a scope opened inside another adds its lock time to the outer one.
+    */
+    class SlowLogScope {
+        public:
+            using Timestamp = std::chrono::steady_clock::time_point;
+
+            /**
+            * @param log The log to record in, or nullptr for no tracing.
+            * @param command A string literal naming the operation.
+            * @param key The (first) key; must outlive the scope.
+            * @param keyCount Keys the operation touches.
+            */
+            SlowLogScope(SlowLog* log, const char* command, std::string_view key, size_t keyCount = 1)
+                : SlowLogScope(log, command, key, keyCount, std::nullopt) {
+            }
+
+            /**
+            * For an operation queued to another thread at `queuedAt`: the time
+            * in the queue counts as lock wait.
+            */
+            SlowLogScope(SlowLog* log, const char* command, std::string_view key, size_t keyCount,
+                         std::optional<Timestamp> queuedAt);
+
+            ~SlowLogScope();
+
+            SlowLogScope(const SlowLogScope&) = delete;
+            SlowLogScope& operator=(const SlowLogScope&) = delete;
+
+            bool active() const { return m_log != nullptr; }
+
+        private:
+            SlowLog* m_log {nullptr};
+            const char* m_command {nullptr};
+            std::string_view m_key {};
+            size_t m_keyCount {0};
+            Timestamp m_start {};
+            LockTrace m_trace {};
+            LockTrace* m_outer {nullptr};
+    };
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <deque>
+#include <functional>
+#include <cstdint>
+#include "shard.h"
+
+namespace streamcache {
+
+    /*
+    * Snapshot file layout:
+    *
+    *   [section 0][section 1]...[section N-1]
+    *   [directory: N x (u64 offset, u64 length, u32 checksum)]
+    *   [trailer: u64 directory offset, u32 section count, u64 generation,
+    *             i64 created epoch-us, 8-byte magic]
+    *
+    * Sections hold about SECTION_BYTES of entries each and are written as soon
+    * as they fill up, so only one section's worth of encoded data is held in
+    * memory at a time, however large a shard is. A section only holds entries
+    * of one shard. The trailer lets a loader find every section up front and
+    * decode them in parallel.
+    *
+    * Each section is a varint entry count followed by the entries:
+    *   key, value                        (varint-length-prefixed)
+    *   timeSet                           (zigzag varint micros before the snapshot time)
+    *   flags (u8: 1 = has expiration, 2 = sorted set)
+    *   expiration, if flagged            (zigzag varint micros relative to the snapshot time)
+    *   log count, then per log entry:    (age, value); the first age is a zigzag
+    *                                     varint like timeSet's, later ones varint
+    *                                     deltas from the previous age
+    *   for a sorted set, member count,
+    *     then per member:                (u64 score bits, member)
+    *
+    * All times are relative to the wall-clock creation time in the trailer, because
+    * steady_clock values mean nothing in another process. They are differences
+    * of whole epoch microseconds, so a time comes back exactly as the AOF
+    * brings back the same write's. Ages are signed because entries are exported
+    * while writes go on, so some are newer than the snapshot time.
+    */
+
+    /**
+    * @class SnapshotWriter
+    * @brief Streams per-shard sections into a temporary file and atomically publishes it.
+    *
+    * Usage: construct, call addEntry() for the entries of a shard, calling
+    * endSection() whenever sectionBytes() reaches SECTION_BYTES and once the
+    * shard is done, repeat per shard, then commit(). The file only becomes visible
+    * under its final name once commit() has fsynced it, so a crash mid-snapshot
+    * leaves the previous snapshot intact.
+    *
+    * Throws std::system_error on I/O failures.
+    */
+    class SnapshotWriter {
+        public:
+            /*
+            * Encoded bytes after which callers should end a section.
+            */
+            static constexpr size_t SECTION_BYTES = 4 * 1024 * 1024;
+
+            explicit SnapshotWriter(std::string path);
+            ~SnapshotWriter();
+
+            SnapshotWriter(const SnapshotWriter&) = delete;
+            SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+            /**
+            * Appends one record (key, current value or members, and retained log)
+            * to the current section.
+            */
+            void addEntry(const StoredEntry& record);
+
+            /**
+            * Bytes encoded into the current section so far.
+            */
+            size_t sectionBytes() const { return m_section.size(); }
+
+            /**
+            * Writes out the current section, if it has any entries, and starts the next one.
+            */
+            void endSection();
+
+            /**
+            * Writes the directory and trailer, fsyncs and renames the file into place.
+            *
+            * @param generation The AOF generation that continues from this snapshot.
+            */
+            void commit(uint64_t generation);
+
+        private:
+            std::string m_path {};
+            std::string m_tmpPath {};
+            int m_fd {-1};
+            Timestamp m_anchor {};
+            int64_t m_anchorMicros {0};
+
+            std::string m_section {};
+            uint64_t m_sectionEntries {0};
+            uint64_t m_sectionCount {0};
+            uint64_t m_offset {0};
+            std::string m_directory {};
+
+            void writeAll(std::string_view data);
+    };
+
+    /*
+    * An entry decoded from a snapshot, with times converted back to this process's clock.
+    */
+    struct SnapshotEntry {
+        std::string key {};
+        CacheEntry entry {};
+        std::deque<LogEntry> logs {};
+    };
+
+    /**
+     * Memory-maps a snapshot and decodes its sections in parallel, on up to one
+     * thread per hardware thread, handing every entry to the callback. The
+     * callback is invoked concurrently from those threads, and the same key may
+     * come up more than once (see Shard::exportSnapshot()).
+     *
+     * @param path The snapshot file.
+     * @param apply Called once per entry.
+     * @param generation Receives the AOF generation recorded in the snapshot.
+     * @return The number of entries loaded. Throws std::runtime_error if the file
+     *         exists but is malformed.
+     */
+    size_t loadSnapshot(const std::string& path, const std::function<void(SnapshotEntry&)>& apply,
+                        uint64_t& generation);
+}
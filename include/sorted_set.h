@@ -0,0 +1,216 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "flat_index.h"
+#include "slab_allocator.h"
+
+namespace streamcache {
+
+    /*
+    * A sorted-set member and its score, as copied out of a set.
+    */
+    struct ScoredMember {
+        std::string member {};
+        double score {0};
+    };
+
+    /*
+    * One end of a score range; exclusive for the "(score" form, and infinite
+    * for "+inf" / "-inf".
+    */
+    struct ScoreBound {
+        double value {0};
+        bool exclusive {false};
+    };
+
+    /**
+    * Encodes a member update as it appears in a key's log, on change streams,
+    * in the AOF and on the replication stream: "<score> <member>", the score
+    * written by util::formatDouble().
+    */
+    std::string encodeMemberUpdate(std::string_view member, double score);
+
+    /**
+    * Decodes encodeMemberUpdate()'s output; member points into update.
+    *
+    * @return false if update is malformed.
+    */
+    bool decodeMemberUpdate(std::string_view update, std::string_view& member, double& score);
+
+    /**
+    * @class SortedSet
+    * @brief Members ordered by (score, member bytes), with rank queries in O(log n).
+    *
+    * A skiplist whose links carry spans (how many members each one skips), so
+    * the same descent that finds a member's position also counts the members
+    * before it, and a rank is reached without walking the list. Each node is
+    * one slab block from the shard's allocator holding the node, its levels
+    * and the member bytes; a FlatIndex from member to node (the member hashed
+    * with util::hashKey()) answers score lookups and finds the node to move
+    * when a score changes. A node keeps its block when it moves, so updating a
+    * score allocates nothing. The index's tables come from the heap like the
+    * shard's own index; their size is kept added to a counter the shard owns,
+    * so they count toward its memory limit.
+    *
+    * Levels are drawn with probability 1/4 per extra level, for about 1.33
+    * links per node; a search touches O(log n) nodes.
+    *
+    * Not thread-safe; the owning shard serializes access with its lock.
+    */
+    class SortedSet {
+        public:
+            static constexpr int MAX_LEVEL = 32;
+
+            /**
+            * @param slab Allocator for the nodes.
+            * @param indexBytes Shard counter the member index's table bytes are added
+            *        to while the set lives. Only changed by the set's writer.
+            */
+            SortedSet(SlabAllocator& slab, std::atomic<size_t>& indexBytes);
+            ~SortedSet();
+
+            SortedSet(const SortedSet&) = delete;
+            SortedSet& operator=(const SortedSet&) = delete;
+
+            size_t size() const { return m_size; }
+            bool empty() const { return m_size == 0; }
+
+            /**
+            * Adds member with score, or moves it to score if it is already a member.
+            *
+            * @return true if the member is new.
+            */
+            bool set(std::string_view member, double score);
+
+            std::optional<double> score(std::string_view member) const;
+
+            /**
+            * The member's 0-based position in ascending order, or nullopt.
+            */
+            std::optional<size_t> rank(std::string_view member) const;
+
+            /**
+            * Visits the members ranked start..stop (inclusive, 0-based) in
+            * ascending order; stop is clamped to the last member.
+            */
+            template <typename Visit>
+            void forEachByRank(size_t start, size_t stop, Visit&& visit) const {
+                if (start >= m_size || start > stop) {
+                    return;
+                }
+                stop = std::min(stop, m_size - 1);
+                for (const Node* node {nodeAtRank(start + 1)}; node && start <= stop; node = node->levels()[0].forward) {
+                    visit(node->key, node->score);
+                    ++start;
+                }
+            }
+
+            /**
+            * Visits the members with min <= score <= max (bounds as given) from
+            * the highest score down, skipping the first `offset` and stopping
+            * after `count`.
+            */
+            template <typename Visit>
+            void forEachByScoreDescending(ScoreBound max, ScoreBound min, size_t offset, size_t count,
+                                          Visit&& visit) const {
+                const Node* node {lastAtOrBelow(max)};
+                for (; node && offset > 0 && aboveMin(node->score, min); node = node->backward) {
+                    --offset;
+                }
+                for (; node && count > 0 && aboveMin(node->score, min); node = node->backward) {
+                    visit(node->key, node->score);
+                    --count;
+                }
+            }
+
+            /**
+            * Visits every member in ascending order.
+            */
+            template <typename Visit>
+            void forEach(Visit&& visit) const {
+                for (const Node* node {m_header->levels()[0].forward}; node; node = node->levels()[0].forward) {
+                    visit(node->key, node->score);
+                }
+            }
+
+        private:
+            struct Node;
+
+            struct Level {
+                Node* forward {nullptr};
+                size_t span {0};
+            };
+
+            /*
+            * The levels and then the member bytes follow the node in its block.
+            * key and hash are what FlatIndex looks members up by.
+            */
+            struct Node {
+                std::string_view key {};
+                uint64_t hash {0};
+                double score {0};
+                Node* backward {nullptr};
+                uint32_t height {0};
+
+                Level* levels() { return reinterpret_cast<Level*>(this + 1); }
+                const Level* levels() const { return reinterpret_cast<const Level*>(this + 1); }
+
+                size_t allocationBytes() const { return sizeof(Node) + height * sizeof(Level) + key.size(); }
+            };
+
+            SlabAllocator& m_slab;
+            std::atomic<size_t>& m_indexBytes;
+            size_t m_countedIndexBytes {0};     // this set's share of m_indexBytes
+            Node* m_header {nullptr};
+            FlatIndex<Node> m_members {};
+            size_t m_size {0};
+            int m_height {1};
+            uint64_t m_random;
+
+            Node* createNode(uint32_t height, std::string_view member, uint64_t hash, double score);
+
+            int randomHeight();
+
+            /**
+            * Brings the shard's index byte counter in line with the member index,
+            * after it may have been rehashed.
+            */
+            void countIndexBytes();
+
+            /**
+            * Links a node whose score is set in at its position.
+            */
+            void link(Node* node);
+
+            /**
+            * Takes a node out of the list, leaving it allocated and indexed.
+            */
+            void unlink(Node* node);
+
+            /**
+            * The node at a 1-based rank, or nullptr.
+            */
+            const Node* nodeAtRank(size_t rank) const;
+
+            /**
+            * The highest-ordered node within max, or nullptr.
+            */
+            const Node* lastAtOrBelow(ScoreBound max) const;
+
+            static bool aboveMin(double score, ScoreBound min) {
+                return min.exclusive ? score > min.value : score >= min.value;
+            }
+
+            /**
+            * The (score, member) order of the list.
+            */
+            static bool before(const Node& node, double score, std::string_view member) {
+                return node.score < score || (node.score == score && node.key < member);
+            }
+    };
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace util {
+
+    /**
+     * The wall-clock time minus the steady_clock time. The wall clock is read
+     * between two steady readings, and the first offset is kept and reused
+     * until the clocks drift apart by more than a millisecond (e.g. the wall
+     * clock was stepped). Equal steady times thus convert to equal wall times
+     * and back, which keeps records written in the same instant in order
+     * through the AOF, and lets a snapshot and the AOF agree on a write's time.
+     * A reading whose steady reads are far apart (the thread was preempted in
+     * between) is off by up to that gap, so it never replaces the kept offset.
+     */
+    inline std::chrono::nanoseconds wallClockOffset() {
+        static std::atomic<int64_t> cached {0};
+
+        const auto before {std::chrono::steady_clock::now()};
+        const auto wall {std::chrono::system_clock::now()};
+        const auto after {std::chrono::steady_clock::now()};
+        const int64_t measured {std::chrono::duration_cast<std::chrono::nanoseconds>(
+            wall.time_since_epoch() - before.time_since_epoch()).count()};
+        const bool tight {after - before < std::chrono::microseconds(100)};
+
+        int64_t offset {cached.load(std::memory_order_relaxed)};
+        if (offset == 0 || (tight && (measured - offset > 1'000'000 || offset - measured > 1'000'000))) {
+            cached.store(measured, std::memory_order_relaxed);
+            offset = measured;
+        }
+        return std::chrono::nanoseconds(offset);
+    }
+
+    /**
+     * Converts a steady_clock timestamp into the equivalent wall-clock time.
+     * steady_clock has no fixed epoch, so the conversion goes through the
+     * current offset between the two clocks (see wallClockOffset()).
+     *
+     * @param t The steady_clock time point to convert.
+     * @return The corresponding system_clock time point.
+     */
+    inline std::chrono::system_clock::time_point toWallClock(std::chrono::steady_clock::time_point t) {
+        return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            t.time_since_epoch() + wallClockOffset()));
+    }
+
+    /**
+     * Converts a steady_clock timestamp into milliseconds since the Unix epoch.
+     *
+     * @param t The steady_clock time point to convert.
+     * @return Wall-clock milliseconds since the Unix epoch.
+     */
+    inline int64_t toEpochMillis(std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            toWallClock(t).time_since_epoch()
+        ).count();
+    }
+
+    /**
+     * Converts a steady_clock timestamp into microseconds since the Unix epoch.
+     * Used by the on-disk formats, where steady_clock values mean nothing to the
+     * next process.
+     *
+     * @param t The steady_clock time point to convert.
+     * @return Wall-clock microseconds since the Unix epoch.
+     */
+    inline int64_t toEpochMicros(std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            toWallClock(t).time_since_epoch()
+        ).count();
+    }
+
+    /**
+     * Converts wall-clock microseconds since the Unix epoch back into a
+     * steady_clock timestamp for this process.
+     *
+     * @param micros Wall-clock microseconds since the Unix epoch.
+     * @return The corresponding steady_clock time point.
+     */
+    inline std::chrono::steady_clock::time_point fromEpochMicros(int64_t micros) {
+        return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::microseconds(micros) - wallClockOffset()));
+    }
+
+    /**
+     * Converts wall-clock milliseconds since the Unix epoch into a steady_clock
+     * timestamp for this process; the inverse of toEpochMillis().
+     *
+     * @param millis Wall-clock milliseconds since the Unix epoch.
+     * @return The corresponding steady_clock time point.
+     */
+    inline std::chrono::steady_clock::time_point fromEpochMillis(int64_t millis) {
+        return fromEpochMicros(millis * 1000);
+    }
+
+    /**
+     * The last steady_clock instant that toEpochMillis() still reports as
+     * `millis`. Upper bounds given in milliseconds (REPLAY ... TO, GET ... AS OF)
+     * use it so they cover the whole millisecond: a time copied from REPLAY
+     * output then includes the record it was printed for.
+     *
+     * @param millis Wall-clock milliseconds since the Unix epoch.
+     * @return The final steady_clock time point within that millisecond.
+     */
+    inline std::chrono::steady_clock::time_point throughEpochMillis(int64_t millis) {
+        return fromEpochMillis(millis + 1) - std::chrono::steady_clock::duration(1);
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+
+namespace streamcache {
+
+    /*
+    * Intrusive hook for the timing wheel. The owner embeds (or derives from) a
+    * TimerNode, so scheduling never allocates or copies the key, and a node can
+    * be unlinked in O(1) when its deadline changes or its owner goes away.
+    * A linked node must not be moved or copied.
+    */
+    struct TimerNode {
+        TimerNode* prev {nullptr};
+        TimerNode* next {nullptr};
+        uint64_t deadline {0};      // in wheel ticks
+        uint8_t level {UNLINKED};
+        uint8_t slot {0};
+
+        static constexpr uint8_t UNLINKED = 0xFF;
+        static constexpr uint8_t PENDING = 0xFE;
+
+        TimerNode() = default;
+        TimerNode(const TimerNode&) = delete;
+        TimerNode& operator=(const TimerNode&) = delete;
+
+        bool isScheduled() const { return level != UNLINKED; }
+    };
+
+    /**
+    * @class TimingWheel
+    * @brief Hierarchical timing wheel used as a shard's expiry index.
+    *
+    * Six levels of 64 slots each cover 64^6 ticks (~2.2 years at the 1ms tick);
+    * anything further out is parked in the last level and re-filed when its slot
+    * comes around. Every level keeps a 64-bit occupancy mask, so finding the next
+    * deadline is a handful of bit operations regardless of how many timers exist.
+    *
+    * Complexity:
+    * - schedule() / cancel(): O(1).
+    * - poll(): O(1) amortized per expired timer; a timer is re-filed at most once
+    *   per level on its way down.
+    *
+    * Deadlines are rounded up to the next tick, so a timer never fires early.
+    * Not thread-safe; the owning shard serializes access with its lock.
+    */
+    class TimingWheel {
+        public:
+            using Timestamp = std::chrono::steady_clock::time_point;
+
+            static constexpr size_t LEVELS = 6;
+            static constexpr size_t SLOT_BITS = 6;
+            static constexpr size_t SLOTS = size_t{1} << SLOT_BITS;
+            static constexpr uint64_t MAX_TICKS = (uint64_t{1} << (LEVELS * SLOT_BITS)) - 1;
+
+            explicit TimingWheel(Timestamp origin = std::chrono::steady_clock::now(),
+                                 std::chrono::nanoseconds tick = std::chrono::milliseconds(1));
+
+            TimingWheel(const TimingWheel&) = delete;
+            TimingWheel& operator=(const TimingWheel&) = delete;
+
+            /**
+            * Schedules the node to fire at `when`. A node that is already scheduled
+            * is moved to the new deadline.
+            */
+            void schedule(TimerNode& node, Timestamp when);
+
+            /**
+            * Unschedules the node. No-op if it is not scheduled.
+            */
+            void cancel(TimerNode& node);
+
+            /**
+            * Returns the next node whose deadline is <= now, unlinked from the wheel,
+            * or nullptr if nothing is due. Call repeatedly to drain; the caller can
+            * stop at any point and resume later without losing timers.
+            */
+            TimerNode* poll(Timestamp now);
+
+            /**
+            * Returns the earliest time at which poll() may have work. For timers in the
+            * coarse levels this is the start of their slot, which can be earlier than
+            * the actual deadline; polling then just re-files them.
+            */
+            std::optional<Timestamp> nextExpiry() const;
+
+            size_t size() const { return m_size; }
+
+        private:
+            struct Level {
+                std::array<TimerNode*, SLOTS> slots {};
+                uint64_t occupied {0};
+            };
+
+            struct Expiration {
+                size_t level {0};
+                size_t slot {0};
+                uint64_t deadline {0};
+            };
+
+            Timestamp m_origin {};
+            std::chrono::nanoseconds m_tick {};
+            uint64_t m_elapsed {0};
+            std::array<Level, LEVELS> m_levels {};
+            TimerNode* m_pending {nullptr};
+            size_t m_size {0};
+
+            uint64_t toTicksCeil(Timestamp t) const;
+            uint64_t toTicksFloor(Timestamp t) const;
+
+            /**
+            * Files a node relative to the current elapsed tick.
+            */
+            void insert(TimerNode& node);
+
+            std::optional<Expiration> nextExpiration() const;
+
+            /**
+            * Moves every node of the expired slot to the pending list or down to a finer level.
+            */
+            void processExpiration(const Expiration& expiration);
+
+            static void pushFront(TimerNode*& head, TimerNode& node);
+            static void unlink(TimerNode*& head, TimerNode& node);
+    };
+}
@@ -0,0 +1,318 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include "seqlock.h"
+#include "slab_allocator.h"
+
+namespace streamcache {
+
+    /*
+    * Header of a shared value buffer; the bytes follow it in the same slab block.
+    * Once released, bytes 8..24 hold the allocator's deferred-free link, so the
+    * padding keeps the value bytes intact for lock-free readers until the block
+    * is actually freed.
+    */
+    struct ValueBuffer {
+        std::atomic<uint32_t> refs {1};
+        uint32_t size {0};
+        SlabAllocator* owner {nullptr};
+        uint64_t reserved {0};
+
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+        const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+    };
+
+    /**
+    * @class Value
+    * @brief Immutable stored value: inline when small, otherwise a refcounted slab buffer.
+    *
+    * Values of up to INLINE_CAPACITY bytes live inside the handle and need no
+    * allocation at all. Larger values are copied once into a ValueBuffer carved
+    * from the shard's SlabAllocator; copying the handle only bumps the refcount,
+    * which is how a key's current value and its newest log record share a single
+    * buffer. The buffer returns to its allocator when the last handle goes away,
+    * through SlabAllocator::deallocateDeferred(), since lock-free readers may
+    * still be copying from it; readers that need the bytes after that take a
+    * ValueRef instead.
+    *
+    * A Value that lock-free readers can see is only ever replaced with publish()
+    * and read with ValueSnapshot, both word by word under the record's SeqLock.
+    */
+    class Value {
+        public:
+            static constexpr size_t INLINE_CAPACITY = 16;
+
+            Value() : m_inline{} {
+            }
+
+            /**
+            * Copies data into a new value, allocating from slab if it does not fit inline.
+            */
+            Value(std::string_view data, SlabAllocator& slab) : m_size(static_cast<uint32_t>(data.size())) {
+                if (data.size() <= INLINE_CAPACITY) {
+                    std::memcpy(m_inline, data.data(), data.size());
+                    return;
+                }
+
+                void* mem {slab.allocate(sizeof(ValueBuffer) + data.size())};
+                m_buffer = new (mem) ValueBuffer();
+                m_buffer->size = m_size;
+                m_buffer->owner = &slab;
+                std::memcpy(m_buffer->data(), data.data(), data.size());
+                m_isInline = false;
+            }
+
+            Value(const Value& other) : m_size(other.m_size), m_isInline(other.m_isInline) {
+                std::memcpy(m_inline, other.m_inline, INLINE_CAPACITY);
+                if (!m_isInline) {
+                    m_buffer->refs.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            Value(Value&& other) noexcept : m_size(other.m_size), m_isInline(other.m_isInline) {
+                std::memcpy(m_inline, other.m_inline, INLINE_CAPACITY);
+                other.m_size = 0;
+                other.m_isInline = true;
+            }
+
+            Value& operator=(Value other) noexcept {
+                swap(other);
+                return *this;
+            }
+
+            ~Value() {
+                release();
+            }
+
+            std::string_view view() const {
+                return {m_isInline ? m_inline : m_buffer->data(), m_size};
+            }
+
+            size_t size() const { return m_size; }
+
+            bool isInline() const { return m_isInline; }
+
+            /**
+            * True if both handles refer to the same shared buffer.
+            */
+            bool sharesBufferWith(const Value& other) const {
+                return !m_isInline && !other.m_isInline && m_buffer == other.m_buffer;
+            }
+
+            /**
+            * Moves next into slot with word-sized atomic stores and returns the handle
+            * slot held before. Must run inside the slot's SeqLock write section.
+            */
+            static Value publish(Value& slot, Value next) {
+                Value previous {};
+                std::memcpy(static_cast<void*>(&previous), &slot, sizeof(Value));
+                SeqLock::storeWords(&slot, &next, sizeof(Value));
+                new (&next) Value();    // ownership moved to slot; nothing to release
+                return previous;
+            }
+
+        private:
+            friend class ValueRef;
+            friend class ValueSnapshot;
+
+            union {
+                ValueBuffer* m_buffer;
+                char m_inline[INLINE_CAPACITY];
+            };
+            uint32_t m_size {0};
+            bool m_isInline {true};
+
+            void swap(Value& other) noexcept {
+                char tmp[INLINE_CAPACITY];
+                std::memcpy(tmp, m_inline, INLINE_CAPACITY);
+                std::memcpy(m_inline, other.m_inline, INLINE_CAPACITY);
+                std::memcpy(other.m_inline, tmp, INLINE_CAPACITY);
+                std::swap(m_size, other.m_size);
+                std::swap(m_isInline, other.m_isInline);
+            }
+
+            void release() {
+                if (m_isInline || m_buffer->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                    return;
+                }
+
+                SlabAllocator* owner {m_buffer->owner};
+                const size_t bytes {sizeof(ValueBuffer) + m_buffer->size};
+                m_buffer->~ValueBuffer();
+                owner->deallocateDeferred(m_buffer, bytes);
+            }
+    };
+
+    static_assert(sizeof(Value) % 8 == 0, "Value is published word by word");
+
+    /**
+    * @class ValueRef
+    * @brief Read-only reference to a stored value that stays valid outside the shard lock.
+    *
+    * Taking a ValueRef costs one refcount increment (or a copy of at most
+    * INLINE_CAPACITY bytes); no value bytes are copied. The buffer is immutable,
+    * so the bytes can be written to a socket long after the lookup, and they stay
+    * valid when the key is overwritten, expired or
+    * evicted meanwhile. If a ValueRef is the last reference, its buffer goes back
+    * through SlabAllocator::deallocateDeferred(), which is safe from any thread.
+    * A ValueRef must not outlive the cache it came from.
+    *
+    * Bytes that are not held in a Value (a decoded sealed log record) are
+    * copied with copyOf() into a buffer of their own, on the heap rather than
+    * in a slab, since the copy may be taken under a shared lock.
+    */
+    class ValueRef {
+        public:
+            ValueRef() : m_inline{} {
+            }
+
+            explicit ValueRef(const Value& value) : m_size(value.m_size), m_isInline(value.m_isInline) {
+                std::memcpy(m_inline, value.m_inline, Value::INLINE_CAPACITY);
+                if (!m_isInline) {
+                    m_buffer->refs.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            ValueRef(const ValueRef& other) : m_size(other.m_size), m_isInline(other.m_isInline) {
+                std::memcpy(m_inline, other.m_inline, Value::INLINE_CAPACITY);
+                if (!m_isInline) {
+                    m_buffer->refs.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            ValueRef(ValueRef&& other) noexcept : m_size(other.m_size), m_isInline(other.m_isInline) {
+                std::memcpy(m_inline, other.m_inline, Value::INLINE_CAPACITY);
+                other.m_size = 0;
+                other.m_isInline = true;
+            }
+
+            ValueRef& operator=(ValueRef other) noexcept {
+                char tmp[Value::INLINE_CAPACITY];
+                std::memcpy(tmp, m_inline, Value::INLINE_CAPACITY);
+                std::memcpy(m_inline, other.m_inline, Value::INLINE_CAPACITY);
+                std::memcpy(other.m_inline, tmp, Value::INLINE_CAPACITY);
+                std::swap(m_size, other.m_size);
+                std::swap(m_isInline, other.m_isInline);
+                return *this;
+            }
+
+            ~ValueRef() {
+                if (m_isInline || m_buffer->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                    return;
+                }
+
+                SlabAllocator* owner {m_buffer->owner};
+                const size_t bytes {sizeof(ValueBuffer) + m_buffer->size};
+                m_buffer->~ValueBuffer();
+                if (!owner) {
+                    ::operator delete(m_buffer);
+                    return;
+                }
+                owner->deallocateDeferred(m_buffer, bytes);
+            }
+
+            /**
+            * A reference to a private copy of data.
+            */
+            static ValueRef copyOf(std::string_view data) {
+                ValueRef ref {};
+                ref.m_size = static_cast<uint32_t>(data.size());
+                if (data.size() <= Value::INLINE_CAPACITY) {
+                    std::memcpy(ref.m_inline, data.data(), data.size());
+                    return ref;
+                }
+
+                ref.m_buffer = new (::operator new(sizeof(ValueBuffer) + data.size())) ValueBuffer();
+                ref.m_buffer->size = ref.m_size;
+                std::memcpy(ref.m_buffer->data(), data.data(), data.size());
+                ref.m_isInline = false;
+                return ref;
+            }
+
+            std::string_view view() const {
+                return {m_isInline ? m_inline : m_buffer->data(), m_size};
+            }
+
+            size_t size() const { return m_size; }
+
+        private:
+            friend class ValueSnapshot;
+
+            union {
+                ValueBuffer* m_buffer;
+                char m_inline[Value::INLINE_CAPACITY];
+            };
+            uint32_t m_size {0};
+            bool m_isInline {true};
+    };
+
+    /**
+    * @class ValueSnapshot
+    * @brief Bitwise copy of a Value handle taken without the shard lock.
+    *
+    * A snapshot owns no reference. It is only meaningful once the record's
+    * SeqLock validated it, and its buffer (if any) stays readable only while the
+    * reader is pinned in the EpochDomain: the buffer may be released right after
+    * the snapshot was taken, but it is not freed before the reader unpins.
+    */
+    class ValueSnapshot {
+        public:
+            ValueSnapshot() : m_inline{} {
+            }
+
+            /**
+            * Copies the handle in slot with word-sized atomic loads.
+            */
+            explicit ValueSnapshot(const Value& slot) {
+                static_assert(sizeof(ValueSnapshot) == sizeof(Value)
+                              && offsetof(ValueSnapshot, m_size) == offsetof(Value, m_size)
+                              && offsetof(ValueSnapshot, m_isInline) == offsetof(Value, m_isInline),
+                              "ValueSnapshot mirrors Value's layout");
+                SeqLock::loadWords(this, &slot, sizeof(Value));
+            }
+
+            std::string_view view() const {
+                return {m_isInline ? m_inline : m_buffer->data(), m_size};
+            }
+
+            size_t size() const { return m_size; }
+
+            /**
+            * Takes a reference that outlives the pin. Fails if the buffer's last
+            * handle is already gone, i.e. the value was replaced and released since
+            * the snapshot; the caller then reads the record again.
+            */
+            std::optional<ValueRef> acquire() const {
+                ValueRef ref {};
+                std::memcpy(ref.m_inline, m_inline, Value::INLINE_CAPACITY);
+                ref.m_size = m_size;
+                if (m_isInline) {
+                    return ref;
+                }
+
+                uint32_t refs {m_buffer->refs.load(std::memory_order_relaxed)};
+                do {
+                    if (refs == 0) {
+                        return std::nullopt;
+                    }
+                } while (!m_buffer->refs.compare_exchange_weak(refs, refs + 1, std::memory_order_relaxed));
+
+                ref.m_isInline = false;
+                return ref;
+            }
+
+        private:
+            union {
+                ValueBuffer* m_buffer;
+                char m_inline[Value::INLINE_CAPACITY];
+            };
+            uint32_t m_size {0};
+            bool m_isInline {true};
+    };
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace streamcache {
+
+    /**
+    * @class WorkerPool
+    * @brief Fixed set of threads that run the iterations of parallelFor() calls.
+    *
+    * The caller of parallelFor() works on its own job too, so a job always makes
+    * progress even when every pool thread is busy with other callers' jobs, and
+    * a pool of N threads gives up to N + 1 way parallelism. Iterations are
+    * claimed one at a time from an atomic counter, so uneven iterations balance
+    * themselves. Several threads may call parallelFor() concurrently.
+    */
+    class WorkerPool {
+        public:
+            /**
+            * @param threads Number of pool threads (at least one).
+            */
+            explicit WorkerPool(size_t threads);
+
+            /**
+            * Joins the threads. No parallelFor() may be running.
+            */
+            ~WorkerPool();
+
+            WorkerPool(const WorkerPool&) = delete;
+            WorkerPool& operator=(const WorkerPool&) = delete;
+
+            /**
+            * Calls fn(i) for every i in [0, count), spread over the pool and the
+            * calling thread, and returns once all calls have finished.
+            */
+            void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+            size_t threadCount() const { return m_threads.size(); }
+
+        private:
+            struct Job {
+                const std::function<void(size_t)>* fn {nullptr};
+                size_t count {0};
+                std::atomic<size_t> next {0};
+                std::atomic<size_t> done {0};
+                std::mutex mutex {};
+                std::condition_variable finished {};
+            };
+
+            std::mutex m_mutex {};
+            std::condition_variable m_cv {};
+            std::deque<std::shared_ptr<Job>> m_jobs {};
+            bool m_running {true};
+            std::vector<std::thread> m_threads {};
+
+            void runWorker();
+
+            /**
+            * Runs iterations of the job until none are left to claim.
+            */
+            static void work(Job& job);
+    };
+}
@@ -0,0 +1,292 @@
+#include "aof.h"
+#include "encoding.h"
+#include "time_util.h"
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <regex>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace streamcache {
+
+    namespace {
+
+        const size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+    }
+
+    void encodeAofRecord(std::string& payload, AofOp op, std::string_view key, std::string_view value,
+                         Timestamp timeSet, std::optional<Timestamp> expiration) {
+        payload.reserve(payload.size() + 1 + 16 + key.size() + value.size() + 10);
+        payload += static_cast<char>(op);
+        util::appendFixed64(payload, static_cast<uint64_t>(util::toEpochMicros(timeSet)));
+        util::appendFixed64(payload, expiration
+            ? static_cast<uint64_t>(util::toEpochMicros(*expiration))
+            : 0);
+        util::appendLengthPrefixed(payload, key);
+        util::appendLengthPrefixed(payload, value);
+    }
+
+    bool decodeAofRecord(std::string_view payload, AofRecord& record) {
+        util::ByteReader reader {payload};
+
+        std::string_view op {};
+        uint64_t timeSet {0};
+        uint64_t expiration {0};
+        std::string_view key {};
+        std::string_view value {};
+
+        if (!reader.readBytes(1, op) || !reader.readFixed64(timeSet) || !reader.readFixed64(expiration)
+            || !reader.readLengthPrefixed(key) || !reader.readLengthPrefixed(value)) {
+            return false;
+        }
+
+        const auto opCode {static_cast<AofOp>(op[0])};
+        if (opCode != AofOp::SET && opCode != AofOp::ZADD) {
+            return false;
+        }
+
+        record.op = opCode;
+        record.key.assign(key);
+        record.entry.value.assign(value);
+        record.entry.timeSet = util::fromEpochMicros(static_cast<int64_t>(timeSet));
+        record.entry.expiration = std::nullopt;
+        if (expiration != 0) {
+            record.entry.expiration = util::fromEpochMicros(static_cast<int64_t>(expiration));
+        }
+
+        return true;
+    }
+
+    std::optional<FsyncPolicy> parseFsyncPolicy(const std::string& name) {
+        if (name == "always") return FsyncPolicy::ALWAYS;
+        if (name == "everysec") return FsyncPolicy::EVERYSEC;
+        if (name == "no") return FsyncPolicy::NO;
+        return std::nullopt;
+    }
+
+    std::string aofPathFor(const std::string& dir, size_t shardIdx, uint64_t generation) {
+        return dir + "/shard-" + std::to_string(shardIdx) + "." + std::to_string(generation) + ".aof";
+    }
+
+    bool parseAofFileName(const std::string& name, size_t& shardIdx, uint64_t& generation) {
+        static const std::regex aofName {R"(shard-(\d+)\.(\d+)\.aof)"};
+
+        std::smatch match {};
+        if (!std::regex_match(name, match, aofName)) {
+            return false;
+        }
+
+        try {
+            shardIdx = std::stoul(match[1].str());
+            generation = std::stoull(match[2].str());
+        } catch (const std::exception&) {
+            return false;
+        }
+
+        return true;
+    }
+
+    AofWriter::AofWriter(std::string path, FsyncPolicy policy)
+        : m_path(std::move(path)), m_policy(policy) {
+        m_fd = open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + m_path);
+        }
+
+        m_running = true;
+        m_thread = std::thread(&AofWriter::runLoop, this);
+    }
+
+    AofWriter::~AofWriter() {
+        stop();
+    }
+
+    void AofWriter::stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_running) {
+                return;
+            }
+            m_running = false;
+        }
+        m_cv.notify_one();
+
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+
+        if (m_fd >= 0) {
+            if (m_policy != FsyncPolicy::NO) {
+                fdatasync(m_fd);
+            }
+            close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    void AofWriter::appendSet(std::string_view key, const CacheEntry& entry) {
+        std::string payload {};
+        encodeAofRecord(payload, AofOp::SET, key, entry.value, entry.timeSet, entry.expiration);
+        append(payload);
+    }
+
+    void AofWriter::appendMember(std::string_view key, std::string_view update, Timestamp timeSet,
+                                 std::optional<Timestamp> expiration) {
+        std::string payload {};
+        encodeAofRecord(payload, AofOp::ZADD, key, update, timeSet, expiration);
+        append(payload);
+    }
+
+    void AofWriter::append(const std::string& payload) {
+        bool wasEmpty {false};
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            wasEmpty = m_pending.empty();
+            util::appendFixed32(m_pending, static_cast<uint32_t>(payload.size()));
+            util::appendFixed32(m_pending, util::checksum(payload));
+            m_pending += payload;
+        }
+
+        /*
+        * Only the first record of a batch needs to wake the writer; later ones
+        * simply ride along in the same write.
+        */
+        if (wasEmpty) {
+            m_cv.notify_one();
+        }
+    }
+
+    void AofWriter::rotate(const std::string& path) {
+        int fd {open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)};
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_retired.emplace_back(m_fd, std::move(m_pending));
+            m_pending.clear();
+            m_fd = fd;
+            m_path = path;
+        }
+        m_cv.notify_one();
+    }
+
+    void AofWriter::writeAll(int fd, const std::string& batch) {
+        size_t written {0};
+        while (written < batch.size()) {
+            ssize_t n {write(fd, batch.data() + written, batch.size() - written)};
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // Nothing sensible to do from the background thread; drop the batch.
+                return;
+            }
+            written += static_cast<size_t>(n);
+        }
+    }
+
+    void AofWriter::runLoop() {
+        std::string batch {};
+        std::vector<std::pair<int, std::string>> retired {};
+        auto lastFsync {std::chrono::steady_clock::now()};
+        bool dirty {false};
+        int fd {-1};
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+
+                /*
+                * With everysec and unsynced data, wake up after at most a second
+                * even if no new writes arrive so the fsync still happens.
+                */
+                if (m_policy == FsyncPolicy::EVERYSEC && dirty) {
+                    m_cv.wait_until(lock, lastFsync + std::chrono::seconds(1), [this] {
+                        return !m_running || !m_pending.empty() || !m_retired.empty();
+                    });
+                } else {
+                    m_cv.wait(lock, [this] {
+                        return !m_running || !m_pending.empty() || !m_retired.empty();
+                    });
+                }
+
+                if (!m_running && m_pending.empty() && m_retired.empty()) {
+                    break;
+                }
+
+                batch.swap(m_pending);
+                retired.swap(m_retired);
+                fd = m_fd;
+            }
+
+            /*
+            * Finish rotated-away files first: their records precede everything
+            * in the current batch.
+            */
+            for (auto& [oldFd, oldBatch] : retired) {
+                writeAll(oldFd, oldBatch);
+                if (m_policy != FsyncPolicy::NO) {
+                    fdatasync(oldFd);
+                }
+                close(oldFd);
+            }
+            retired.clear();
+
+            if (!batch.empty()) {
+                writeAll(fd, batch);
+                batch.clear();
+                dirty = true;
+            }
+
+            auto now {std::chrono::steady_clock::now()};
+            if (m_policy == FsyncPolicy::ALWAYS
+                || (m_policy == FsyncPolicy::EVERYSEC && dirty && now - lastFsync >= std::chrono::seconds(1))) {
+                fdatasync(fd);
+                lastFsync = now;
+                dirty = false;
+            }
+        }
+    }
+
+    size_t replayAof(const std::string& path, const std::function<void(AofRecord&)>& apply) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            return 0;
+        }
+
+        std::string contents {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+        in.close();
+
+        util::ByteReader reader {contents};
+        AofRecord record {};
+        size_t applied {0};
+        size_t goodEnd {0};
+
+        while (reader.remaining() >= RECORD_HEADER_SIZE) {
+            uint32_t length {0};
+            uint32_t sum {0};
+            std::string_view payload {};
+
+            reader.readFixed32(length);
+            reader.readFixed32(sum);
+            if (!reader.readBytes(length, payload) || util::checksum(payload) != sum
+                || !decodeAofRecord(payload, record)) {
+                break;
+            }
+
+            apply(record);
+            ++applied;
+            goodEnd = reader.pos;
+        }
+
+        if (goodEnd < contents.size()) {
+            truncate(path.c_str(), static_cast<off_t>(goodEnd));
+        }
+
+        return applied;
+    }
+}
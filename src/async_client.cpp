@@ -0,0 +1,170 @@
+#include "async_client.h"
+#include <memory>
+#include <unordered_set>
+#include <utility>
+
+namespace streamcache {
+
+    AsyncClient::AsyncClient(Cache& cache, size_t maxBatch)
+        : m_cache(cache),
+          m_maxBatch(maxBatch > 0 ? maxBatch : 1) {
+        m_thread = std::thread(&AsyncClient::run, this);
+    }
+
+    AsyncClient::~AsyncClient() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+    }
+
+    void AsyncClient::get(std::string_view key, std::function<void(std::optional<ValueRef>)> done) {
+        auto* op {new Operation()};
+        op->key = std::string(key);
+        op->onGet = std::move(done);
+        push(op);
+    }
+
+    std::future<std::optional<ValueRef>> AsyncClient::get(std::string_view key) {
+        auto promise {std::make_shared<std::promise<std::optional<ValueRef>>>()};
+        std::future<std::optional<ValueRef>> result {promise->get_future()};
+        get(key, [promise](std::optional<ValueRef> value) {
+            promise->set_value(std::move(value));
+        });
+        return result;
+    }
+
+    void AsyncClient::set(std::string_view key, CacheEntry entry, std::function<void()> done) {
+        auto* op {new Operation()};
+        op->write = true;
+        op->key = std::string(key);
+        op->entry = std::move(entry);
+        op->onSet = std::move(done);
+        push(op);
+    }
+
+    std::future<void> AsyncClient::set(std::string_view key, CacheEntry entry) {
+        auto promise {std::make_shared<std::promise<void>>()};
+        std::future<void> result {promise->get_future()};
+        set(key, std::move(entry), [promise] {
+            promise->set_value();
+        });
+        return result;
+    }
+
+    AsyncClientStats AsyncClient::stats() const {
+        AsyncClientStats stats {};
+        stats.submitted = m_submitted.load(std::memory_order_relaxed);
+        stats.completed = m_completed.load(std::memory_order_relaxed);
+        stats.batches = m_batches.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void AsyncClient::push(Operation* op) {
+        m_submitted.fetch_add(1, std::memory_order_relaxed);
+        while (!m_queue.tryPush(op)) {
+            std::this_thread::yield();
+        }
+
+        // Pairs with the fence in waitForWork(); see ShardExecutor::push().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cv.notify_one();
+        }
+    }
+
+    void AsyncClient::run() {
+        std::vector<Operation*> batch {};
+        batch.reserve(m_maxBatch);
+        std::unordered_set<std::string_view> readKeys {};
+
+        for (;;) {
+            batch.clear();
+            Operation* op {nullptr};
+            while (batch.size() < m_maxBatch && m_queue.tryPop(op)) {
+                batch.push_back(op);
+            }
+
+            if (batch.empty()) {
+                if (!waitForWork()) {
+                    return;
+                }
+                continue;
+            }
+
+            /*
+            * A segment's writes are applied before its reads, so a read may move
+            * ahead of a write but never behind one: a segment ends where a write
+            * would overtake a read of the same key queued before it.
+            */
+            size_t begin {0};
+            readKeys.clear();
+            for (size_t i {0}; i < batch.size(); ++i) {
+                if (!batch[i]->write) {
+                    readKeys.insert(batch[i]->key);
+                } else if (readKeys.count(batch[i]->key)) {
+                    apply(batch.data() + begin, i - begin);
+                    begin = i;
+                    readKeys.clear();
+                }
+            }
+            apply(batch.data() + begin, batch.size() - begin);
+        }
+    }
+
+    void AsyncClient::apply(Operation* const* ops, size_t count) {
+        std::vector<std::string_view> writeKeys {};
+        std::vector<CacheEntry> entries {};
+        std::vector<std::string_view> readKeys {};
+        for (size_t i {0}; i < count; ++i) {
+            if (ops[i]->write) {
+                writeKeys.push_back(ops[i]->key);
+                entries.push_back(std::move(ops[i]->entry));
+            } else {
+                readKeys.push_back(ops[i]->key);
+            }
+        }
+
+        if (!writeKeys.empty()) {
+            m_cache.multiSet(writeKeys, std::move(entries));
+        }
+        std::vector<std::optional<ValueRef>> values {};
+        if (!readKeys.empty()) {
+            values = m_cache.multiGet(readKeys);
+        }
+
+        // Called back in queue order.
+        size_t read {0};
+        for (size_t i {0}; i < count; ++i) {
+            std::unique_ptr<Operation> op {ops[i]};
+            if (op->write) {
+                if (op->onSet) {
+                    op->onSet();
+                }
+            } else if (op->onGet) {
+                op->onGet(std::move(values[read++]));
+            } else {
+                ++read;
+            }
+        }
+
+        m_batches.fetch_add(1, std::memory_order_relaxed);
+        m_completed.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    bool AsyncClient::waitForWork() {
+        m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] {
+            return m_stopping || !m_queue.empty();
+        });
+        m_sleeping.store(false, std::memory_order_relaxed);
+
+        return !m_queue.empty() || !m_stopping;
+    }
+}
@@ -1,38 +1,1080 @@
 #include "cache.h"
+#include "snapshot.h"
+#include "hash_util.h"
+#include "glob_util.h"
+#include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <thread>
 
 namespace streamcache {
 
-    Cache::Cache(size_t numShards)
-        : m_numShards(numShards), m_shards(numShards) {
+    size_t Cache::defaultShardCount() {
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    Cache::Cache(size_t numShards, size_t evictionWorkers, ExecutionMode mode)
+        : m_shards(MAX_SHARDS), m_evictionScheduler(evictionWorkers) {
+        numShards = std::clamp<size_t>(numShards, 1, MAX_SHARDS);
+        const bool owned {mode == ExecutionMode::THREAD_PER_CORE};
+        const size_t cpus {defaultShardCount()};
+
+        for (size_t i {0}; i < numShards; ++i) {
+            m_shards[i] = std::make_unique<Shard>(owned, &m_slowLog, i, &m_changeFeed);
+            if (owned) {
+                // Shards beyond the core count share cores round-robin.
+                m_executors.push_back(std::make_unique<ShardExecutor>(*m_shards[i], i % cpus));
+            } else {
+                m_evictionScheduler.attach(*m_shards[i]);
+            }
+        }
+        m_layout.store(packLayout(numShards, numShards), std::memory_order_release);
+
+        // Owner threads evict their own shards.
+        if (!owned) {
+            m_evictionScheduler.start();
+        }
     }
     
     Cache::~Cache() {
-        // Shards clean themselves up
+        m_stopMigration.store(true, std::memory_order_relaxed);
+        if (m_migrator.joinable()) {
+            m_migrator.join();
+        }
+
+        // Stop eviction before the shards it works on are destroyed
+        m_evictionScheduler.stop();
+    }
+
+    Cache::RoutingGuard::RoutingGuard(std::shared_mutex& routingMutex)
+        : pin(EpochDomain::global().pin()), lock(routingMutex, std::defer_lock) {
+        if (!pin) {
+            lock.lock();
+        }
+    }
+
+    Cache::Route Cache::route(uint64_t hash) const {
+        const uint64_t layout {m_layout.load(std::memory_order_acquire)};
+        const size_t from {static_cast<size_t>(layout & 0xFFFFFFFF)};
+        const size_t to {static_cast<size_t>(layout >> 32)};
+
+        const size_t target {util::jumpHash(hash, to)};
+        return {from == to ? target : util::jumpHash(hash, from), target};
+    }
+
+    size_t Cache::shardFor(uint64_t hash) const {
+        return route(hash).target;
+    }
+
+    size_t Cache::shardCount() const {
+        return static_cast<size_t>(m_layout.load(std::memory_order_acquire) >> 32);
+    }
+
+    bool Cache::resharding() const {
+        const uint64_t layout {m_layout.load(std::memory_order_acquire)};
+        return (layout & 0xFFFFFFFF) != (layout >> 32);
+    }
+
+    size_t Cache::settledShardCount() const {
+        const uint64_t layout {m_layout.load(std::memory_order_acquire)};
+        const size_t to {static_cast<size_t>(layout >> 32)};
+        return (layout & 0xFFFFFFFF) == to ? to : 0;
+    }
+
+    void Cache::set(std::string_view key, CacheEntry entry) {
+        m_opCounters.recordCall(MetricOp::SET);
+        SlowLogScope trace(&m_slowLog, "SET", key);
+        const uint64_t hash {util::hashKey(key)};
+        if (threadPerCore()) {
+            onShard(shardFor(hash), [&](Shard& shard) { shard.set(key, hash, std::move(entry)); });
+            return;
+        }
+
+        RoutingGuard guard(m_routingMutex);
+        store(key, hash, std::move(entry), route(hash));
+    }
+
+    void Cache::store(std::string_view key, uint64_t hash, CacheEntry entry, const Route& route) {
+        /*
+        * A moving key is written where it is until the migration takes it; once
+        * it is gone from the old shard it never comes back there.
+        */
+        if (route.source != route.target && m_shards[route.source]->setExisting(key, hash, entry)) {
+            return;
+        }
+        m_shards[route.target]->set(key, hash, std::move(entry));
+    }
+
+    IncrementResult Cache::incrBy(std::string_view key, int64_t delta) {
+        m_opCounters.recordCall(MetricOp::INCR);
+        SlowLogScope trace(&m_slowLog, "INCRBY", key);
+        const uint64_t hash {util::hashKey(key)};
+        return increment(hash, [&](Shard& shard, bool ifPresent) {
+            return shard.incrBy(key, hash, delta, ifPresent);
+        });
+    }
+
+    IncrementResult Cache::incrByFloat(std::string_view key, double delta) {
+        m_opCounters.recordCall(MetricOp::INCR);
+        SlowLogScope trace(&m_slowLog, "INCRBYFLOAT", key);
+        const uint64_t hash {util::hashKey(key)};
+        return increment(hash, [&](Shard& shard, bool ifPresent) {
+            return shard.incrByFloat(key, hash, delta, ifPresent);
+        });
+    }
+
+    IncrementResult Cache::increment(uint64_t hash, const std::function<IncrementResult(Shard&, bool)>& apply) {
+        if (threadPerCore()) {
+            return onShard(shardFor(hash), [&](Shard& shard) { return apply(shard, false); });
+        }
+
+        RoutingGuard guard(m_routingMutex);
+        const Route r {route(hash)};
+        if (r.source != r.target) {
+            IncrementResult result {apply(*m_shards[r.source], true)};
+            if (result.status != IncrementStatus::MISSING) {
+                return result;
+            }
+        }
+        return apply(*m_shards[r.target], false);
+    }
+
+    SortedSetResult Cache::zadd(std::string_view key, const std::vector<ScoredMember>& members,
+                                const ZAddOptions& options) {
+        m_opCounters.recordCall(MetricOp::ZADD);
+        SlowLogScope trace(&m_slowLog, "ZADD", key);
+        const uint64_t hash {util::hashKey(key)};
+        return updateSortedSet(hash, [&](Shard& shard, bool ifPresent) {
+            return shard.zadd(key, hash, members, options, ifPresent);
+        });
+    }
+
+    SortedSetResult Cache::zincrBy(std::string_view key, std::string_view member, double delta) {
+        m_opCounters.recordCall(MetricOp::ZADD);
+        SlowLogScope trace(&m_slowLog, "ZINCRBY", key);
+        const uint64_t hash {util::hashKey(key)};
+        return updateSortedSet(hash, [&](Shard& shard, bool ifPresent) {
+            return shard.zincrBy(key, hash, member, delta, ifPresent);
+        });
+    }
+
+    SortedSetResult Cache::updateSortedSet(uint64_t hash, const std::function<SortedSetResult(Shard&, bool)>& apply) {
+        if (threadPerCore()) {
+            return onShard(shardFor(hash), [&](Shard& shard) { return apply(shard, false); });
+        }
+
+        RoutingGuard guard(m_routingMutex);
+        const Route r {route(hash)};
+        if (r.source != r.target) {
+            SortedSetResult result {apply(*m_shards[r.source], true)};
+            if (result.status != SortedSetStatus::MISSING) {
+                return result;
+            }
+        }
+        return apply(*m_shards[r.target], false);
+    }
+
+    SortedSetStatus Cache::zscore(std::string_view key, std::string_view member, std::optional<double>& score) {
+        m_opCounters.recordCall(MetricOp::ZRANGE);
+        SlowLogScope trace(&m_slowLog, "ZSCORE", key);
+        score = std::nullopt;
+        return readSortedSet(key, util::hashKey(key), [&](const SortedSet& zset) {
+            score = zset.score(member);
+        });
+    }
+
+    SortedSetStatus Cache::zrank(std::string_view key, std::string_view member, std::optional<size_t>& rank) {
+        m_opCounters.recordCall(MetricOp::ZRANGE);
+        SlowLogScope trace(&m_slowLog, "ZRANK", key);
+        rank = std::nullopt;
+        return readSortedSet(key, util::hashKey(key), [&](const SortedSet& zset) {
+            rank = zset.rank(member);
+        });
+    }
+
+    SortedSetStatus Cache::zcard(std::string_view key, size_t& count) {
+        m_opCounters.recordCall(MetricOp::ZRANGE);
+        SlowLogScope trace(&m_slowLog, "ZCARD", key);
+        count = 0;
+        return readSortedSet(key, util::hashKey(key), [&](const SortedSet& zset) {
+            count = zset.size();
+        });
+    }
+
+    SortedSetStatus Cache::zrange(std::string_view key, int64_t start, int64_t stop,
+                                  std::vector<ScoredMember>& members) {
+        m_opCounters.recordCall(MetricOp::ZRANGE);
+        SlowLogScope trace(&m_slowLog, "ZRANGE", key);
+        return readSortedSet(key, util::hashKey(key), [&](const SortedSet& zset) {
+            const auto size {static_cast<int64_t>(zset.size())};
+            const int64_t first {std::max<int64_t>(start < 0 ? start + size : start, 0)};
+            const int64_t last {stop < 0 ? stop + size : stop};
+            if (last < 0) {
+                return;
+            }
+            zset.forEachByRank(static_cast<size_t>(first), static_cast<size_t>(last),
+                               [&members](std::string_view member, double score) {
+                members.push_back({std::string(member), score});
+            });
+        });
+    }
+
+    SortedSetStatus Cache::zrevrangeByScore(std::string_view key, ScoreBound max, ScoreBound min, size_t offset,
+                                            size_t count, std::vector<ScoredMember>& members) {
+        m_opCounters.recordCall(MetricOp::ZRANGE);
+        SlowLogScope trace(&m_slowLog, "ZREVRANGEBYSCORE", key);
+        return readSortedSet(key, util::hashKey(key), [&](const SortedSet& zset) {
+            zset.forEachByScoreDescending(max, min, offset, count, [&members](std::string_view member, double score) {
+                members.push_back({std::string(member), score});
+            });
+        });
+    }
+
+    SortedSetStatus Cache::readSortedSet(std::string_view key, uint64_t hash,
+                                         const std::function<void(const SortedSet&)>& visit) {
+        SortedSetStatus status {SortedSetStatus::MISSING};
+        if (threadPerCore()) {
+            status = onShard(shardFor(hash), [&](Shard& shard) { return shard.readSortedSet(key, hash, visit); });
+        } else {
+            RoutingGuard guard(m_routingMutex);
+            const Route r {route(hash)};
+
+            // The old shard first, as for get().
+            if (r.source != r.target) {
+                status = m_shards[r.source]->readSortedSet(key, hash, visit);
+            }
+            if (status == SortedSetStatus::MISSING) {
+                status = m_shards[r.target]->readSortedSet(key, hash, visit);
+            }
+        }
+
+        // A missing key is an empty set; the outputs already say so.
+        return status == SortedSetStatus::MISSING ? SortedSetStatus::OK : status;
+    }
+
+    std::optional<std::string> Cache::get(std::string_view key) {
+        SlowLogScope trace(&m_slowLog, "GET", key);
+        std::optional<std::string> value {lookup(key)};
+        m_opCounters.recordCall(MetricOp::GET);
+        m_opCounters.recordLookups(value ? 1 : 0, value ? 0 : 1);
+        return value;
+    }
+
+    std::optional<std::string> Cache::lookup(std::string_view key) {
+        const uint64_t hash {util::hashKey(key)};
+        if (threadPerCore()) {
+            return onShard(shardFor(hash), [&](Shard& shard) { return shard.get(key, hash); });
+        }
+
+        RoutingGuard guard(m_routingMutex);
+        const Route r {route(hash)};
+
+        // The old shard first: a migrated key is in its new shard before it leaves the old one.
+        if (r.source != r.target) {
+            if (auto value {m_shards[r.source]->get(key, hash)}) {
+                return value;
+            }
+        }
+        return m_shards[r.target]->get(key, hash);
+    }
+
+    std::optional<ValueRef> Cache::getRef(std::string_view key, bool* wrongType) {
+        SlowLogScope trace(&m_slowLog, "GET", key);
+        const uint64_t hash {util::hashKey(key)};
+        std::optional<ValueRef> value {};
+        if (threadPerCore()) {
+            value = onShard(shardFor(hash), [&](Shard& shard) { return shard.getRef(key, hash, wrongType); });
+        } else {
+            RoutingGuard guard(m_routingMutex);
+            value = lookupRef(key, hash, route(hash), wrongType);
+        }
+
+        m_opCounters.recordCall(MetricOp::GET);
+        m_opCounters.recordLookups(value ? 1 : 0, value ? 0 : 1);
+        return value;
+    }
+
+    void Cache::getAsync(std::string_view key, std::function<void(std::optional<ValueRef>)> done) {
+        if (!threadPerCore()) {
+            done(getRef(key));
+            return;
+        }
+
+        const uint64_t hash {util::hashKey(key)};
+        const auto queuedAt {queueTimeIfTracing()};
+        m_executors[shardFor(hash)]->post([this, key = std::string(key), hash, queuedAt, done = std::move(done)](Shard& shard) {
+            std::optional<ValueRef> value {};
+            {
+                SlowLogScope trace(&m_slowLog, "GET", key, 1, queuedAt);
+                value = shard.getRef(key, hash);
+            }
+            m_opCounters.recordCall(MetricOp::GET);
+            m_opCounters.recordLookups(value ? 1 : 0, value ? 0 : 1);
+            done(std::move(value));
+        });
+    }
+
+    std::future<std::optional<ValueRef>> Cache::getAsync(std::string_view key) {
+        auto promise {std::make_shared<std::promise<std::optional<ValueRef>>>()};
+        std::future<std::optional<ValueRef>> result {promise->get_future()};
+        getAsync(key, [promise](std::optional<ValueRef> value) {
+            promise->set_value(std::move(value));
+        });
+        return result;
+    }
+
+    void Cache::setAsync(std::string_view key, CacheEntry entry, std::function<void()> done) {
+        if (!threadPerCore()) {
+            set(key, std::move(entry));
+            if (done) {
+                done();
+            }
+            return;
+        }
+
+        m_opCounters.recordCall(MetricOp::SET);
+        const uint64_t hash {util::hashKey(key)};
+        const auto queuedAt {queueTimeIfTracing()};
+        m_executors[shardFor(hash)]->post([this, key = std::string(key), hash, queuedAt, entry = std::move(entry),
+                                           done = std::move(done)](Shard& shard) mutable {
+            {
+                SlowLogScope trace(&m_slowLog, "SET", key, 1, queuedAt);
+                shard.set(key, hash, std::move(entry));
+            }
+            if (done) {
+                done();
+            }
+        });
+    }
+
+    std::future<void> Cache::setAsync(std::string_view key, CacheEntry entry) {
+        auto promise {std::make_shared<std::promise<void>>()};
+        std::future<void> result {promise->get_future()};
+        setAsync(key, std::move(entry), [promise] {
+            promise->set_value();
+        });
+        return result;
+    }
+
+    std::optional<ValueRef> Cache::lookupRef(std::string_view key, uint64_t hash, const Route& route, bool* wrongType) {
+        if (route.source != route.target) {
+            bool sortedSet {false};
+            if (auto value {m_shards[route.source]->getRef(key, hash, &sortedSet)}) {
+                return value;
+            }
+            if (sortedSet) {
+                if (wrongType) {
+                    *wrongType = true;
+                }
+                return std::nullopt;
+            }
+        }
+        return m_shards[route.target]->getRef(key, hash, wrongType);
+    }
+
+    std::vector<std::optional<ValueRef>> Cache::multiGet(const std::vector<std::string_view>& keys, bool* wrongType) {
+        std::vector<std::optional<ValueRef>> results(keys.size());
+        // Request-ordered like results, so groups running in parallel never share a flag.
+        std::unique_ptr<bool[]> wrongTypes {wrongType ? std::make_unique<bool[]>(keys.size()) : nullptr};
+        {
+            SlowLogScope trace(&m_slowLog, "MGET", keys.empty() ? std::string_view{} : keys[0], keys.size());
+            std::optional<RoutingGuard> guard {};
+            if (!threadPerCore()) {
+                guard.emplace(m_routingMutex);
+            }
+
+            const size_t numShards {settledShardCount()};
+            if (numShards == 0) {
+                for (size_t i {0}; i < keys.size(); ++i) {
+                    const uint64_t hash {util::hashKey(keys[i])};
+                    results[i] = lookupRef(keys[i], hash, route(hash), wrongTypes ? &wrongTypes[i] : nullptr);
+                }
+            } else {
+                std::vector<BatchKey> batch {};
+                std::vector<size_t> offsets {};
+                groupByShard(keys, numShards, batch, offsets);
+
+                forEachShardGroup(batch, offsets, [&results, &wrongTypes](Shard& shard, const BatchKey* group, size_t count) {
+                    shard.multiGet(group, count, results.data(), wrongTypes.get());
+                });
+            }
+        }
+
+        if (wrongType) {
+            *wrongType = std::any_of(wrongTypes.get(), wrongTypes.get() + keys.size(), [](bool flag) { return flag; });
+        }
+
+        const uint64_t hits {static_cast<uint64_t>(
+            std::count_if(results.begin(), results.end(), [](const auto& value) { return value.has_value(); }))};
+        m_opCounters.recordCall(MetricOp::MGET);
+        m_opCounters.recordLookups(hits, results.size() - hits);
+        return results;
+    }
+
+    void Cache::multiSet(const std::vector<std::string_view>& keys, std::vector<CacheEntry> entries) {
+        assert(entries.size() == keys.size());
+        m_opCounters.recordCall(MetricOp::MSET);
+        SlowLogScope trace(&m_slowLog, "MSET", keys.empty() ? std::string_view{} : keys[0], keys.size());
+        std::optional<RoutingGuard> guard {};
+        if (!threadPerCore()) {
+            guard.emplace(m_routingMutex);
+        }
+
+        const size_t numShards {settledShardCount()};
+        if (numShards == 0) {
+            for (size_t i {0}; i < keys.size(); ++i) {
+                const uint64_t hash {util::hashKey(keys[i])};
+                store(keys[i], hash, std::move(entries[i]), route(hash));
+            }
+            return;
+        }
+
+        std::vector<BatchKey> batch {};
+        std::vector<size_t> offsets {};
+        groupByShard(keys, numShards, batch, offsets);
+
+        forEachShardGroup(batch, offsets, [&entries](Shard& shard, const BatchKey* group, size_t count) {
+            shard.multiSet(group, count, entries.data());
+        });
+    }
+
+    std::optional<Timestamp> Cache::queueTimeIfTracing() const {
+        if (!m_slowLog.enabled()) {
+            return std::nullopt;
+        }
+        return std::chrono::steady_clock::now();
+    }
+
+    void Cache::setBatchWorkers(size_t workers) {
+        m_batchPool = workers > 0 ? std::make_unique<WorkerPool>(workers) : nullptr;
+    }
+
+    void Cache::groupByShard(const std::vector<std::string_view>& keys, size_t numShards,
+                             std::vector<BatchKey>& batch, std::vector<size_t>& offsets) const {
+        std::vector<BatchKey> hashed(keys.size());
+        std::vector<uint32_t> shardOf(keys.size());
+        offsets.assign(numShards + 1, 0);
+
+        for (size_t i {0}; i < keys.size(); ++i) {
+            const uint64_t hash {util::hashKey(keys[i])};
+            hashed[i] = {keys[i], hash, i};
+            shardOf[i] = static_cast<uint32_t>(util::jumpHash(hash, numShards));
+            ++offsets[shardOf[i] + 1];
+        }
+
+        // Counting sort: prefix sums give each shard's range, filled in request order.
+        for (size_t s {0}; s < numShards; ++s) {
+            offsets[s + 1] += offsets[s];
+        }
+
+        std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+        batch.resize(keys.size());
+        for (size_t i {0}; i < keys.size(); ++i) {
+            batch[cursor[shardOf[i]]++] = hashed[i];
+        }
+    }
+
+    void Cache::forEachShardGroup(const std::vector<BatchKey>& batch, const std::vector<size_t>& offsets,
+                                  const std::function<void(Shard&, const BatchKey*, size_t)>& run) {
+        std::vector<size_t> groups {};
+        for (size_t s {0}; s + 1 < offsets.size(); ++s) {
+            if (offsets[s + 1] > offsets[s]) {
+                groups.push_back(s);
+            }
+        }
+
+        /*
+        * Groups that run on other threads trace their lock time separately; a
+        * traced batch reports the sum over its groups.
+        */
+        LockTrace* trace {LockTrace::current()};
+        std::vector<LockTrace> groupTraces(trace ? groups.size() : 0);
+        const auto mergeGroupTraces = [&] {
+            for (const LockTrace& groupTrace : groupTraces) {
+                trace->merge(groupTrace);
+            }
+        };
+
+        if (threadPerCore()) {
+            // Every group goes to its owner at once; the groups run in parallel.
+            const auto queuedAt {std::chrono::steady_clock::now()};
+            auto groupTask = [&](size_t g) {
+                const size_t s {groups[g]};
+                return [&run, &groupTraces, g, queuedAt, keys = batch.data() + offsets[s],
+                        count = offsets[s + 1] - offsets[s]](Shard& shard) {
+                    std::optional<QueuedSpan> span {};
+                    if (!groupTraces.empty()) {
+                        span.emplace(groupTraces[g], queuedAt);
+                    }
+                    run(shard, keys, count);
+                };
+            };
+
+            std::vector<decltype(groupTask(0))> tasks {};
+            tasks.reserve(groups.size());
+            Completion done {groups.size()};
+            for (size_t g {0}; g < groups.size(); ++g) {
+                tasks.push_back(groupTask(g));
+                m_executors[groups[g]]->execute(tasks.back(), done);
+            }
+            done.wait();
+            mergeGroupTraces();
+            return;
+        }
+
+        auto runGroup = [&](size_t g) {
+            const size_t s {groups[g]};
+            run(*m_shards[s], batch.data() + offsets[s], offsets[s + 1] - offsets[s]);
+        };
+
+        if (m_batchPool && groups.size() > 1 && batch.size() >= PARALLEL_BATCH_MIN) {
+            m_batchPool->parallelFor(groups.size(), [&](size_t g) {
+                LockTraceBinding binding(groupTraces.empty() ? nullptr : &groupTraces[g]);
+                runGroup(g);
+            });
+            mergeGroupTraces();
+            return;
+        }
+
+        for (size_t g {0}; g < groups.size(); ++g) {
+            runGroup(g);
+        }
+    }
+
+    void Cache::replay(std::string_view key) {
+        m_opCounters.recordCall(MetricOp::REPLAY);
+        SlowLogScope trace(&m_slowLog, "REPLAY", key);
+        uint64_t hash {util::hashKey(key)};
+        if (threadPerCore()) {
+            onShard(shardFor(hash), [&](Shard& shard) { shard.replay(key, hash); });
+            return;
+        }
+
+        RoutingGuard guard(m_routingMutex);
+        const Route r {route(hash)};
+
+        if (r.source != r.target && m_shards[r.source]->getReplay(key, hash)) {
+            m_shards[r.source]->replay(key, hash);
+            return;
+        }
+        m_shards[r.target]->replay(key, hash);
+    }
+
+    std::optional<std::deque<LogEntry>> Cache::getReplay(std::string_view key) const {
+        m_opCounters.recordCall(MetricOp::REPLAY);
+        SlowLogScope trace(&m_slowLog, "REPLAY", key);
+        uint64_t hash {util::hashKey(key)};
+        if (threadPerCore()) {
+            return m_executors[shardFor(hash)]->call([&](Shard& shard) { return shard.getReplay(key, hash); });
+        }
+
+        RoutingGuard guard(m_routingMutex);
+        const Route r {route(hash)};
+
+        if (r.source != r.target) {
+            if (auto replayLog {m_shards[r.source]->getReplay(key, hash)}) {
+                return replayLog;
+            }
+        }
+        return m_shards[r.target]->getReplay(key, hash);
+    }
+
+    std::optional<std::vector<ReplayRecord>> Cache::replay(std::string_view key, const ReplayRange& range) {
+        std::vector<ReplayRecord> records {};
+        const bool found {replay(key, range, [&records](const LogRecordView& record) {
+            records.push_back({record.timestamp, record.ref()});
+        })};
+
+        if (!found) {
+            return std::nullopt;
+        }
+        return records;
+    }
+
+    bool Cache::replay(std::string_view key, const ReplayRange& range,
+                       const std::function<void(const LogRecordView&)>& visit) {
+        m_opCounters.recordCall(MetricOp::REPLAY);
+        SlowLogScope trace(&m_slowLog, "REPLAY", key);
+        const uint64_t hash {util::hashKey(key)};
+        if (threadPerCore()) {
+            return onShard(shardFor(hash), [&](Shard& shard) { return shard.replay(key, hash, range, visit); });
+        }
+
+        RoutingGuard guard(m_routingMutex);
+        const Route r {route(hash)};
+
+        // Nothing is visited if the key is not in the old shard, so trying it first is safe.
+        if (r.source != r.target && m_shards[r.source]->replay(key, hash, range, visit)) {
+            return true;
+        }
+        return m_shards[r.target]->replay(key, hash, range, visit);
+    }
+
+    std::optional<ValueRef> Cache::getAsOf(std::string_view key, Timestamp at) {
+        SlowLogScope trace(&m_slowLog, "GET", key);
+        const uint64_t hash {util::hashKey(key)};
+        std::optional<ValueRef> value {};
+        if (threadPerCore()) {
+            value = onShard(shardFor(hash), [&](Shard& shard) { return shard.getAsOf(key, hash, at); });
+        } else {
+            RoutingGuard guard(m_routingMutex);
+            const Route r {route(hash)};
+            if (r.source != r.target) {
+                value = m_shards[r.source]->getAsOf(key, hash, at);
+            }
+            if (!value) {
+                value = m_shards[r.target]->getAsOf(key, hash, at);
+            }
+        }
+
+        m_opCounters.recordCall(MetricOp::GET);
+        m_opCounters.recordLookups(value ? 1 : 0, value ? 0 : 1);
+        return value;
+    }
+
+    ScanResult Cache::scan(uint64_t cursor, size_t count, std::string_view pattern) {
+        m_opCounters.recordCall(MetricOp::SCAN);
+        SlowLogScope trace(&m_slowLog, "SCAN", pattern);
+
+        ScanResult result {};
+        size_t shard {static_cast<size_t>(cursor & ((uint64_t{1} << SCAN_SHARD_BITS) - 1))};
+        size_t shardCursor {static_cast<size_t>(cursor >> SCAN_SHARD_BITS)};
+        count = std::max<size_t>(count, 1);
+        const size_t groups {(count + FlatIndex<StoredEntry>::GROUP_WIDTH - 1) / FlatIndex<StoredEntry>::GROUP_WIDTH};
+
+        // Moves on to the next shard while the step has visited fewer than `count` keys.
+        while (shard < shardCount()) {
+            shardCursor = onShard(shard, [&](Shard& s) { return s.scanKeys(shardCursor, groups, result.keys); });
+            if (shardCursor != 0) {
+                break;
+            }
+            ++shard;
+            if (result.keys.size() >= count) {
+                break;
+            }
+        }
+
+        result.cursor = shard >= shardCount() ? 0 : static_cast<uint64_t>(shardCursor) << SCAN_SHARD_BITS | shard;
+
+        if (!pattern.empty()) {
+            result.keys.erase(std::remove_if(result.keys.begin(), result.keys.end(), [pattern](const std::string& key) {
+                return !util::globMatch(pattern, key);
+            }), result.keys.end());
+        }
+        return result;
+    }
+
+    std::unique_ptr<ChangeSubscription> Cache::subscribeChanges() {
+        std::vector<uint64_t> cursors(shardCount());
+        for (size_t i {0}; i < cursors.size(); ++i) {
+            cursors[i] = m_shards[i]->changes().head();
+        }
+        return std::make_unique<ChangeSubscription>(m_changeFeed, std::move(cursors));
     }
 
-    size_t Cache::shardFor(const std::string& key) const {
-        size_t h {std::hash<std::string>{}(key)};
-        return h % m_numShards;
+    std::unique_ptr<ChangeSubscription> Cache::subscribeChanges(std::vector<uint64_t> cursors) {
+        return std::make_unique<ChangeSubscription>(m_changeFeed, std::move(cursors));
     }
 
-    void Cache::set(const std::string& key, CacheEntry entry) {
-        size_t shardIdx {shardFor(key)};
-        m_shards[shardIdx].set(key, std::move(entry));
+    size_t Cache::readChanges(ChangeSubscription& subscription, size_t max,
+                              const std::function<void(const ChangeEvent&)>& visit) {
+        // Without a reader slot nothing can be read safely; the caller tries again later.
+        EpochDomain::Guard pin {EpochDomain::global().pin()};
+        if (!pin) {
+            return 0;
+        }
+
+        // Shards a reshard added since the last read start from their beginning.
+        const size_t numShards {shardCount()};
+        std::vector<uint64_t>& cursors {subscription.m_cursors};
+        if (cursors.size() < numShards) {
+            cursors.resize(numShards, 0);
+        }
+
+        // Each read starts one shard further on, so a busy shard cannot starve the others.
+        uint64_t lost {0};
+        size_t visited {0};
+        for (size_t n {0}; n < numShards && visited < max; ++n) {
+            const size_t i {(subscription.m_nextShard + n) % numShards};
+            visited += m_shards[i]->changes().read(cursors[i], max - visited, lost, visit);
+        }
+        subscription.m_nextShard = (subscription.m_nextShard + 1) % numShards;
+
+        uint64_t position {0};
+        for (uint64_t cursor : cursors) {
+            position += cursor;
+        }
+        subscription.m_position.store(position, std::memory_order_relaxed);
+        if (lost > 0) {
+            subscription.m_lost.fetch_add(lost, std::memory_order_relaxed);
+        }
+        return visited;
     }
 
-    std::optional<std::string> Cache::get(const std::string& key) {
-        size_t shardIdx {shardFor(key)};
-        return m_shards[shardIdx].get(key);
+    uint64_t Cache::changesPublished() const {
+        uint64_t published {0};
+        for (size_t i {0}; i < shardCount(); ++i) {
+            published += m_shards[i]->changes().head();
+        }
+        return published;
     }
 
-    void Cache::replay(const std::string& key) {
-        size_t shardIdx {shardFor(key)};
-        m_shards[shardIdx].replay(key);
+    uint64_t Cache::changeLag(const ChangeSubscription& subscription) const {
+        const uint64_t published {changesPublished()};
+        const uint64_t position {subscription.position()};
+        return published > position ? published - position : 0;
     }
 
     void Cache::pruneAllLogs(Timestamp cutoff) {
-        for (auto& shard : m_shards) {
-            shard.pruneAllLogs(cutoff);
+        for (size_t i {0}; i < shardCount(); ++i) {
+            onShard(i, [cutoff](Shard& shard) { shard.pruneAllLogs(cutoff); });
+        }
+    }
+
+    HistogramSnapshot Cache::evictionLag() const {
+        HistogramSnapshot merged {};
+        for (size_t i {0}; i < shardCount(); ++i) {
+            merged.merge(m_shards[i]->evictionLag());
+        }
+        return merged;
+    }
+
+    MemoryStats Cache::memoryStats() const {
+        MemoryStats total {};
+        for (size_t i {0}; i < shardCount(); ++i) {
+            MemoryStats stats {m_shards[i]->memoryStats()};
+            total.allocated += stats.allocated;
+            total.reserved += stats.reserved;
+        }
+        return total;
+    }
+
+    CacheMetrics Cache::metrics() const {
+        CacheMetrics metrics {};
+        metrics.takenAt = std::chrono::steady_clock::now();
+        metrics.uptime = metrics.takenAt - m_startedAt;
+        metrics.threadPerCore = threadPerCore();
+        metrics.ops = m_opCounters.totals();
+        metrics.migratedKeys = migratedKeys();
+        metrics.evictionQueueEntries = threadPerCore() ? 0 : m_evictionScheduler.queueSize();
+        metrics.changes.published = changesPublished();
+        m_changeFeed.collect(metrics.changes);
+
+        const size_t numShards {shardCount()};
+        metrics.shards.reserve(numShards);
+        for (size_t i {0}; i < numShards; ++i) {
+            if (threadPerCore()) {
+                metrics.shards.push_back(m_executors[i]->call([](Shard& shard) { return shard.metrics(); }));
+            } else {
+                metrics.shards.push_back(m_shards[i]->metrics());
+            }
+        }
+        return metrics;
+    }
+
+    void Cache::setMemoryLimit(size_t maxBytes, EvictionPolicy policy) {
+        std::lock_guard<std::mutex> lock(m_configMutex);
+        m_maxMemory = maxBytes;
+        m_evictionPolicy = policy;
+
+        const size_t numShards {shardCount()};
+        const size_t perShard {maxBytes == 0 ? 0 : std::max<size_t>(1, maxBytes / numShards)};
+        for (size_t i {0}; i < numShards; ++i) {
+            onShard(i, [perShard, policy](Shard& shard) { shard.setMemoryLimit(perShard, policy); });
+        }
+    }
+
+    uint64_t Cache::memoryEvictions() const {
+        uint64_t total {0};
+        for (size_t i {0}; i < shardCount(); ++i) {
+            total += m_shards[i]->memoryEvictions();
+        }
+        return total;
+    }
+
+    void Cache::setMaxLogRecords(size_t maxRecords) {
+        std::lock_guard<std::mutex> lock(m_configMutex);
+        m_maxLogRecords = maxRecords;
+
+        for (size_t i {0}; i < shardCount(); ++i) {
+            onShard(i, [maxRecords](Shard& shard) { shard.setMaxLogRecords(maxRecords); });
+        }
+    }
+
+    bool Cache::reshard(size_t numShards) {
+        std::lock_guard<std::mutex> configLock(m_configMutex);
+        const size_t current {shardCount()};
+        if (numShards <= current || numShards > MAX_SHARDS || resharding() || threadPerCore()) {
+            return false;
+        }
+
+        // The previous migration has finished; reap its thread.
+        if (m_migrator.joinable()) {
+            m_migrator.join();
+        }
+
+        for (size_t i {current}; i < numShards; ++i) {
+            m_shards[i] = std::make_unique<Shard>(false, &m_slowLog, i, &m_changeFeed);
+            Shard& shard {*m_shards[i]};
+            shard.setMaxLogRecords(m_maxLogRecords);
+            if (m_maxMemory > 0) {
+                shard.setMemoryLimit(std::max<size_t>(1, m_maxMemory / numShards), m_evictionPolicy);
+            }
+            m_evictionScheduler.attach(shard);
+        }
+
+        {
+            /*
+            * Not during a snapshot: it exports the shards that existed when it
+            * started, and would delete the AOF files of shards it did not rotate.
+            */
+            std::lock_guard<std::mutex> snapshotLock(m_snapshotMutex);
+            if (!m_aofDir.empty()) {
+                for (size_t i {current}; i < numShards; ++i) {
+                    m_shards[i]->attachAof(std::make_unique<AofWriter>(aofPathFor(m_aofDir, i, m_generation), m_aofFsync));
+                }
+            }
+            m_layout.store(packLayout(current, numShards), std::memory_order_release);
+        }
+
+        m_migrator = std::thread(&Cache::migrate, this, current, numShards);
+        return true;
+    }
+
+    void Cache::migrate(size_t from, size_t to) {
+        /*
+        * Operations that routed with the old layout may still write a moving key
+        * into its old shard; wait them out so no record lands behind the cursors.
+        */
+        EpochDomain::global().synchronize();
+        {
+            std::unique_lock<std::shared_mutex> drain(m_routingMutex);
+        }
+
+        for (size_t source {0}; source < from; ++source) {
+            Shard& shard {*m_shards[source]};
+            auto destinationOf = [this, source, to](uint64_t hash) -> Shard* {
+                const size_t target {util::jumpHash(hash, to)};
+                return target == source ? nullptr : m_shards[target].get();
+            };
+
+            // Passes repeat until one moves nothing (see Shard::migrateOut()).
+            size_t moved {1};
+            while (moved > 0) {
+                moved = 0;
+                bool unfinished {true};
+                while (unfinished) {
+                    if (m_stopMigration.load(std::memory_order_relaxed)) {
+                        return;
+                    }
+                    // Batches wait for a running snapshot, so it never sees a key twice or not at all.
+                    std::lock_guard<std::mutex> snapshotLock(m_snapshotMutex);
+                    const size_t before {moved};
+                    unfinished = shard.migrateOut(destinationOf, moved);
+                    m_migratedKeys.fetch_add(moved - before, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> configLock(m_configMutex);
+        m_layout.store(packLayout(to, to), std::memory_order_release);
+
+        // The old shards give up the part of their memory share that moved out.
+        if (m_maxMemory > 0) {
+            const size_t perShard {std::max<size_t>(1, m_maxMemory / to)};
+            for (size_t i {0}; i < from; ++i) {
+                m_shards[i]->setMemoryLimit(perShard, m_evictionPolicy);
+            }
+        }
+    }
+
+    void Cache::drainExecutors() {
+        for (auto& executor : m_executors) {
+            executor->call([](Shard&) {});
+        }
+    }
+
+    size_t Cache::loadSnapshot(const std::string& path) {
+        const size_t loaded {streamcache::loadSnapshot(path, [this](SnapshotEntry& loaded) {
+            uint64_t hash {util::hashKey(loaded.key)};
+            if (threadPerCore()) {
+                // Restores are last-writer-wins, so they need not wait for each other.
+                m_executors[shardFor(hash)]->post([hash, loaded = std::move(loaded)](Shard& shard) mutable {
+                    shard.restore(loaded.key, hash, std::move(loaded.entry), std::move(loaded.logs));
+                });
+                return;
+            }
+            m_shards[shardFor(hash)]->restore(loaded.key, hash, std::move(loaded.entry), std::move(loaded.logs));
+        }, m_generation)};
+
+        drainExecutors();
+        return loaded;
+    }
+
+    size_t Cache::enableAof(const AofConfig& config) {
+        namespace fs = std::filesystem;
+        fs::create_directories(config.dir);
+
+        /*
+        * Group the AOF files by the shard that wrote them, oldest generation first.
+        * Files from a run with a different shard count are included too; records
+        * are routed by key and restored last-writer-wins.
+        */
+        std::map<size_t, std::map<uint64_t, std::string>> filesByShard {};
+        uint64_t generation {m_generation};
+
+        for (const auto& dirEntry : fs::directory_iterator(config.dir)) {
+            size_t shardIdx {0};
+            uint64_t fileGeneration {0};
+            if (!dirEntry.is_regular_file()
+                || !parseAofFileName(dirEntry.path().filename().string(), shardIdx, fileGeneration)) {
+                continue;
+            }
+
+            // Everything before the snapshot's generation is already in the snapshot.
+            if (fileGeneration < m_generation) {
+                fs::remove(dirEntry.path());
+                continue;
+            }
+
+            filesByShard[shardIdx][fileGeneration] = dirEntry.path().string();
+            generation = std::max(generation, fileGeneration);
+        }
+
+        std::atomic<size_t> recovered {0};
+        std::vector<std::thread> workers {};
+        for (const auto& [shardIdx, files] : filesByShard) {
+            workers.emplace_back([this, &files, &recovered] {
+                for (const auto& [fileGeneration, file] : files) {
+                    size_t n {replayAof(file, [this](AofRecord& record) {
+                        uint64_t hash {util::hashKey(record.key)};
+                        const auto apply {[hash](Shard& shard, AofRecord& record) {
+                            if (record.op == AofOp::ZADD) {
+                                shard.restoreMember(record.key, hash, std::move(record.entry));
+                            } else {
+                                shard.restore(record.key, hash, std::move(record.entry));
+                            }
+                        }};
+                        if (threadPerCore()) {
+                            m_executors[shardFor(hash)]->post([apply, record = std::move(record)](Shard& shard) mutable {
+                                apply(shard, record);
+                            });
+                            return;
+                        }
+                        apply(*m_shards[shardFor(hash)], record);
+                    })};
+                    recovered.fetch_add(n, std::memory_order_relaxed);
+                }
+            });
+        }
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        drainExecutors();
+
+        std::lock_guard<std::mutex> lock(m_snapshotMutex);
+        m_aofDir = config.dir;
+        m_aofFsync = config.fsync;
+        m_generation = generation;
+
+        for (size_t i {0}; i < shardCount(); ++i) {
+            auto aof {std::make_unique<AofWriter>(aofPathFor(config.dir, i, generation), config.fsync)};
+            onShard(i, [&aof](Shard& shard) { shard.attachAof(std::move(aof)); });
+        }
+
+        return recovered.load();
+    }
+
+    void Cache::snapshot(const std::string& path) {
+        std::lock_guard<std::mutex> lock(m_snapshotMutex);
+
+        const uint64_t nextGeneration {m_generation + 1};
+        SnapshotWriter writer(path);
+        exportShards(writer, nextGeneration, nullptr);
+        writer.commit(nextGeneration);
+        m_generation = nextGeneration;
+
+        if (m_aofDir.empty()) {
+            return;
+        }
+
+        /*
+        * The snapshot now covers every record written before each shard's
+        * rotation, so older generations (and leftovers from other shard counts)
+        * can go.
+        */
+        namespace fs = std::filesystem;
+        for (const auto& dirEntry : fs::directory_iterator(m_aofDir)) {
+            size_t shardIdx {0};
+            uint64_t fileGeneration {0};
+            if (parseAofFileName(dirEntry.path().filename().string(), shardIdx, fileGeneration)
+                && fileGeneration < nextGeneration) {
+                std::error_code ec {};
+                fs::remove(dirEntry.path(), ec);
+            }
+        }
+    }
+
+    void Cache::exportSnapshot(const std::string& path, std::vector<uint64_t>& changeHeads) {
+        std::lock_guard<std::mutex> lock(m_snapshotMutex);
+
+        SnapshotWriter writer(path);
+        changeHeads.assign(shardCount(), 0);
+        exportShards(writer, std::nullopt, &changeHeads);
+        writer.commit(m_generation);
+    }
+
+    void Cache::exportShards(SnapshotWriter& writer, std::optional<uint64_t> aofGeneration,
+                             std::vector<uint64_t>* changeHeads) {
+        const SnapshotVisitor addEntry {[&writer](const StoredEntry& record) {
+            writer.addEntry(record);
+        }};
+
+        for (size_t i {0}; i < shardCount(); ++i) {
+            const std::string nextAofPath {m_aofDir.empty() || !aofGeneration
+                ? std::string() : aofPathFor(m_aofDir, i, *aofGeneration)};
+            uint64_t* head {changeHeads ? &(*changeHeads)[i] : nullptr};
+            onShard(i, [&nextAofPath, head](Shard& shard) { shard.markSnapshot(nextAofPath, head); });
+
+            // Each step is its own lock acquisition (or owner-thread task); sections go to disk in between.
+            size_t cursor {0};
+            do {
+                cursor = onShard(i, [cursor, &addEntry](Shard& shard) { return shard.exportSnapshot(cursor, addEntry); });
+                if (cursor == 0 || writer.sectionBytes() >= SnapshotWriter::SECTION_BYTES) {
+                    writer.endSection();
+                }
+            } while (cursor != 0);
+        }
+    }
+
+    void Cache::restore(std::string_view key, CacheEntry entry) {
+        const uint64_t hash {util::hashKey(key)};
+        if (threadPerCore()) {
+            onShard(shardFor(hash), [&](Shard& shard) { shard.restore(key, hash, std::move(entry)); });
+            return;
+        }
+
+        RoutingGuard guard(m_routingMutex);
+        m_shards[shardFor(hash)]->restore(key, hash, std::move(entry));
+    }
+
+    void Cache::restoreMember(std::string_view key, CacheEntry entry) {
+        const uint64_t hash {util::hashKey(key)};
+        if (threadPerCore()) {
+            onShard(shardFor(hash), [&](Shard& shard) { shard.restoreMember(key, hash, std::move(entry)); });
+            return;
+        }
+
+        RoutingGuard guard(m_routingMutex);
+        m_shards[shardFor(hash)]->restoreMember(key, hash, std::move(entry));
+    }
+
+    void Cache::clear() {
+        for (size_t i {0}; i < shardCount(); ++i) {
+            onShard(i, [](Shard& shard) { shard.clear(); });
         }
     }
-}
\ No newline at end of file
+}
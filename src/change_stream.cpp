@@ -0,0 +1,119 @@
+#include "change_stream.h"
+#include "epoch.h"
+#include <algorithm>
+
+namespace streamcache {
+
+    ChangeRing::ChangeRing() : m_slots(new std::atomic<ChangeEvent*>[CAPACITY]) {
+        for (size_t i {0}; i < CAPACITY; ++i) {
+            m_slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ChangeRing::~ChangeRing() {
+        // No reader can be left by now.
+        for (size_t i {0}; i < CAPACITY; ++i) {
+            delete m_slots[i].load(std::memory_order_relaxed);
+        }
+        for (auto& [stamp, event] : m_retired) {
+            delete event;
+        }
+    }
+
+    void ChangeRing::publish(std::string_view key, const Value& value, std::optional<Timestamp> expiration,
+                             Timestamp timestamp, ChangeKind kind) {
+        const uint64_t sequence {m_head.load(std::memory_order_relaxed)};
+        auto* event {new ChangeEvent{sequence, timestamp, std::string(key), ValueRef(value), expiration, kind}};
+
+        ChangeEvent* overwritten {m_slots[sequence % CAPACITY].exchange(event, std::memory_order_acq_rel)};
+        m_head.store(sequence + 1, std::memory_order_release);
+
+        if (overwritten) {
+            m_retired.emplace_back(EpochDomain::global().retireStamp(), overwritten);
+            if (m_retired.size() >= RECLAIM_BATCH) {
+                reclaim();
+            }
+        }
+    }
+
+    size_t ChangeRing::read(uint64_t& cursor, size_t max, uint64_t& lost,
+                            const std::function<void(const ChangeEvent&)>& visit) const {
+        size_t visited {0};
+        uint64_t head {m_head.load(std::memory_order_acquire)};
+
+        while (visited < max && cursor < head) {
+            if (head - cursor > CAPACITY) {
+                lost += head - CAPACITY - cursor;
+                cursor = head - CAPACITY;
+            }
+
+            /*
+            * The slot holds this event, or, if the producer lapped the reader
+            * since head was loaded, a newer one: skip to what is still there.
+            */
+            const ChangeEvent* event {m_slots[cursor % CAPACITY].load(std::memory_order_acquire)};
+            if (!event || event->sequence != cursor) {
+                head = m_head.load(std::memory_order_acquire);
+                continue;
+            }
+
+            visit(*event);
+            ++cursor;
+            ++visited;
+        }
+        return visited;
+    }
+
+    void ChangeRing::reclaim() {
+        const uint64_t safe {EpochDomain::global().safeEpoch()};
+        while (!m_retired.empty() && m_retired.front().first < safe) {
+            delete m_retired.front().second;
+            m_retired.pop_front();
+        }
+    }
+
+    void ChangeFeed::setListener(std::function<void()> listener) {
+        std::lock_guard<std::mutex> lock(m_listenerMutex);
+        m_listener = std::move(listener);
+    }
+
+    void ChangeFeed::notify() {
+        std::lock_guard<std::mutex> lock(m_listenerMutex);
+        if (m_listener) {
+            m_listener();
+        }
+    }
+
+    void ChangeFeed::collect(ChangeStreamMetrics& metrics) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        metrics.subscribers = m_subscriptions.size();
+        metrics.lost = m_closedLost;
+        metrics.maxLag = 0;
+        for (const ChangeSubscription* subscription : m_subscriptions) {
+            metrics.lost += subscription->lost();
+            const uint64_t position {subscription->position()};
+            metrics.maxLag = std::max(metrics.maxLag, metrics.published > position ? metrics.published - position : 0);
+        }
+    }
+
+    ChangeSubscription::ChangeSubscription(ChangeFeed& feed, std::vector<uint64_t> cursors)
+        : m_feed(feed), m_cursors(std::move(cursors)) {
+        uint64_t position {0};
+        for (uint64_t cursor : m_cursors) {
+            position += cursor;
+        }
+        m_position.store(position, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(m_feed.m_mutex);
+        m_feed.m_subscriptions.push_back(this);
+        m_feed.m_subscriberCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ChangeSubscription::~ChangeSubscription() {
+        std::lock_guard<std::mutex> lock(m_feed.m_mutex);
+        auto& subscriptions {m_feed.m_subscriptions};
+        subscriptions.erase(std::find(subscriptions.begin(), subscriptions.end(), this));
+        m_feed.m_closedLost += lost();
+        m_feed.m_subscriberCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,113 @@
+#include "epoch.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace streamcache {
+
+    /*
+    * The slot is returned to the domain when the thread exits.
+    */
+    struct EpochDomain::ThreadState {
+        EpochDomain* domain {nullptr};
+        Slot* slot {nullptr};
+        size_t depth {0};
+        bool exhausted {false};     // no slot was free; don't rescan on every pin
+
+        ~ThreadState() {
+            if (domain && slot) {
+                domain->releaseSlot(slot);
+            }
+        }
+    };
+
+    EpochDomain::ThreadState& EpochDomain::threadState() {
+        thread_local ThreadState state {};
+        return state;
+    }
+
+    EpochDomain& EpochDomain::global() {
+        static EpochDomain domain {};
+        return domain;
+    }
+
+    EpochDomain::Guard EpochDomain::pin() {
+        ThreadState& state {threadState()};
+
+        if (!state.slot) {
+            if (state.exhausted) {
+                return Guard(nullptr);
+            }
+            state.slot = claimSlot();
+            if (!state.slot) {
+                state.exhausted = true;
+                return Guard(nullptr);
+            }
+            state.domain = this;
+        }
+
+        if (state.depth++ == 0) {
+            /*
+            * Publish the epoch before reading any shard memory. The fence pairs with
+            * the one in safeEpoch(): either the reclaimer sees this slot, or this
+            * reader sees every unlink that preceded the reclaimer's scan.
+            */
+            state.slot->epoch.store(m_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        return Guard(this);
+    }
+
+    void EpochDomain::unpin() {
+        ThreadState& state {threadState()};
+        if (--state.depth == 0) {
+            state.slot->epoch.store(IDLE, std::memory_order_release);
+        }
+    }
+
+    uint64_t EpochDomain::retireStamp() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_epoch.load(std::memory_order_seq_cst);
+    }
+
+    uint64_t EpochDomain::safeEpoch() {
+        uint64_t oldest {m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1};
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        const size_t used {m_highWater.load(std::memory_order_acquire)};
+        for (size_t i {0}; i < used; ++i) {
+            const uint64_t epoch {m_slots[i].epoch.load(std::memory_order_acquire)};
+            if (epoch != IDLE) {
+                oldest = std::min(oldest, epoch);
+            }
+        }
+        return oldest;
+    }
+
+    void EpochDomain::synchronize() {
+        const uint64_t stamp {retireStamp()};
+        while (safeEpoch() <= stamp) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    EpochDomain::Slot* EpochDomain::claimSlot() {
+        for (size_t i {0}; i < MAX_READERS; ++i) {
+            bool expected {false};
+            if (!m_slots[i].owned.load(std::memory_order_relaxed)
+                && m_slots[i].owned.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                size_t highWater {m_highWater.load(std::memory_order_relaxed)};
+                while (highWater < i + 1
+                       && !m_highWater.compare_exchange_weak(highWater, i + 1, std::memory_order_acq_rel)) {
+                }
+                return &m_slots[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void EpochDomain::releaseSlot(Slot* slot) {
+        slot->epoch.store(IDLE, std::memory_order_release);
+        slot->owned.store(false, std::memory_order_release);
+    }
+}
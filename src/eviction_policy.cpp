@@ -0,0 +1,394 @@
+#include "eviction_policy.h"
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <thread>
+
+namespace streamcache {
+
+    std::optional<EvictionPolicy> parseEvictionPolicy(const std::string& name) {
+        std::string lower {name};
+        std::transform(lower.begin(), lower.end(), lower.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+        if (lower == "lru") {
+            return EvictionPolicy::LRU;
+        }
+        if (lower == "lfu") {
+            return EvictionPolicy::LFU;
+        }
+        if (lower == "wtinylfu" || lower == "w-tinylfu") {
+            return EvictionPolicy::WTINYLFU;
+        }
+        return std::nullopt;
+    }
+
+    const char* evictionPolicyName(EvictionPolicy policy) {
+        switch (policy) {
+            case EvictionPolicy::LRU: return "lru";
+            case EvictionPolicy::LFU: return "lfu";
+            case EvictionPolicy::WTINYLFU: return "wtinylfu";
+        }
+        return "?";
+    }
+
+    void PolicyList::pushFront(PolicyNode& node, uint8_t id) {
+        node.prev = nullptr;
+        node.next = m_head;
+        if (m_head) {
+            m_head->prev = &node;
+        } else {
+            m_tail = &node;
+        }
+        m_head = &node;
+        node.list = id;
+        ++m_size;
+    }
+
+    void PolicyList::remove(PolicyNode& node) {
+        if (node.prev) {
+            node.prev->next = node.next;
+        } else {
+            m_head = node.next;
+        }
+        if (node.next) {
+            node.next->prev = node.prev;
+        } else {
+            m_tail = node.prev;
+        }
+        node.prev = nullptr;
+        node.next = nullptr;
+        node.list = PolicyNode::UNLINKED;
+        --m_size;
+    }
+
+    void PolicyList::moveToFront(PolicyNode& node) {
+        const uint8_t id {node.list};
+        remove(node);
+        pushFront(node, id);
+    }
+
+    void CountMinSketch::ensureCapacity(size_t entries) {
+        if (entries <= m_width) {
+            return;
+        }
+
+        size_t width {std::max<size_t>(m_width, 1024)};
+        while (width < entries) {
+            width *= 2;
+        }
+
+        m_width = width;
+        m_table.assign(ROWS * width / 16, 0);
+        m_additions = 0;
+        m_sampleSize = 10 * width;
+    }
+
+    size_t CountMinSketch::indexOf(uint64_t hash, size_t row) const {
+        // One multiply per row gives four (nearly) independent hash functions.
+        static constexpr uint64_t SEEDS[ROWS] {
+            0x97CB3127ull, 0xB8F54E2Dull, 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full
+        };
+        uint64_t h {(hash + SEEDS[row]) * SEEDS[(row + 1) % ROWS]};
+        h ^= h >> 32;
+        return row * m_width + static_cast<size_t>(h & (m_width - 1));
+    }
+
+    void CountMinSketch::increment(uint64_t hash) {
+        if (m_width == 0) {
+            return;
+        }
+
+        bool added {false};
+        for (size_t row {0}; row < ROWS; ++row) {
+            const size_t counter {indexOf(hash, row)};
+            uint64_t& word {m_table[counter / 16]};
+            const unsigned shift {static_cast<unsigned>((counter % 16) * 4)};
+            if (((word >> shift) & 0xF) != 0xF) {
+                word += uint64_t{1} << shift;
+                added = true;
+            }
+        }
+
+        if (added && ++m_additions >= m_sampleSize) {
+            halve();
+        }
+    }
+
+    uint32_t CountMinSketch::estimate(uint64_t hash) const {
+        if (m_width == 0) {
+            return 0;
+        }
+
+        uint32_t result {0xF};
+        for (size_t row {0}; row < ROWS; ++row) {
+            const size_t counter {indexOf(hash, row)};
+            const unsigned shift {static_cast<unsigned>((counter % 16) * 4)};
+            result = std::min(result, static_cast<uint32_t>((m_table[counter / 16] >> shift) & 0xF));
+        }
+        return result;
+    }
+
+    void CountMinSketch::halve() {
+        for (auto& word : m_table) {
+            word = (word >> 1) & 0x7777777777777777ull;
+        }
+        m_additions /= 2;
+    }
+
+    namespace {
+
+        /*
+        * Classic LRU: one list, accessed records move to the front, the back is evicted.
+        */
+        class LruPolicy : public ReplacementPolicy {
+            public:
+                void onInsert(PolicyNode& node) override {
+                    m_list.pushFront(node, 0);
+                }
+
+                void onAccess(PolicyNode& node) override {
+                    m_list.moveToFront(node);
+                }
+
+                void onRemove(PolicyNode& node) override {
+                    m_list.remove(node);
+                }
+
+                PolicyNode* victim(const PolicyNode* keep) override {
+                    PolicyNode* node {m_list.back()};
+                    return node == keep ? node->prev : node;
+                }
+
+            private:
+                PolicyList m_list {};
+        };
+
+        /*
+        * O(1) LFU: one LRU-ordered list per counter value. A hit moves the record
+        * up one list; the victim is the least recent record of the lowest
+        * non-empty list. Counters saturate at 255.
+        */
+        class LfuPolicy : public ReplacementPolicy {
+            public:
+                void onInsert(PolicyNode& node) override {
+                    node.frequency = 1;
+                    m_lists[1].pushFront(node, 0);
+                    m_lowest = std::min<size_t>(m_lowest, 1);
+                }
+
+                void onAccess(PolicyNode& node) override {
+                    if (node.frequency == LEVELS - 1) {
+                        m_lists[node.frequency].moveToFront(node);
+                        return;
+                    }
+                    m_lists[node.frequency].remove(node);
+                    ++node.frequency;
+                    m_lists[node.frequency].pushFront(node, 0);
+                }
+
+                void onRemove(PolicyNode& node) override {
+                    m_lists[node.frequency].remove(node);
+                }
+
+                uint8_t frequencyOf(const PolicyNode& node) const override {
+                    return node.frequency;
+                }
+
+                void onAdopt(PolicyNode& node, uint8_t frequency) override {
+                    node.frequency = std::max<uint8_t>(frequency, 1);
+                    m_lists[node.frequency].pushFront(node, 0);
+                    m_lowest = std::min<size_t>(m_lowest, node.frequency);
+                }
+
+                PolicyNode* victim(const PolicyNode* keep) override {
+                    while (m_lowest < LEVELS && m_lists[m_lowest].empty()) {
+                        ++m_lowest;
+                    }
+
+                    for (size_t level {m_lowest}; level < LEVELS; ++level) {
+                        for (PolicyNode* node {m_lists[level].back()}; node; node = node->prev) {
+                            if (node != keep) {
+                                return node;
+                            }
+                        }
+                    }
+                    return nullptr;
+                }
+
+            private:
+                static constexpr size_t LEVELS = 256;
+
+                std::array<PolicyList, LEVELS> m_lists {};
+                size_t m_lowest {LEVELS};   // no non-empty list below this one
+        };
+
+        /*
+        * W-TinyLFU (Einziger, Friedman, Manes): new records enter a small LRU window;
+        * records leaving the window compete with the main area's LRU victim and
+        * only the one the count-min sketch has seen more often stays. The main area
+        * is a segmented LRU: probation, and protected for records hit again there.
+        */
+        class TinyLfuPolicy : public ReplacementPolicy {
+            public:
+                explicit TinyLfuPolicy(HashOf hashOf) : m_hashOf(hashOf) {
+                }
+
+                void onInsert(PolicyNode& node) override {
+                    m_sketch.ensureCapacity(size());
+                    m_sketch.increment(m_hashOf(node));
+                    m_window.pushFront(node, WINDOW);
+                }
+
+                void onAccess(PolicyNode& node) override {
+                    m_sketch.increment(m_hashOf(node));
+
+                    switch (node.list) {
+                        case WINDOW:
+                            m_window.moveToFront(node);
+                            break;
+                        case PROBATION:
+                            m_probation.remove(node);
+                            m_protected.pushFront(node, PROTECTED);
+                            while (m_protected.size() > protectedCapacity()) {
+                                PolicyNode& demoted {*m_protected.back()};
+                                m_protected.remove(demoted);
+                                m_probation.pushFront(demoted, PROBATION);
+                            }
+                            break;
+                        case PROTECTED:
+                            m_protected.moveToFront(node);
+                            break;
+                        default:
+                            break;
+                    }
+                }
+
+                void onRemove(PolicyNode& node) override {
+                    listFor(node.list).remove(node);
+                }
+
+                uint8_t frequencyOf(const PolicyNode& node) const override {
+                    return static_cast<uint8_t>(m_sketch.estimate(m_hashOf(node)));
+                }
+
+                /*
+                * A record with history skips the window: its sketch count is rebuilt
+                * and it competes in the main area like any record that was admitted.
+                */
+                void onAdopt(PolicyNode& node, uint8_t frequency) override {
+                    m_sketch.ensureCapacity(size());
+                    for (uint8_t i {0}; i < std::max<uint8_t>(frequency, 1); ++i) {
+                        m_sketch.increment(m_hashOf(node));
+                    }
+                    if (frequency > 1) {
+                        m_probation.pushFront(node, PROBATION);
+                    } else {
+                        m_window.pushFront(node, WINDOW);
+                    }
+                }
+
+                PolicyNode* victim(const PolicyNode* keep) override {
+                    /*
+                    * While the window is over its share, its LRU record is the candidate
+                    * and must win admission against the main area's victim.
+                    */
+                    if (m_window.size() > windowCapacity()) {
+                        PolicyNode* candidate {m_window.back()};
+                        PolicyNode* mainVictim {mainBack(keep)};
+
+                        if (candidate != keep && mainVictim) {
+                            if (m_sketch.estimate(m_hashOf(*candidate)) > m_sketch.estimate(m_hashOf(*mainVictim))) {
+                                m_window.remove(*candidate);
+                                m_probation.pushFront(*candidate, PROBATION);
+                                return mainVictim;
+                            }
+                            return candidate;
+                        }
+                    }
+
+                    if (PolicyNode* node {mainBack(keep)}) {
+                        return node;
+                    }
+                    for (PolicyNode* node {m_window.back()}; node; node = node->prev) {
+                        if (node != keep) {
+                            return node;
+                        }
+                    }
+                    return nullptr;
+                }
+
+            private:
+                static constexpr uint8_t WINDOW = 0;
+                static constexpr uint8_t PROBATION = 1;
+                static constexpr uint8_t PROTECTED = 2;
+
+                HashOf m_hashOf;
+                CountMinSketch m_sketch {};
+                PolicyList m_window {};
+                PolicyList m_probation {};
+                PolicyList m_protected {};
+
+                size_t size() const { return m_window.size() + m_probation.size() + m_protected.size(); }
+
+                // 1% of the records form the window, 80% of the main area is protected.
+                size_t windowCapacity() const { return std::max<size_t>(1, size() / 100); }
+                size_t protectedCapacity() const { return (size() - m_window.size()) * 4 / 5; }
+
+                PolicyList& listFor(uint8_t id) {
+                    return id == WINDOW ? m_window : id == PROBATION ? m_probation : m_protected;
+                }
+
+                PolicyNode* mainBack(const PolicyNode* keep) const {
+                    for (const PolicyList* list : {&m_probation, &m_protected}) {
+                        for (PolicyNode* node {list->back()}; node; node = node->prev) {
+                            if (node != keep) {
+                                return node;
+                            }
+                        }
+                    }
+                    return nullptr;
+                }
+        };
+    }
+
+    std::unique_ptr<ReplacementPolicy> ReplacementPolicy::create(EvictionPolicy policy, HashOf hashOf) {
+        switch (policy) {
+            case EvictionPolicy::LRU:
+                return std::make_unique<LruPolicy>();
+            case EvictionPolicy::LFU:
+                return std::make_unique<LfuPolicy>();
+            case EvictionPolicy::WTINYLFU:
+                return std::make_unique<TinyLfuPolicy>(hashOf);
+        }
+        return nullptr;
+    }
+
+    void AccessBuffer::record(uint64_t hash) {
+        static thread_local const size_t stripe {std::hash<std::thread::id>{}(std::this_thread::get_id()) % STRIPES};
+
+        Stripe& s {m_stripes[stripe]};
+        const size_t write {s.writes.fetch_add(1, std::memory_order_relaxed)};
+        s.slots[write % SLOTS].store(hash, std::memory_order_relaxed);
+    }
+
+    void AccessBuffer::drain(ReplacementPolicy& policy, const std::function<PolicyNode*(uint64_t)>& resolve) {
+        for (Stripe& s : m_stripes) {
+            /*
+            * The last min(SLOTS, new writes) slots hold the accesses not yet drained;
+            * anything older was overwritten and is dropped. A reader that has
+            * claimed a slot but not stored into it yet leaves an older hash there,
+            * which is harmless.
+            */
+            const size_t writes {s.writes.load(std::memory_order_relaxed)};
+            const size_t first {std::max(s.drained, writes >= SLOTS ? writes - SLOTS : 0)};
+
+            for (size_t i {first}; i < writes; ++i) {
+                if (PolicyNode* node {resolve(s.slots[i % SLOTS].load(std::memory_order_relaxed))}) {
+                    policy.onAccess(*node);
+                }
+            }
+            s.drained = writes;
+        }
+    }
+}
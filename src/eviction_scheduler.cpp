@@ -0,0 +1,166 @@
+#include "eviction_scheduler.h"
+#include "shard.h"
+#include <algorithm>
+#include <cassert>
+
+namespace streamcache {
+
+    EvictionScheduler::EvictionScheduler(size_t workers)
+        : m_workerCount(std::max<size_t>(1, workers)) {
+    }
+
+    EvictionScheduler::~EvictionScheduler() {
+        stop();
+    }
+
+    void EvictionScheduler::attach(Shard& shard) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const size_t index {m_shards.size()};
+        ShardState state {};
+        state.shard = &shard;
+        state.nextPrune = std::chrono::steady_clock::now() + PRUNE_INTERVAL;
+        m_shards.push_back(state);
+        scheduleLocked(index, state.nextPrune);
+
+        shard.setNotifyWakeup([this, index](Timestamp deadline) {
+            notify(index, deadline);
+        });
+    }
+
+    void EvictionScheduler::start() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        assert(m_workers.empty());
+
+        m_running = true;
+        for (size_t i {0}; i < m_workerCount; ++i) {
+            m_workers.emplace_back(&EvictionScheduler::runWorker, this);
+        }
+    }
+
+    void EvictionScheduler::stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_running) {
+                return;
+            }
+            m_running = false;
+        }
+
+        m_cv.notify_all();
+
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+        m_workers.clear();
+    }
+
+    size_t EvictionScheduler::queueSize() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_queue.size();
+    }
+
+    void EvictionScheduler::notify(size_t index, Timestamp deadline) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        ShardState& state {m_shards[index]};
+        if (state.claimed) {
+            // The worker holding the shard picks this up when it re-arms it.
+            if (!state.deferred || deadline < *state.deferred) {
+                state.deferred = deadline;
+            }
+            return;
+        }
+
+        scheduleLocked(index, deadline);
+    }
+
+    void EvictionScheduler::scheduleLocked(size_t index, Timestamp deadline) {
+        ShardState& state {m_shards[index]};
+        if (state.scheduled && *state.scheduled <= deadline) {
+            return;
+        }
+
+        /*
+        * The shard's previous, later entry stays in the heap and is skipped as
+        * stale when it surfaces, because it no longer matches state.scheduled.
+        */
+        const bool newHead {m_queue.empty() || deadline < m_queue.top().first};
+        state.scheduled = deadline;
+        m_queue.push({deadline, index});
+
+        if (newHead) {
+            m_cv.notify_one();
+        }
+    }
+
+    void EvictionScheduler::runWorker() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (m_running) {
+            while (!m_queue.empty()) {
+                const auto& [deadline, index] {m_queue.top()};
+                const ShardState& state {m_shards[index]};
+                if (state.scheduled && *state.scheduled == deadline) {
+                    break;
+                }
+                m_queue.pop();
+            }
+
+            if (m_queue.empty()) {
+                m_cv.wait(lock);
+                continue;
+            }
+
+            const Timestamp deadline {m_queue.top().first};
+            if (std::chrono::steady_clock::now() < deadline) {
+                m_cv.wait_until(lock, deadline);
+                continue;
+            }
+
+            const size_t index {m_queue.top().second};
+            m_queue.pop();
+
+            ShardState& state {m_shards[index]};
+            state.scheduled.reset();
+            state.claimed = true;
+            Shard& shard {*state.shard};
+
+            lock.unlock();
+
+            /*
+            * Evict in bounded slices; the shard lock is released between them so
+            * readers and writers are never stalled behind a large expiry burst.
+            */
+            const auto now {std::chrono::steady_clock::now()};
+            while (shard.evictExpired(now)) {
+            }
+
+            // nextPrune is only touched by the worker that has the shard claimed.
+            if (now >= state.nextPrune) {
+                const auto pruneStart {std::chrono::steady_clock::now()};
+                bool unfinished {true};
+                while (unfinished && std::chrono::steady_clock::now() - pruneStart < PRUNE_BUDGET) {
+                    unfinished = shard.pruneLogs(now - LOG_RETENTION);
+                }
+                state.nextPrune = unfinished ? now : now + PRUNE_INTERVAL;
+            }
+
+            const std::optional<Timestamp> nextExpiry {shard.peekNextExpiry()};
+
+            lock.lock();
+
+            Timestamp next {state.nextPrune};
+            if (nextExpiry) {
+                next = std::min(next, *nextExpiry);
+            }
+            if (state.deferred) {
+                next = std::min(next, *state.deferred);
+            }
+
+            state.claimed = false;
+            state.deferred.reset();
+            scheduleLocked(index, next);
+        }
+    }
+}
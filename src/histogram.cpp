@@ -0,0 +1,97 @@
+#include "histogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace streamcache {
+
+    size_t LatencyHistogram::bucketFor(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+
+        const size_t exponent {static_cast<size_t>(63 - __builtin_clzll(value))};
+        if (exponent > MAX_EXPONENT) {
+            return BUCKET_COUNT - 1;
+        }
+
+        // The top SUB_BUCKET_BITS bits below the leading one pick the linear sub-bucket.
+        const size_t sub {static_cast<size_t>(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1)};
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+    }
+
+    uint64_t LatencyHistogram::bucketUpperBound(size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+
+        const size_t exponent {bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1};
+        const uint64_t sub {bucket % SUB_BUCKETS};
+        const uint64_t width {uint64_t{1} << (exponent - SUB_BUCKET_BITS)};
+
+        return (uint64_t{1} << exponent) + (sub + 1) * width - 1;
+    }
+
+    void LatencyHistogram::record(uint64_t value) {
+        m_counts[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t currentMax {m_max.load(std::memory_order_relaxed)};
+        while (value > currentMax
+               && !m_max.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    HistogramSnapshot LatencyHistogram::snapshot() const {
+        HistogramSnapshot snap {};
+        snap.counts.resize(BUCKET_COUNT);
+
+        for (size_t i {0}; i < BUCKET_COUNT; ++i) {
+            snap.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+            snap.total += snap.counts[i];
+        }
+        snap.sum = m_sum.load(std::memory_order_relaxed);
+        snap.max = m_max.load(std::memory_order_relaxed);
+
+        return snap;
+    }
+
+    void LatencyHistogram::reset() {
+        for (auto& count : m_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        m_sum.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+    void HistogramSnapshot::merge(const HistogramSnapshot& other) {
+        if (counts.size() < other.counts.size()) {
+            counts.resize(other.counts.size());
+        }
+
+        for (size_t i {0}; i < other.counts.size(); ++i) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        max = std::max(max, other.max);
+    }
+
+    uint64_t HistogramSnapshot::percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+
+        const auto rank {static_cast<uint64_t>(std::ceil(p / 100.0 * static_cast<double>(total)))};
+        const uint64_t target {std::max<uint64_t>(1, rank)};
+
+        uint64_t seen {0};
+        for (size_t i {0}; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= target) {
+                return std::min(LatencyHistogram::bucketUpperBound(i), max);
+            }
+        }
+
+        return max;
+    }
+}
@@ -0,0 +1,218 @@
+#include "log_block.h"
+#include "number_util.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace streamcache {
+
+    namespace {
+        size_t varintBytes(uint64_t v) {
+            size_t bytes {1};
+            while (v >= 0x80) {
+                v >>= 7;
+                ++bytes;
+            }
+            return bytes;
+        }
+
+        uint64_t zigzag(int64_t v) {
+            return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+        }
+
+        size_t sharedPrefix(std::string_view a, std::string_view b) {
+            const size_t n {std::min(a.size(), b.size())};
+            size_t i {0};
+            while (i < n && a[i] == b[i]) {
+                ++i;
+            }
+            return i;
+        }
+
+        /*
+        * Length of the common suffix of a and b that does not overlap the first
+        * `prefix` bytes of either.
+        */
+        size_t sharedSuffix(std::string_view a, std::string_view b, size_t prefix) {
+            const size_t n {std::min(a.size(), b.size()) - prefix};
+            size_t i {0};
+            while (i < n && a[a.size() - 1 - i] == b[b.size() - 1 - i]) {
+                ++i;
+            }
+            return i;
+        }
+
+        /*
+        * Counts the leading records whose timestamp satisfies `before`, reading
+        * only the timestamps section.
+        */
+        template <typename Before>
+        size_t countWhile(const LogBlock& block, Before before) {
+            util::ByteReader times {{block.data(), block.timesBytes}};
+            LogBlock::Timestamp t {block.first};
+            for (size_t i {0}; i < block.count; ++i) {
+                uint64_t delta {0};
+                if (i > 0 && times.readVarint(delta)) {
+                    t += std::chrono::steady_clock::duration(static_cast<int64_t>(delta));
+                }
+                if (!before(t)) {
+                    return i;
+                }
+            }
+            return block.count;
+        }
+    }
+
+    size_t LogBlock::lowerBound(Timestamp t) const {
+        return countWhile(*this, [t](Timestamp record) { return record < t; });
+    }
+
+    size_t LogBlock::upperBound(Timestamp t) const {
+        return countWhile(*this, [t](Timestamp record) { return !(t < record); });
+    }
+
+    void LogBlock::destroy(LogBlock* block, SlabAllocator& slab) {
+        const size_t bytes {block->allocationBytes()};
+        block->~LogBlock();
+        slab.deallocate(block, bytes);
+    }
+
+    void LogBlock::Builder::add(Timestamp timestamp, std::string_view value) {
+        if (m_count == 0) {
+            m_first = timestamp;
+        } else {
+            util::appendVarint(m_times, static_cast<uint64_t>((timestamp - m_last).count()));
+        }
+        m_last = timestamp;
+
+        /*
+        * Pick the earlier value that leaves the fewest bytes to spell out. Slots
+        * not filled yet are empty, which the reader's window mirrors.
+        */
+        size_t bestReference {0};
+        size_t bestPrefix {0};
+        size_t bestSuffix {0};
+        const size_t candidates {std::max<size_t>(1, std::min<size_t>(m_count, REFERENCE_WINDOW))};
+        for (size_t back {0}; back < candidates; ++back) {
+            const std::string_view reference {m_window[(m_count + REFERENCE_WINDOW - 1 - back) % REFERENCE_WINDOW]};
+            const size_t prefix {sharedPrefix(value, reference)};
+            const size_t suffix {sharedSuffix(value, reference, prefix)};
+            if (prefix + suffix > bestPrefix + bestSuffix) {
+                bestReference = back;
+                bestPrefix = prefix;
+                bestSuffix = suffix;
+                if (prefix + suffix == value.size() && value.size() == reference.size()) {
+                    break;
+                }
+            }
+        }
+
+        const std::string_view literal {value.substr(bestPrefix, value.size() - bestPrefix - bestSuffix)};
+
+        // A counter's step is usually smaller as a number than as differing digits.
+        int64_t number {0};
+        int64_t previous {0};
+        int64_t delta {0};
+        if (m_count > 0 && util::parseInteger(value, number)
+            && util::parseInteger(m_window[(m_count - 1) % REFERENCE_WINDOW], previous)
+            && !__builtin_sub_overflow(number, previous, &delta)
+            && 1 + varintBytes(zigzag(delta)) < varintBytes(bestReference) + varintBytes(bestPrefix)
+                + varintBytes(bestSuffix) + varintBytes(literal.size()) + literal.size()) {
+            util::appendVarint(m_values, NUMERIC_DELTA);
+            util::appendSignedVarint(m_values, delta);
+        } else {
+            util::appendVarint(m_values, bestReference);
+            util::appendVarint(m_values, bestPrefix);
+            util::appendVarint(m_values, bestSuffix);
+            util::appendLengthPrefixed(m_values, literal);
+        }
+
+        m_window[m_count % REFERENCE_WINDOW] = value;
+        ++m_count;
+    }
+
+    LogBlock* LogBlock::Builder::build(SlabAllocator& slab) {
+        void* mem {slab.allocate(sizeof(LogBlock) + m_times.size() + m_values.size())};
+        auto* block {new (mem) LogBlock()};
+        block->first = m_first;
+        block->last = m_last;
+        block->count = m_count;
+        block->timesBytes = static_cast<uint32_t>(m_times.size());
+        block->valuesBytes = static_cast<uint32_t>(m_values.size());
+
+        char* data {reinterpret_cast<char*>(block + 1)};
+        std::memcpy(data, m_times.data(), m_times.size());
+        std::memcpy(data + m_times.size(), m_values.data(), m_values.size());
+
+        *this = Builder();
+        return block;
+    }
+
+    LogBlock::Reader::Reader(const LogBlock& block)
+        : m_times{{block.data(), block.timesBytes}},
+          m_values{{block.data() + block.timesBytes, block.valuesBytes}},
+          m_timestamp(block.first),
+          m_remaining(block.count) {
+    }
+
+    bool LogBlock::Reader::next(Timestamp& timestamp, std::string_view& value) {
+        if (m_remaining == 0) {
+            return false;
+        }
+
+        uint64_t delta {0};
+        if (m_index > 0 && m_times.readVarint(delta)) {
+            m_timestamp += std::chrono::steady_clock::duration(static_cast<int64_t>(delta));
+        }
+
+        uint64_t back {0};
+        if (!m_values.readVarint(back) || !decodeValue(back)) {
+            m_remaining = 0;
+            return false;
+        }
+
+        std::string& slot {m_window[m_index % REFERENCE_WINDOW]};
+        std::swap(slot, m_scratch);
+        ++m_index;
+        --m_remaining;
+
+        timestamp = m_timestamp;
+        value = slot;
+        return true;
+    }
+
+    bool LogBlock::Reader::decodeValue(uint64_t back) {
+        if (back == NUMERIC_DELTA) {
+            int64_t delta {0};
+            int64_t previous {0};
+            int64_t number {0};
+            if (m_index == 0 || !m_values.readSignedVarint(delta)
+                || !util::parseInteger(m_window[(m_index - 1) % REFERENCE_WINDOW], previous)
+                || __builtin_add_overflow(previous, delta, &number)) {
+                return false;
+            }
+            m_scratch = util::formatInteger(number);
+            return true;
+        }
+
+        uint64_t prefix {0};
+        uint64_t suffix {0};
+        std::string_view literal {};
+        if (!m_values.readVarint(prefix) || !m_values.readVarint(suffix)
+            || !m_values.readLengthPrefixed(literal) || back >= REFERENCE_WINDOW) {
+            return false;
+        }
+
+        const std::string& reference {m_window[(m_index + REFERENCE_WINDOW - 1 - back) % REFERENCE_WINDOW]};
+        if (prefix + suffix > reference.size()) {
+            return false;
+        }
+
+        // Built aside first: the slot it goes to may be the reference itself.
+        m_scratch.assign(reference, 0, prefix);
+        m_scratch.append(literal);
+        m_scratch.append(reference, reference.size() - suffix, suffix);
+        return true;
+    }
+}
@@ -0,0 +1,356 @@
+#include "log_ring.h"
+#include <algorithm>
+#include <new>
+#include <utility>
+
+namespace streamcache {
+
+    LogRing::~LogRing() {
+        clear();
+    }
+
+    void LogRing::pushBack(LogRecord record, size_t maxRecords) {
+        maxRecords = std::max<size_t>(maxRecords, 1);
+        while (size() >= maxRecords) {
+            popOldest();
+        }
+
+        growIfFull();
+        emplaceBack(std::move(record));
+    }
+
+    void LogRing::insert(LogRecord record, size_t maxRecords) {
+        maxRecords = std::max<size_t>(maxRecords, 1);
+        if (m_sealed && !(m_sealed->blocks.back()->last < record.timestamp)) {
+            unseal();
+        }
+        size_t pos {upperBound(record.timestamp)};
+
+        // The same write can arrive twice: from a snapshot taken while writes went on, then from the AOF.
+        for (size_t i {pos}; i > 0 && (*this)[i - 1].timestamp == record.timestamp; --i) {
+            if ((*this)[i - 1].value.view() == record.value.view()) {
+                return;
+            }
+        }
+
+        while (size() >= maxRecords) {
+            // Sealed records are all older than this one.
+            if (m_sealed) {
+                retireSealed(1);
+                continue;
+            }
+            // Older than everything in a full ring: it would be the record retired.
+            if (pos == 0) {
+                return;
+            }
+            popFront();
+            --pos;
+        }
+
+        growIfFull();
+        if (pos == m_size) {
+            emplaceBack(std::move(record));
+            return;
+        }
+
+        // Shift the newer records back by one; recovery is the only out-of-order writer.
+        const size_t bytes {record.value.size()};
+        new (&at(m_size)) LogRecord(std::move(at(m_size - 1)));
+        for (size_t i {m_size - 1}; i > pos; --i) {
+            at(i) = std::move(at(i - 1));
+        }
+        at(pos) = std::move(record);
+        ++m_size;
+        ++m_stats->records;
+        m_stats->bytes += bytes;
+    }
+
+    size_t LogRing::truncateBefore(Timestamp cutoff) {
+        size_t sealedRemoved {0};
+        while (m_sealed) {
+            const LogBlock& front {*m_sealed->blocks.front()};
+            const size_t older {front.last < cutoff ? front.count : front.lowerBound(cutoff)};
+            if (older <= m_sealed->skip) {
+                // The ring only holds newer records.
+                return sealedRemoved;
+            }
+            sealedRemoved += older - m_sealed->skip;
+            retireSealed(older - m_sealed->skip);
+        }
+
+        const size_t removed {lowerBound(cutoff)};
+        if (removed == 0) {
+            return sealedRemoved;
+        }
+
+        if (removed == m_size) {
+            clear();
+            return sealedRemoved + removed;
+        }
+
+        for (size_t i {0}; i < removed; ++i) {
+            popFront();
+        }
+
+        shrinkIfSparse();
+        return sealedRemoved + removed;
+    }
+
+    size_t LogRing::seal() {
+        size_t sealed {0};
+        while (m_size >= HOT_RECORDS + BLOCK_RECORDS) {
+            LogBlock::Builder builder {};
+            for (size_t i {0}; i < BLOCK_RECORDS; ++i) {
+                builder.add((*this)[i].timestamp, (*this)[i].value.view());
+            }
+            LogBlock* block {builder.build(*m_slab)};
+
+            for (size_t i {0}; i < BLOCK_RECORDS; ++i) {
+                popFront();
+            }
+            if (!m_sealed) {
+                m_sealed = new (m_slab->allocate(sizeof(Sealed))) Sealed(*m_slab);
+            }
+            m_sealed->blocks.push_back(block);
+            m_sealed->size += BLOCK_RECORDS;
+
+            m_stats->records += BLOCK_RECORDS;
+            m_stats->sealedRecords += BLOCK_RECORDS;
+            m_stats->bytes += block->allocationBytes();
+            m_stats->sealedBytes += block->allocationBytes();
+            sealed += BLOCK_RECORDS;
+        }
+
+        if (sealed > 0) {
+            shrinkIfSparse();
+        }
+        return sealed;
+    }
+
+    void LogRing::clear() {
+        releaseSealed();
+        while (m_size > 0) {
+            popFront();
+        }
+        if (m_records) {
+            m_slab->deallocate(m_records, m_capacity * sizeof(LogRecord));
+            m_stats->bytes -= m_capacity * sizeof(LogRecord);
+            m_records = nullptr;
+        }
+        m_capacity = 0;
+        m_head = 0;
+    }
+
+    void LogRing::forEach(Timestamp from, Timestamp to, size_t limit,
+                          const std::function<void(const LogRecordView&)>& visit) const {
+        if (limit == 0 || to < from) {
+            return;
+        }
+
+        if (m_sealed) {
+            const auto& blocks {m_sealed->blocks};
+            auto it {std::partition_point(blocks.begin(), blocks.end(), [from](const LogBlock* block) {
+                return block->last < from;
+            })};
+
+            for (; it != blocks.end() && !(to < (*it)->first); ++it) {
+                const size_t skip {it == blocks.begin() ? m_sealed->skip : 0};
+                LogBlock::Reader reader(**it);
+                Timestamp timestamp {};
+                std::string_view value {};
+                for (size_t i {0}; reader.next(timestamp, value); ++i) {
+                    if (i < skip || timestamp < from) {
+                        continue;
+                    }
+                    if (to < timestamp) {
+                        return;
+                    }
+                    visit({timestamp, value, nullptr});
+                    if (--limit == 0) {
+                        return;
+                    }
+                }
+            }
+        }
+
+        for (size_t i {lowerBound(from)}; i < m_size && !(to < (*this)[i].timestamp); ++i) {
+            const LogRecord& record {(*this)[i]};
+            visit({record.timestamp, record.value.view(), &record.value});
+            if (--limit == 0) {
+                return;
+            }
+        }
+    }
+
+    std::optional<ValueRef> LogRing::valueAt(Timestamp at) const {
+        const size_t newer {upperBound(at)};
+        if (newer > 0) {
+            return ValueRef((*this)[newer - 1].value);
+        }
+        if (!m_sealed) {
+            return std::nullopt;
+        }
+
+        // The last block that starts at or before `at` holds the record, if any is retained.
+        const auto& blocks {m_sealed->blocks};
+        auto it {std::partition_point(blocks.begin(), blocks.end(), [at](const LogBlock* block) {
+            return !(at < block->first);
+        })};
+        if (it == blocks.begin()) {
+            return std::nullopt;
+        }
+        --it;
+
+        const size_t index {(*it)->upperBound(at) - 1};
+        if (it == blocks.begin() && index < m_sealed->skip) {
+            return std::nullopt;
+        }
+
+        LogBlock::Reader reader(**it);
+        Timestamp timestamp {};
+        std::string_view value {};
+        for (size_t i {0}; i <= index; ++i) {
+            reader.next(timestamp, value);
+        }
+        return ValueRef::copyOf(value);
+    }
+
+    size_t LogRing::lowerBound(Timestamp t) const {
+        size_t low {0};
+        size_t high {m_size};
+        while (low < high) {
+            const size_t mid {low + (high - low) / 2};
+            if ((*this)[mid].timestamp < t) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    size_t LogRing::upperBound(Timestamp t) const {
+        size_t low {0};
+        size_t high {m_size};
+        while (low < high) {
+            const size_t mid {low + (high - low) / 2};
+            if (t < (*this)[mid].timestamp) {
+                high = mid;
+            } else {
+                low = mid + 1;
+            }
+        }
+        return low;
+    }
+
+    void LogRing::emplaceBack(LogRecord record) {
+        m_stats->bytes += record.value.size();
+        ++m_stats->records;
+        new (&at(m_size)) LogRecord(std::move(record));
+        ++m_size;
+    }
+
+    void LogRing::popFront() {
+        --m_stats->records;
+        m_stats->bytes -= at(0).value.size();
+        at(0).~LogRecord();
+        m_head = (m_head + 1) & (m_capacity - 1);
+        --m_size;
+    }
+
+    void LogRing::popOldest() {
+        if (m_sealed) {
+            retireSealed(1);
+        } else {
+            popFront();
+        }
+    }
+
+    void LogRing::retireSealed(size_t n) {
+        Sealed& sealed {*m_sealed};
+        sealed.skip += n;
+        sealed.size -= n;
+        m_stats->records -= n;
+        m_stats->sealedRecords -= n;
+
+        LogBlock* front {sealed.blocks.front()};
+        if (sealed.skip < front->count) {
+            return;
+        }
+
+        m_stats->bytes -= front->allocationBytes();
+        m_stats->sealedBytes -= front->allocationBytes();
+        LogBlock::destroy(front, *m_slab);
+        sealed.blocks.erase(sealed.blocks.begin());
+        sealed.skip = 0;
+
+        if (sealed.blocks.empty()) {
+            releaseSealed();
+        }
+    }
+
+    void LogRing::releaseSealed() {
+        if (!m_sealed) {
+            return;
+        }
+
+        m_stats->records -= m_sealed->size;
+        m_stats->sealedRecords -= m_sealed->size;
+        for (LogBlock* block : m_sealed->blocks) {
+            m_stats->bytes -= block->allocationBytes();
+            m_stats->sealedBytes -= block->allocationBytes();
+            LogBlock::destroy(block, *m_slab);
+        }
+
+        m_sealed->~Sealed();
+        m_slab->deallocate(m_sealed, sizeof(Sealed));
+        m_sealed = nullptr;
+    }
+
+    void LogRing::unseal() {
+        std::vector<LogRecord> records {};
+        records.reserve(size());
+        forEach([this, &records](const LogRecordView& record) {
+            records.push_back({record.timestamp, record.stored ? *record.stored : Value(record.value, *m_slab)});
+        });
+
+        clear();
+        for (LogRecord& record : records) {
+            growIfFull();
+            emplaceBack(std::move(record));
+        }
+    }
+
+    void LogRing::shrinkIfSparse() {
+        // Give memory back once the ring is at most a quarter full.
+        if (m_capacity >= 4 && m_size <= m_capacity / 4) {
+            size_t capacity {m_capacity};
+            while (capacity >= 4 && m_size <= capacity / 4) {
+                capacity /= 2;
+            }
+            reallocate(capacity);
+        }
+    }
+
+    void LogRing::growIfFull() {
+        if (m_size == m_capacity) {
+            reallocate(m_capacity == 0 ? 1 : size_t{m_capacity} * 2);
+        }
+    }
+
+    void LogRing::reallocate(size_t capacity) {
+        auto* records {static_cast<LogRecord*>(m_slab->allocate(capacity * sizeof(LogRecord)))};
+        for (size_t i {0}; i < m_size; ++i) {
+            new (&records[i]) LogRecord(std::move(at(i)));
+            at(i).~LogRecord();
+        }
+
+        if (m_records) {
+            m_slab->deallocate(m_records, m_capacity * sizeof(LogRecord));
+        }
+        m_stats->bytes = m_stats->bytes + capacity * sizeof(LogRecord) - m_capacity * sizeof(LogRecord);
+        m_records = records;
+        m_capacity = static_cast<uint32_t>(capacity);
+        m_head = 0;
+    }
+}
@@ -5,7 +5,6 @@
 #include "command_parser.h"
 #include "cache_builder.h"
 #include "cache.h"
-#include "eviction_thread.h"
 
 enum class Command {
     EXIT,
@@ -26,11 +25,28 @@ Command getCommand(const std::string& cmd) {
 /*
  * Core runtime REPL loop for the engine.
  */
-int main() {
+int main(int argc, char** argv) {
     /*
-    * Configure the cache with a fixed number of shards.
+    * One shard per hardware thread unless --shards says otherwise.
     */
-    streamcache::Cache cache(2);
+    size_t numShards {streamcache::Cache::defaultShardCount()};
+    for (int i {1}; i < argc; ++i) {
+        const std::string arg {argv[i]};
+        try {
+            if (arg == "--shards" && i + 1 < argc) {
+                numShards = std::stoul(argv[++i]);
+                if (numShards == 0 || numShards > streamcache::Cache::MAX_SHARDS) {
+                    throw std::out_of_range(arg);
+                }
+                continue;
+            }
+        } catch (const std::exception&) {
+        }
+        std::cout << "Usage: streamcache [--shards <n>]\n";
+        return arg == "--help" ? 0 : 1;
+    }
+
+    streamcache::Cache cache(numShards);
 
     while(true) {
         std::cout << "> " << std::flush;
@@ -65,11 +81,11 @@ int main() {
                 }
 
                 {
-                    auto value {cache.get(tokens[1])};
+                    auto value {cache.getRef(tokens[1])};
                     if (!value) {
                         std::cout << "Key not found.\n";
                     } else {
-                        std::cout << "Value: " << *value << "\n";
+                        std::cout << "Value: " << value->view() << "\n";
                     }
                 }
                 break;
@@ -0,0 +1,273 @@
+#include "metrics.h"
+#include <functional>
+#include <sstream>
+#include <thread>
+
+namespace streamcache {
+
+    namespace {
+        double seconds(std::chrono::steady_clock::duration d) {
+            return std::chrono::duration<double>(d).count();
+        }
+
+        double nanosToMicros(uint64_t ns) {
+            return static_cast<double>(ns) / 1e3;
+        }
+
+        /*
+        * One Prometheus summary: quantile samples, _sum and _count, in seconds.
+        */
+        void appendSummary(std::ostringstream& out, const std::string& name, const std::string& labels,
+                           const HistogramSnapshot& h) {
+            const std::string prefix {labels.empty() ? "{" : "{" + labels + ","};
+            for (double q : {0.5, 0.99, 0.999}) {
+                out << name << prefix << "quantile=\"" << q << "\"} "
+                    << static_cast<double>(h.percentile(q * 100.0)) / 1e9 << "\n";
+            }
+            out << name << "_sum{" << labels << "} " << static_cast<double>(h.sum) / 1e9 << "\n";
+            out << name << "_count{" << labels << "} " << h.total << "\n";
+        }
+
+        void appendHeader(std::ostringstream& out, const char* name, const char* type, const char* help) {
+            out << "# HELP " << name << " " << help << "\n";
+            out << "# TYPE " << name << " " << type << "\n";
+        }
+
+        /*
+        * count/p99 of a latency histogram for INFO, e.g. "12/3.20us".
+        */
+        std::string countAndP99(const HistogramSnapshot& h) {
+            std::ostringstream out;
+            out.setf(std::ios::fixed);
+            out.precision(2);
+            out << h.total << "/" << nanosToMicros(h.percentile(99)) << "us";
+            return out.str();
+        }
+    }
+
+    const char* metricOpName(MetricOp op) {
+        switch (op) {
+            case MetricOp::GET: return "get";
+            case MetricOp::SET: return "set";
+            case MetricOp::MGET: return "mget";
+            case MetricOp::MSET: return "mset";
+            case MetricOp::REPLAY: return "replay";
+            case MetricOp::SCAN: return "scan";
+            case MetricOp::INCR: return "incr";
+            case MetricOp::ZADD: return "zadd";
+            case MetricOp::ZRANGE: return "zrange";
+            default: return "?";
+        }
+    }
+
+    uint64_t OpTotals::totalCalls() const {
+        uint64_t total {0};
+        for (uint64_t n : calls) {
+            total += n;
+        }
+        return total;
+    }
+
+    OpCounters::Stripe& OpCounters::stripe() {
+        static thread_local const size_t index {std::hash<std::thread::id>{}(std::this_thread::get_id()) % STRIPES};
+        return m_stripes[index];
+    }
+
+    OpTotals OpCounters::totals() const {
+        OpTotals totals {};
+        for (const Stripe& s : m_stripes) {
+            for (size_t i {0}; i < METRIC_OP_COUNT; ++i) {
+                totals.calls[i] += s.calls[i].load(std::memory_order_relaxed);
+            }
+            totals.hits += s.hits.load(std::memory_order_relaxed);
+            totals.misses += s.misses.load(std::memory_order_relaxed);
+        }
+        return totals;
+    }
+
+    std::string formatInfo(const CacheMetrics& metrics, const CacheMetrics* previous) {
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(2);
+
+        // Rates over the interval since the previous snapshot, or since startup.
+        const double interval {previous ? seconds(metrics.takenAt - previous->takenAt) : seconds(metrics.uptime)};
+        const auto rate {[&](uint64_t now, uint64_t before) {
+            return interval > 0.0 ? static_cast<double>(now - before) / interval : 0.0;
+        }};
+        const OpTotals before {previous ? previous->ops : OpTotals{}};
+
+        out << "# Server\r\n"
+            << "uptime_in_seconds:" << static_cast<uint64_t>(seconds(metrics.uptime)) << "\r\n"
+            << "execution_mode:" << (metrics.threadPerCore ? "thread-per-core" : "shared") << "\r\n"
+            << "shards:" << metrics.shards.size() << "\r\n";
+
+        out << "\r\n# Stats\r\n"
+            << "total_commands_processed:" << metrics.ops.totalCalls() << "\r\n"
+            << "instantaneous_ops_per_sec:" << rate(metrics.ops.totalCalls(), before.totalCalls()) << "\r\n";
+        for (size_t i {0}; i < METRIC_OP_COUNT; ++i) {
+            const char* name {metricOpName(static_cast<MetricOp>(i))};
+            out << "cmd_" << name << "_calls:" << metrics.ops.calls[i] << "\r\n"
+                << "cmd_" << name << "_ops_per_sec:" << rate(metrics.ops.calls[i], before.calls[i]) << "\r\n";
+        }
+
+        const uint64_t lookups {metrics.ops.hits + metrics.ops.misses};
+        out << "keyspace_hits:" << metrics.ops.hits << "\r\n"
+            << "keyspace_misses:" << metrics.ops.misses << "\r\n"
+            << "hit_ratio:" << (lookups ? static_cast<double>(metrics.ops.hits) / static_cast<double>(lookups) : 0.0) << "\r\n"
+            << "migrated_keys:" << metrics.migratedKeys << "\r\n"
+            << "eviction_queue_entries:" << metrics.evictionQueueEntries << "\r\n";
+
+        size_t keys {0};
+        size_t logRecords {0};
+        size_t logBytes {0};
+        size_t logSealedRecords {0};
+        size_t logSealedBytes {0};
+        MemoryStats memory {};
+        uint64_t memoryEvictions {0};
+        HistogramSnapshot evictionLag {};
+        HistogramSnapshot pruneTime {};
+        for (const ShardMetrics& shard : metrics.shards) {
+            keys += shard.keys;
+            logRecords += shard.logRecords;
+            logBytes += shard.logBytes;
+            logSealedRecords += shard.logSealedRecords;
+            logSealedBytes += shard.logSealedBytes;
+            memory.allocated += shard.memory.allocated;
+            memory.reserved += shard.memory.reserved;
+            memoryEvictions += shard.memoryEvictions;
+            evictionLag.merge(shard.evictionLag);
+            pruneTime.merge(shard.pruneTime);
+        }
+
+        out << "expired_keys:" << evictionLag.total << "\r\n"
+            << "evicted_keys:" << memoryEvictions << "\r\n"
+            << "eviction_lag_p50_us:" << nanosToMicros(evictionLag.percentile(50)) << "\r\n"
+            << "eviction_lag_p99_us:" << nanosToMicros(evictionLag.percentile(99)) << "\r\n"
+            << "log_prune_batches:" << pruneTime.total << "\r\n"
+            << "log_prune_time_ms:" << static_cast<double>(pruneTime.sum) / 1e6 << "\r\n";
+
+        out << "\r\n# Memory\r\n"
+            << "used_memory:" << memory.allocated << "\r\n"
+            << "reserved_memory:" << memory.reserved << "\r\n"
+            << "log_records:" << logRecords << "\r\n"
+            << "log_bytes:" << logBytes << "\r\n"
+            << "log_sealed_records:" << logSealedRecords << "\r\n"
+            << "log_sealed_bytes:" << logSealedBytes << "\r\n";
+
+        out << "\r\n# Keyspace\r\n"
+            << "keys:" << keys << "\r\n";
+
+        out << "\r\n# Changes\r\n"
+            << "change_subscribers:" << metrics.changes.subscribers << "\r\n"
+            << "change_events_published:" << metrics.changes.published << "\r\n"
+            << "change_events_lost:" << metrics.changes.lost << "\r\n"
+            << "change_max_lag:" << metrics.changes.maxLag << "\r\n";
+
+        // Lock waits are contended acquisitions as count/p99.
+        out << "\r\n# Shards\r\n";
+        for (size_t i {0}; i < metrics.shards.size(); ++i) {
+            const ShardMetrics& shard {metrics.shards[i]};
+            out << "shard" << i << ":keys=" << shard.keys
+                << ",expiry_timers=" << shard.expiryTimers
+                << ",log_records=" << shard.logRecords
+                << ",log_bytes=" << shard.logBytes
+                << ",log_sealed_records=" << shard.logSealedRecords
+                << ",used_memory=" << shard.memory.allocated
+                << ",expired=" << shard.evictionLag.total
+                << ",evicted=" << shard.memoryEvictions
+                << ",prune_time_ms=" << static_cast<double>(shard.pruneTime.sum) / 1e6
+                << ",lock_wait_exclusive=" << countAndP99(shard.exclusiveWaits)
+                << ",lock_wait_shared=" << countAndP99(shard.sharedWaits) << "\r\n";
+        }
+
+        return out.str();
+    }
+
+    std::string formatPrometheus(const CacheMetrics& metrics) {
+        std::ostringstream out;
+        out.precision(9);
+
+        appendHeader(out, "streamcache_uptime_seconds", "gauge", "Time since the cache was created.");
+        out << "streamcache_uptime_seconds " << seconds(metrics.uptime) << "\n";
+
+        appendHeader(out, "streamcache_commands_total", "counter", "Cache operations by command.");
+        for (size_t i {0}; i < METRIC_OP_COUNT; ++i) {
+            out << "streamcache_commands_total{cmd=\"" << metricOpName(static_cast<MetricOp>(i)) << "\"} "
+                << metrics.ops.calls[i] << "\n";
+        }
+
+        appendHeader(out, "streamcache_keyspace_hits_total", "counter", "Key lookups that found a live value.");
+        out << "streamcache_keyspace_hits_total " << metrics.ops.hits << "\n";
+        appendHeader(out, "streamcache_keyspace_misses_total", "counter", "Key lookups that found nothing.");
+        out << "streamcache_keyspace_misses_total " << metrics.ops.misses << "\n";
+
+        appendHeader(out, "streamcache_migrated_keys_total", "counter", "Records moved by resharding.");
+        out << "streamcache_migrated_keys_total " << metrics.migratedKeys << "\n";
+
+        appendHeader(out, "streamcache_eviction_queue_entries", "gauge",
+                     "Entries in the eviction scheduler's deadline heap, stale ones included.");
+        out << "streamcache_eviction_queue_entries " << metrics.evictionQueueEntries << "\n";
+
+        appendHeader(out, "streamcache_change_subscribers", "gauge", "Open change-stream subscriptions.");
+        out << "streamcache_change_subscribers " << metrics.changes.subscribers << "\n";
+        appendHeader(out, "streamcache_change_events_published_total", "counter", "Writes published to change-stream subscribers.");
+        out << "streamcache_change_events_published_total " << metrics.changes.published << "\n";
+        appendHeader(out, "streamcache_change_events_lost_total", "counter",
+                     "Change events overwritten before a subscriber read them, summed over subscribers.");
+        out << "streamcache_change_events_lost_total " << metrics.changes.lost << "\n";
+        appendHeader(out, "streamcache_change_max_lag", "gauge", "Change events the furthest-behind subscriber has yet to read.");
+        out << "streamcache_change_max_lag " << metrics.changes.maxLag << "\n";
+
+        /*
+        * Per-shard series, one metric family at a time as the format requires.
+        */
+        const auto perShard {[&](const char* name, const char* type, const char* help, auto value) {
+            appendHeader(out, name, type, help);
+            for (size_t i {0}; i < metrics.shards.size(); ++i) {
+                out << name << "{shard=\"" << i << "\"} " << value(metrics.shards[i]) << "\n";
+            }
+        }};
+
+        perShard("streamcache_keys", "gauge", "Keys stored in the shard.",
+                 [](const ShardMetrics& s) { return s.keys; });
+        perShard("streamcache_expiry_timers", "gauge", "Keys scheduled in the shard's expiry wheel.",
+                 [](const ShardMetrics& s) { return s.expiryTimers; });
+        perShard("streamcache_log_records", "gauge", "Log records retained by the shard.",
+                 [](const ShardMetrics& s) { return s.logRecords; });
+        perShard("streamcache_log_bytes", "gauge", "Bytes of log rings and the values they hold.",
+                 [](const ShardMetrics& s) { return s.logBytes; });
+        perShard("streamcache_log_sealed_records", "gauge", "Log records held in compressed blocks.",
+                 [](const ShardMetrics& s) { return s.logSealedRecords; });
+        perShard("streamcache_log_sealed_bytes", "gauge", "Bytes of compressed log blocks.",
+                 [](const ShardMetrics& s) { return s.logSealedBytes; });
+        perShard("streamcache_memory_allocated_bytes", "gauge", "Slab and index bytes in use.",
+                 [](const ShardMetrics& s) { return s.memory.allocated; });
+        perShard("streamcache_memory_reserved_bytes", "gauge", "Slab and index bytes obtained from the system.",
+                 [](const ShardMetrics& s) { return s.memory.reserved; });
+        perShard("streamcache_evicted_keys_total", "counter", "Keys evicted to stay within the memory limit.",
+                 [](const ShardMetrics& s) { return s.memoryEvictions; });
+        perShard("streamcache_expired_keys_total", "counter", "Expired keys removed.",
+                 [](const ShardMetrics& s) { return s.evictionLag.total; });
+
+        const auto perShardSummary {[&](const char* name, const char* help, HistogramSnapshot ShardMetrics::*member) {
+            appendHeader(out, name, "summary", help);
+            for (size_t i {0}; i < metrics.shards.size(); ++i) {
+                appendSummary(out, name, "shard=\"" + std::to_string(i) + "\"", metrics.shards[i].*member);
+            }
+        }};
+
+        perShardSummary("streamcache_eviction_lag_seconds", "Delay between a key's expiry and its removal.",
+                        &ShardMetrics::evictionLag);
+        perShardSummary("streamcache_log_prune_seconds", "Duration of log-pruning batches.", &ShardMetrics::pruneTime);
+
+        appendHeader(out, "streamcache_lock_wait_seconds", "summary", "Time contended shard lock acquisitions waited.");
+        for (size_t i {0}; i < metrics.shards.size(); ++i) {
+            const std::string shard {"shard=\"" + std::to_string(i) + "\""};
+            appendSummary(out, "streamcache_lock_wait_seconds", shard + ",mode=\"exclusive\"", metrics.shards[i].exclusiveWaits);
+            appendSummary(out, "streamcache_lock_wait_seconds", shard + ",mode=\"shared\"", metrics.shards[i].sharedWaits);
+        }
+
+        return out.str();
+    }
+}
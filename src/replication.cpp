@@ -0,0 +1,389 @@
+#include "replication.h"
+#include "aof.h"
+#include "resp.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace streamcache {
+
+    namespace {
+        const size_t READ_CHUNK = 64 * 1024;
+        const std::string_view FULLRESYNC {"+FULLRESYNC "};
+
+        int64_t ticksNow() {
+            return std::chrono::steady_clock::now().time_since_epoch().count();
+        }
+
+        bool parseUnsigned(std::string_view text, uint64_t& value) {
+            if (text.empty() || text.size() > 19) {
+                return false;
+            }
+            value = 0;
+            for (char c : text) {
+                if (c < '0' || c > '9') {
+                    return false;
+                }
+                value = value * 10 + static_cast<uint64_t>(c - '0');
+            }
+            return true;
+        }
+
+        int connectTcp(const std::string& host, uint16_t port) {
+            addrinfo hints {};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+
+            addrinfo* result {nullptr};
+            const std::string service {std::to_string(port)};
+            if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0) {
+                return -1;
+            }
+
+            int fd {-1};
+            for (addrinfo* ai {result}; ai != nullptr; ai = ai->ai_next) {
+                fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+                if (fd < 0) {
+                    continue;
+                }
+                if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+                    int one {1};
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    break;
+                }
+                close(fd);
+                fd = -1;
+            }
+            freeaddrinfo(result);
+            return fd;
+        }
+
+        int connectUnix(const std::string& path) {
+            sockaddr_un addr {};
+            if (path.size() >= sizeof(addr.sun_path)) {
+                return -1;
+            }
+
+            int fd {socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+            if (fd < 0) {
+                return -1;
+            }
+
+            addr.sun_family = AF_UNIX;
+            std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+            if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+    }
+
+    namespace replication {
+
+        void appendWrite(std::string& out, const ChangeEvent& event) {
+            const bool member {event.kind == ChangeKind::ZADD};
+            std::string payload {};
+            encodeAofRecord(payload, member ? AofOp::ZADD : AofOp::SET, event.key, event.value.view(),
+                            event.timestamp, event.expiration);
+
+            resp::appendArrayHeader(out, 2);
+            resp::appendBulkString(out, member ? "ZADD" : "SET");
+            resp::appendBulkString(out, payload);
+        }
+
+        void appendOffset(std::string& out, uint64_t sent, uint64_t published) {
+            resp::appendArrayHeader(out, 3);
+            resp::appendBulkString(out, "OFFSET");
+            resp::appendBulkString(out, std::to_string(sent));
+            resp::appendBulkString(out, std::to_string(published));
+        }
+
+        void appendFullResync(std::string& out, uint64_t offset, size_t snapshotBytes) {
+            out += FULLRESYNC;
+            out += std::to_string(offset);
+            out += "\r\n";
+            resp::appendBulkHeader(out, snapshotBytes);
+        }
+    }
+
+    std::optional<ReplicationSource> ReplicationSource::parse(const std::string& text) {
+        ReplicationSource source {};
+        if (text.find('/') != std::string::npos) {
+            source.unixSocket = text;
+            return source;
+        }
+
+        const size_t colon {text.rfind(':')};
+        uint64_t port {0};
+        if (colon == std::string::npos || colon == 0
+            || !parseUnsigned(std::string_view(text).substr(colon + 1), port) || port == 0 || port > 65535) {
+            return std::nullopt;
+        }
+
+        source.host = text.substr(0, colon);
+        source.port = static_cast<uint16_t>(port);
+        return source;
+    }
+
+    std::string ReplicationSource::toString() const {
+        return unixSocket.empty() ? host + ":" + std::to_string(port) : unixSocket;
+    }
+
+    ReplicaLink::ReplicaLink(Cache& cache, ReplicationSource source, std::string spoolDir)
+        : m_cache(cache),
+          m_source(std::move(source)),
+          m_spoolPath(spoolDir + "/streamcache-replica-" + std::to_string(getpid()) + ".snapshot") {
+    }
+
+    ReplicaLink::~ReplicaLink() {
+        stop();
+    }
+
+    void ReplicaLink::start() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_thread.joinable()) {
+            return;
+        }
+        m_stopping = false;
+        m_thread = std::thread(&ReplicaLink::run, this);
+    }
+
+    void ReplicaLink::stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+            if (m_fd >= 0) {
+                shutdown(m_fd, SHUT_RDWR);
+            }
+        }
+        m_cv.notify_one();
+
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    ReplicaStatus ReplicaLink::status() const {
+        ReplicaStatus status {};
+        status.primary = m_source.toString();
+        status.linkUp = m_linkUp.load(std::memory_order_relaxed);
+        status.syncing = m_syncing.load(std::memory_order_relaxed);
+        status.offset = m_offset.load(std::memory_order_relaxed);
+        status.primaryOffset = std::max(status.offset, m_primaryOffset.load(std::memory_order_relaxed));
+        status.fullSyncs = m_fullSyncs.load(std::memory_order_relaxed);
+        status.writesApplied = m_writesApplied.load(std::memory_order_relaxed);
+
+        const int64_t lastIo {m_lastIo.load(std::memory_order_relaxed)};
+        if (lastIo != 0) {
+            status.sinceLastIo = std::chrono::steady_clock::duration(ticksNow() - lastIo);
+        }
+        return status;
+    }
+
+    void ReplicaLink::run() {
+        std::chrono::milliseconds delay {MIN_RETRY_DELAY};
+
+        for (;;) {
+            const int fd {connectToPrimary()};
+            if (fd >= 0) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (m_stopping) {
+                        close(fd);
+                        return;
+                    }
+                    m_fd = fd;
+                }
+
+                m_linkUp.store(true, std::memory_order_relaxed);
+                delay = MIN_RETRY_DELAY;
+                follow(fd);
+                m_linkUp.store(false, std::memory_order_relaxed);
+                m_syncing.store(false, std::memory_order_relaxed);
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_fd = -1;
+                close(fd);
+            }
+
+            if (!waitToRetry(delay)) {
+                return;
+            }
+            delay = std::min(delay * 2, MAX_RETRY_DELAY);
+        }
+    }
+
+    int ReplicaLink::connectToPrimary() {
+        const int fd {m_source.unixSocket.empty() ? connectTcp(m_source.host, m_source.port)
+                                                  : connectUnix(m_source.unixSocket)};
+        if (fd < 0) {
+            return -1;
+        }
+
+        std::string request {};
+        resp::appendArrayHeader(request, 1);
+        resp::appendBulkString(request, "SYNC");
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+            close(fd);
+            return -1;
+        }
+
+        m_syncing.store(true, std::memory_order_relaxed);
+        return fd;
+    }
+
+    void ReplicaLink::follow(int fd) {
+        std::string buf {};
+        for (;;) {
+            const size_t oldSize {buf.size()};
+            buf.resize(oldSize + READ_CHUNK);
+            const ssize_t n {recv(fd, &buf[oldSize], READ_CHUNK, 0)};
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    buf.resize(oldSize);
+                    continue;
+                }
+                return;
+            }
+            buf.resize(oldSize + static_cast<size_t>(n));
+            m_lastIo.store(ticksNow(), std::memory_order_relaxed);
+
+            const std::optional<size_t> consumed {apply(buf)};
+            if (!consumed) {
+                std::cerr << "Replication stream from " << m_source.toString() << " is malformed; resyncing\n";
+                return;
+            }
+            buf.erase(0, *consumed);
+        }
+    }
+
+    std::optional<size_t> ReplicaLink::apply(std::string_view buf) {
+        size_t total {0};
+        std::vector<std::string> args {};
+
+        while (total < buf.size()) {
+            std::string_view pending {buf.substr(total)};
+
+            if (pending[0] == '+' || pending[0] == '-') {
+                const size_t lineEnd {pending.find("\r\n")};
+                if (lineEnd == std::string_view::npos) {
+                    break;
+                }
+
+                uint64_t offset {0};
+                if (pending.substr(0, FULLRESYNC.size()) != FULLRESYNC
+                    || !parseUnsigned(pending.substr(FULLRESYNC.size(), lineEnd - FULLRESYNC.size()), offset)) {
+                    std::cerr << "Primary " << m_source.toString() << " refused to sync: "
+                              << pending.substr(0, lineEnd) << "\n";
+                    return std::nullopt;
+                }
+
+                // The snapshot follows as one bulk string.
+                std::string_view rest {pending.substr(lineEnd + 2)};
+                const size_t headerEnd {rest.find("\r\n")};
+                if (headerEnd == std::string_view::npos) {
+                    break;
+                }
+                uint64_t length {0};
+                if (rest[0] != '$' || !parseUnsigned(rest.substr(1, headerEnd - 1), length)) {
+                    return std::nullopt;
+                }
+                if (rest.size() < headerEnd + 2 + length + 2) {
+                    break;
+                }
+
+                if (!loadSnapshot(rest.substr(headerEnd + 2, length), offset)) {
+                    return std::nullopt;
+                }
+                total += lineEnd + 2 + headerEnd + 2 + length + 2;
+                continue;
+            }
+
+            size_t consumed {0};
+            std::string error {};
+            const resp::ParseStatus status {resp::parseCommand(pending, consumed, args, error)};
+            if (status == resp::ParseStatus::INCOMPLETE) {
+                break;
+            }
+            if (status == resp::ParseStatus::ERROR || args.empty()) {
+                return std::nullopt;
+            }
+            total += consumed;
+
+            if ((args[0] == "SET" || args[0] == "ZADD") && args.size() == 2) {
+                AofRecord record {};
+                if (!decodeAofRecord(args[1], record) || (record.op == AofOp::ZADD) != (args[0] == "ZADD")) {
+                    return std::nullopt;
+                }
+                if (record.op == AofOp::ZADD) {
+                    m_cache.restoreMember(record.key, std::move(record.entry));
+                } else {
+                    m_cache.restore(record.key, std::move(record.entry));
+                }
+                m_offset.fetch_add(1, std::memory_order_relaxed);
+                m_writesApplied.fetch_add(1, std::memory_order_relaxed);
+            } else if (args[0] == "OFFSET" && args.size() == 3) {
+                uint64_t sent {0};
+                uint64_t published {0};
+                if (!parseUnsigned(args[1], sent) || !parseUnsigned(args[2], published)) {
+                    return std::nullopt;
+                }
+                m_offset.store(sent, std::memory_order_relaxed);
+                m_primaryOffset.store(published, std::memory_order_relaxed);
+            } else {
+                return std::nullopt;
+            }
+        }
+
+        return total;
+    }
+
+    bool ReplicaLink::loadSnapshot(std::string_view bytes, uint64_t offset) {
+        m_syncing.store(true, std::memory_order_relaxed);
+        {
+            std::ofstream file(m_spoolPath, std::ios::binary | std::ios::trunc);
+            file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            if (!file) {
+                std::cerr << "Cannot write " << m_spoolPath << "\n";
+                return false;
+            }
+        }
+
+        m_cache.clear();
+        size_t loaded {0};
+        try {
+            loaded = m_cache.loadSnapshot(m_spoolPath);
+        } catch (const std::exception& e) {
+            std::cerr << "Snapshot from " << m_source.toString() << " failed to load: " << e.what() << "\n";
+            loaded = SIZE_MAX;
+        }
+
+        std::error_code ec {};
+        std::filesystem::remove(m_spoolPath, ec);
+        if (loaded == SIZE_MAX) {
+            return false;
+        }
+
+        m_offset.store(offset, std::memory_order_relaxed);
+        m_primaryOffset.store(offset, std::memory_order_relaxed);
+        m_fullSyncs.fetch_add(1, std::memory_order_relaxed);
+        m_syncing.store(false, std::memory_order_relaxed);
+        std::cout << "Full sync from " << m_source.toString() << ": " << loaded << " keys at offset " << offset << "\n";
+        return true;
+    }
+
+    bool ReplicaLink::waitToRetry(std::chrono::milliseconds delay) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return !m_cv.wait_for(lock, delay, [this] { return m_stopping; });
+    }
+}
@@ -0,0 +1,163 @@
+#include "resp.h"
+#include "command_parser.h"
+#include <charconv>
+
+namespace streamcache::resp {
+
+    namespace {
+
+        /*
+        * Reads a "<prefix><integer>\r\n" header starting at pos. On success, pos is
+        * moved past the CRLF.
+        */
+        ParseStatus parseHeader(std::string_view buf, size_t& pos, char prefix,
+                                int64_t& value, std::string& error) {
+            if (pos >= buf.size()) {
+                return ParseStatus::INCOMPLETE;
+            }
+
+            if (buf[pos] != prefix) {
+                error = std::string("expected '") + prefix + "', got '" + buf[pos] + "'";
+                return ParseStatus::ERROR;
+            }
+
+            size_t crlf {buf.find("\r\n", pos + 1)};
+            if (crlf == std::string_view::npos) {
+                // A header is a handful of digits; a long run without CRLF is garbage.
+                if (buf.size() - pos > 32) {
+                    error = "invalid length header";
+                    return ParseStatus::ERROR;
+                }
+                return ParseStatus::INCOMPLETE;
+            }
+
+            const char* first {buf.data() + pos + 1};
+            const char* last {buf.data() + crlf};
+            auto [ptr, ec] {std::from_chars(first, last, value)};
+            if (ec != std::errc() || ptr != last) {
+                error = "invalid length header";
+                return ParseStatus::ERROR;
+            }
+
+            pos = crlf + 2;
+            return ParseStatus::OK;
+        }
+
+        ParseStatus parseInline(std::string_view buf, size_t& consumed,
+                                std::vector<std::string>& args, std::string& error) {
+            size_t newline {buf.find('\n')};
+            if (newline == std::string_view::npos) {
+                if (buf.size() > MAX_INLINE_LENGTH) {
+                    error = "inline command too long";
+                    return ParseStatus::ERROR;
+                }
+                return ParseStatus::INCOMPLETE;
+            }
+
+            std::string_view line {buf.substr(0, newline)};
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+
+            args = util::parse(std::string(line));
+            consumed = newline + 1;
+            return ParseStatus::OK;
+        }
+    }
+
+    ParseStatus parseCommand(std::string_view buf, size_t& consumed,
+                             std::vector<std::string>& args, std::string& error) {
+        args.clear();
+
+        if (buf.empty()) {
+            return ParseStatus::INCOMPLETE;
+        }
+
+        if (buf[0] != '*') {
+            return parseInline(buf, consumed, args, error);
+        }
+
+        size_t pos {0};
+        int64_t count {0};
+        ParseStatus status {parseHeader(buf, pos, '*', count, error)};
+        if (status != ParseStatus::OK) {
+            return status;
+        }
+
+        if (count < 0 || static_cast<size_t>(count) > MAX_ARRAY_LENGTH) {
+            error = "invalid multibulk length";
+            return ParseStatus::ERROR;
+        }
+
+        args.reserve(static_cast<size_t>(count));
+
+        for (int64_t i {0}; i < count; ++i) {
+            int64_t len {0};
+            status = parseHeader(buf, pos, '$', len, error);
+            if (status != ParseStatus::OK) {
+                return status;
+            }
+
+            if (len < 0 || static_cast<size_t>(len) > MAX_BULK_LENGTH) {
+                error = "invalid bulk length";
+                return ParseStatus::ERROR;
+            }
+
+            const size_t n {static_cast<size_t>(len)};
+            if (buf.size() - pos < n + 2) {
+                return ParseStatus::INCOMPLETE;
+            }
+
+            if (buf[pos + n] != '\r' || buf[pos + n + 1] != '\n') {
+                error = "bulk string not terminated by CRLF";
+                return ParseStatus::ERROR;
+            }
+
+            args.emplace_back(buf.substr(pos, n));
+            pos += n + 2;
+        }
+
+        consumed = pos;
+        return ParseStatus::OK;
+    }
+
+    void appendSimpleString(std::string& out, std::string_view s) {
+        out += '+';
+        out += s;
+        out += "\r\n";
+    }
+
+    void appendError(std::string& out, std::string_view msg) {
+        out += '-';
+        out += msg;
+        out += "\r\n";
+    }
+
+    void appendInteger(std::string& out, int64_t v) {
+        out += ':';
+        out += std::to_string(v);
+        out += "\r\n";
+    }
+
+    void appendBulkString(std::string& out, std::string_view s) {
+        appendBulkHeader(out, s.size());
+        out += s;
+        out += "\r\n";
+    }
+
+    void appendBulkHeader(std::string& out, size_t len) {
+        out += '$';
+        out += std::to_string(len);
+        out += "\r\n";
+    }
+
+    void appendNull(std::string& out) {
+        out += "$-1\r\n";
+    }
+
+    void appendArrayHeader(std::string& out, size_t n) {
+        out += '*';
+        out += std::to_string(n);
+        out += "\r\n";
+    }
+}
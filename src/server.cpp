@@ -0,0 +1,1696 @@
+#include "server.h"
+#include "resp.h"
+#include "cache_builder.h"
+#include "time_util.h"
+#include "glob_util.h"
+#include "number_util.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <system_error>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace streamcache {
+
+    namespace {
+
+        const size_t READ_CHUNK = 64 * 1024;
+        const size_t MAX_QUERY_BUFFER = 1024 * 1024 * 1024;
+        const int MAX_EVENTS = 256;
+
+        // Entries SLOWLOG GET returns without a count, as in Redis.
+        const size_t DEFAULT_SLOWLOG_GET = 10;
+
+        // Below this a copy into the output buffer is cheaper than an extra iovec.
+        const size_t ZERO_COPY_MIN = 4096;
+        const size_t MAX_IOVECS = 64;
+
+        // Replies a pipeline builds up before they are flushed mid-batch.
+        const size_t OUTPUT_FLUSH_BYTES = 64 * 1024;
+
+        // Writes read per subscriber before flushing, and batches per wakeup before other work runs.
+        const size_t DELIVERY_BATCH = 256;
+        const size_t DELIVERY_ROUNDS = 8;
+
+        [[noreturn]] void throwErrno(const std::string& what) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+
+        void setNonBlocking(int fd) {
+            int flags {fcntl(fd, F_GETFL, 0)};
+            if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+                throwErrno("fcntl");
+            }
+        }
+
+        int listenTcp(const std::string& address, uint16_t port, int backlog) {
+            addrinfo hints {};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = AI_PASSIVE;
+
+            addrinfo* result {nullptr};
+            const std::string service {std::to_string(port)};
+            int rc {getaddrinfo(address.empty() ? nullptr : address.c_str(), service.c_str(), &hints, &result)};
+            if (rc != 0) {
+                throw std::runtime_error("getaddrinfo: " + std::string(gai_strerror(rc)));
+            }
+
+            int fd {-1};
+            int lastErrno {0};
+            for (addrinfo* ai {result}; ai != nullptr; ai = ai->ai_next) {
+                fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+                if (fd < 0) {
+                    lastErrno = errno;
+                    continue;
+                }
+
+                int one {1};
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+                if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, backlog) == 0) {
+                    break;
+                }
+
+                lastErrno = errno;
+                close(fd);
+                fd = -1;
+            }
+            freeaddrinfo(result);
+
+            if (fd < 0) {
+                errno = lastErrno;
+                throwErrno("listen on " + address + ":" + service);
+            }
+
+            setNonBlocking(fd);
+            return fd;
+        }
+
+        int listenUnix(const std::string& path, int backlog) {
+            sockaddr_un addr {};
+            if (path.size() >= sizeof(addr.sun_path)) {
+                throw std::runtime_error("unix socket path too long: " + path);
+            }
+
+            int fd {socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+            if (fd < 0) {
+                throwErrno("socket");
+            }
+
+            addr.sun_family = AF_UNIX;
+            std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+            // Remove a stale socket file left behind by a previous run.
+            unlink(path.c_str());
+
+            if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, backlog) != 0) {
+                int savedErrno {errno};
+                close(fd);
+                errno = savedErrno;
+                throwErrno("listen on " + path);
+            }
+
+            setNonBlocking(fd);
+            return fd;
+        }
+
+        void toUpper(std::string& s) {
+            std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) {
+                return static_cast<char>(std::toupper(c));
+            });
+        }
+
+        std::string toLower(std::string s) {
+            std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) {
+                return static_cast<char>(std::tolower(c));
+            });
+            return s;
+        }
+
+        /*
+        * Commands a replica rejects: its data only changes through its primary.
+        */
+        bool isWriteCommand(const std::string& cmd) {
+            return cmd == "SET" || cmd == "MSET" || cmd == "RESHARD" || cmd == "INCR" || cmd == "DECR"
+                || cmd == "INCRBY" || cmd == "DECRBY" || cmd == "INCRBYFLOAT" || cmd == "ZADD" || cmd == "ZINCRBY";
+        }
+
+        bool isSortedSetCommand(const std::string& cmd) {
+            return cmd == "ZADD" || cmd == "ZINCRBY" || cmd == "ZSCORE" || cmd == "ZRANK" || cmd == "ZCARD"
+                || cmd == "ZRANGE" || cmd == "ZREVRANGEBYSCORE";
+        }
+
+        const char* const WRONG_TYPE_ERROR {"WRONGTYPE Operation against a key holding the wrong kind of value"};
+
+        /*
+        * Parses a ZREVRANGEBYSCORE bound: a score, "(" before one to exclude it,
+        * or +inf / -inf.
+        */
+        bool parseScoreBound(std::string_view text, streamcache::ScoreBound& bound) {
+            bound.exclusive = !text.empty() && text[0] == '(';
+            if (bound.exclusive) {
+                text.remove_prefix(1);
+            }
+
+            std::string lower {toLower(std::string(text))};
+            if (lower == "+inf" || lower == "inf") {
+                bound.value = std::numeric_limits<double>::infinity();
+                return true;
+            }
+            if (lower == "-inf") {
+                bound.value = -std::numeric_limits<double>::infinity();
+                return true;
+            }
+            return util::parseDouble(text, bound.value);
+        }
+
+        /*
+        * Parses a non-negative decimal count argument; rejects signs and trailing junk.
+        */
+        bool parseCount(const std::string& text, size_t& value) {
+            if (text.empty() || text.size() > 18
+                || !std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isdigit(c); })) {
+                return false;
+            }
+            value = std::stoull(text);
+            return true;
+        }
+    }
+
+    Server::Server(Cache& cache, ServerConfig config)
+        : m_cache(cache), m_config(std::move(config)) {
+    }
+
+    Server::~Server() {
+        stop();
+    }
+
+    void Server::openListeners() {
+        if (m_config.port != 0) {
+            m_listenFds.push_back(listenTcp(m_config.bindAddress, m_config.port, m_config.backlog));
+        }
+
+        if (!m_config.unixSocket.empty()) {
+            m_listenFds.push_back(listenUnix(m_config.unixSocket, m_config.backlog));
+        }
+
+        if (m_listenFds.empty()) {
+            throw std::runtime_error("no listeners configured");
+        }
+    }
+
+    void Server::start() {
+        if (m_running.exchange(true)) {
+            return;
+        }
+
+        if (!m_config.replicaOf.empty() && !ReplicationSource::parse(m_config.replicaOf)) {
+            m_running.store(false);
+            throw std::runtime_error("invalid primary address: " + m_config.replicaOf);
+        }
+
+        try {
+            openListeners();
+
+            const size_t threads {std::max<size_t>(1, m_config.ioThreads)};
+            for (size_t i {0}; i < threads; ++i) {
+                auto io {std::make_unique<IoThread>()};
+
+                io->epollFd = epoll_create1(EPOLL_CLOEXEC);
+                if (io->epollFd < 0) {
+                    throwErrno("epoll_create1");
+                }
+
+                io->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (io->wakeFd < 0) {
+                    throwErrno("eventfd");
+                }
+
+                epoll_event ev {};
+                ev.events = EPOLLIN;
+                ev.data.fd = io->wakeFd;
+                epoll_ctl(io->epollFd, EPOLL_CTL_ADD, io->wakeFd, &ev);
+
+                /*
+                * Every thread watches every listener; EPOLLEXCLUSIVE avoids waking
+                * all of them for each incoming connection.
+                */
+                for (int fd : m_listenFds) {
+                    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+                    ev.data.fd = fd;
+                    if (epoll_ctl(io->epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                        throwErrno("epoll_ctl");
+                    }
+                }
+
+                m_ioThreads.push_back(std::move(io));
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+
+        // Runs on writer threads; one eventfd write per thread and armed pass.
+        m_cache.changeFeed().setListener([this] {
+            for (auto& io : m_ioThreads) {
+                uint64_t one {1};
+                ssize_t ignored {write(io->wakeFd, &one, sizeof(one))};
+                (void)ignored;
+            }
+        });
+
+        // Before the I/O threads, which read m_replicaLink.
+        if (m_config.replicaOf.empty()) {
+            m_syncStopping = false;
+            m_syncThread = std::thread(&Server::runSyncs, this);
+        } else {
+            m_replicaLink = std::make_unique<ReplicaLink>(m_cache, *ReplicationSource::parse(m_config.replicaOf),
+                std::filesystem::temp_directory_path().string());
+            m_replicaLink->start();
+        }
+
+        for (auto& io : m_ioThreads) {
+            io->thread = std::thread(&Server::runLoop, this, std::ref(*io));
+        }
+
+        if (!m_config.metricsFile.empty()) {
+            m_metricsStopping = false;
+            m_metricsThread = std::thread(&Server::dumpMetrics, this);
+        }
+    }
+
+    void Server::stop() {
+        if (!m_running.exchange(false)) {
+            return;
+        }
+
+        // Waits out a listener call in progress; no writer touches the wake fds after this.
+        m_cache.changeFeed().setListener(nullptr);
+
+        if (m_metricsThread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_metricsMutex);
+                m_metricsStopping = true;
+            }
+            m_metricsCv.notify_one();
+            m_metricsThread.join();
+        }
+
+        if (m_replicaLink) {
+            m_replicaLink->stop();
+        }
+
+        // Finishes an export in progress; its results are dropped with the connections below.
+        if (m_syncThread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_syncMutex);
+                m_syncStopping = true;
+            }
+            m_syncCv.notify_one();
+            m_syncThread.join();
+            m_syncRequests.clear();
+        }
+
+        for (auto& io : m_ioThreads) {
+            if (io->wakeFd >= 0) {
+                uint64_t one {1};
+                ssize_t ignored {write(io->wakeFd, &one, sizeof(one))};
+                (void)ignored;
+            }
+        }
+
+        for (auto& io : m_ioThreads) {
+            if (io->thread.joinable()) {
+                io->thread.join();
+            }
+
+            for (auto& [fd, conn] : io->connections) {
+                close(fd);
+            }
+            io->connections.clear();
+            io->syncDone.clear();
+
+            if (io->wakeFd >= 0) {
+                close(io->wakeFd);
+            }
+            if (io->epollFd >= 0) {
+                close(io->epollFd);
+            }
+        }
+        m_ioThreads.clear();
+        m_replicaLink.reset();
+
+        {
+            std::lock_guard<std::mutex> lock(m_replicasMutex);
+            m_replicas.clear();
+        }
+
+        for (int fd : m_listenFds) {
+            close(fd);
+        }
+        m_listenFds.clear();
+
+        if (!m_config.unixSocket.empty()) {
+            unlink(m_config.unixSocket.c_str());
+        }
+
+        std::lock_guard<std::mutex> lock(m_snapshotMutex);
+        if (m_snapshotThread.joinable()) {
+            m_snapshotThread.join();
+        }
+    }
+
+    bool Server::startSnapshot() {
+        std::lock_guard<std::mutex> lock(m_snapshotMutex);
+
+        if (m_snapshotRunning.load()) {
+            return false;
+        }
+
+        if (m_snapshotThread.joinable()) {
+            m_snapshotThread.join();
+        }
+
+        m_snapshotRunning.store(true);
+        m_snapshotThread = std::thread([this] {
+            try {
+                m_cache.snapshot(m_config.snapshotPath);
+            } catch (const std::exception& e) {
+                std::cerr << "Snapshot failed: " << e.what() << "\n";
+            }
+            m_snapshotRunning.store(false);
+        });
+
+        return true;
+    }
+
+    void Server::executeGetAsOf(std::vector<std::string>& args, Connection& conn) {
+        std::string& out {conn.out};
+        std::string as {args[2]};
+        std::string of {args[3]};
+        toUpper(as);
+        toUpper(of);
+        size_t millis {0};
+        if (as != "AS" || of != "OF") {
+            resp::appendError(out, "ERR syntax error");
+            return;
+        }
+        if (!parseCount(args[4], millis)) {
+            resp::appendError(out, "ERR timestamp must be a non-negative number of milliseconds");
+            return;
+        }
+
+        auto value {m_cache.getAsOf(args[1], util::throughEpochMillis(static_cast<int64_t>(millis)))};
+        if (value) {
+            appendValue(conn, std::move(*value));
+        } else {
+            resp::appendNull(out);
+        }
+    }
+
+    void Server::executeIncrement(std::vector<std::string>& args, Connection& conn) {
+        std::string& out {conn.out};
+        const std::string& cmd {args[0]};
+        const bool byOne {cmd == "INCR" || cmd == "DECR"};
+        if (args.size() != (byOne ? 2u : 3u)) {
+            resp::appendError(out, "ERR wrong number of arguments for '" + cmd + "'");
+            return;
+        }
+
+        if (cmd == "INCRBYFLOAT") {
+            double delta {0};
+            if (!util::parseDouble(args[2], delta)) {
+                resp::appendError(out, "ERR value is not a valid float");
+                return;
+            }
+
+            IncrementResult result {m_cache.incrByFloat(args[1], delta)};
+            if (result.status == IncrementStatus::WRONG_TYPE) {
+                resp::appendError(out, WRONG_TYPE_ERROR);
+            } else if (result.status == IncrementStatus::NOT_A_NUMBER) {
+                resp::appendError(out, "ERR value is not a valid float");
+            } else if (result.status == IncrementStatus::OUT_OF_RANGE) {
+                resp::appendError(out, "ERR increment would produce NaN or Infinity");
+            } else {
+                resp::appendBulkString(out, result.value);
+            }
+            return;
+        }
+
+        int64_t delta {1};
+        if (!byOne && !util::parseInteger(args[2], delta)) {
+            resp::appendError(out, "ERR value is not an integer or out of range");
+            return;
+        }
+        if (cmd == "DECR" || cmd == "DECRBY") {
+            if (delta == INT64_MIN) {
+                resp::appendError(out, "ERR decrement would overflow");
+                return;
+            }
+            delta = -delta;
+        }
+
+        IncrementResult result {m_cache.incrBy(args[1], delta)};
+        if (result.status == IncrementStatus::WRONG_TYPE) {
+            resp::appendError(out, WRONG_TYPE_ERROR);
+        } else if (result.status != IncrementStatus::OK) {
+            resp::appendError(out, "ERR value is not an integer or out of range");
+        } else {
+            resp::appendInteger(out, result.integer);
+        }
+    }
+
+    void Server::executeSortedSet(std::vector<std::string>& args, Connection& conn) {
+        std::string& out {conn.out};
+        const std::string& cmd {args[0]};
+        const auto wrongArguments {[&] {
+            resp::appendError(out, "ERR wrong number of arguments for '" + cmd + "'");
+        }};
+        const auto appendMembers {[&out](const std::vector<ScoredMember>& members, bool withScores) {
+            resp::appendArrayHeader(out, members.size() * (withScores ? 2 : 1));
+            for (const ScoredMember& member : members) {
+                resp::appendBulkString(out, member.member);
+                if (withScores) {
+                    resp::appendBulkString(out, util::formatDouble(member.score));
+                }
+            }
+        }};
+
+        if (cmd == "ZADD") {
+            ZAddOptions options {};
+            bool reportChanged {false};
+            size_t i {2};
+            for (; i < args.size(); ++i) {
+                std::string option {args[i]};
+                toUpper(option);
+                if (option == "NX") {
+                    options.nx = true;
+                } else if (option == "XX") {
+                    options.xx = true;
+                } else if (option == "GT") {
+                    options.gt = true;
+                } else if (option == "LT") {
+                    options.lt = true;
+                } else if (option == "CH") {
+                    reportChanged = true;
+                } else if (option == "EX" && i + 1 < args.size()) {
+                    size_t seconds {0};
+                    if (!parseCount(args[++i], seconds)) {
+                        resp::appendError(out, "ERR invalid TTL, expected a non-negative number of seconds");
+                        return;
+                    }
+                    options.expiration = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+                } else {
+                    break;
+                }
+            }
+
+            if (args.size() < 2 || i == args.size() || (args.size() - i) % 2 != 0) {
+                wrongArguments();
+                return;
+            }
+            if ((options.nx && options.xx) || (options.gt && options.lt) || (options.nx && (options.gt || options.lt))) {
+                resp::appendError(out, "ERR GT, LT, and/or NX options at the same time are not compatible");
+                return;
+            }
+
+            std::vector<ScoredMember> members {};
+            members.reserve((args.size() - i) / 2);
+            for (; i + 1 < args.size(); i += 2) {
+                ScoredMember member {std::move(args[i + 1]), 0};
+                if (!util::parseDouble(args[i], member.score)) {
+                    resp::appendError(out, "ERR value is not a valid float");
+                    return;
+                }
+                members.push_back(std::move(member));
+            }
+
+            const SortedSetResult result {m_cache.zadd(args[1], members, options)};
+            if (result.status == SortedSetStatus::WRONG_TYPE) {
+                resp::appendError(out, WRONG_TYPE_ERROR);
+            } else {
+                resp::appendInteger(out, static_cast<int64_t>(result.added + (reportChanged ? result.updated : 0)));
+            }
+            return;
+        }
+
+        if (cmd == "ZINCRBY") {
+            if (args.size() != 4) {
+                wrongArguments();
+                return;
+            }
+
+            double delta {0};
+            if (!util::parseDouble(args[2], delta)) {
+                resp::appendError(out, "ERR value is not a valid float");
+                return;
+            }
+
+            const SortedSetResult result {m_cache.zincrBy(args[1], args[3], delta)};
+            if (result.status == SortedSetStatus::WRONG_TYPE) {
+                resp::appendError(out, WRONG_TYPE_ERROR);
+            } else if (result.status == SortedSetStatus::NOT_FINITE) {
+                resp::appendError(out, "ERR resulting score is not a number (NaN)");
+            } else {
+                resp::appendBulkString(out, util::formatDouble(result.score));
+            }
+            return;
+        }
+
+        if (cmd == "ZSCORE" || cmd == "ZRANK") {
+            if (args.size() != 3) {
+                wrongArguments();
+                return;
+            }
+
+            std::optional<double> score {};
+            std::optional<size_t> rank {};
+            const SortedSetStatus status {cmd == "ZSCORE" ? m_cache.zscore(args[1], args[2], score)
+                                                          : m_cache.zrank(args[1], args[2], rank)};
+            if (status == SortedSetStatus::WRONG_TYPE) {
+                resp::appendError(out, WRONG_TYPE_ERROR);
+            } else if (score) {
+                resp::appendBulkString(out, util::formatDouble(*score));
+            } else if (rank) {
+                resp::appendInteger(out, static_cast<int64_t>(*rank));
+            } else {
+                resp::appendNull(out);
+            }
+            return;
+        }
+
+        if (cmd == "ZCARD") {
+            if (args.size() != 2) {
+                wrongArguments();
+                return;
+            }
+
+            size_t count {0};
+            if (m_cache.zcard(args[1], count) == SortedSetStatus::WRONG_TYPE) {
+                resp::appendError(out, WRONG_TYPE_ERROR);
+            } else {
+                resp::appendInteger(out, static_cast<int64_t>(count));
+            }
+            return;
+        }
+
+        if (cmd == "ZRANGE") {
+            if (args.size() != 4 && args.size() != 5) {
+                wrongArguments();
+                return;
+            }
+
+            bool withScores {false};
+            if (args.size() == 5) {
+                std::string option {args[4]};
+                toUpper(option);
+                if (option != "WITHSCORES") {
+                    resp::appendError(out, "ERR syntax error");
+                    return;
+                }
+                withScores = true;
+            }
+
+            int64_t start {0};
+            int64_t stop {0};
+            if (!util::parseInteger(args[2], start) || !util::parseInteger(args[3], stop)) {
+                resp::appendError(out, "ERR value is not an integer or out of range");
+                return;
+            }
+
+            std::vector<ScoredMember> members {};
+            if (m_cache.zrange(args[1], start, stop, members) == SortedSetStatus::WRONG_TYPE) {
+                resp::appendError(out, WRONG_TYPE_ERROR);
+            } else {
+                appendMembers(members, withScores);
+            }
+            return;
+        }
+
+        // ZREVRANGEBYSCORE
+        if (args.size() < 4) {
+            wrongArguments();
+            return;
+        }
+
+        ScoreBound max {};
+        ScoreBound min {};
+        if (!parseScoreBound(args[2], max) || !parseScoreBound(args[3], min)) {
+            resp::appendError(out, "ERR min or max is not a float");
+            return;
+        }
+
+        bool withScores {false};
+        size_t offset {0};
+        size_t count {SIZE_MAX};
+        for (size_t i {4}; i < args.size(); ++i) {
+            std::string option {args[i]};
+            toUpper(option);
+            if (option == "WITHSCORES") {
+                withScores = true;
+            } else if (option == "LIMIT" && i + 2 < args.size()) {
+                int64_t limit {0};
+                if (!parseCount(args[i + 1], offset) || !util::parseInteger(args[i + 2], limit)) {
+                    resp::appendError(out, "ERR value is not an integer or out of range");
+                    return;
+                }
+                // A negative count means no limit.
+                count = limit < 0 ? SIZE_MAX : static_cast<size_t>(limit);
+                i += 2;
+            } else {
+                resp::appendError(out, "ERR syntax error");
+                return;
+            }
+        }
+
+        std::vector<ScoredMember> members {};
+        if (m_cache.zrevrangeByScore(args[1], max, min, offset, count, members) == SortedSetStatus::WRONG_TYPE) {
+            resp::appendError(out, WRONG_TYPE_ERROR);
+        } else {
+            appendMembers(members, withScores);
+        }
+    }
+
+    void Server::executeReplay(std::vector<std::string>& args, Connection& conn) {
+        std::string& out {conn.out};
+        if (args.size() < 2 || args.size() % 2 != 0) {
+            resp::appendError(out, "ERR wrong number of arguments for 'REPLAY'");
+            return;
+        }
+
+        ReplayRange range {};
+        for (size_t i {2}; i + 1 < args.size(); i += 2) {
+            std::string option {args[i]};
+            toUpper(option);
+            size_t value {0};
+            if (option != "FROM" && option != "TO" && option != "LIMIT") {
+                resp::appendError(out, "ERR syntax error");
+                return;
+            }
+            if (!parseCount(args[i + 1], value)) {
+                resp::appendError(out, "ERR " + option + " must be a non-negative integer");
+                return;
+            }
+
+            if (option == "FROM") {
+                range.from = util::fromEpochMillis(static_cast<int64_t>(value));
+            } else if (option == "TO") {
+                range.to = util::throughEpochMillis(static_cast<int64_t>(value));
+            } else {
+                range.limit = value;
+            }
+        }
+
+        auto records {m_cache.replay(args[1], range)};
+        if (!records) {
+            resp::appendNull(out);
+            return;
+        }
+
+        // Each record is a [wall-clock millis, value] pair.
+        resp::appendArrayHeader(out, records->size());
+        for (ReplayRecord& record : *records) {
+            resp::appendArrayHeader(out, 2);
+            resp::appendInteger(out, util::toEpochMillis(record.timestamp));
+            appendValue(conn, std::move(record.value));
+        }
+    }
+
+    void Server::executeSlowLog(std::vector<std::string>& args, std::string& out) {
+        SlowLog& slowLog {m_cache.slowLog()};
+        std::string sub {args.size() > 1 ? args[1] : ""};
+        toUpper(sub);
+
+        if (sub == "GET" && args.size() <= 3) {
+            size_t count {DEFAULT_SLOWLOG_GET};
+            if (args.size() == 3 && !parseCount(args[2], count)) {
+                resp::appendError(out, "ERR count must be a non-negative integer");
+                return;
+            }
+
+            const auto micros {[](std::chrono::nanoseconds d) {
+                return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+            }};
+
+            /*
+            * Redis' entry layout, with the client address and name replaced by
+            * the time spent waiting for and holding shard locks (microseconds).
+            */
+            const std::vector<SlowLogEntry> entries {slowLog.entries(count)};
+            resp::appendArrayHeader(out, entries.size());
+            for (const SlowLogEntry& entry : entries) {
+                resp::appendArrayHeader(out, 6);
+                resp::appendInteger(out, static_cast<int64_t>(entry.id));
+                resp::appendInteger(out, std::chrono::duration_cast<std::chrono::seconds>(
+                    entry.startedAt.time_since_epoch()).count());
+                resp::appendInteger(out, micros(entry.duration));
+
+                const bool moreKeys {entry.keyCount > 1};
+                resp::appendArrayHeader(out, moreKeys ? 3 : 2);
+                resp::appendBulkString(out, entry.command);
+                resp::appendBulkString(out, entry.key);
+                if (moreKeys) {
+                    resp::appendBulkString(out, "... (" + std::to_string(entry.keyCount - 1) + " more keys)");
+                }
+
+                resp::appendInteger(out, micros(entry.lockWait));
+                resp::appendInteger(out, micros(entry.lockHold));
+            }
+            return;
+        }
+
+        if (sub == "LEN" && args.size() == 2) {
+            resp::appendInteger(out, static_cast<int64_t>(slowLog.size()));
+            return;
+        }
+
+        if (sub == "RESET" && args.size() == 2) {
+            slowLog.reset();
+            resp::appendSimpleString(out, "OK");
+            return;
+        }
+
+        resp::appendError(out, "ERR usage: SLOWLOG GET [count] | LEN | RESET");
+    }
+
+    void Server::executeSubscribe(std::vector<std::string>& args, Connection& conn) {
+        std::string& out {conn.out};
+        const std::string& cmd {args[0]};
+        const std::string kind {toLower(cmd)};
+        const bool pattern {cmd[0] == 'P'};
+        const bool subscribe {cmd == "SUBSCRIBE" || cmd == "PSUBSCRIBE"};
+
+        if (subscribe && args.size() < 2) {
+            resp::appendError(out, "ERR wrong number of arguments for '" + cmd + "'");
+            return;
+        }
+
+        // Each (un)subscription is confirmed with [kind, name, subscriptions left].
+        const auto confirm {[&](const std::string* name, size_t count) {
+            resp::appendArrayHeader(out, 3);
+            resp::appendBulkString(out, kind);
+            if (name) {
+                resp::appendBulkString(out, *name);
+            } else {
+                resp::appendNull(out);
+            }
+            resp::appendInteger(out, static_cast<int64_t>(count));
+        }};
+
+        if (subscribe) {
+            if (!conn.subscriber) {
+                // Positioned at the current end of every ring: only later writes are delivered.
+                conn.subscriber = std::make_unique<Subscriber>();
+                conn.subscriber->subscription = m_cache.subscribeChanges();
+            }
+
+            Subscriber& sub {*conn.subscriber};
+            for (size_t i {1}; i < args.size(); ++i) {
+                if (!pattern) {
+                    sub.keys.insert(args[i]);
+                } else if (std::find(sub.patterns.begin(), sub.patterns.end(), args[i]) == sub.patterns.end()) {
+                    sub.patterns.push_back(args[i]);
+                }
+                confirm(&args[i], sub.count());
+            }
+            return;
+        }
+
+        if (!conn.subscriber) {
+            confirm(nullptr, 0);
+            return;
+        }
+
+        // Without arguments, drops every key (or pattern) subscription.
+        Subscriber& sub {*conn.subscriber};
+        std::vector<std::string> names {args.begin() + 1, args.end()};
+        if (names.empty()) {
+            if (pattern) {
+                names = sub.patterns;
+            } else {
+                names.assign(sub.keys.begin(), sub.keys.end());
+            }
+        }
+
+        if (names.empty()) {
+            confirm(nullptr, sub.count());
+        }
+        for (const std::string& name : names) {
+            if (pattern) {
+                sub.patterns.erase(std::remove(sub.patterns.begin(), sub.patterns.end(), name), sub.patterns.end());
+            } else {
+                sub.keys.erase(name);
+            }
+            confirm(&name, sub.count());
+        }
+
+        if (sub.count() == 0) {
+            conn.subscriber.reset();
+        }
+    }
+
+    void Server::appendChange(Connection& conn, const ChangeEvent& event) {
+        std::string& out {conn.out};
+        const Subscriber& sub {*conn.subscriber};
+
+        if (sub.keys.count(event.key)) {
+            resp::appendArrayHeader(out, 3);
+            resp::appendBulkString(out, "message");
+            resp::appendBulkString(out, event.key);
+            appendValue(conn, event.value);
+        }
+
+        for (const std::string& pattern : sub.patterns) {
+            if (util::globMatch(pattern, event.key)) {
+                resp::appendArrayHeader(out, 4);
+                resp::appendBulkString(out, "pmessage");
+                resp::appendBulkString(out, pattern);
+                resp::appendBulkString(out, event.key);
+                appendValue(conn, event.value);
+            }
+        }
+    }
+
+    void Server::deliverChanges(IoThread& io) {
+        io.changesReady = false;
+        io.deliveryPending = false;
+
+        // Armed before reading, so a write the reads below miss wakes the thread again.
+        m_cache.changeFeed().arm();
+
+        std::vector<int> closed {};
+        for (int fd : io.subscribers) {
+            if (!deliverChanges(io, *io.connections.at(fd))) {
+                closed.push_back(fd);
+            }
+        }
+        for (int fd : closed) {
+            closeConnection(io, fd);
+        }
+    }
+
+    bool Server::deliverChanges(IoThread& io, Connection& conn) {
+        if (conn.replica) {
+            return deliverReplication(io, conn);
+        }
+        Subscriber& sub {*conn.subscriber};
+
+        for (size_t round {0}; round < DELIVERY_ROUNDS; ++round) {
+            /*
+            * Backpressure: a client that is not reading gets nothing more until
+            * EPOLLOUT drains its output. Writers never wait for it; what the
+            * rings overwrite meanwhile is reported as lost when it catches up.
+            */
+            if (conn.wantWrite || conn.closeAfterWrite) {
+                return true;
+            }
+
+            const size_t read {m_cache.readChanges(*sub.subscription, DELIVERY_BATCH,
+                [&](const ChangeEvent& event) { appendChange(conn, event); })};
+
+            const uint64_t lost {sub.subscription->lost()};
+            if (lost > sub.reportedLost) {
+                resp::appendArrayHeader(conn.out, 2);
+                resp::appendBulkString(conn.out, "lost");
+                resp::appendInteger(conn.out, static_cast<int64_t>(lost - sub.reportedLost));
+                sub.reportedLost = lost;
+            }
+
+            if (!flush(io, conn)) {
+                return false;
+            }
+            if (read < DELIVERY_BATCH) {
+                return true;
+            }
+        }
+
+        // More is waiting; finish on the next pass, after other connections had their turn.
+        io.deliveryPending = true;
+        return true;
+    }
+
+    void Server::startSync(IoThread& io, Connection& conn) {
+        ReplicaFeed& replica {*conn.replica};
+        replica.syncing.store(true, std::memory_order_relaxed);
+        replica.syncId = m_nextSyncId.fetch_add(1, std::memory_order_relaxed);
+        replica.subscription = m_cache.subscribeChanges();
+
+        {
+            std::lock_guard<std::mutex> lock(m_syncMutex);
+            m_syncRequests.push_back({&io, conn.fd, replica.syncId});
+        }
+        m_syncCv.notify_one();
+    }
+
+    void Server::runSyncs() {
+        const std::string path {(std::filesystem::temp_directory_path()
+            / ("streamcache-sync-" + std::to_string(getpid()) + ".snapshot")).string()};
+
+        std::unique_lock<std::mutex> lock(m_syncMutex);
+        while (true) {
+            m_syncCv.wait(lock, [this] { return m_syncStopping || !m_syncRequests.empty(); });
+            if (m_syncStopping) {
+                return;
+            }
+
+            // Every replica that asked so far is served by the same export.
+            std::vector<SyncRequest> requests {};
+            requests.swap(m_syncRequests);
+            lock.unlock();
+
+            std::shared_ptr<std::string> snapshot {};
+            std::vector<uint64_t> heads {};
+            try {
+                m_cache.exportSnapshot(path, heads);
+
+                std::ifstream file(path, std::ios::binary);
+                snapshot = std::make_shared<std::string>(std::istreambuf_iterator<char>(file),
+                    std::istreambuf_iterator<char>());
+                if (!file.good() && !file.eof()) {
+                    throw std::runtime_error("cannot read " + path);
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Replica sync failed: " << e.what() << "\n";
+                snapshot.reset();
+            }
+            std::remove(path.c_str());
+
+            for (const SyncRequest& request : requests) {
+                {
+                    std::lock_guard<std::mutex> ioLock(request.io->syncMutex);
+                    request.io->syncDone.push_back({request.fd, request.syncId, snapshot, heads});
+                }
+                uint64_t one {1};
+                ssize_t ignored {write(request.io->wakeFd, &one, sizeof(one))};
+                (void)ignored;
+            }
+
+            lock.lock();
+        }
+    }
+
+    void Server::finishSyncs(IoThread& io) {
+        std::vector<SyncResult> done {};
+        {
+            std::lock_guard<std::mutex> lock(io.syncMutex);
+            done.swap(io.syncDone);
+        }
+
+        for (SyncResult& result : done) {
+            // The connection may have closed, or asked for a newer sync, meanwhile.
+            auto it {io.connections.find(result.fd)};
+            if (it == io.connections.end() || !it->second->replica
+                || it->second->replica->syncId != result.syncId) {
+                continue;
+            }
+            Connection& conn {*it->second};
+            ReplicaFeed& replica {*conn.replica};
+
+            if (!result.snapshot) {
+                closeConnection(io, result.fd);
+                continue;
+            }
+
+            uint64_t offset {0};
+            for (uint64_t head : result.changeHeads) {
+                offset += head;
+            }
+
+            // The subscription opened by startSync() has kept these positions published.
+            replica.subscription = m_cache.subscribeChanges(std::move(result.changeHeads));
+            replica.offset.store(offset, std::memory_order_relaxed);
+            replica.fullSyncs.fetch_add(1, std::memory_order_relaxed);
+            replica.syncing.store(false, std::memory_order_relaxed);
+
+            replication::appendFullResync(conn.out, offset, result.snapshot->size());
+            conn.out += *result.snapshot;
+            conn.out += "\r\n";
+            io.changesReady = true;
+
+            if (!flush(io, conn)) {
+                closeConnection(io, result.fd);
+            }
+        }
+    }
+
+    bool Server::deliverReplication(IoThread& io, Connection& conn) {
+        ReplicaFeed& replica {*conn.replica};
+        if (replica.syncing.load(std::memory_order_relaxed)) {
+            return true;
+        }
+
+        for (size_t round {0}; round < DELIVERY_ROUNDS; ++round) {
+            // Backpressure as for subscribers: the rings hold what the replica has not taken yet.
+            if (conn.wantWrite || conn.closeAfterWrite) {
+                return true;
+            }
+
+            const size_t read {m_cache.readChanges(*replica.subscription, DELIVERY_BATCH,
+                [&](const ChangeEvent& event) { replication::appendWrite(conn.out, event); })};
+
+            // Writes were overwritten before it took them: only a new snapshot can close the gap.
+            if (replica.subscription->lost() > 0) {
+                startSync(io, conn);
+                return flush(io, conn);
+            }
+
+            if (read > 0) {
+                const uint64_t position {replica.subscription->position()};
+                replica.offset.store(position, std::memory_order_relaxed);
+                replication::appendOffset(conn.out, position, m_cache.changesPublished());
+            }
+
+            if (!flush(io, conn)) {
+                return false;
+            }
+            if (read < DELIVERY_BATCH) {
+                return true;
+            }
+        }
+
+        io.deliveryPending = true;
+        return true;
+    }
+
+    std::string Server::replicationInfo() {
+        std::string text {"\r\n# Replication\r\n"};
+
+        if (m_replicaLink) {
+            const ReplicaStatus status {m_replicaLink->status()};
+            text += "role:replica\r\n";
+            text += "master:" + status.primary + "\r\n";
+            text += std::string("master_link_status:") + (status.linkUp ? "up" : "down") + "\r\n";
+            text += std::string("master_sync_in_progress:") + (status.syncing ? "1" : "0") + "\r\n";
+            text += "master_last_io_seconds_ago:" + (status.sinceLastIo
+                ? std::to_string(std::chrono::duration_cast<std::chrono::seconds>(*status.sinceLastIo).count())
+                : std::string("-1")) + "\r\n";
+            text += "master_repl_offset:" + std::to_string(status.primaryOffset) + "\r\n";
+            text += "repl_offset:" + std::to_string(status.offset) + "\r\n";
+            text += "repl_lag:" + std::to_string(status.primaryOffset > status.offset
+                ? status.primaryOffset - status.offset : 0) + "\r\n";
+            text += "full_syncs:" + std::to_string(status.fullSyncs) + "\r\n";
+            text += "replicated_writes:" + std::to_string(status.writesApplied) + "\r\n";
+            return text;
+        }
+
+        const uint64_t published {m_cache.changesPublished()};
+        std::lock_guard<std::mutex> lock(m_replicasMutex);
+        text += "role:master\r\n";
+        text += "connected_replicas:" + std::to_string(m_replicas.size()) + "\r\n";
+        text += "master_repl_offset:" + std::to_string(published) + "\r\n";
+        for (size_t i {0}; i < m_replicas.size(); ++i) {
+            const ReplicaFeed& replica {*m_replicas[i]};
+            const bool syncing {replica.syncing.load(std::memory_order_relaxed)};
+            const uint64_t offset {replica.offset.load(std::memory_order_relaxed)};
+            text += "replica" + std::to_string(i) + ":state=" + (syncing ? "sync" : "online")
+                + ",offset=" + std::to_string(offset)
+                + ",lag=" + std::to_string(published > offset ? published - offset : 0)
+                + ",full_syncs=" + std::to_string(replica.fullSyncs.load(std::memory_order_relaxed)) + "\r\n";
+        }
+        return text;
+    }
+
+    std::string Server::info() {
+        CacheMetrics metrics {m_cache.metrics()};
+
+        std::lock_guard<std::mutex> lock(m_infoMutex);
+        std::string text {formatInfo(metrics, m_lastInfo ? &*m_lastInfo : nullptr)};
+        m_lastInfo = std::move(metrics);
+        text += replicationInfo();
+        return text;
+    }
+
+    void Server::dumpMetrics() {
+        const std::string& path {m_config.metricsFile};
+        const std::string tmpPath {path + ".tmp"};
+
+        std::unique_lock<std::mutex> lock(m_metricsMutex);
+        while (!m_metricsStopping) {
+            lock.unlock();
+            {
+                // Readers must never see a half-written file.
+                std::ofstream file(tmpPath, std::ios::trunc);
+                file << formatPrometheus(m_cache.metrics());
+                file.close();
+                if (!file || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+                    std::cerr << "Failed to write metrics file " << path << "\n";
+                }
+            }
+            lock.lock();
+
+            m_metricsCv.wait_for(lock, m_config.metricsInterval, [this] { return m_metricsStopping; });
+        }
+    }
+
+    void Server::runLoop(IoThread& io) {
+        epoll_event events[MAX_EVENTS];
+
+        while (m_running.load(std::memory_order_relaxed)) {
+            int n {epoll_wait(io.epollFd, events, MAX_EVENTS, io.deliveryPending ? 0 : -1)};
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+
+            for (int i {0}; i < n; ++i) {
+                const int fd {events[i].data.fd};
+                const uint32_t mask {events[i].events};
+
+                if (fd == io.wakeFd) {
+                    uint64_t count {0};
+                    ssize_t ignored {read(io.wakeFd, &count, sizeof(count))};
+                    (void)ignored;
+                    io.changesReady = true;
+                    finishSyncs(io);
+                    continue;
+                }
+
+                if (std::find(m_listenFds.begin(), m_listenFds.end(), fd) != m_listenFds.end()) {
+                    acceptConnections(io, fd);
+                    continue;
+                }
+
+                auto it {io.connections.find(fd)};
+                if (it == io.connections.end()) {
+                    continue;
+                }
+                Connection& conn {*it->second};
+
+                bool keep {true};
+                if (mask & (EPOLLERR | EPOLLHUP)) {
+                    keep = false;
+                }
+                if (keep && (mask & EPOLLOUT)) {
+                    keep = flush(io, conn);
+                    // Output drained: run the commands that waited for it, then feed a subscriber or replica.
+                    if (keep && !conn.wantWrite && conn.inPos < conn.in.size()) {
+                        keep = processInput(io, conn);
+                    }
+                    if (keep && (conn.subscriber || conn.replica) && !conn.wantWrite) {
+                        keep = deliverChanges(io, conn);
+                    }
+                }
+                if (keep && (mask & EPOLLIN) && !conn.wantWrite) {
+                    keep = handleReadable(io, conn);
+                }
+
+                if (!keep) {
+                    closeConnection(io, fd);
+                }
+            }
+
+            if (!io.subscribers.empty() && (io.changesReady || io.deliveryPending)) {
+                deliverChanges(io);
+            }
+        }
+    }
+
+    void Server::acceptConnections(IoThread& io, int listenFd) {
+        while (true) {
+            int fd {accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+            if (fd < 0) {
+                // EAGAIN: another thread got there first or the queue is drained.
+                return;
+            }
+
+            int one {1};
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            epoll_event ev {};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            if (epoll_ctl(io.epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                close(fd);
+                continue;
+            }
+
+            auto conn {std::make_unique<Connection>()};
+            conn->fd = fd;
+            io.connections.emplace(fd, std::move(conn));
+        }
+    }
+
+    void Server::closeConnection(IoThread& io, int fd) {
+        auto it {io.connections.find(fd)};
+        if (it != io.connections.end() && it->second->replica) {
+            std::lock_guard<std::mutex> lock(m_replicasMutex);
+            m_replicas.erase(std::find(m_replicas.begin(), m_replicas.end(), it->second->replica.get()));
+        }
+        io.subscribers.erase(fd);
+        epoll_ctl(io.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        io.connections.erase(fd);
+    }
+
+    bool Server::handleReadable(IoThread& io, Connection& conn) {
+        const size_t oldSize {conn.in.size()};
+        conn.in.resize(oldSize + READ_CHUNK);
+
+        ssize_t n {read(conn.fd, &conn.in[oldSize], READ_CHUNK)};
+        if (n <= 0) {
+            conn.in.resize(oldSize);
+            return n < 0 && (errno == EAGAIN || errno == EINTR);
+        }
+        conn.in.resize(oldSize + static_cast<size_t>(n));
+
+        return processInput(io, conn);
+    }
+
+    bool Server::processInput(IoThread& io, Connection& conn) {
+        /*
+        * Execute the complete commands in the buffer. Replies accumulate in
+        * conn.out and go out together in the flush below, or earlier once a
+        * pipeline has built up OUTPUT_FLUSH_BYTES of them (or a full iovec
+        * batch of queued values). If the socket then takes no more, the rest
+        * waits in conn.in until EPOLLOUT drains the output, and flush() stops
+        * reading meanwhile: a client that does not read its replies gets TCP
+        * backpressure instead of an output buffer that grows without bound.
+        */
+        std::vector<std::string> args {};
+        while (!conn.closeAfterWrite && !conn.wantWrite) {
+            std::string_view pending {conn.in};
+            pending.remove_prefix(conn.inPos);
+
+            size_t consumed {0};
+            std::string error {};
+            resp::ParseStatus status {resp::parseCommand(pending, consumed, args, error)};
+
+            if (status == resp::ParseStatus::INCOMPLETE) {
+                break;
+            }
+
+            if (status == resp::ParseStatus::ERROR) {
+                resp::appendError(conn.out, "ERR Protocol error: " + error);
+                conn.closeAfterWrite = true;
+                break;
+            }
+
+            conn.inPos += consumed;
+            if (!args.empty()) {
+                execute(args, conn);
+            }
+
+            if ((conn.out.size() >= OUTPUT_FLUSH_BYTES || conn.queued.size() >= MAX_IOVECS) && !flush(io, conn)) {
+                return false;
+            }
+        }
+
+        // Drop consumed bytes; a partial command stays at the front of the buffer.
+        if (conn.inPos == conn.in.size()) {
+            conn.in.clear();
+            conn.inPos = 0;
+        } else if (conn.inPos > 0) {
+            conn.in.erase(0, conn.inPos);
+            conn.inPos = 0;
+        }
+
+        if (conn.in.size() > MAX_QUERY_BUFFER) {
+            return false;
+        }
+
+        // A replica that just sent SYNC waits for its snapshot.
+        if (conn.replica && conn.replica->syncId == 0) {
+            startSync(io, conn);
+        }
+
+        // A connection that just subscribed arms the feed on this loop iteration.
+        if (!conn.subscriber && !conn.replica) {
+            io.subscribers.erase(conn.fd);
+        } else if (io.subscribers.insert(conn.fd).second) {
+            io.changesReady = true;
+        }
+
+        return flush(io, conn);
+    }
+
+    void Server::appendValue(Connection& conn, ValueRef value) {
+        if (value.size() < ZERO_COPY_MIN) {
+            resp::appendBulkString(conn.out, value.view());
+            return;
+        }
+
+        resp::appendBulkHeader(conn.out, value.size());
+        conn.queued.push_back({std::move(conn.out), std::nullopt});
+        conn.queued.push_back({std::string(), std::move(value)});
+        conn.out = "\r\n";
+    }
+
+    bool Server::flush(IoThread& io, Connection& conn) {
+        while (!conn.queued.empty() || conn.outPos < conn.out.size()) {
+            // Gather the queued segments and the output buffer into one write.
+            iovec iov[MAX_IOVECS];
+            size_t count {0};
+            size_t offset {conn.outPos};
+            for (const auto& segment : conn.queued) {
+                if (count == MAX_IOVECS) {
+                    break;
+                }
+                const std::string_view bytes {segment.view()};
+                iov[count++] = {const_cast<char*>(bytes.data()) + offset, bytes.size() - offset};
+                offset = 0;
+            }
+            if (count < MAX_IOVECS) {
+                iov[count++] = {conn.out.data() + offset, conn.out.size() - offset};
+            }
+
+            msghdr msg {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+
+            ssize_t n {sendmsg(conn.fd, &msg, MSG_NOSIGNAL)};
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN) {
+                    return false;
+                }
+
+                // Socket buffer is full; wait for EPOLLOUT before writing (or reading) more.
+                if (!conn.wantWrite) {
+                    epoll_event ev {};
+                    ev.events = EPOLLOUT;
+                    ev.data.fd = conn.fd;
+                    epoll_ctl(io.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+                    conn.wantWrite = true;
+                }
+                return true;
+            }
+
+            // Retire fully written segments; the value references go with them.
+            size_t written {static_cast<size_t>(n)};
+            while (!conn.queued.empty() && written >= conn.queued.front().view().size() - conn.outPos) {
+                written -= conn.queued.front().view().size() - conn.outPos;
+                conn.queued.pop_front();
+                conn.outPos = 0;
+            }
+            conn.outPos += written;
+        }
+
+        conn.out.clear();
+        conn.outPos = 0;
+
+        if (conn.wantWrite) {
+            epoll_event ev {};
+            ev.events = EPOLLIN;
+            ev.data.fd = conn.fd;
+            epoll_ctl(io.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+            conn.wantWrite = false;
+        }
+
+        return !conn.closeAfterWrite;
+    }
+
+    void Server::execute(std::vector<std::string>& args, Connection& conn) {
+        std::string& out {conn.out};
+        std::string& cmd {args[0]};
+        toUpper(cmd);
+
+        // A replica feed only listens; the primary ignores anything it sends.
+        if (conn.replica) {
+            return;
+        }
+
+        if (cmd == "SYNC") {
+            if (m_replicaLink) {
+                resp::appendError(out, "ERR SYNC is not supported by a replica");
+            } else if (conn.subscriber) {
+                resp::appendError(out, "ERR Can't execute 'sync' in subscribed mode");
+            } else {
+                // The snapshot is requested once the command loop is done (see handleReadable()).
+                conn.replica = std::make_unique<ReplicaFeed>();
+                std::lock_guard<std::mutex> lock(m_replicasMutex);
+                m_replicas.push_back(conn.replica.get());
+            }
+            return;
+        }
+
+        if (m_replicaLink && isWriteCommand(cmd)) {
+            resp::appendError(out, "READONLY You can't write against a read only replica.");
+            return;
+        }
+
+        if (cmd == "SUBSCRIBE" || cmd == "PSUBSCRIBE" || cmd == "UNSUBSCRIBE" || cmd == "PUNSUBSCRIBE") {
+            executeSubscribe(args, conn);
+            return;
+        }
+
+        // Like Redis, a subscribed connection only manages its subscriptions.
+        if (conn.subscriber) {
+            if (cmd == "PING") {
+                resp::appendArrayHeader(out, 2);
+                resp::appendBulkString(out, "pong");
+                resp::appendBulkString(out, args.size() > 1 ? args[1] : "");
+                return;
+            }
+            if (cmd != "QUIT" && cmd != "PUBSUB") {
+                resp::appendError(out, "ERR Can't execute '" + toLower(cmd)
+                    + "': only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING / QUIT / PUBSUB are allowed in this context");
+                return;
+            }
+        }
+
+        if (cmd == "GET") {
+            if (args.size() == 5) {
+                executeGetAsOf(args, conn);
+                return;
+            }
+            if (args.size() != 2) {
+                resp::appendError(out, "ERR wrong number of arguments for 'GET'");
+                return;
+            }
+
+            bool wrongType {false};
+            auto value {m_cache.getRef(args[1], &wrongType)};
+            if (value) {
+                appendValue(conn, std::move(*value));
+            } else if (wrongType) {
+                resp::appendError(out, WRONG_TYPE_ERROR);
+            } else {
+                resp::appendNull(out);
+            }
+            return;
+        }
+
+        if (cmd == "SET") {
+            if (args.size() != 3 && args.size() != 4) {
+                resp::appendError(out, "ERR wrong number of arguments for 'SET'");
+                return;
+            }
+
+            auto entry {util::buildCacheEntry(args)};
+            if (!entry) {
+                resp::appendError(out, "ERR invalid TTL, expected a non-negative number of seconds");
+                return;
+            }
+
+            m_cache.set(args[1], std::move(*entry));
+            resp::appendSimpleString(out, "OK");
+            return;
+        }
+
+        if (cmd == "MGET") {
+            if (args.size() < 2) {
+                resp::appendError(out, "ERR wrong number of arguments for 'MGET'");
+                return;
+            }
+
+            std::vector<std::string_view> keys(args.begin() + 1, args.end());
+            bool wrongType {false};
+            auto values {m_cache.multiGet(keys, &wrongType)};
+            if (wrongType) {
+                resp::appendError(out, WRONG_TYPE_ERROR);
+                return;
+            }
+
+            resp::appendArrayHeader(out, values.size());
+            for (auto& value : values) {
+                if (value) {
+                    appendValue(conn, std::move(*value));
+                } else {
+                    resp::appendNull(out);
+                }
+            }
+            return;
+        }
+
+        if (cmd == "MSET") {
+            if (args.size() < 3 || args.size() % 2 != 1) {
+                resp::appendError(out, "ERR wrong number of arguments for 'MSET'");
+                return;
+            }
+
+            std::vector<std::string_view> keys {};
+            std::vector<CacheEntry> entries {};
+            keys.reserve(args.size() / 2);
+            entries.reserve(args.size() / 2);
+            for (size_t i {1}; i + 1 < args.size(); i += 2) {
+                keys.push_back(args[i]);
+                entries.push_back({std::move(args[i + 1]), std::nullopt, {}});
+            }
+
+            m_cache.multiSet(keys, std::move(entries));
+            resp::appendSimpleString(out, "OK");
+            return;
+        }
+
+        if (cmd == "INCR" || cmd == "DECR" || cmd == "INCRBY" || cmd == "DECRBY" || cmd == "INCRBYFLOAT") {
+            executeIncrement(args, conn);
+            return;
+        }
+
+        if (isSortedSetCommand(cmd)) {
+            executeSortedSet(args, conn);
+            return;
+        }
+
+        if (cmd == "REPLAY") {
+            executeReplay(args, conn);
+            return;
+        }
+
+        if (cmd == "SCAN") {
+            size_t cursor {0};
+            size_t count {Cache::DEFAULT_SCAN_COUNT};
+            std::string_view pattern {};
+            bool valid {args.size() >= 2 && args.size() % 2 == 0 && parseCount(args[1], cursor)};
+
+            for (size_t i {2}; valid && i + 1 < args.size(); i += 2) {
+                std::string option {args[i]};
+                toUpper(option);
+                if (option == "MATCH") {
+                    pattern = args[i + 1];
+                } else if (option == "COUNT") {
+                    valid = parseCount(args[i + 1], count) && count > 0;
+                } else {
+                    valid = false;
+                }
+            }
+
+            if (!valid) {
+                resp::appendError(out, "ERR usage: SCAN cursor [MATCH pattern] [COUNT count]");
+                return;
+            }
+
+            // "*" matches everything; skip the filter.
+            ScanResult result {m_cache.scan(cursor, count, pattern == "*" ? std::string_view{} : pattern)};
+            resp::appendArrayHeader(out, 2);
+            resp::appendBulkString(out, std::to_string(result.cursor));
+            resp::appendArrayHeader(out, result.keys.size());
+            for (const std::string& key : result.keys) {
+                resp::appendBulkString(out, key);
+            }
+            return;
+        }
+
+        if (cmd == "SNAPSHOT") {
+            if (m_config.snapshotPath.empty()) {
+                resp::appendError(out, "ERR snapshots are disabled (no data directory configured)");
+            } else if (!startSnapshot()) {
+                resp::appendError(out, "ERR snapshot already in progress");
+            } else {
+                resp::appendSimpleString(out, "Snapshot started");
+            }
+            return;
+        }
+
+        if (cmd == "RESHARD") {
+            size_t numShards {0};
+            if (args.size() != 2 || !parseCount(args[1], numShards)) {
+                resp::appendError(out, "ERR usage: RESHARD <shard-count>");
+            } else if (m_cache.executionMode() == ExecutionMode::THREAD_PER_CORE) {
+                resp::appendError(out, "ERR resharding is not supported in thread-per-core mode");
+            } else if (m_cache.resharding()) {
+                resp::appendError(out, "ERR resharding already in progress");
+            } else if (numShards <= m_cache.shardCount() || numShards > Cache::MAX_SHARDS) {
+                resp::appendError(out, "ERR shard count must grow, up to " + std::to_string(Cache::MAX_SHARDS));
+            } else if (!m_cache.reshard(numShards)) {
+                resp::appendError(out, "ERR resharding already in progress");
+            } else {
+                resp::appendSimpleString(out, "Resharding started");
+            }
+            return;
+        }
+
+        if (cmd == "INFO") {
+            // Sections are not selectable: INFO always replies with all of them.
+            if (args.size() > 2) {
+                resp::appendError(out, "ERR wrong number of arguments for 'INFO'");
+                return;
+            }
+            resp::appendBulkString(out, info());
+            return;
+        }
+
+        if (cmd == "METRICS") {
+            if (args.size() != 1) {
+                resp::appendError(out, "ERR wrong number of arguments for 'METRICS'");
+                return;
+            }
+            resp::appendBulkString(out, formatPrometheus(m_cache.metrics()));
+            return;
+        }
+
+        if (cmd == "SLOWLOG") {
+            executeSlowLog(args, out);
+            return;
+        }
+
+        if (cmd == "PUBSUB") {
+            std::string sub {args.size() == 2 ? args[1] : ""};
+            toUpper(sub);
+            if (sub != "LAG") {
+                resp::appendError(out, "ERR usage: PUBSUB LAG");
+                return;
+            }
+
+            // [writes not yet delivered, writes lost]; zeros when not subscribed.
+            const ChangeSubscription* subscription {conn.subscriber ? conn.subscriber->subscription.get() : nullptr};
+            resp::appendArrayHeader(out, 2);
+            resp::appendInteger(out, subscription ? static_cast<int64_t>(m_cache.changeLag(*subscription)) : 0);
+            resp::appendInteger(out, subscription ? static_cast<int64_t>(subscription->lost()) : 0);
+            return;
+        }
+
+        if (cmd == "PING") {
+            if (args.size() > 1) {
+                resp::appendBulkString(out, args[1]);
+            } else {
+                resp::appendSimpleString(out, "PONG");
+            }
+            return;
+        }
+
+        if (cmd == "QUIT") {
+            resp::appendSimpleString(out, "OK");
+            conn.closeAfterWrite = true;
+            return;
+        }
+
+        if (cmd == "COMMAND") {
+            // Sent by redis-cli on connect; an empty reply is enough for it.
+            resp::appendArrayHeader(out, 0);
+            return;
+        }
+
+        resp::appendError(out, "ERR unknown command '" + args[0] + "'");
+    }
+}
@@ -0,0 +1,212 @@
+#include <iostream>
+#include <string>
+#include <optional>
+#include <csignal>
+#include <pthread.h>
+#include "cache.h"
+#include "server.h"
+
+namespace {
+
+    void printUsage() {
+        std::cout << "Usage: streamcache-server [--bind <addr>] [--port <port>] [--unix <path>]\n"
+                  << "                          [--io-threads <n>] [--shards <n>] [--eviction-threads <n>]\n"
+                  << "                          [--dir <data-dir>] [--appendfsync always|everysec|no]\n"
+                  << "                          [--maxmemory <bytes>[k|m|g]] [--maxmemory-policy lru|lfu|wtinylfu]\n"
+                  << "                          [--log-max-entries <n>] [--batch-threads <n>] [--thread-per-core]\n"
+                  << "                          [--metrics-file <path>] [--metrics-interval <seconds>]\n"
+                  << "                          [--slowlog-log-slower-than <us>] [--slowlog-max-len <n>]\n"
+                  << "                          [--replicaof <host:port>|<unix-socket-path>]\n";
+    }
+
+    /*
+    * Parses a byte count with an optional k/m/g suffix (powers of 1024).
+    */
+    std::optional<size_t> parseMemorySize(const std::string& text) {
+        size_t pos {0};
+        const unsigned long long value {std::stoull(text, &pos)};
+        const std::string suffix {text.substr(pos)};
+
+        if (suffix.empty() || suffix == "b" || suffix == "B") {
+            return static_cast<size_t>(value);
+        }
+        if (suffix == "k" || suffix == "K" || suffix == "kb" || suffix == "KB") {
+            return static_cast<size_t>(value) << 10;
+        }
+        if (suffix == "m" || suffix == "M" || suffix == "mb" || suffix == "MB") {
+            return static_cast<size_t>(value) << 20;
+        }
+        if (suffix == "g" || suffix == "G" || suffix == "gb" || suffix == "GB") {
+            return static_cast<size_t>(value) << 30;
+        }
+        return std::nullopt;
+    }
+}
+
+/*
+ * Entry point for the network server mode.
+ */
+int main(int argc, char** argv) {
+    streamcache::ServerConfig config {};
+    size_t numShards {streamcache::Cache::defaultShardCount()};
+    size_t evictionThreads {streamcache::EvictionScheduler::DEFAULT_WORKERS};
+    std::string dataDir {};
+    streamcache::FsyncPolicy fsyncPolicy {streamcache::FsyncPolicy::EVERYSEC};
+    size_t maxMemory {0};
+    streamcache::EvictionPolicy evictionPolicy {streamcache::EvictionPolicy::WTINYLFU};
+    size_t maxLogRecords {streamcache::LogRing::DEFAULT_MAX_RECORDS};
+    size_t batchThreads {0};
+    streamcache::ExecutionMode executionMode {streamcache::ExecutionMode::SHARED};
+    long long slowLogThresholdMicros {10000};    // as in Redis; negative disables tracing
+    size_t slowLogMaxLen {streamcache::SlowLog::DEFAULT_MAX_LEN};
+
+    for (int i {1}; i < argc; ++i) {
+        const std::string arg {argv[i]};
+        const bool hasValue {i + 1 < argc};
+
+        try {
+            if (arg == "--bind" && hasValue) {
+                config.bindAddress = argv[++i];
+            } else if (arg == "--port" && hasValue) {
+                config.port = static_cast<uint16_t>(std::stoi(argv[++i]));
+            } else if (arg == "--unix" && hasValue) {
+                config.unixSocket = argv[++i];
+            } else if (arg == "--io-threads" && hasValue) {
+                config.ioThreads = std::stoul(argv[++i]);
+            } else if (arg == "--shards" && hasValue) {
+                numShards = std::stoul(argv[++i]);
+            } else if (arg == "--eviction-threads" && hasValue) {
+                evictionThreads = std::stoul(argv[++i]);
+            } else if (arg == "--batch-threads" && hasValue) {
+                batchThreads = std::stoul(argv[++i]);
+            } else if (arg == "--thread-per-core") {
+                executionMode = streamcache::ExecutionMode::THREAD_PER_CORE;
+            } else if (arg == "--metrics-file" && hasValue) {
+                config.metricsFile = argv[++i];
+            } else if (arg == "--metrics-interval" && hasValue) {
+                config.metricsInterval = std::chrono::seconds(std::stoul(argv[++i]));
+                if (config.metricsInterval.count() == 0) {
+                    printUsage();
+                    return 1;
+                }
+            } else if (arg == "--slowlog-log-slower-than" && hasValue) {
+                slowLogThresholdMicros = std::stoll(argv[++i]);
+            } else if (arg == "--slowlog-max-len" && hasValue) {
+                slowLogMaxLen = std::stoul(argv[++i]);
+                if (slowLogMaxLen > streamcache::SlowLog::CAPACITY) {
+                    printUsage();
+                    return 1;
+                }
+            } else if (arg == "--replicaof" && hasValue) {
+                config.replicaOf = argv[++i];
+                if (!streamcache::ReplicationSource::parse(config.replicaOf)) {
+                    printUsage();
+                    return 1;
+                }
+            } else if (arg == "--dir" && hasValue) {
+                dataDir = argv[++i];
+            } else if (arg == "--appendfsync" && hasValue) {
+                auto policy {streamcache::parseFsyncPolicy(argv[++i])};
+                if (!policy) {
+                    printUsage();
+                    return 1;
+                }
+                fsyncPolicy = *policy;
+            } else if (arg == "--maxmemory" && hasValue) {
+                auto bytes {parseMemorySize(argv[++i])};
+                if (!bytes) {
+                    printUsage();
+                    return 1;
+                }
+                maxMemory = *bytes;
+            } else if (arg == "--log-max-entries" && hasValue) {
+                maxLogRecords = std::stoul(argv[++i]);
+                if (maxLogRecords == 0) {
+                    printUsage();
+                    return 1;
+                }
+            } else if (arg == "--maxmemory-policy" && hasValue) {
+                auto policy {streamcache::parseEvictionPolicy(argv[++i])};
+                if (!policy) {
+                    printUsage();
+                    return 1;
+                }
+                evictionPolicy = *policy;
+            } else {
+                printUsage();
+                return arg == "--help" ? 0 : 1;
+            }
+        } catch (const std::exception&) {
+            printUsage();
+            return 1;
+        }
+    }
+
+    // A replica's data is its primary's; it keeps no AOF or snapshot of its own.
+    if (numShards == 0 || numShards > streamcache::Cache::MAX_SHARDS || evictionThreads == 0
+        || (!config.replicaOf.empty() && !dataDir.empty())) {
+        printUsage();
+        return 1;
+    }
+
+    /*
+    * Block the shutdown signals before any thread is started so that every thread
+    * inherits the mask and only sigwait() below ever sees them.
+    */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    if (!dataDir.empty()) {
+        config.snapshotPath = dataDir + "/dump.snapshot";
+    }
+
+    streamcache::Cache cache(numShards, evictionThreads, executionMode);
+    streamcache::Server server(cache, config);
+
+    // Set before recovery so a data set larger than the limits is trimmed while loading.
+    cache.setMaxLogRecords(maxLogRecords);
+    cache.setBatchWorkers(batchThreads);
+    cache.slowLog().setMaxLen(slowLogMaxLen);
+    cache.slowLog().setThreshold(std::chrono::microseconds(slowLogThresholdMicros));
+    if (maxMemory > 0) {
+        cache.setMemoryLimit(maxMemory, evictionPolicy);
+    }
+
+    try {
+        /*
+        * Recovery order: the snapshot first, then whatever the AOF recorded after it.
+        */
+        if (!dataDir.empty()) {
+            size_t loaded {cache.loadSnapshot(config.snapshotPath)};
+            size_t recovered {cache.enableAof({dataDir, fsyncPolicy})};
+            std::cout << "Loaded " << loaded << " keys from snapshot and "
+                      << recovered << " AOF records from " << dataDir << "\n";
+        }
+
+        server.start();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to start server: " << e.what() << "\n";
+        return 1;
+    }
+
+    if (config.port != 0) {
+        std::cout << "Listening on " << config.bindAddress << ":" << config.port << "\n";
+    }
+    if (!config.unixSocket.empty()) {
+        std::cout << "Listening on " << config.unixSocket << "\n";
+    }
+    if (!config.replicaOf.empty()) {
+        std::cout << "Replicating from " << config.replicaOf << "\n";
+    }
+
+    int sig {0};
+    sigwait(&signals, &sig);
+
+    std::cout << "Shutting down.\n";
+    server.stop();
+
+    return 0;
+}
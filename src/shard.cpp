@@ -1,173 +1,971 @@
 #include "shard.h"
-#include "eviction_thread.h"
+#include "aof.h"
+#include "number_util.h"
+#include "time_util.h"
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 namespace streamcache {
-    Shard::Shard() : m_evictionThread(std::make_unique<EvictionThread>()) {
-        m_evictionThread->start(*this);
+    Shard::Shard(bool owned, SlowLog* slowLog, size_t index, ChangeFeed* changeFeed)
+        : m_mutex(owned), m_slowLog(slowLog), m_traceName("shard " + std::to_string(index)), m_changeFeed(changeFeed) {
     }
 
     Shard::~Shard() {
-        if (m_evictionThread) {
-            m_evictionThread->stop();
+        m_cache.forEach([this](StoredEntry& stored) {
+            const size_t bytes {sizeof(StoredEntry) + stored.key.size()};
+            stored.~StoredEntry();
+            m_slab.deallocate(&stored, bytes);
+        });
+    }
+
+    StoredEntry& Shard::recordFor(std::string_view key, uint64_t hash, bool& created) {
+        created = false;
+        if (StoredEntry* stored {m_cache.find(key, hash)}) {
+            return *stored;
+        }
+
+        // One slab block: the record, immediately followed by the key bytes.
+        void* mem {m_slab.allocate(sizeof(StoredEntry) + key.size())};
+        auto* stored {new (mem) StoredEntry(m_slab, m_logStats)};
+        char* keyBytes {reinterpret_cast<char*>(stored + 1)};
+        std::memcpy(keyBytes, key.data(), key.size());
+        stored->key = std::string_view(keyBytes, key.size());
+        stored->hash = hash;
+
+        created = true;
+        return *stored;
+    }
+
+    void Shard::linkRecord(StoredEntry& stored, std::optional<uint8_t> frequency) {
+        m_cache.insert(&stored);
+        m_indexBytes.store(m_cache.memoryBytes(), std::memory_order_relaxed);
+        if (m_policy) {
+            if (frequency) {
+                m_policy->onAdopt(stored, *frequency);
+            } else {
+                m_policy->onInsert(stored);
+            }
+        }
+    }
+
+    void Shard::destroyRecord(StoredEntry* stored) {
+        m_cache.erase(stored->key, stored->hash);
+        if (m_policy) {
+            m_policy->onRemove(*stored);
+        }
+
+        /*
+        * A reader that found the record before the erase may still read it: make
+        * it look expired, and keep the block until those readers have unpinned.
+        * After this the members own nothing, so the record is not destroyed; the
+        * slab's free-list link lands in the (unlinked) timer hooks, which readers
+        * never look at.
+        */
+        stored->log.clear();
+        stored->zset.reset();
+        stored->publish(Value(), Timestamp{});
+
+        m_slab.deallocateDeferred(stored, sizeof(StoredEntry) + stored->key.size());
+    }
+
+    void Shard::drainAccesses() {
+        m_accessBuffer.drain(*m_policy, [this](uint64_t hash) -> PolicyNode* {
+            return m_cache.findByHash(hash);
+        });
+    }
+
+    void Shard::setMemoryLimit(size_t maxBytes, EvictionPolicy policy) {
+        std::unique_lock<ShardMutex> lock(m_mutex);
+
+        if (maxBytes == 0) {
+            m_trackAccess.store(false, std::memory_order_relaxed);
+            m_policy.reset();
+            m_maxMemory = 0;
+            return;
+        }
+
+        if (m_policy && m_policyKind == policy) {
+            m_maxMemory = maxBytes;
+            enforceMemoryLimit(nullptr);
+            return;
         }
+
+        // Hits buffered for the old policy are spent on it rather than on the new one.
+        if (m_policy) {
+            drainAccesses();
+        }
+
+        m_policy = ReplacementPolicy::create(policy, [](const PolicyNode& node) {
+            return static_cast<const StoredEntry&>(node).hash;
+        });
+        m_policyKind = policy;
+        m_maxMemory = maxBytes;
+
+        m_cache.forEach([this](StoredEntry& stored) {
+            m_policy->onInsert(stored);
+        });
+        m_trackAccess.store(true, std::memory_order_relaxed);
+
+        enforceMemoryLimit(nullptr);
+    }
+
+    void Shard::enforceMemoryLimit(const StoredEntry* keep) {
+        /*
+        * Blocks waiting for readers to unpin are on their way out and do not count;
+        * otherwise every eviction would look like it freed nothing.
+        */
+        const auto liveBytes {[this] { return memoryStats().allocated - m_slab.deferredBytes(); }};
+
+        if (!m_policy || liveBytes() <= m_maxMemory) {
+            return;
+        }
+
+        // Apply buffered reads first, so recent hits protect their records.
+        drainAccesses();
+
+        while (liveBytes() > m_maxMemory) {
+            PolicyNode* node {m_policy->victim(keep)};
+            if (!node) {
+                break;
+            }
+
+            auto* victim {static_cast<StoredEntry*>(node)};
+            m_expiryWheel.cancel(*victim);
+            destroyRecord(victim);
+            m_memoryEvictions.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        m_indexBytes.store(m_cache.memoryBytes(), std::memory_order_relaxed);
+    }
+
+    ShardMetrics Shard::metrics() const {
+        ShardMetrics metrics {};
+        {
+            std::shared_lock<ShardMutex> lock(m_mutex);
+            metrics.keys = m_cache.size();
+            metrics.expiryTimers = m_expiryWheel.size();
+            metrics.logRecords = m_logStats.records;
+            metrics.logBytes = m_logStats.bytes;
+            metrics.logSealedRecords = m_logStats.sealedRecords;
+            metrics.logSealedBytes = m_logStats.sealedBytes;
+        }
+
+        metrics.memory = memoryStats();
+        metrics.memoryEvictions = memoryEvictions();
+        metrics.evictionLag = m_evictionLag.snapshot();
+        metrics.pruneTime = m_pruneTime.snapshot();
+        metrics.exclusiveWaits = m_mutex.exclusiveWaits();
+        metrics.sharedWaits = m_mutex.sharedWaits();
+        return metrics;
     }
 
-    void Shard::set(const std::string& key, CacheEntry entry) {
+    MemoryStats Shard::memoryStats() const {
+        MemoryStats stats {m_slab.stats()};
+        const size_t indexBytes {m_indexBytes.load(std::memory_order_relaxed)
+                                 + m_sortedSetIndexBytes.load(std::memory_order_relaxed)};
+        stats.allocated += indexBytes;
+        stats.reserved += indexBytes;
+        return stats;
+    }
+
+    std::optional<Timestamp> Shard::updateExpiry(StoredEntry& stored) {
+        const std::optional<Timestamp> before {m_expiryWheel.nextExpiry()};
+
+        if (stored.expiration) {
+            m_expiryWheel.schedule(stored, *stored.expiration);
+        } else {
+            m_expiryWheel.cancel(stored);
+        }
+
+        const std::optional<Timestamp> after {m_expiryWheel.nextExpiry()};
+        if (after && (!before || *after < *before)) {
+            return after;
+        }
+        return std::nullopt;
+    }
+
+    void Shard::set(std::string_view key, uint64_t hash, CacheEntry entry) {
         auto now {std::chrono::steady_clock::now()};
 
-        // Decide after unlocking whether to notify the eviction thread
+        // Decide after unlocking whether to notify the eviction scheduler
         std::optional<Timestamp> notifyAt;
 
         {
-            std::unique_lock<std::shared_mutex> lock(m_mutex);
-            
-            /*
-            * If the entry has no expiration, but the key already exists with an expiration,
-            * preserve the existing expiration time.
-            */
-            auto existingIt {m_cache.find(key)};
-            if (!entry.expiration && existingIt != m_cache.end()
-                && existingIt->second.expiration) {
-
-                entry.expiration = existingIt->second.expiration;
-            }
-            
-            entry.timeSet = now;
-            m_cache[key] = entry;
-            
-            if (entry.expiration) {
-                const Timestamp t = *entry.expiration;
-                m_evictionHeap.push({t, key});
-                notifyAt = t;
-            }
-
-            m_logs[key].push_back({now, entry.value});
-        }
-        
+            std::unique_lock<ShardMutex> lock(m_mutex);
+            notifyAt = setLocked(key, hash, entry, now);
+        }
+
         if (notifyAt) {
             notifyNewExpiry(*notifyAt);
         }
     }
 
-    std::optional<std::string> Shard::get(const std::string& key) {
-        std::shared_lock<std::shared_mutex> lock(m_mutex);
+    void Shard::multiSet(const BatchKey* keys, size_t count, CacheEntry* entries) {
+        auto now {std::chrono::steady_clock::now()};
+        std::optional<Timestamp> notifyAt;
 
-        auto it {m_cache.find(key)};
-        if (it != m_cache.end()) {
-            const auto& entry {it->second};
-            if (entry.expiration && *entry.expiration <= std::chrono::steady_clock::now()) {
-                // Entry is expired, don't serve it (cleanup left to eviction thread)
-                return std::nullopt;
+        {
+            std::unique_lock<ShardMutex> lock(m_mutex);
+
+            for (size_t i {0}; i < count; ++i) {
+                const BatchKey& batchKey {keys[i]};
+                std::optional<Timestamp> moved {setLocked(batchKey.key, batchKey.hash, entries[batchKey.index], now)};
+                if (moved && (!notifyAt || *moved < *notifyAt)) {
+                    notifyAt = moved;
+                }
             }
-            return entry.value;
         }
 
-        return std::nullopt;
+        // One wakeup for the whole batch: the earliest new deadline covers the rest.
+        if (notifyAt) {
+            notifyNewExpiry(*notifyAt);
+        }
     }
 
-    void Shard::evictExpired(Timestamp now) {
-        std::vector<std::string> expiredKeys {};
-        
+    bool Shard::setExisting(std::string_view key, uint64_t hash, CacheEntry& entry) {
+        auto now {std::chrono::steady_clock::now()};
+        std::optional<Timestamp> notifyAt;
+
         {
-            std::unique_lock<std::shared_mutex> lock(m_mutex);
-
-            while (!m_evictionHeap.empty() && m_evictionHeap.top().first <= now) {
-                std::pair<Timestamp, std::string> topEntry {m_evictionHeap.top()};
-                auto expiry {topEntry.first};
-                auto key {topEntry.second};
-                
-                auto it {m_cache.find(key)};
-                
-                if (it != m_cache.end()) {
-                    const auto& cacheEntry {it->second};
-                    
-                    /*
-                    * Remove the entry from the shard if it matches the expiration time.
-                    */
-                    if (cacheEntry.expiration && cacheEntry.expiration.value() == expiry) {
-                        expiredKeys.push_back(key);
-                        m_cache.erase(it);
-                    }
+            std::unique_lock<ShardMutex> lock(m_mutex);
+            if (!m_cache.find(key, hash)) {
+                return false;
+            }
+            notifyAt = setLocked(key, hash, entry, now);
+        }
+
+        if (notifyAt) {
+            notifyNewExpiry(*notifyAt);
+        }
+        return true;
+    }
+
+    std::optional<Timestamp> Shard::setLocked(std::string_view key, uint64_t hash, CacheEntry& entry, Timestamp now) {
+        std::optional<Timestamp> notifyAt;
+
+        bool created {false};
+        StoredEntry& stored {recordFor(key, hash, created)};
+        if (!created && m_policy) {
+            m_policy->onAccess(stored);
+        }
+
+        /*
+        * If the entry has no expiration, but the key already exists with an expiration,
+        * preserve the existing expiration time.
+        */
+        if (!entry.expiration && stored.expiration) {
+            entry.expiration = stored.expiration;
+        }
+
+        entry.timeSet = now;
+        const bool expiryChanged {entry.expiration != stored.expiration};
+
+        // A string overwrites a sorted set whole, members and their history alike.
+        if (stored.zset) {
+            stored.zset.reset();
+            stored.log.clear();
+        }
+
+        // The value is copied once; the newest log record shares its buffer.
+        stored.publish(Value(entry.value, m_slab), entry.expiration);
+        stored.timeSet = now;
+        if (created) {
+            linkRecord(stored);
+        }
+
+        if (expiryChanged) {
+            notifyAt = updateExpiry(stored);
+        }
+
+        stored.log.pushBack({now, stored.value}, m_maxLogRecords);
+
+        // Published under the lock too, so subscribers see a key's writes in order.
+        if (m_changeFeed && m_changeFeed->active()) {
+            m_changes.publish(stored.key, stored.value, entry.expiration, now);
+            m_changeFeed->published();
+        }
+
+        /*
+        * Queued while still holding the lock so the AOF order matches the
+        * order in which writes to the same key were applied.
+        */
+        if (m_aof) {
+            m_aof->appendSet(stored.key, entry);
+        }
+
+        enforceMemoryLimit(&stored);
+        return notifyAt;
+    }
+
+    IncrementResult Shard::incrBy(std::string_view key, uint64_t hash, int64_t delta, bool ifPresent) {
+        return increment(key, hash, ifPresent, [delta](std::optional<std::string_view> current, IncrementResult& result) {
+            int64_t value {0};
+            if (current && !util::parseInteger(*current, value)) {
+                return IncrementStatus::NOT_A_NUMBER;
+            }
+            if (__builtin_add_overflow(value, delta, &result.integer)) {
+                return IncrementStatus::OUT_OF_RANGE;
+            }
+            result.value = util::formatInteger(result.integer);
+            return IncrementStatus::OK;
+        });
+    }
+
+    IncrementResult Shard::incrByFloat(std::string_view key, uint64_t hash, double delta, bool ifPresent) {
+        return increment(key, hash, ifPresent, [delta](std::optional<std::string_view> current, IncrementResult& result) {
+            double value {0};
+            if (current && !util::parseDouble(*current, value)) {
+                return IncrementStatus::NOT_A_NUMBER;
+            }
+            const double sum {value + delta};
+            if (!std::isfinite(sum)) {
+                return IncrementStatus::OUT_OF_RANGE;
+            }
+            result.value = util::formatDouble(sum);
+            return IncrementStatus::OK;
+        });
+    }
+
+    template <typename Compute>
+    IncrementResult Shard::increment(std::string_view key, uint64_t hash, bool ifPresent, Compute compute) {
+        auto now {std::chrono::steady_clock::now()};
+        IncrementResult result {};
+        std::optional<Timestamp> notifyAt;
+
+        {
+            std::unique_lock<ShardMutex> lock(m_mutex);
+
+            StoredEntry* stored {m_cache.find(key, hash)};
+            if (stored && stored->expiration && *stored->expiration <= now) {
+                // Gone already as far as readers can tell: start over without its TTL and history.
+                m_expiryWheel.cancel(*stored);
+                destroyRecord(stored);
+                m_indexBytes.store(m_cache.memoryBytes(), std::memory_order_relaxed);
+                stored = nullptr;
+            }
+            if (!stored && ifPresent) {
+                result.status = IncrementStatus::MISSING;
+                return result;
+            }
+            if (stored && stored->zset) {
+                result.status = IncrementStatus::WRONG_TYPE;
+                return result;
+            }
+
+            std::optional<std::string_view> current {};
+            if (stored) {
+                current = stored->value.view();
+            }
+            result.status = compute(current, result);
+            if (result.status != IncrementStatus::OK) {
+                return result;
+            }
+
+            // No expiration: setLocked() keeps the key's current one.
+            CacheEntry entry {result.value, std::nullopt, {}};
+            notifyAt = setLocked(key, hash, entry, now);
+        }
+
+        if (notifyAt) {
+            notifyNewExpiry(*notifyAt);
+        }
+        return result;
+    }
+
+    SortedSetResult Shard::zadd(std::string_view key, uint64_t hash, const std::vector<ScoredMember>& members,
+                                const ZAddOptions& options, bool ifPresent) {
+        return updateSortedSet(key, hash, ifPresent, options.expiration, [&](auto score, auto write) {
+            SortedSetResult result {};
+            for (const ScoredMember& member : members) {
+                const std::optional<double> current {score(member.member)};
+                if (current ? options.nx : options.xx) {
+                    continue;
+                }
+                if (current && (*current == member.score || (options.gt && member.score < *current)
+                                || (options.lt && member.score > *current))) {
+                    continue;
+                }
+
+                write(member.member, member.score);
+                ++(current ? result.updated : result.added);
+            }
+            return result;
+        });
+    }
+
+    SortedSetResult Shard::zincrBy(std::string_view key, uint64_t hash, std::string_view member, double delta,
+                                   bool ifPresent) {
+        return updateSortedSet(key, hash, ifPresent, std::nullopt, [&](auto score, auto write) {
+            SortedSetResult result {};
+            const std::optional<double> current {score(member)};
+            result.score = current.value_or(0) + delta;
+            if (!std::isfinite(result.score)) {
+                result.status = SortedSetStatus::NOT_FINITE;
+                return result;
+            }
+
+            write(member, result.score);
+            ++(current ? result.updated : result.added);
+            return result;
+        });
+    }
+
+    template <typename Apply>
+    SortedSetResult Shard::updateSortedSet(std::string_view key, uint64_t hash, bool ifPresent,
+                                           std::optional<Timestamp> expiration, Apply apply) {
+        auto now {std::chrono::steady_clock::now()};
+        SortedSetResult result {};
+        std::optional<Timestamp> notifyAt;
+
+        {
+            std::unique_lock<ShardMutex> lock(m_mutex);
+
+            StoredEntry* stored {m_cache.find(key, hash)};
+            if (stored && stored->expiration && *stored->expiration <= now) {
+                m_expiryWheel.cancel(*stored);
+                destroyRecord(stored);
+                m_indexBytes.store(m_cache.memoryBytes(), std::memory_order_relaxed);
+                stored = nullptr;
+            }
+            if (!stored && ifPresent) {
+                result.status = SortedSetStatus::MISSING;
+                return result;
+            }
+            if (stored && !stored->zset) {
+                result.status = SortedSetStatus::WRONG_TYPE;
+                return result;
+            }
+
+            // Without a new expiration the key keeps its TTL.
+            if (!expiration && stored) {
+                expiration = stored->expiration;
+            }
+
+            bool created {false};
+            const auto score {[&stored](std::string_view member) -> std::optional<double> {
+                return stored ? stored->zset->score(member) : std::nullopt;
+            }};
+            const auto write {[&](std::string_view member, double memberScore) {
+                if (!stored) {
+                    stored = &recordFor(key, hash, created);
+                    stored->zset = std::make_unique<SortedSet>(m_slab, m_sortedSetIndexBytes);
+                    stored->publish(Value(), expiration, true);
+                    linkRecord(*stored);
+                }
+                stored->zset->set(member, memberScore);
+
+                // The update is encoded once; the log and the change ring share it.
+                Value update(encodeMemberUpdate(member, memberScore), m_slab);
+                stored->log.pushBack({now, update}, m_maxLogRecords);
+                if (m_changeFeed && m_changeFeed->active()) {
+                    m_changes.publish(stored->key, update, expiration, now, ChangeKind::ZADD);
+                    m_changeFeed->published();
+                }
+                if (m_aof) {
+                    m_aof->appendMember(stored->key, update.view(), now, expiration);
                 }
-                
+            }};
+
+            result = apply(score, write);
+            if (result.status != SortedSetStatus::OK || result.added + result.updated == 0) {
+                return result;
+            }
+
+            if (!created && m_policy) {
+                m_policy->onAccess(*stored);
+            }
+            // A new key was published with its expiration already.
+            const bool expiryChanged {stored->expiration != expiration};
+            if (expiryChanged) {
+                stored->publish(Value(), expiration, true);
+            }
+            if (expiryChanged || (created && expiration)) {
+                notifyAt = updateExpiry(*stored);
+            }
+            stored->timeSet = now;
+
+            enforceMemoryLimit(stored);
+        }
+
+        if (notifyAt) {
+            notifyNewExpiry(*notifyAt);
+        }
+        return result;
+    }
+
+    SortedSetStatus Shard::readSortedSet(std::string_view key, uint64_t hash,
+                                         const std::function<void(const SortedSet&)>& visit) {
+        std::shared_lock<ShardMutex> lock(m_mutex);
+        const auto now {std::chrono::steady_clock::now()};
+
+        StoredEntry* stored {m_cache.find(key, hash)};
+        if (!stored || (stored->expiration && *stored->expiration <= now)) {
+            return SortedSetStatus::MISSING;
+        }
+        if (!stored->zset) {
+            return SortedSetStatus::WRONG_TYPE;
+        }
+
+        if (m_policy) {
+            if (m_mutex.owned()) {
+                m_policy->onAccess(*stored);
+            } else {
+                m_accessBuffer.record(hash);
+            }
+        }
+
+        visit(*stored->zset);
+        return SortedSetStatus::OK;
+    }
+
+    void Shard::restore(std::string_view key, uint64_t hash, CacheEntry entry) {
+        std::optional<Timestamp> notifyAt;
+
+        {
+            std::unique_lock<ShardMutex> lock(m_mutex);
+
+            bool created {false};
+            StoredEntry& stored {recordFor(key, hash, created)};
+            auto& log {stored.log};
+
+            Value value(entry.value, m_slab);
+
+            if (created || stored.timeSet <= entry.timeSet) {
                 /*
-                * If the key isn't found or the expiration time doesn't match, it's a stale entry → pop it.
+                * If the previous incarnation of the key had already expired when this
+                * write happened, the live process evicted it along with its history.
+                * A sorted set's history goes with its members.
                 */
-                m_evictionHeap.pop();
+                if (!created && ((stored.expiration && *stored.expiration <= entry.timeSet) || stored.zset)) {
+                    log.clear();
+                    stored.zset.reset();
+                }
+
+                stored.publish(value, entry.expiration);
+                stored.timeSet = entry.timeSet;
+                notifyAt = updateExpiry(stored);
+            } else if (stored.zset) {
+                // Overwritten by a later sorted set: the string is not part of its history.
+                return;
+            }
+            if (created) {
+                linkRecord(stored);
+            }
+
+            // Keep the log time-ordered even if records arrive out of order.
+            log.insert({entry.timeSet, std::move(value)}, m_maxLogRecords);
+
+            enforceMemoryLimit(&stored);
+        }
+
+        if (notifyAt) {
+            notifyNewExpiry(*notifyAt);
+        }
+    }
+
+    void Shard::restoreMember(std::string_view key, uint64_t hash, CacheEntry entry) {
+        std::string_view member {};
+        double score {0};
+        if (!decodeMemberUpdate(entry.value, member, score)) {
+            return;
+        }
+
+        std::optional<Timestamp> notifyAt;
+
+        {
+            std::unique_lock<ShardMutex> lock(m_mutex);
+
+            bool created {false};
+            StoredEntry& stored {recordFor(key, hash, created)};
+            const bool newest {created || stored.timeSet <= entry.timeSet};
+
+            if (!created) {
+                if (!stored.zset && !newest) {
+                    return;
+                }
+
+                // A string written earlier, or an expired set, was gone by the time of this update.
+                if (!stored.zset || (stored.expiration && *stored.expiration <= entry.timeSet)) {
+                    stored.log.clear();
+                    stored.zset.reset();
+                }
+            }
+            const bool replaced {!stored.zset};
+            if (replaced) {
+                stored.zset = std::make_unique<SortedSet>(m_slab, m_sortedSetIndexBytes);
+            }
+            stored.zset->set(member, score);
+
+            if (newest || replaced) {
+                stored.publish(Value(), entry.expiration, true);
+                stored.timeSet = entry.timeSet;
+                notifyAt = updateExpiry(stored);
+            }
+            if (created) {
+                linkRecord(stored);
             }
+
+            stored.log.insert({entry.timeSet, Value(entry.value, m_slab)}, m_maxLogRecords);
+
+            enforceMemoryLimit(&stored);
+        }
+
+        if (notifyAt) {
+            notifyNewExpiry(*notifyAt);
+        }
+    }
+
+    void Shard::restore(std::string_view key, uint64_t hash, CacheEntry entry, std::deque<LogEntry> logs) {
+        std::optional<Timestamp> notifyAt;
+
+        {
+            std::unique_lock<ShardMutex> lock(m_mutex);
+            notifyAt = restoreLocked(key, hash, entry, logs, std::nullopt);
+        }
+
+        if (notifyAt) {
+            notifyNewExpiry(*notifyAt);
+        }
+    }
+
+    void Shard::adopt(std::string_view key, uint64_t hash, MigratedRecord record) {
+        std::optional<Timestamp> notifyAt;
+
+        {
+            std::unique_lock<ShardMutex> lock(m_mutex);
+            notifyAt = restoreLocked(key, hash, record.entry, record.logs, record.frequency);
+        }
+
+        if (notifyAt) {
+            notifyNewExpiry(*notifyAt);
+        }
+    }
+
+    std::optional<Timestamp> Shard::restoreLocked(std::string_view key, uint64_t hash, CacheEntry& entry,
+                                                  std::deque<LogEntry>& logs, std::optional<uint8_t> frequency) {
+        std::optional<Timestamp> notifyAt;
+
+        bool created {false};
+        StoredEntry& stored {recordFor(key, hash, created)};
+        Value value(entry.value, m_slab);
+
+        /*
+        * A migrated record always wins: the destination can only hold the key if
+        * it was written here while the old shard did not have it, i.e. before the
+        * write that the old shard is handing over.
+        */
+        if (created || frequency || stored.timeSet <= entry.timeSet) {
+            stored.zset.reset();
+            if (entry.members) {
+                stored.zset = std::make_unique<SortedSet>(m_slab, m_sortedSetIndexBytes);
+                for (const ScoredMember& member : *entry.members) {
+                    stored.zset->set(member.member, member.score);
+                }
+            }
+            stored.publish(value, entry.expiration, entry.members.has_value());
+            stored.timeSet = entry.timeSet;
+            notifyAt = updateExpiry(stored);
+        }
+        if (created) {
+            linkRecord(stored, frequency);
         }
 
         /*
-        * Erase the logs outside the lock to avoid holding it for potentially long operations.
+        * The snapshot stores the newest log record's value separately from the
+        * entry's; share the buffer again when they are the same write.
+        * Records are inserted at their time position, which is an append when
+        * the key had no log yet.
         */
-        for (auto& k: expiredKeys) {
-            m_logs.erase(k);
+        for (auto& logEntry : logs) {
+            if (logEntry.timestamp == entry.timeSet && logEntry.value == value.view()) {
+                stored.log.insert({logEntry.timestamp, value}, m_maxLogRecords);
+            } else {
+                stored.log.insert({logEntry.timestamp, Value(logEntry.value, m_slab)}, m_maxLogRecords);
+            }
         }
 
+        enforceMemoryLimit(&stored);
+        return notifyAt;
     }
 
-    std::deque<LogEntry> Shard::getLogsForReplay(const std::string& key, Timestamp cutoff) const {
-        std::shared_lock<std::shared_mutex> lock(m_mutex);
+    void Shard::markSnapshot(const std::string& nextAofPath, uint64_t* changeHead) {
+        std::shared_lock<ShardMutex> lock(m_mutex);
 
-        auto lit {m_logs.find(key)};
-        if (lit == m_logs.end()) {
-            return {};
+        // Writes publish and append under the exclusive lock, so both mark exactly the same point.
+        if (changeHead) {
+            *changeHead = m_changes.head();
+        }
+        if (m_aof && !nextAofPath.empty()) {
+            m_aof->rotate(nextAofPath);
         }
+    }
 
-        std::deque<LogEntry> replayLog {};
-        for (const auto& logEntry: lit->second) {
-            if (logEntry.timestamp >= cutoff) {
-                replayLog.push_back(logEntry);
+    size_t Shard::exportSnapshot(size_t cursor, const SnapshotVisitor& visit) const {
+        std::shared_lock<ShardMutex> lock(m_mutex);
+        return m_cache.scan(cursor, SNAPSHOT_BATCH, [&visit](const StoredEntry& stored) {
+            visit(stored);
+        });
+    }
+
+    void Shard::clear() {
+        std::unique_lock<ShardMutex> lock(m_mutex);
+
+        // Removing records never moves the others, so a plain slot walk sees each once.
+        for (size_t i {0}; i < m_cache.capacity(); ++i) {
+            if (StoredEntry* stored {m_cache.at(i)}) {
+                m_expiryWheel.cancel(*stored);
+                destroyRecord(stored);
             }
         }
 
-        return replayLog;
+        m_indexBytes.store(m_cache.memoryBytes(), std::memory_order_relaxed);
     }
 
-    void Shard::replay(const std::string& key) {
-        std::shared_lock<std::shared_mutex> lock(m_mutex);
-        
-        auto it {m_cache.find(key)};
-        if (it == m_cache.end()) {
-            std::cout << "Key not found.\n";
+    void Shard::attachAof(std::unique_ptr<AofWriter> aof) {
+        std::unique_lock<ShardMutex> lock(m_mutex);
+        m_aof = std::move(aof);
+    }
+
+    std::optional<std::string> Shard::get(std::string_view key, uint64_t hash) {
+        const auto now {std::chrono::steady_clock::now()};
+        if (m_mutex.owned()) {
+            auto ref {getLocked(key, hash, now)};
+            return ref ? std::optional<std::string>(ref->view()) : std::nullopt;
+        }
+
+        EpochDomain::Guard pin {EpochDomain::global().pin()};
+        if (!pin) {
+            std::shared_lock<ShardMutex> lock(m_mutex);
+            auto ref {getLocked(key, hash, now)};
+            return ref ? std::optional<std::string>(ref->view()) : std::nullopt;
+        }
+
+        // Copied straight from the snapshot: no refcount traffic on the buffer.
+        ValueSnapshot snapshot {};
+        if (!readPinned(key, hash, now, snapshot)) {
+            return std::nullopt;
+        }
+        return std::string(snapshot.view());
+    }
+
+    std::optional<ValueRef> Shard::getRef(std::string_view key, uint64_t hash, bool* wrongType) {
+        const auto now {std::chrono::steady_clock::now()};
+        if (m_mutex.owned()) {
+            return getLocked(key, hash, now, wrongType);
+        }
+
+        EpochDomain::Guard pin {EpochDomain::global().pin()};
+        if (!pin) {
+            std::shared_lock<ShardMutex> lock(m_mutex);
+            return getLocked(key, hash, now, wrongType);
+        }
+        return getPinned(key, hash, now, wrongType);
+    }
+
+    void Shard::multiGet(const BatchKey* keys, size_t count, std::optional<ValueRef>* results, bool* wrongTypes) {
+        const auto now {std::chrono::steady_clock::now()};
+        const auto wrongTypeOf {[wrongTypes](const BatchKey& key) {
+            return wrongTypes ? &wrongTypes[key.index] : nullptr;
+        }};
+        const auto readLocked {[&] {
+            std::shared_lock<ShardMutex> lock(m_mutex);
+            for (size_t i {0}; i < count; ++i) {
+                results[keys[i].index] = getLocked(keys[i].key, keys[i].hash, now, wrongTypeOf(keys[i]));
+            }
+        }};
+
+        if (m_mutex.owned()) {
+            readLocked();
+            return;
+        }
+
+        EpochDomain::Guard pin {EpochDomain::global().pin()};
+        if (!pin) {
+            readLocked();
             return;
         }
 
+        for (size_t i {0}; i < count; ++i) {
+            results[keys[i].index] = getPinned(keys[i].key, keys[i].hash, now, wrongTypeOf(keys[i]));
+        }
+    }
+
+    std::optional<ValueRef> Shard::getPinned(std::string_view key, uint64_t hash, Timestamp now, bool* wrongType) {
+        ValueSnapshot snapshot {};
+        while (readPinned(key, hash, now, snapshot, wrongType)) {
+            // Fails only if the value was overwritten and released meanwhile; read the new one.
+            if (std::optional<ValueRef> ref {snapshot.acquire()}) {
+                return ref;
+            }
+        }
+        return std::nullopt;
+    }
+
+    bool Shard::readPinned(std::string_view key, uint64_t hash, Timestamp now, ValueSnapshot& snapshot,
+                           bool* wrongType) {
+        const StoredEntry* stored {m_cache.find(key, hash)};
+        if (!stored) {
+            return false;
+        }
+
+        // Records retired after the lookup read as expired.
+        std::optional<Timestamp> expiration {};
+        bool sortedSet {false};
+        stored->read(snapshot, expiration, sortedSet);
+        if (expiration && *expiration <= now) {
+            return false;
+        }
+        if (sortedSet) {
+            if (wrongType) {
+                *wrongType = true;
+            }
+            return false;
+        }
+
+        if (m_trackAccess.load(std::memory_order_relaxed)) {
+            m_accessBuffer.record(hash);
+        }
+        return true;
+    }
+
+    std::optional<ValueRef> Shard::getLocked(std::string_view key, uint64_t hash, Timestamp now, bool* wrongType) {
+        if (StoredEntry* stored {m_cache.find(key, hash)}) {
+            if (stored->expiration && *stored->expiration <= now) {
+                // Entry is expired, don't serve it (cleanup left to the eviction scheduler)
+                return std::nullopt;
+            }
+            if (stored->zset) {
+                if (wrongType) {
+                    *wrongType = true;
+                }
+                return std::nullopt;
+            }
+            // Policy bookkeeping is deferred so GET never needs the exclusive lock.
+            if (m_policy) {
+                if (m_mutex.owned()) {
+                    m_policy->onAccess(*stored);
+                } else {
+                    m_accessBuffer.record(hash);
+                }
+            }
+            return ValueRef(stored->value);
+        }
+
+        return std::nullopt;
+    }
+
+    bool Shard::evictExpired(Timestamp now) {
+        SlowLogScope trace(m_slowLog, "EVICT", m_traceName);
+        std::unique_lock<ShardMutex> lock(m_mutex);
+
+        if (m_policy) {
+            drainAccesses();
+        }
+
         /*
-        * Use original TTL (expiration - timeSet) to create a fixed replay window.
+        * Every wheel node is the StoredEntry of a live key: overwrites move the
+        * timer instead of adding a new one, so there are no stale entries to skip.
         */
-        const auto& entry {it->second};
-        std::deque<LogEntry> replayLog;
-        
-        if (entry.expiration) {
-            auto originalTTL {entry.expiration.value() - entry.timeSet};
-            auto cutoff {std::chrono::steady_clock::now() - originalTTL};
-            replayLog = getLogsForReplay(key, cutoff);
-        } else {
-            // No expiration, show all logs
-            replayLog = getLogsForReplay(key, Timestamp{});
+        for (size_t evicted {0}; evicted < EVICTION_SLICE; ++evicted) {
+            auto* stored {static_cast<StoredEntry*>(m_expiryWheel.poll(now))};
+            if (!stored) {
+                return false;
+            }
+
+            m_evictionLag.record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - *stored->expiration).count()));
+
+            // The key's log lives in the record and goes with it.
+            destroyRecord(stored);
         }
 
-        if (replayLog.empty()) {
-            std::cout << "No recent history for key: " << key << "\n";
-            return;
+        m_indexBytes.store(m_cache.memoryBytes(), std::memory_order_relaxed);
+        return true;
+    }
+
+    std::optional<std::deque<LogEntry>> Shard::getReplay(std::string_view key, uint64_t hash) const {
+        std::deque<LogEntry> replayLog {};
+        const bool found {replay(key, hash, ReplayRange{}, [&replayLog](const LogRecordView& record) {
+            replayLog.push_back({record.timestamp, std::string(record.value)});
+        })};
+
+        if (!found) {
+            return std::nullopt;
+        }
+        return replayLog;
+    }
+
+    bool Shard::replay(std::string_view key, uint64_t hash, const ReplayRange& range,
+                       const std::function<void(const LogRecordView&)>& visit) const {
+        std::shared_lock<ShardMutex> lock(m_mutex);
+        const auto now {std::chrono::steady_clock::now()};
+
+        const StoredEntry* stored {m_cache.find(key, hash)};
+        if (!stored || (stored->expiration && *stored->expiration <= now)) {
+            return false;
+        }
+
+        /*
+        * The default window is the key's original TTL (expiration - timeSet)
+        * back from now; without an expiration it starts at the oldest record.
+        */
+        Timestamp from {Timestamp::min()};
+        if (range.from) {
+            from = *range.from;
+        } else if (stored->expiration) {
+            from = now - (*stored->expiration - stored->timeSet);
+        }
+
+        stored->log.forEach(from, range.to.value_or(Timestamp::max()), range.limit, visit);
+        return true;
+    }
+
+    std::optional<ValueRef> Shard::getAsOf(std::string_view key, uint64_t hash, Timestamp at) const {
+        std::shared_lock<ShardMutex> lock(m_mutex);
+
+        const StoredEntry* stored {m_cache.find(key, hash)};
+        if (!stored || stored->zset
+            || (stored->expiration && *stored->expiration <= std::chrono::steady_clock::now())) {
+            return std::nullopt;
         }
 
-        // Convert steady_clock timestamp to system_clock for display
-        auto sysNow = std::chrono::system_clock::now();
-        auto steadyNow = std::chrono::steady_clock::now();
+        // The current value holds from its write on, even once its log record is pruned.
+        if (at >= stored->timeSet) {
+            return ValueRef(stored->value);
+        }
+
+        return stored->log.valueAt(at);
+    }
+
+    size_t Shard::scanKeys(size_t cursor, size_t groups, std::vector<std::string>& keys) const {
+        std::shared_lock<ShardMutex> lock(m_mutex);
+        const auto now {std::chrono::steady_clock::now()};
+
+        return m_cache.scan(cursor, groups, [&keys, now](const StoredEntry& stored) {
+            if (!stored.expiration || *stored.expiration > now) {
+                keys.emplace_back(stored.key);
+            }
+        });
+    }
+
+    void Shard::replay(std::string_view key, uint64_t hash) {
+        auto replayLog {getReplay(key, hash)};
+        if (!replayLog) {
+            std::cout << "Key not found.\n";
+            return;
+        }
 
-        for (const auto& logEntry : replayLog) {
-            
-            // Explicitly cast the duration to system_clock duration
-            auto duration = std::chrono::duration_cast<std::chrono::system_clock::duration>(
-                logEntry.timestamp - steadyNow
-            );
-            auto sysTime = sysNow + duration;
+        if (replayLog->empty()) {
+            std::cout << "No recent history for key: " << key << "\n";
+            return;
+        }
 
-            std::time_t t = std::chrono::system_clock::to_time_t(sysTime);
+        for (const auto& logEntry : *replayLog) {
+            // Convert steady_clock timestamp to system_clock for display
+            std::time_t t = std::chrono::system_clock::to_time_t(util::toWallClock(logEntry.timestamp));
 
             // Format time as YYYY-MM-DD HH:MM:SS
             std::cout << "[" << std::put_time(std::localtime(&t), "%F %T") << "] "
@@ -176,47 +974,106 @@ namespace streamcache {
     }
 
     void Shard::pruneAllLogs(Timestamp cutoff) {
-        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        while (pruneLogs(cutoff)) {
+        }
+    }
 
-        auto startTime = std::chrono::steady_clock::now();
-        const auto MAX_PRUNE_TIME = std::chrono::milliseconds(5);
+    bool Shard::pruneLogs(Timestamp cutoff) {
+        SlowLogScope trace(m_slowLog, "PRUNE", m_traceName);
+        std::unique_lock<ShardMutex> lock(m_mutex);
+        const auto start {std::chrono::steady_clock::now()};
 
-        for (auto& [key, log] : m_logs) {
-            while (!log.empty() && log.front().timestamp < cutoff) {
-                log.pop_front();
-            }
+        /*
+        * Records, buffers and index tables retired for lock-free readers are
+        * otherwise only recycled by later writes.
+        */
+        m_slab.reclaimDeferred();
+        m_cache.reclaimRetired();
+        m_indexBytes.store(m_cache.memoryBytes(), std::memory_order_relaxed);
 
-            if (std::chrono::steady_clock::now() - startTime > MAX_PRUNE_TIME) {
-                break;
+        /*
+        * The cursor is a slot position, so it stays meaningful between batches
+        * even though writers run in between. A rehash can reorder keys mid-pass;
+        * the few that move behind the cursor are simply pruned on the next pass.
+        */
+        const size_t capacity {m_cache.capacity()};
+        const size_t end {std::min(capacity, m_pruneCursor + PRUNE_BATCH)};
+
+        for (size_t i {m_pruneCursor}; i < end; ++i) {
+            if (StoredEntry* stored {m_cache.at(i)}) {
+                stored->log.truncateBefore(cutoff);
+                stored->log.seal();
             }
         }
-    }
 
-    std::optional<Timestamp> Shard::peekNextExpiry() const {
-        std::shared_lock lock(m_mutex);
-        
-        if (m_evictionHeap.empty()) {
-            return std::nullopt;
-        }
+        m_pruneTime.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count()));
 
-        return m_evictionHeap.top().first;
+        if (end >= capacity) {
+            m_pruneCursor = 0;
+            return false;
+        }
+        m_pruneCursor = end;
+        return true;
     }
 
-    void Shard::notifyNewExpiry(Timestamp t) {
-        bool shouldNotify {false};
-        {
-            std::shared_lock lock(m_mutex);
-            const bool earlier {
-                m_evictionHeap.empty() || t < m_evictionHeap.top().first
-            };
+    bool Shard::migrateOut(const std::function<Shard*(uint64_t)>& destinationOf, size_t& moved) {
+        SlowLogScope trace(m_slowLog, "MIGRATE", m_traceName);
+        std::unique_lock<ShardMutex> lock(m_mutex);
+        const auto now {std::chrono::steady_clock::now()};
+
+        /*
+        * Removing records never moves the others, so the slot cursor stays valid.
+        * New keys that route elsewhere are never inserted here while a migration
+        * runs, but inserts of staying keys can rehash and move a few records
+        * behind the cursor; the caller repeats passes until one moves nothing.
+        */
+        const size_t capacity {m_cache.capacity()};
+        const size_t end {std::min(capacity, m_migrateCursor + MIGRATE_BATCH)};
+
+        for (size_t i {m_migrateCursor}; i < end; ++i) {
+            StoredEntry* stored {m_cache.at(i)};
+            Shard* destination {stored ? destinationOf(stored->hash) : nullptr};
+            if (!destination) {
+                continue;
+            }
 
-            if (earlier) {
-                shouldNotify = true;
+            if (!stored->expiration || *stored->expiration > now) {
+                MigratedRecord record {stored->toCacheEntry(), {}, m_policy ? m_policy->frequencyOf(*stored) : uint8_t{0}};
+                stored->log.forEach([&record](const LogRecordView& logRecord) {
+                    record.logs.push_back({logRecord.timestamp, std::string(logRecord.value)});
+                });
+                destination->adopt(stored->key, stored->hash, std::move(record));
+                ++moved;
             }
+
+            m_expiryWheel.cancel(*stored);
+            destroyRecord(stored);
+        }
+
+        m_indexBytes.store(m_cache.memoryBytes(), std::memory_order_relaxed);
+
+        if (end >= capacity) {
+            m_migrateCursor = 0;
+            return false;
         }
+        m_migrateCursor = end;
+        return true;
+    }
+
+    void Shard::setMaxLogRecords(size_t maxRecords) {
+        std::unique_lock<ShardMutex> lock(m_mutex);
+        m_maxLogRecords = std::max<size_t>(maxRecords, 1);
+    }
+
+    std::optional<Timestamp> Shard::peekNextExpiry() const {
+        std::shared_lock lock(m_mutex);
+        return m_expiryWheel.nextExpiry();
+    }
 
-        if (shouldNotify && m_notifyWakeup) {
-            m_notifyWakeup();
+    void Shard::notifyNewExpiry(Timestamp t) {
+        if (m_notifyWakeup) {
+            m_notifyWakeup(t);
         }
     }
 
@@ -0,0 +1,154 @@
+#include "shard_executor.h"
+#include "eviction_scheduler.h"
+#include "shard.h"
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace streamcache {
+
+    namespace {
+        /*
+        * Busy-wait iterations before a waiting thread yields or sleeps.
+        */
+        constexpr size_t SPIN_LIMIT = 256;
+
+        void cpuRelax() {
+#if defined(__SSE2__)
+            _mm_pause();
+#endif
+        }
+
+        void pinCurrentThread(size_t cpu) {
+#ifdef __linux__
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu % CPU_SETSIZE, &set);
+            // Best effort: a restricted affinity mask just leaves the thread unpinned.
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+            (void)cpu;
+#endif
+        }
+    }
+
+    void Completion::wait() const {
+        for (size_t spins {0}; m_pending.load(std::memory_order_acquire) != 0; ++spins) {
+            if (spins < SPIN_LIMIT) {
+                cpuRelax();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    ShardExecutor::ShardExecutor(Shard& shard, std::optional<size_t> cpu) : m_shard(shard) {
+        const auto now {std::chrono::steady_clock::now()};
+        m_nextPrune = now + EvictionScheduler::PRUNE_INTERVAL;
+        m_nextDeadline = std::min(m_nextPrune, m_shard.peekNextExpiry().value_or(m_nextPrune));
+
+        // Called from tasks, i.e. on the owner thread.
+        m_shard.setNotifyWakeup([this](Timestamp deadline) {
+            m_nextDeadline = std::min(m_nextDeadline, deadline);
+        });
+
+        m_thread = std::thread(&ShardExecutor::run, this, cpu);
+    }
+
+    ShardExecutor::~ShardExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+    }
+
+    void ShardExecutor::push(Task task) {
+        while (!m_queue.tryPush(task)) {
+            std::this_thread::yield();
+        }
+
+        /*
+        * Pairs with the fence in waitForWork(): either the owner sees the task
+        * before it sleeps, or this sees it sleeping and wakes it. The mutex makes
+        * the notification land after the owner has started waiting.
+        */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cv.notify_one();
+        }
+    }
+
+    void ShardExecutor::run(std::optional<size_t> cpu) {
+        if (cpu) {
+            pinCurrentThread(*cpu);
+        }
+
+        Task task {};
+        for (;;) {
+            size_t ran {0};
+            while (ran < TASK_BATCH && m_queue.tryPop(task)) {
+                task.run(task.context, m_shard);
+                if (task.done) {
+                    task.done->countDown();
+                }
+                ++ran;
+            }
+
+            const auto now {std::chrono::steady_clock::now()};
+            if (now >= m_nextDeadline) {
+                housekeep(now);
+            }
+
+            if (ran == 0 && !waitForWork()) {
+                return;
+            }
+        }
+    }
+
+    void ShardExecutor::housekeep(Timestamp now) {
+        /*
+        * One bounded step per loop iteration, so queued tasks wait for at most
+        * one eviction slice or one prune batch.
+        */
+        if (m_shard.evictExpired(now)) {
+            m_nextDeadline = now;
+            return;
+        }
+
+        if (now >= m_nextPrune) {
+            // An unfinished pass resumes from the shard's cursor on the next iteration.
+            const bool unfinished {m_shard.pruneLogs(now - EvictionScheduler::LOG_RETENTION)};
+            m_nextPrune = unfinished ? now : now + EvictionScheduler::PRUNE_INTERVAL;
+        }
+
+        m_nextDeadline = std::min(m_nextPrune, m_shard.peekNextExpiry().value_or(m_nextPrune));
+    }
+
+    bool ShardExecutor::waitForWork() {
+        for (size_t spins {0}; spins < SPIN_LIMIT; ++spins) {
+            if (!m_queue.empty()) {
+                return true;
+            }
+            cpuRelax();
+        }
+
+        m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait_until(lock, m_nextDeadline, [this] {
+            return m_stopping || !m_queue.empty();
+        });
+        m_sleeping.store(false, std::memory_order_relaxed);
+
+        return !m_stopping || !m_queue.empty();
+    }
+}
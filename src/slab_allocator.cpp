@@ -0,0 +1,145 @@
+#include "slab_allocator.h"
+#include "epoch.h"
+#include <new>
+
+namespace streamcache {
+
+    namespace {
+        // Classes below this size are spaced 16 bytes apart, above it four per power of two.
+        constexpr size_t LINEAR_LIMIT = 128;
+        constexpr size_t LINEAR_STEP = 16;
+        constexpr size_t LINEAR_CLASSES = LINEAR_LIMIT / LINEAR_STEP;
+        constexpr size_t LINEAR_LIMIT_BITS = 7;
+    }
+
+    size_t SlabAllocator::classFor(size_t bytes) {
+        if (bytes <= LINEAR_LIMIT) {
+            return bytes == 0 ? 0 : (bytes + LINEAR_STEP - 1) / LINEAR_STEP - 1;
+        }
+
+        const size_t exponent {static_cast<size_t>(63 - __builtin_clzll(bytes - 1))};
+        const size_t sub {((bytes - 1) >> (exponent - 2)) & 3};
+        return LINEAR_CLASSES + (exponent - LINEAR_LIMIT_BITS) * 4 + sub;
+    }
+
+    size_t SlabAllocator::classSize(size_t index) {
+        if (index < LINEAR_CLASSES) {
+            return (index + 1) * LINEAR_STEP;
+        }
+
+        const size_t exponent {(index - LINEAR_CLASSES) / 4 + LINEAR_LIMIT_BITS};
+        const size_t sub {(index - LINEAR_CLASSES) % 4};
+        return (size_t{1} << exponent) + (sub + 1) * (size_t{1} << (exponent - 2));
+    }
+
+    SlabAllocator::~SlabAllocator() {
+        // No reader can outlive the shard; large deferred blocks would otherwise leak.
+        void* p {m_deferred.exchange(nullptr, std::memory_order_acquire)};
+        while (p) {
+            void* next {deferredHeader(p)->next};
+            freeDeferred(p, deferredHeader(p)->bytes);
+            p = next;
+        }
+        for (const PendingBlock& pending : m_pending) {
+            freeDeferred(pending.p, pending.bytes);
+        }
+    }
+
+    void* SlabAllocator::allocate(size_t bytes) {
+        if (m_deferredCount.load(std::memory_order_relaxed) >= m_reclaimAt) {
+            reclaimDeferred();
+        }
+
+        if (bytes > MAX_SMALL_SIZE) {
+            void* p {::operator new(bytes)};
+            add(m_allocated, bytes);
+            add(m_reserved, bytes);
+            return p;
+        }
+
+        const size_t index {classFor(bytes)};
+        const size_t size {classSize(index)};
+        SizeClass& sizeClass {m_classes[index]};
+        add(m_allocated, size);
+
+        if (FreeBlock* block {sizeClass.freeList}) {
+            sizeClass.freeList = block->next;
+            return block;
+        }
+
+        if (sizeClass.cursor == nullptr || sizeClass.cursor + size > sizeClass.end) {
+            m_slabs.emplace_back(new char[SLAB_SIZE]);
+            sizeClass.cursor = m_slabs.back().get();
+            sizeClass.end = sizeClass.cursor + SLAB_SIZE;
+            add(m_reserved, SLAB_SIZE);
+        }
+
+        void* p {sizeClass.cursor};
+        sizeClass.cursor += size;
+        return p;
+    }
+
+    void SlabAllocator::deallocateDeferred(void* p, size_t bytes) {
+        m_deferredBytes.fetch_add(blockSize(bytes), std::memory_order_relaxed);
+        m_deferredCount.fetch_add(1, std::memory_order_relaxed);
+
+        DeferredBlock* header {deferredHeader(p)};
+        header->bytes = bytes;
+        header->next = m_deferred.load(std::memory_order_relaxed);
+        while (!m_deferred.compare_exchange_weak(header->next, p,
+                                                 std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    void SlabAllocator::reclaimDeferred() {
+        EpochDomain& epochs {EpochDomain::global()};
+
+        // Everything queued so far was unlinked before this stamp.
+        if (void* p {m_deferred.exchange(nullptr, std::memory_order_acquire)}) {
+            const uint64_t stamp {epochs.retireStamp()};
+            while (p) {
+                DeferredBlock* header {deferredHeader(p)};
+                m_pending.push_back({p, header->bytes, stamp});
+                p = header->next;
+            }
+        }
+
+        if (!m_pending.empty()) {
+            // Stamps only grow along the queue, so the safe blocks are a prefix.
+            const uint64_t safe {epochs.safeEpoch()};
+            while (!m_pending.empty() && m_pending.front().stamp < safe) {
+                freeDeferred(m_pending.front().p, m_pending.front().bytes);
+                m_pending.pop_front();
+            }
+        }
+
+        m_reclaimAt = m_pending.size() + RECLAIM_BATCH;
+    }
+
+    void SlabAllocator::freeDeferred(void* p, size_t bytes) {
+        m_deferredBytes.fetch_sub(blockSize(bytes), std::memory_order_relaxed);
+        m_deferredCount.fetch_sub(1, std::memory_order_relaxed);
+        deallocate(p, bytes);
+    }
+
+    void SlabAllocator::deallocate(void* p, size_t bytes) {
+        if (p == nullptr) {
+            return;
+        }
+
+        if (bytes > MAX_SMALL_SIZE) {
+            ::operator delete(p);
+            sub(m_allocated, bytes);
+            sub(m_reserved, bytes);
+            return;
+        }
+
+        const size_t index {classFor(bytes)};
+        SizeClass& sizeClass {m_classes[index]};
+
+        auto* block {static_cast<FreeBlock*>(p)};
+        block->next = sizeClass.freeList;
+        sizeClass.freeList = block;
+        sub(m_allocated, classSize(index));
+    }
+}
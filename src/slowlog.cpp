@@ -0,0 +1,121 @@
+#include "slowlog.h"
+#include <algorithm>
+#include <cstring>
+
+namespace streamcache {
+
+    namespace {
+        uint64_t toNanos(std::chrono::steady_clock::duration d) {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+        }
+    }
+
+    SlowLog::SlowLog() : m_slots(std::make_unique<Slot[]>(CAPACITY)) {
+    }
+
+    void SlowLog::setMaxLen(size_t maxLen) {
+        m_maxLen.store(std::min(maxLen, CAPACITY), std::memory_order_relaxed);
+    }
+
+    void SlowLog::record(const char* command, std::string_view key, size_t keyCount,
+                         std::chrono::nanoseconds duration, const LockTrace& locks) {
+        const int64_t threshold {m_thresholdNs.load(std::memory_order_relaxed)};
+        if (threshold < 0 || duration.count() < threshold) {
+            return;
+        }
+
+        Record record {};
+        const uint64_t id {m_next.fetch_add(1, std::memory_order_relaxed)};
+        record.stamp = id + 1;
+        record.startedAtMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+            (std::chrono::system_clock::now() - duration).time_since_epoch()).count();
+        record.durationNs = static_cast<uint64_t>(duration.count());
+        record.lockWaitNs = locks.waitNs;
+        record.lockHoldNs = locks.holdNs;
+        record.keyCount = keyCount;
+        record.keyLength = std::min(key.size(), MAX_KEY_BYTES);
+        std::strncpy(record.command, command, COMMAND_BYTES - 1);
+        std::memcpy(record.key, key.data(), record.keyLength);
+
+        Slot& slot {m_slots[id % CAPACITY]};
+        if (slot.writing.exchange(true, std::memory_order_acquire)) {
+            return;     // lapped a writer still filling this slot
+        }
+        slot.lock.beginWrite();
+        SeqLock::storeWords(&slot.record, &record, sizeof(Record));
+        slot.lock.endWrite();
+        slot.writing.store(false, std::memory_order_release);
+    }
+
+    std::vector<SlowLogEntry> SlowLog::entries(size_t count) const {
+        std::vector<SlowLogEntry> result {};
+        const uint64_t next {m_next.load(std::memory_order_acquire)};
+        const uint64_t window {std::min<uint64_t>(maxLen(), next)};
+        const uint64_t oldest {std::max(m_resetAt.load(std::memory_order_relaxed), next - window)};
+
+        for (uint64_t id {next}; id > oldest && result.size() < count; --id) {
+            const Slot& slot {m_slots[(id - 1) % CAPACITY]};
+            Record record {};
+            const uint32_t version {slot.lock.readBegin()};
+            SeqLock::loadWords(&record, &slot.record, sizeof(Record));
+            // Skip slots being rewritten and ids whose write has not landed (or was dropped).
+            if (!slot.lock.validate(version) || record.stamp != id) {
+                continue;
+            }
+
+            SlowLogEntry entry {};
+            entry.id = id - 1;
+            entry.startedAt = std::chrono::system_clock::time_point(std::chrono::microseconds(record.startedAtMicros));
+            entry.duration = std::chrono::nanoseconds(record.durationNs);
+            entry.lockWait = std::chrono::nanoseconds(record.lockWaitNs);
+            entry.lockHold = std::chrono::nanoseconds(record.lockHoldNs);
+            entry.command.assign(record.command, strnlen(record.command, COMMAND_BYTES));
+            entry.key.assign(record.key, std::min<size_t>(record.keyLength, MAX_KEY_BYTES));
+            entry.keyCount = record.keyCount;
+            result.push_back(std::move(entry));
+        }
+        return result;
+    }
+
+    size_t SlowLog::size() const {
+        return entries(CAPACITY).size();
+    }
+
+    void SlowLog::reset() {
+        m_resetAt.store(m_next.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+
+    SlowLogScope::SlowLogScope(SlowLog* log, const char* command, std::string_view key, size_t keyCount,
+                               std::optional<Timestamp> queuedAt) {
+        if (!log || !log->enabled()) {
+            return;
+        }
+
+        m_log = log;
+        m_command = command;
+        m_key = key;
+        m_keyCount = keyCount;
+        m_start = std::chrono::steady_clock::now();
+        if (queuedAt) {
+            m_trace.waitNs = toNanos(m_start - *queuedAt);
+            m_trace.holdNs = 0;
+            m_start = *queuedAt;
+        }
+
+        m_outer = LockTrace::current();
+        LockTrace::current() = &m_trace;
+    }
+
+    SlowLogScope::~SlowLogScope() {
+        if (!m_log) {
+            return;
+        }
+
+        const auto end {std::chrono::steady_clock::now()};
+        LockTrace::current() = m_outer;
+        if (m_outer) {
+            m_outer->merge(m_trace);
+        }
+        m_log->record(m_command, m_key, m_keyCount, std::chrono::nanoseconds(toNanos(end - m_start)), m_trace);
+    }
+}
@@ -0,0 +1,350 @@
+#include "snapshot.h"
+#include "encoding.h"
+#include "time_util.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace streamcache {
+
+    namespace {
+
+        const char SNAPSHOT_MAGIC[8] = {'S', 'C', 'S', 'N', 'A', 'P', '0', '1'};
+        const size_t TRAILER_SIZE = 8 + 4 + 8 + 8 + sizeof(SNAPSHOT_MAGIC);
+        const size_t DIRECTORY_ENTRY_SIZE = 8 + 8 + 4;
+
+        // Bits of an entry's flags byte.
+        const uint8_t HAS_EXPIRATION = 1;
+        const uint8_t SORTED_SET = 2;
+
+        [[noreturn]] void throwErrno(const std::string& what) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+
+
+        /*
+        * Decodes one section. Returns false on malformed input.
+        */
+        bool decodeSection(std::string_view data, Timestamp anchor,
+                           const std::function<void(SnapshotEntry&)>& apply, size_t& count) {
+            util::ByteReader reader {data};
+
+            uint64_t entries {0};
+            if (!reader.readVarint(entries)) {
+                return false;
+            }
+
+            SnapshotEntry decoded {};
+            for (uint64_t i {0}; i < entries; ++i) {
+                std::string_view key {};
+                std::string_view value {};
+                int64_t age {0};
+                std::string_view flagByte {};
+
+                if (!reader.readLengthPrefixed(key) || !reader.readLengthPrefixed(value)
+                    || !reader.readSignedVarint(age) || !reader.readBytes(1, flagByte)) {
+                    return false;
+                }
+
+                const auto flags {static_cast<uint8_t>(flagByte[0])};
+                decoded.key.assign(key);
+                decoded.entry.value.assign(value);
+                decoded.entry.timeSet = anchor - std::chrono::microseconds(age);
+                decoded.entry.expiration = std::nullopt;
+                decoded.entry.members = std::nullopt;
+
+                if (flags & HAS_EXPIRATION) {
+                    int64_t relative {0};
+                    if (!reader.readSignedVarint(relative)) {
+                        return false;
+                    }
+                    decoded.entry.expiration = anchor + std::chrono::microseconds(relative);
+                }
+
+                uint64_t logCount {0};
+                if (!reader.readVarint(logCount)) {
+                    return false;
+                }
+
+                decoded.logs.clear();
+                int64_t logAge {0};
+                for (uint64_t j {0}; j < logCount; ++j) {
+                    int64_t first {0};
+                    uint64_t delta {0};
+                    std::string_view logValue {};
+                    if (!(j == 0 ? reader.readSignedVarint(first) : reader.readVarint(delta))
+                        || !reader.readLengthPrefixed(logValue)) {
+                        return false;
+                    }
+
+                    // The first age is absolute; later ones shrink by delta as the log moves forward in time.
+                    logAge = (j == 0) ? first : logAge - static_cast<int64_t>(delta);
+                    decoded.logs.push_back({anchor - std::chrono::microseconds(logAge), std::string(logValue)});
+                }
+
+                if (flags & SORTED_SET) {
+                    uint64_t memberCount {0};
+                    if (!reader.readVarint(memberCount)) {
+                        return false;
+                    }
+
+                    decoded.entry.members.emplace();
+                    for (uint64_t j {0}; j < memberCount; ++j) {
+                        uint64_t bits {0};
+                        std::string_view member {};
+                        if (!reader.readFixed64(bits) || !reader.readLengthPrefixed(member)) {
+                            return false;
+                        }
+
+                        double score {0};
+                        std::memcpy(&score, &bits, sizeof(score));
+                        decoded.entry.members->push_back({std::string(member), score});
+                    }
+                }
+
+                apply(decoded);
+                ++count;
+            }
+
+            return reader.remaining() == 0;
+        }
+    }
+
+    SnapshotWriter::SnapshotWriter(std::string path)
+        : m_path(std::move(path)), m_tmpPath(m_path + ".tmp") {
+        m_fd = open(m_tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (m_fd < 0) {
+            throwErrno("open " + m_tmpPath);
+        }
+
+        m_anchor = std::chrono::steady_clock::now();
+        m_anchorMicros = util::toEpochMicros(m_anchor);
+    }
+
+    SnapshotWriter::~SnapshotWriter() {
+        // Not committed: discard the partial file.
+        if (m_fd >= 0) {
+            close(m_fd);
+            unlink(m_tmpPath.c_str());
+        }
+    }
+
+    void SnapshotWriter::writeAll(std::string_view data) {
+        size_t written {0};
+        while (written < data.size()) {
+            ssize_t n {write(m_fd, data.data() + written, data.size() - written)};
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throwErrno("write " + m_tmpPath);
+            }
+            written += static_cast<size_t>(n);
+        }
+    }
+
+    void SnapshotWriter::addEntry(const StoredEntry& record) {
+        const auto age {[this](Timestamp t) { return m_anchorMicros - util::toEpochMicros(t); }};
+
+        util::appendLengthPrefixed(m_section, record.key);
+        util::appendLengthPrefixed(m_section, record.value.view());
+        util::appendSignedVarint(m_section, age(record.timeSet));
+
+        const uint8_t flags {static_cast<uint8_t>((record.expiration ? HAS_EXPIRATION : 0)
+                                                  | (record.zset ? SORTED_SET : 0))};
+        m_section += static_cast<char>(flags);
+        if (record.expiration) {
+            util::appendSignedVarint(m_section, util::toEpochMicros(*record.expiration) - m_anchorMicros);
+        }
+
+        util::appendVarint(m_section, record.log.size());
+        int64_t prevAge {0};
+        bool first {true};
+        record.log.forEach([&](const LogRecordView& logEntry) {
+            int64_t logAge {age(logEntry.timestamp)};
+            if (!first) {
+                logAge = std::min(logAge, prevAge);
+            }
+            if (first) {
+                util::appendSignedVarint(m_section, logAge);
+            } else {
+                util::appendVarint(m_section, static_cast<uint64_t>(prevAge - logAge));
+            }
+            util::appendLengthPrefixed(m_section, logEntry.value);
+            prevAge = logAge;
+            first = false;
+        });
+
+        if (record.zset) {
+            util::appendVarint(m_section, record.zset->size());
+            record.zset->forEach([this](std::string_view member, double score) {
+                uint64_t bits {0};
+                std::memcpy(&bits, &score, sizeof(bits));
+                util::appendFixed64(m_section, bits);
+                util::appendLengthPrefixed(m_section, member);
+            });
+        }
+
+        ++m_sectionEntries;
+    }
+
+    void SnapshotWriter::endSection() {
+        if (m_sectionEntries == 0) {
+            return;
+        }
+
+        std::string encoded {};
+        util::appendVarint(encoded, m_sectionEntries);
+        encoded += m_section;
+
+        writeAll(encoded);
+
+        util::appendFixed64(m_directory, m_offset);
+        util::appendFixed64(m_directory, encoded.size());
+        util::appendFixed32(m_directory, util::checksum(encoded));
+
+        m_offset += encoded.size();
+        ++m_sectionCount;
+        m_section.clear();
+        m_sectionEntries = 0;
+    }
+
+    void SnapshotWriter::commit(uint64_t generation) {
+        std::string trailer {m_directory};
+        util::appendFixed64(trailer, m_offset);
+        util::appendFixed32(trailer, static_cast<uint32_t>(m_sectionCount));
+        util::appendFixed64(trailer, generation);
+        util::appendFixed64(trailer, static_cast<uint64_t>(m_anchorMicros));
+        trailer.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        writeAll(trailer);
+
+        if (fsync(m_fd) != 0) {
+            throwErrno("fsync " + m_tmpPath);
+        }
+        close(m_fd);
+        m_fd = -1;
+
+        if (rename(m_tmpPath.c_str(), m_path.c_str()) != 0) {
+            throwErrno("rename " + m_tmpPath);
+        }
+
+        // Make the rename itself durable.
+        std::string dir {std::filesystem::path(m_path).parent_path().string()};
+        int dirFd {open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+        if (dirFd >= 0) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+
+    size_t loadSnapshot(const std::string& path, const std::function<void(SnapshotEntry&)>& apply,
+                        uint64_t& generation) {
+        int fd {open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+        if (fd < 0) {
+            if (errno == ENOENT) {
+                return 0;
+            }
+            throwErrno("open " + path);
+        }
+
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            int savedErrno {errno};
+            close(fd);
+            errno = savedErrno;
+            throwErrno("stat " + path);
+        }
+
+        const size_t size {static_cast<size_t>(st.st_size)};
+        if (size < TRAILER_SIZE) {
+            close(fd);
+            throw std::runtime_error("snapshot too short: " + path);
+        }
+
+        void* mapped {mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)};
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            throwErrno("mmap " + path);
+        }
+
+        struct Unmapper {
+            void* addr;
+            size_t len;
+            ~Unmapper() { munmap(addr, len); }
+        } unmapper {mapped, size};
+
+        std::string_view file {static_cast<const char*>(mapped), size};
+
+        util::ByteReader trailer {file.substr(size - TRAILER_SIZE)};
+        uint64_t directoryOffset {0};
+        uint32_t sectionCount {0};
+        uint64_t anchorMicros {0};
+        trailer.readFixed64(directoryOffset);
+        trailer.readFixed32(sectionCount);
+        trailer.readFixed64(generation);
+        trailer.readFixed64(anchorMicros);
+
+        if (std::memcmp(file.data() + size - sizeof(SNAPSHOT_MAGIC), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+            || directoryOffset + static_cast<uint64_t>(sectionCount) * DIRECTORY_ENTRY_SIZE != size - TRAILER_SIZE) {
+            throw std::runtime_error("not a valid snapshot: " + path);
+        }
+
+        std::vector<std::string_view> sections {};
+        util::ByteReader directory {file.substr(directoryOffset, sectionCount * DIRECTORY_ENTRY_SIZE)};
+        for (uint32_t i {0}; i < sectionCount; ++i) {
+            uint64_t offset {0};
+            uint64_t length {0};
+            uint32_t sum {0};
+            directory.readFixed64(offset);
+            directory.readFixed64(length);
+            directory.readFixed32(sum);
+
+            if (offset + length > directoryOffset || util::checksum(file.substr(offset, length)) != sum) {
+                throw std::runtime_error("corrupt snapshot section " + std::to_string(i) + ": " + path);
+            }
+            sections.push_back(file.substr(offset, length));
+        }
+
+        madvise(mapped, size, MADV_SEQUENTIAL);
+
+        const Timestamp anchor {util::fromEpochMicros(static_cast<int64_t>(anchorMicros))};
+        std::atomic<size_t> loaded {0};
+        std::atomic<size_t> next {0};
+        std::atomic<bool> malformed {false};
+        std::vector<std::thread> workers {};
+
+        // Workers take sections in file order until none are left.
+        const size_t threads {std::min<size_t>(sections.size(), std::max(1u, std::thread::hardware_concurrency()))};
+        for (size_t i {0}; i < threads; ++i) {
+            workers.emplace_back([&] {
+                for (size_t index {next++}; index < sections.size(); index = next++) {
+                    size_t count {0};
+                    if (!decodeSection(sections[index], anchor, apply, count)) {
+                        malformed.store(true);
+                    }
+                    loaded.fetch_add(count, std::memory_order_relaxed);
+                }
+            });
+        }
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        if (malformed.load()) {
+            throw std::runtime_error("malformed snapshot section: " + path);
+        }
+
+        return loaded.load();
+    }
+}
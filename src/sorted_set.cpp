@@ -0,0 +1,246 @@
+#include "sorted_set.h"
+#include "hash_util.h"
+#include "number_util.h"
+#include <cstring>
+#include <new>
+
+namespace streamcache {
+
+    std::string encodeMemberUpdate(std::string_view member, double score) {
+        std::string update {util::formatDouble(score)};
+        update.reserve(update.size() + 1 + member.size());
+        update += ' ';
+        update += member;
+        return update;
+    }
+
+    bool decodeMemberUpdate(std::string_view update, std::string_view& member, double& score) {
+        const size_t space {update.find(' ')};
+        if (space == std::string_view::npos || !util::parseDouble(update.substr(0, space), score)) {
+            return false;
+        }
+        member = update.substr(space + 1);
+        return true;
+    }
+
+    SortedSet::SortedSet(SlabAllocator& slab, std::atomic<size_t>& indexBytes)
+        : m_slab(slab),
+          m_indexBytes(indexBytes),
+          m_random(reinterpret_cast<uintptr_t>(this) | 1) {
+        m_header = createNode(MAX_LEVEL, {}, 0, 0);
+    }
+
+    SortedSet::~SortedSet() {
+        m_indexBytes.store(m_indexBytes.load(std::memory_order_relaxed) - m_countedIndexBytes,
+                           std::memory_order_relaxed);
+
+        Node* node {m_header->levels()[0].forward};
+        while (node) {
+            Node* next {node->levels()[0].forward};
+            m_slab.deallocate(node, node->allocationBytes());
+            node = next;
+        }
+        m_slab.deallocate(m_header, m_header->allocationBytes());
+    }
+
+    SortedSet::Node* SortedSet::createNode(uint32_t height, std::string_view member, uint64_t hash, double score) {
+        const size_t bytes {sizeof(Node) + height * sizeof(Level) + member.size()};
+        Node* node {new (m_slab.allocate(bytes)) Node{}};
+        node->height = height;
+        for (uint32_t i {0}; i < height; ++i) {
+            new (&node->levels()[i]) Level{};
+        }
+        char* text {reinterpret_cast<char*>(node->levels() + height)};
+        if (!member.empty()) {
+            std::memcpy(text, member.data(), member.size());
+        }
+        node->key = std::string_view(text, member.size());
+        node->hash = hash;
+        node->score = score;
+        return node;
+    }
+
+    int SortedSet::randomHeight() {
+        // One extra level per pair of zero bits: probability 1/4 each.
+        m_random ^= m_random << 13;
+        m_random ^= m_random >> 7;
+        m_random ^= m_random << 17;
+        uint64_t bits {m_random};
+        int height {1};
+        while (height < MAX_LEVEL && (bits & 3) == 0) {
+            ++height;
+            bits >>= 2;
+        }
+        return height;
+    }
+
+    bool SortedSet::set(std::string_view member, double score) {
+        const uint64_t hash {util::hashKey(member)};
+        if (Node* node {m_members.find(member, hash)}) {
+            if (node->score == score) {
+                return false;
+            }
+
+            // A node that stays between its neighbours just takes the new score.
+            const Node* prev {node->backward};
+            const Node* next {node->levels()[0].forward};
+            if ((!prev || before(*prev, score, member)) && (!next || !before(*next, score, member))) {
+                node->score = score;
+                return false;
+            }
+            unlink(node);
+            node->score = score;
+            link(node);
+            return false;
+        }
+
+        Node* node {createNode(static_cast<uint32_t>(randomHeight()), member, hash, score)};
+        m_members.insert(node);
+        m_members.reclaimRetired();
+        countIndexBytes();
+        link(node);
+        return true;
+    }
+
+    void SortedSet::countIndexBytes() {
+        const size_t bytes {m_members.memoryBytes()};
+        if (bytes != m_countedIndexBytes) {
+            m_indexBytes.store(m_indexBytes.load(std::memory_order_relaxed) - m_countedIndexBytes + bytes,
+                               std::memory_order_relaxed);
+            m_countedIndexBytes = bytes;
+        }
+    }
+
+    std::optional<double> SortedSet::score(std::string_view member) const {
+        const Node* node {m_members.find(member, util::hashKey(member))};
+        if (!node) {
+            return std::nullopt;
+        }
+        return node->score;
+    }
+
+    std::optional<size_t> SortedSet::rank(std::string_view member) const {
+        const Node* node {m_members.find(member, util::hashKey(member))};
+        if (!node) {
+            return std::nullopt;
+        }
+
+        const Node* x {m_header};
+        size_t traversed {0};
+        for (int i {m_height - 1}; i >= 0; --i) {
+            for (const Node* next {x->levels()[i].forward};
+                 next && (next == node || before(*next, node->score, node->key));
+                 next = x->levels()[i].forward) {
+                traversed += x->levels()[i].span;
+                x = next;
+            }
+            if (x == node) {
+                return traversed - 1;
+            }
+        }
+        return std::nullopt;
+    }
+
+    void SortedSet::link(Node* node) {
+        Node* update[MAX_LEVEL];
+        size_t rank[MAX_LEVEL];
+
+        Node* x {m_header};
+        for (int i {m_height - 1}; i >= 0; --i) {
+            rank[i] = i == m_height - 1 ? 0 : rank[i + 1];
+            for (Node* next {x->levels()[i].forward}; next && before(*next, node->score, node->key);
+                 next = x->levels()[i].forward) {
+                rank[i] += x->levels()[i].span;
+                x = next;
+            }
+            update[i] = x;
+        }
+
+        const int height {static_cast<int>(node->height)};
+        if (height > m_height) {
+            for (int i {m_height}; i < height; ++i) {
+                rank[i] = 0;
+                update[i] = m_header;
+                m_header->levels()[i].span = m_size;
+            }
+            m_height = height;
+        }
+
+        for (int i {0}; i < height; ++i) {
+            Level& level {node->levels()[i]};
+            Level& prev {update[i]->levels()[i]};
+            level.forward = prev.forward;
+            prev.forward = node;
+            level.span = prev.span - (rank[0] - rank[i]);
+            prev.span = rank[0] - rank[i] + 1;
+        }
+        for (int i {height}; i < m_height; ++i) {
+            ++update[i]->levels()[i].span;
+        }
+
+        node->backward = update[0] == m_header ? nullptr : update[0];
+        if (Node* next {node->levels()[0].forward}) {
+            next->backward = node;
+        }
+        ++m_size;
+    }
+
+    void SortedSet::unlink(Node* node) {
+        Node* update[MAX_LEVEL];
+
+        Node* x {m_header};
+        for (int i {m_height - 1}; i >= 0; --i) {
+            for (Node* next {x->levels()[i].forward}; next && before(*next, node->score, node->key);
+                 next = x->levels()[i].forward) {
+                x = next;
+            }
+            update[i] = x;
+        }
+
+        for (int i {0}; i < m_height; ++i) {
+            Level& prev {update[i]->levels()[i]};
+            if (prev.forward == node) {
+                prev.span += node->levels()[i].span - 1;
+                prev.forward = node->levels()[i].forward;
+            } else {
+                --prev.span;
+            }
+        }
+
+        if (Node* next {node->levels()[0].forward}) {
+            next->backward = node->backward;
+        }
+        while (m_height > 1 && !m_header->levels()[m_height - 1].forward) {
+            m_header->levels()[m_height - 1].span = 0;
+            --m_height;
+        }
+        --m_size;
+    }
+
+    const SortedSet::Node* SortedSet::nodeAtRank(size_t rank) const {
+        const Node* x {m_header};
+        size_t traversed {0};
+        for (int i {m_height - 1}; i >= 0; --i) {
+            while (x->levels()[i].forward && traversed + x->levels()[i].span <= rank) {
+                traversed += x->levels()[i].span;
+                x = x->levels()[i].forward;
+            }
+            if (traversed == rank) {
+                return x == m_header ? nullptr : x;
+            }
+        }
+        return nullptr;
+    }
+
+    const SortedSet::Node* SortedSet::lastAtOrBelow(ScoreBound max) const {
+        const Node* x {m_header};
+        for (int i {m_height - 1}; i >= 0; --i) {
+            for (const Node* next {x->levels()[i].forward};
+                 next && (max.exclusive ? next->score < max.value : next->score <= max.value);
+                 next = x->levels()[i].forward) {
+                x = next;
+            }
+        }
+        return x == m_header ? nullptr : x;
+    }
+}
@@ -0,0 +1,200 @@
+#include "timing_wheel.h"
+#include <algorithm>
+
+namespace streamcache {
+
+    namespace {
+
+        uint64_t slotRange(size_t level) {
+            return uint64_t{1} << (level * TimingWheel::SLOT_BITS);
+        }
+
+        uint64_t levelRange(size_t level) {
+            return uint64_t{1} << ((level + 1) * TimingWheel::SLOT_BITS);
+        }
+
+        /*
+        * The level is chosen by the highest bit in which the deadline differs from
+        * the current tick: timers due within the current 64-tick block go to level 0,
+        * within the current 4096-tick block to level 1, and so on.
+        */
+        size_t levelFor(uint64_t elapsed, uint64_t when) {
+            const uint64_t masked {((elapsed ^ when) | (TimingWheel::SLOTS - 1))};
+            const size_t significant {static_cast<size_t>(63 - __builtin_clzll(masked))};
+            return std::min(significant / TimingWheel::SLOT_BITS, TimingWheel::LEVELS - 1);
+        }
+
+        uint64_t rotateRight(uint64_t v, unsigned n) {
+            n &= 63;
+            return n == 0 ? v : (v >> n) | (v << (64 - n));
+        }
+    }
+
+    TimingWheel::TimingWheel(Timestamp origin, std::chrono::nanoseconds tick)
+        : m_origin(origin), m_tick(tick) {
+    }
+
+    uint64_t TimingWheel::toTicksCeil(Timestamp t) const {
+        if (t <= m_origin) {
+            return 0;
+        }
+        const auto ns {std::chrono::duration_cast<std::chrono::nanoseconds>(t - m_origin).count()};
+        return static_cast<uint64_t>((ns + m_tick.count() - 1) / m_tick.count());
+    }
+
+    uint64_t TimingWheel::toTicksFloor(Timestamp t) const {
+        if (t <= m_origin) {
+            return 0;
+        }
+        const auto ns {std::chrono::duration_cast<std::chrono::nanoseconds>(t - m_origin).count()};
+        return static_cast<uint64_t>(ns / m_tick.count());
+    }
+
+    void TimingWheel::pushFront(TimerNode*& head, TimerNode& node) {
+        node.prev = nullptr;
+        node.next = head;
+        if (head) {
+            head->prev = &node;
+        }
+        head = &node;
+    }
+
+    void TimingWheel::unlink(TimerNode*& head, TimerNode& node) {
+        if (node.prev) {
+            node.prev->next = node.next;
+        } else {
+            head = node.next;
+        }
+        if (node.next) {
+            node.next->prev = node.prev;
+        }
+        node.prev = nullptr;
+        node.next = nullptr;
+    }
+
+    void TimingWheel::insert(TimerNode& node) {
+        if (node.deadline <= m_elapsed) {
+            node.level = TimerNode::PENDING;
+            pushFront(m_pending, node);
+            return;
+        }
+
+        /*
+        * Deadlines beyond the wheel's horizon are parked in the last level; they
+        * are re-filed when that slot is processed.
+        */
+        const uint64_t placement {std::min(node.deadline, m_elapsed + MAX_TICKS)};
+        const size_t level {levelFor(m_elapsed, placement)};
+        const size_t slot {static_cast<size_t>((placement >> (level * SLOT_BITS)) & (SLOTS - 1))};
+
+        node.level = static_cast<uint8_t>(level);
+        node.slot = static_cast<uint8_t>(slot);
+        pushFront(m_levels[level].slots[slot], node);
+        m_levels[level].occupied |= uint64_t{1} << slot;
+    }
+
+    void TimingWheel::schedule(TimerNode& node, Timestamp when) {
+        cancel(node);
+
+        node.deadline = toTicksCeil(when);
+        insert(node);
+        ++m_size;
+    }
+
+    void TimingWheel::cancel(TimerNode& node) {
+        if (!node.isScheduled()) {
+            return;
+        }
+
+        if (node.level == TimerNode::PENDING) {
+            unlink(m_pending, node);
+        } else {
+            Level& level {m_levels[node.level]};
+            unlink(level.slots[node.slot], node);
+            if (!level.slots[node.slot]) {
+                level.occupied &= ~(uint64_t{1} << node.slot);
+            }
+        }
+
+        node.level = TimerNode::UNLINKED;
+        --m_size;
+    }
+
+    std::optional<TimingWheel::Expiration> TimingWheel::nextExpiration() const {
+        for (size_t level {0}; level < LEVELS; ++level) {
+            const uint64_t occupied {m_levels[level].occupied};
+            if (occupied == 0) {
+                continue;
+            }
+
+            // First occupied slot at or after the current position in this level.
+            const uint64_t nowSlot {m_elapsed / slotRange(level)};
+            const uint64_t rotated {rotateRight(occupied, static_cast<unsigned>(nowSlot & 63))};
+            const size_t slot {static_cast<size_t>((__builtin_ctzll(rotated) + nowSlot) % SLOTS)};
+
+            const uint64_t levelStart {m_elapsed & ~(levelRange(level) - 1)};
+            uint64_t deadline {levelStart + slot * slotRange(level)};
+
+            // Only possible in the last level, for timers parked past the horizon.
+            if (deadline <= m_elapsed) {
+                deadline += levelRange(level);
+            }
+
+            return Expiration {level, slot, deadline};
+        }
+
+        return std::nullopt;
+    }
+
+    void TimingWheel::processExpiration(const Expiration& expiration) {
+        Level& level {m_levels[expiration.level]};
+        TimerNode* node {level.slots[expiration.slot]};
+        level.slots[expiration.slot] = nullptr;
+        level.occupied &= ~(uint64_t{1} << expiration.slot);
+
+        m_elapsed = expiration.deadline;
+
+        while (node) {
+            TimerNode* next {node->next};
+            node->prev = nullptr;
+            node->next = nullptr;
+            insert(*node);
+            node = next;
+        }
+    }
+
+    TimerNode* TimingWheel::poll(Timestamp now) {
+        const uint64_t nowTicks {toTicksFloor(now)};
+
+        while (!m_pending) {
+            auto expiration {nextExpiration()};
+            if (!expiration || expiration->deadline > nowTicks) {
+                m_elapsed = std::max(m_elapsed, nowTicks);
+                return nullptr;
+            }
+            processExpiration(*expiration);
+        }
+
+        TimerNode* node {m_pending};
+        unlink(m_pending, *node);
+        node->level = TimerNode::UNLINKED;
+        --m_size;
+        return node;
+    }
+
+    std::optional<TimingWheel::Timestamp> TimingWheel::nextExpiry() const {
+        auto toTimestamp {[this](uint64_t ticks) {
+            return m_origin + std::chrono::duration_cast<Timestamp::duration>(m_tick * ticks);
+        }};
+
+        if (m_pending) {
+            return toTimestamp(m_elapsed);
+        }
+
+        auto expiration {nextExpiration()};
+        if (!expiration) {
+            return std::nullopt;
+        }
+        return toTimestamp(expiration->deadline);
+    }
+}
@@ -0,0 +1,93 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+namespace streamcache {
+
+    WorkerPool::WorkerPool(size_t threads) {
+        const size_t count {std::max<size_t>(1, threads)};
+        m_threads.reserve(count);
+        for (size_t i {0}; i < count; ++i) {
+            m_threads.emplace_back([this] { runWorker(); });
+        }
+    }
+
+    WorkerPool::~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        m_cv.notify_all();
+
+        for (auto& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) {
+            return;
+        }
+
+        auto job {std::make_shared<Job>()};
+        job->fn = &fn;
+        job->count = count;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(job);
+        }
+        m_cv.notify_all();
+
+        work(*job);
+
+        // Every iteration is claimed now; take the job off the queue if no worker did.
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it {std::find(m_jobs.begin(), m_jobs.end(), job)};
+            if (it != m_jobs.end()) {
+                m_jobs.erase(it);
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job] { return job->done.load(std::memory_order_acquire) == job->count; });
+    }
+
+    void WorkerPool::runWorker() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (true) {
+            m_cv.wait(lock, [this] { return !m_running || !m_jobs.empty(); });
+            if (!m_running) {
+                return;
+            }
+
+            std::shared_ptr<Job> job {m_jobs.front()};
+            lock.unlock();
+
+            work(*job);
+
+            lock.lock();
+            if (!m_jobs.empty() && m_jobs.front() == job) {
+                m_jobs.pop_front();
+            }
+        }
+    }
+
+    void WorkerPool::work(Job& job) {
+        while (true) {
+            const size_t i {job.next.fetch_add(1, std::memory_order_relaxed)};
+            if (i >= job.count) {
+                return;
+            }
+
+            (*job.fn)(i);
+
+            if (job.done.fetch_add(1, std::memory_order_acq_rel) + 1 == job.count) {
+                // Lock so the notification cannot slip between the waiter's check and its wait.
+                std::lock_guard<std::mutex> lock(job.mutex);
+                job.finished.notify_all();
+            }
+        }
+    }
+}
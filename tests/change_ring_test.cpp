@@ -0,0 +1,130 @@
+#include "change_stream.h"
+#include "check.h"
+#include "epoch.h"
+#include "slab_allocator.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using streamcache::ChangeEvent;
+using streamcache::ChangeKind;
+using streamcache::ChangeRing;
+using streamcache::EpochDomain;
+using streamcache::SlabAllocator;
+using streamcache::Value;
+
+namespace {
+
+    // Long enough to live in a slab buffer rather than inline.
+    std::string valueFor(uint64_t sequence) {
+        return "value-" + std::to_string(sequence) + "-padding-padding";
+    }
+
+    void publish(ChangeRing& ring, SlabAllocator& slab, uint64_t sequence) {
+        const ChangeKind kind {sequence % 2 ? ChangeKind::ZADD : ChangeKind::SET};
+        ring.publish("key:" + std::to_string(sequence), Value(valueFor(sequence), slab), std::nullopt,
+                     std::chrono::steady_clock::now(), kind);
+    }
+
+    bool matches(const ChangeEvent& event, uint64_t sequence) {
+        return event.sequence == sequence && event.key == "key:" + std::to_string(sequence)
+            && event.value.view() == valueFor(sequence)
+            && event.kind == (sequence % 2 ? ChangeKind::ZADD : ChangeKind::SET);
+    }
+
+    /*
+    * A reader that keeps up sees every event in order; one that falls more
+    * than CAPACITY behind is told how many it lost and resumes at the oldest
+    * event still in the ring.
+    */
+    void readersSeeEventsInOrder() {
+        SlabAllocator slab {};
+        ChangeRing ring {};
+        for (uint64_t i {0}; i < 100; ++i) {
+            publish(ring, slab, i);
+        }
+        CHECK(ring.head() == 100);
+
+        uint64_t cursor {0};
+        uint64_t lost {0};
+        EpochDomain::Guard guard {EpochDomain::global().pin()};
+        CHECK(ring.read(cursor, 60, lost, [&](const ChangeEvent& event) { CHECK(matches(event, event.sequence)); }) == 60);
+        CHECK(cursor == 60);
+        uint64_t expected {60};
+        CHECK(ring.read(cursor, 1000, lost, [&](const ChangeEvent& event) { CHECK(matches(event, expected++)); }) == 40);
+        CHECK(cursor == 100 && lost == 0);
+
+        for (uint64_t i {100}; i < 100 + ChangeRing::CAPACITY + 25; ++i) {
+            publish(ring, slab, i);
+        }
+        expected = 125;
+        const size_t visited {ring.read(cursor, SIZE_MAX, lost, [&](const ChangeEvent& event) {
+            CHECK(matches(event, expected++));
+        })};
+        CHECK(visited == ChangeRing::CAPACITY);
+        CHECK(lost == 25);
+        CHECK(cursor == ring.head());
+    }
+
+    /*
+    * Readers follow a producer that laps them: every position is either
+    * visited, in order and intact, or counted as lost.
+    */
+    void concurrentReadersAreNeverTorn() {
+        constexpr uint64_t EVENTS {200000};
+        constexpr size_t READERS {3};
+        SlabAllocator slab {};
+        std::atomic<bool> done {false};
+
+        {
+            ChangeRing ring {};
+            std::vector<uint64_t> visitedCounts(READERS, 0);
+            std::vector<uint64_t> lostCounts(READERS, 0);
+            std::vector<std::thread> readers {};
+            for (size_t r {0}; r < READERS; ++r) {
+                readers.emplace_back([&, r] {
+                    uint64_t cursor {0};
+                    uint64_t lost {0};
+                    uint64_t visited {0};
+                    for (;;) {
+                        const bool finished {done.load(std::memory_order_acquire)};
+                        EpochDomain::Guard guard {EpochDomain::global().pin()};
+                        ring.read(cursor, 64, lost, [&](const ChangeEvent& event) {
+                            CHECK(matches(event, cursor));
+                            ++visited;
+                        });
+                        if (finished && cursor == ring.head()) {
+                            break;
+                        }
+                    }
+                    visitedCounts[r] = visited;
+                    lostCounts[r] = lost;
+                });
+            }
+
+            for (uint64_t i {0}; i < EVENTS; ++i) {
+                publish(ring, slab, i);
+            }
+            done.store(true, std::memory_order_release);
+            for (std::thread& reader : readers) {
+                reader.join();
+            }
+
+            for (size_t r {0}; r < READERS; ++r) {
+                CHECK(visitedCounts[r] + lostCounts[r] == EVENTS);
+            }
+        }
+
+        // Every value buffer is released with its event, by reclaim or by the ring's destructor.
+        slab.reclaimDeferred();
+        CHECK(slab.stats().allocated == 0);
+    }
+}
+
+int main() {
+    readersSeeEventsInOrder();
+    concurrentReadersAreNeverTorn();
+    return check::result();
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+
+/*
+* Minimal assertion helpers for the unit tests: a failed CHECK prints where it
+* failed and the test binary exits non-zero at the end, so CTest reports it.
+*/
+namespace check {
+
+    // Checks may fail on any thread of a concurrency test.
+    inline std::atomic<int>& failures() {
+        static std::atomic<int> count {0};
+        return count;
+    }
+
+    inline void fail(const char* file, int line, const char* expression) {
+        std::cerr << file << ':' << line << ": check failed: " << expression << '\n';
+        ++failures();
+    }
+
+    inline int result() {
+        if (failures() != 0) {
+            std::cerr << failures().load() << " check(s) failed\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+}
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            ::check::fail(__FILE__, __LINE__, #expression); \
+        } \
+    } while (false)
@@ -0,0 +1,52 @@
+#include "check.h"
+#include "epoch.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using streamcache::EpochDomain;
+
+namespace {
+
+    /*
+    * synchronize() returns only after readers pinned before it have unpinned,
+    * and safeEpoch() does not pass a stamp taken while a reader is pinned.
+    */
+    void epochWaitsForPinnedReaders() {
+        EpochDomain& domain {EpochDomain::global()};
+        std::atomic<bool> pinned {false};
+        std::atomic<bool> release {false};
+        std::atomic<bool> unpinned {false};
+
+        std::thread reader([&] {
+            {
+                EpochDomain::Guard outer {domain.pin()};
+                EpochDomain::Guard inner {domain.pin()};    // pins nest
+                pinned.store(true);
+                while (!release.load()) {
+                    std::this_thread::yield();
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                unpinned.store(true);
+            }
+        });
+
+        while (!pinned.load()) {
+            std::this_thread::yield();
+        }
+        const uint64_t stamp {domain.retireStamp()};
+        CHECK(domain.safeEpoch() <= stamp);
+        CHECK(domain.safeEpoch() <= stamp);
+
+        release.store(true);
+        domain.synchronize();
+        CHECK(unpinned.load());
+        CHECK(domain.safeEpoch() > stamp);
+        reader.join();
+    }
+}
+
+int main() {
+    epochWaitsForPinnedReaders();
+    return check::result();
+}
@@ -0,0 +1,173 @@
+#include "check.h"
+#include "epoch.h"
+#include "flat_index.h"
+#include "hash_util.h"
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using streamcache::EpochDomain;
+using streamcache::FlatIndex;
+
+namespace {
+
+    struct Record {
+        std::string key {};
+        uint64_t hash {0};
+    };
+
+    std::vector<std::unique_ptr<Record>> makeRecords(size_t count) {
+        std::vector<std::unique_ptr<Record>> records {};
+        records.reserve(count);
+        for (size_t i {0}; i < count; ++i) {
+            auto record {std::make_unique<Record>()};
+            record->key = "key:" + std::to_string(i);
+            record->hash = util::hashKey(record->key);
+            records.push_back(std::move(record));
+        }
+        return records;
+    }
+
+    /*
+    * Random inserts and erases against std::unordered_map; the churn leaves
+    * tombstones, so both growing and same-size rehashes happen.
+    */
+    void randomOperationsMatchReference() {
+        const auto records {makeRecords(4000)};
+        FlatIndex<Record> index {};
+        std::unordered_map<std::string, Record*> reference {};
+        std::mt19937_64 random {42};
+
+        for (size_t step {0}; step < 200000; ++step) {
+            Record* record {records[random() % records.size()].get()};
+            const bool present {reference.count(record->key) != 0};
+
+            if (random() % 3 == 0) {
+                CHECK(index.erase(record->key, record->hash) == (present ? record : nullptr));
+                reference.erase(record->key);
+            } else if (!present) {
+                index.insert(record);
+                reference.emplace(record->key, record);
+            }
+            CHECK(index.find(record->key, record->hash) == (reference.count(record->key) ? record : nullptr));
+
+            if (step % 10000 == 0) {
+                CHECK(index.size() == reference.size());
+                size_t visited {0};
+                index.forEach([&](Record& found) {
+                    CHECK(reference.count(found.key) != 0 && reference[found.key] == &found);
+                    ++visited;
+                });
+                CHECK(visited == reference.size());
+            }
+        }
+
+        for (const auto& record : records) {
+            CHECK(index.find(record->key, record->hash) == (reference.count(record->key) ? record.get() : nullptr));
+        }
+    }
+
+    /*
+    * Every key present for the whole scan is visited, though the table keeps
+    * growing between steps.
+    */
+    void scanVisitsEveryKeyAcrossGrowth() {
+        const auto records {makeRecords(6000)};
+        FlatIndex<Record> index {};
+        for (size_t i {0}; i < 1000; ++i) {
+            index.insert(records[i].get());
+        }
+
+        std::unordered_set<std::string> seen {};
+        size_t cursor {0};
+        size_t next {1000};
+        do {
+            cursor = index.scan(cursor, 2, [&seen](Record& record) { seen.insert(record.key); });
+            for (size_t i {0}; i < 50 && next < records.size(); ++i) {
+                index.insert(records[next++].get());
+            }
+        } while (cursor != 0);
+
+        for (size_t i {0}; i < 1000; ++i) {
+            CHECK(seen.count(records[i]->key) != 0);
+        }
+    }
+
+    /*
+    * Pinned readers probe while the writer grows the table and then churns
+    * it; a key that was inserted and never erased must always be found, and
+    * the retired tables must all be freed once the readers are gone.
+    */
+    void concurrentFindDuringRehash() {
+        constexpr size_t KEYS {100000};
+        const auto records {makeRecords(KEYS)};
+        FlatIndex<Record> index {};
+        std::atomic<size_t> published {0};
+        std::atomic<bool> churning {false};
+        std::atomic<bool> done {false};
+        std::atomic<size_t> misses {0};
+
+        std::vector<std::thread> readers {};
+        for (size_t r {0}; r < 4; ++r) {
+            readers.emplace_back([&, r] {
+                std::mt19937_64 random {r};
+                while (!done.load(std::memory_order_acquire)) {
+                    const size_t limit {published.load(std::memory_order_acquire)};
+                    if (limit == 0) {
+                        continue;
+                    }
+                    // While churning, only even keys are guaranteed to be present.
+                    size_t i {random() % limit};
+                    if (churning.load(std::memory_order_acquire)) {
+                        i &= ~size_t{1};
+                    }
+
+                    EpochDomain::Guard guard {EpochDomain::global().pin()};
+                    CHECK(guard);
+                    const bool found {index.find(records[i]->key, records[i]->hash) == records[i].get()};
+                    // An odd key may have been erased by churn that started after the check above.
+                    if (!found && (i % 2 == 0 || !churning.load(std::memory_order_acquire))) {
+                        misses.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            });
+        }
+
+        for (size_t i {0}; i < KEYS; ++i) {
+            index.insert(records[i].get());
+            published.store(i + 1, std::memory_order_release);
+        }
+
+        churning.store(true, std::memory_order_release);
+        for (size_t round {0}; round < 5; ++round) {
+            for (size_t i {1}; i < KEYS; i += 2) {
+                CHECK(index.erase(records[i]->key, records[i]->hash) == records[i].get());
+            }
+            for (size_t i {1}; i < KEYS; i += 2) {
+                index.insert(records[i].get());
+            }
+        }
+
+        done.store(true, std::memory_order_release);
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+
+        CHECK(misses.load() == 0);
+        CHECK(index.size() == KEYS);
+        index.reclaimRetired();
+        CHECK(index.memoryBytes() == index.capacity() * (1 + sizeof(Record*)));
+    }
+}
+
+int main() {
+    randomOperationsMatchReference();
+    scanVisitsEveryKeyAcrossGrowth();
+    concurrentFindDuringRehash();
+    return check::result();
+}
@@ -0,0 +1,184 @@
+#include "check.h"
+#include "log_block.h"
+#include "number_util.h"
+#include "slab_allocator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using streamcache::LogBlock;
+using streamcache::SlabAllocator;
+
+namespace {
+
+    using History = std::vector<std::pair<LogBlock::Timestamp, std::string>>;
+
+    /*
+    * Builds one block from history, decodes it and compares record by record,
+    * then checks the time searches against the reference timestamps.
+    */
+    void checkRoundTrip(const History& history, SlabAllocator& slab) {
+        LogBlock::Builder builder {};
+        for (const auto& [timestamp, value] : history) {
+            builder.add(timestamp, value);
+        }
+        LogBlock* block {builder.build(slab)};
+        CHECK(block->count == history.size());
+
+        LogBlock::Reader reader {*block};
+        LogBlock::Timestamp timestamp {};
+        std::string_view value {};
+        for (const auto& record : history) {
+            CHECK(reader.next(timestamp, value));
+            CHECK(timestamp == record.first);
+            CHECK(value == record.second);
+        }
+        CHECK(!reader.next(timestamp, value));
+
+        for (const auto& record : history) {
+            for (const auto probe : {record.first - std::chrono::nanoseconds(1), record.first,
+                                     record.first + std::chrono::nanoseconds(1)}) {
+                const auto lower {std::count_if(history.begin(), history.end(),
+                                                [probe](const auto& r) { return r.first < probe; })};
+                const auto upper {std::count_if(history.begin(), history.end(),
+                                                [probe](const auto& r) { return r.first <= probe; })};
+                CHECK(block->lowerBound(probe) == static_cast<size_t>(lower));
+                CHECK(block->upperBound(probe) == static_cast<size_t>(upper));
+            }
+        }
+
+        LogBlock::destroy(block, slab);
+    }
+
+    /*
+    * Timestamps with repeats, small steps and large gaps, oldest first.
+    */
+    History timeline(std::mt19937_64& random, size_t count) {
+        History history {};
+        LogBlock::Timestamp t {std::chrono::steady_clock::now()};
+        for (size_t i {0}; i < count; ++i) {
+            switch (random() % 4) {
+                case 0: break;
+                case 1: t += std::chrono::nanoseconds(random() % 1000); break;
+                case 2: t += std::chrono::milliseconds(random() % 1000); break;
+                default: t += std::chrono::hours(random() % 100); break;
+            }
+            history.emplace_back(t, std::string());
+        }
+        return history;
+    }
+
+    /*
+    * Arbitrary bytes (NULs included), often edits of one of the last few values,
+    * so every reference, prefix and suffix path is taken.
+    */
+    void binaryHistories(SlabAllocator& slab) {
+        std::mt19937_64 random {1};
+        for (size_t round {0}; round < 300; ++round) {
+            History history {timeline(random, 1 + random() % 64)};
+            for (size_t i {0}; i < history.size(); ++i) {
+                std::string value {};
+                if (i > 0 && random() % 4 != 0) {
+                    value = history[i - 1 - random() % std::min<size_t>(i, 10)].second;
+                    const size_t edits {random() % 4};
+                    for (size_t e {0}; e < edits; ++e) {
+                        const size_t at {value.empty() ? 0 : random() % (value.size() + 1)};
+                        switch (random() % 3) {
+                            case 0: value.insert(at, 1 + random() % 5, static_cast<char>(random())); break;
+                            case 1: value.erase(at, random() % 5); break;
+                            default:
+                                if (at < value.size()) {
+                                    value[at] = static_cast<char>(random());
+                                }
+                                break;
+                        }
+                    }
+                } else {
+                    value.resize(random() % 100);
+                    for (char& c : value) {
+                        c = static_cast<char>(random() % 4 == 0 ? 0 : random());
+                    }
+                }
+                history[i].second = value;
+            }
+            checkRoundTrip(history, slab);
+        }
+    }
+
+    /*
+    * Counters with small and extreme steps, interleaved with text that only
+    * looks numeric ("007", "-0", "+5"), which must not be re-spelled.
+    */
+    void integerHistories(SlabAllocator& slab) {
+        constexpr int64_t MIN {std::numeric_limits<int64_t>::min()};
+        constexpr int64_t MAX {std::numeric_limits<int64_t>::max()};
+        const std::vector<std::string> lookalikes {"007", "-0", "+5", " 1", "1 ", "", "-", "99999999999999999999"};
+
+        std::mt19937_64 random {2};
+        for (size_t round {0}; round < 300; ++round) {
+            History history {timeline(random, 1 + random() % 64)};
+            int64_t counter {static_cast<int64_t>(random() % 2000) - 1000};
+            for (auto& record : history) {
+                switch (random() % 8) {
+                    case 0: counter = random() % 2 ? MIN : MAX; break;
+                    case 1: counter = static_cast<int64_t>(random()); break;
+                    case 2: record.second = lookalikes[random() % lookalikes.size()]; continue;
+                    default: counter += static_cast<int64_t>(random() % 7) - 3; break;
+                }
+                record.second = util::formatInteger(counter);
+            }
+            checkRoundTrip(history, slab);
+        }
+    }
+
+    /*
+    * INCRBYFLOAT-style values: fixed-notation doubles, with whole numbers
+    * among them that read as integers.
+    */
+    void floatHistories(SlabAllocator& slab) {
+        std::mt19937_64 random {3};
+        std::uniform_real_distribution<double> step {-10.0, 10.0};
+        for (size_t round {0}; round < 300; ++round) {
+            History history {timeline(random, 1 + random() % 64)};
+            double value {0};
+            for (auto& record : history) {
+                value = random() % 5 == 0 ? static_cast<double>(static_cast<int64_t>(value)) : value + step(random);
+                if (random() % 20 == 0) {
+                    value *= 1e200;
+                }
+                record.second = util::formatDouble(value);
+            }
+            checkRoundTrip(history, slab);
+        }
+    }
+
+    /*
+    * Steady counter increments stay at about two bytes a record.
+    */
+    void counterStepsAreCompact(SlabAllocator& slab) {
+        LogBlock::Builder builder {};
+        LogBlock::Timestamp t {std::chrono::steady_clock::now()};
+        for (int64_t i {0}; i < 64; ++i) {
+            builder.add(t, util::formatInteger(1'000'000 + i));
+            t += std::chrono::milliseconds(10);
+        }
+        LogBlock* block {builder.build(slab)};
+        CHECK(block->valuesBytes < 64 * 3);
+        LogBlock::destroy(block, slab);
+    }
+}
+
+int main() {
+    SlabAllocator slab {};
+    binaryHistories(slab);
+    integerHistories(slab);
+    floatHistories(slab);
+    counterStepsAreCompact(slab);
+    CHECK(slab.stats().allocated == 0);
+    return check::result();
+}
@@ -0,0 +1,85 @@
+#include "check.h"
+#include "mpsc_queue.h"
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using streamcache::MpscQueue;
+
+namespace {
+
+    /*
+    * Single-threaded: FIFO order, a full queue refuses pushes, and cells are
+    * reused lap after lap.
+    */
+    void boundedFifo() {
+        MpscQueue<uint64_t> queue {5};      // rounded up to 8
+        uint64_t item {0};
+        CHECK(queue.empty());
+        CHECK(!queue.tryPop(item));
+
+        for (uint64_t lap {0}; lap < 3; ++lap) {
+            for (uint64_t i {0}; i < 8; ++i) {
+                CHECK(queue.tryPush(lap * 8 + i));
+            }
+            CHECK(!queue.tryPush(99));
+            for (uint64_t i {0}; i < 8; ++i) {
+                CHECK(queue.tryPop(item));
+                CHECK(item == lap * 8 + i);
+            }
+            CHECK(queue.empty());
+        }
+    }
+
+    /*
+    * Several producers push through a small queue while one consumer drains
+    * it: every item arrives exactly once, and each producer's items arrive in
+    * the order it pushed them.
+    */
+    void producersKeepTheirOrder() {
+        constexpr uint64_t PRODUCERS {4};
+        constexpr uint64_t ITEMS {200000};
+        MpscQueue<uint64_t> queue {64};
+
+        std::vector<std::thread> producers {};
+        for (uint64_t p {0}; p < PRODUCERS; ++p) {
+            producers.emplace_back([&queue, p] {
+                for (uint64_t i {0}; i < ITEMS; ++i) {
+                    while (!queue.tryPush(p << 32 | i)) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+
+        std::vector<uint64_t> next(PRODUCERS, 0);
+        for (uint64_t received {0}; received < PRODUCERS * ITEMS;) {
+            uint64_t item {0};
+            if (!queue.tryPop(item)) {
+                std::this_thread::yield();
+                continue;
+            }
+            const uint64_t producer {item >> 32};
+            CHECK(producer < PRODUCERS);
+            if (producer < PRODUCERS) {
+                CHECK((item & 0xFFFFFFFFu) == next[producer]);
+                next[producer] = (item & 0xFFFFFFFFu) + 1;
+            }
+            ++received;
+        }
+
+        for (std::thread& producer : producers) {
+            producer.join();
+        }
+        for (uint64_t count : next) {
+            CHECK(count == ITEMS);
+        }
+        CHECK(queue.empty());
+    }
+}
+
+int main() {
+    boundedFifo();
+    producersKeepTheirOrder();
+    return check::result();
+}
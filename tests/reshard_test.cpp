@@ -0,0 +1,117 @@
+#include "cache.h"
+#include "check.h"
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using streamcache::Cache;
+using streamcache::CacheEntry;
+using streamcache::ValueRef;
+
+namespace {
+
+    constexpr size_t KEYS = 256;
+    constexpr size_t GROUP = 8;
+    constexpr size_t MAX_SHARDS = 16;
+
+    std::vector<CacheEntry> entriesFor(size_t count, const std::string& value) {
+        std::vector<CacheEntry> entries {};
+        for (size_t i {0}; i < count; ++i) {
+            entries.push_back(CacheEntry {value, std::nullopt, std::chrono::steady_clock::now()});
+        }
+        return entries;
+    }
+
+    std::vector<std::string> groupKeys(size_t group) {
+        std::vector<std::string> names {};
+        for (size_t i {0}; i < GROUP; ++i) {
+            names.push_back("group:" + std::to_string(group) + ":" + std::to_string(i));
+        }
+        return names;
+    }
+
+    std::vector<std::string_view> views(const std::vector<std::string>& names) {
+        return std::vector<std::string_view>(names.begin(), names.end());
+    }
+
+    /*
+    * MSET and MGET keep running while the cache grows one shard at a time.
+    * Each MSET writes one group of keys for the first time and the previous
+    * group for the second and last time, so a second write that a migration
+    * overwrites with the first is never hidden by a later one. No MGET may
+    * miss a key that exists, and every group must end with its second value.
+    */
+    void batchesSurviveResharding() {
+        Cache cache {1};
+        const std::vector<std::string> fixedNames {[] {
+            std::vector<std::string> names {};
+            for (size_t i {0}; i < KEYS; ++i) {
+                names.push_back("key:" + std::to_string(i));
+            }
+            return names;
+        }()};
+        const std::vector<std::string_view> fixed {views(fixedNames)};
+        cache.multiSet(fixed, entriesFor(KEYS, "fixed"));
+
+        std::atomic<bool> stop {false};
+        std::atomic<size_t> groups {0};
+        std::thread writer([&] {
+            std::vector<std::string> previous {};
+            for (size_t group {0}; !stop.load(); ++group) {
+                std::vector<std::string> names {groupKeys(group)};
+                std::vector<CacheEntry> entries {entriesFor(GROUP, "first")};
+                for (const std::string& name : previous) {
+                    names.push_back(name);
+                    entries.push_back(CacheEntry {"second", std::nullopt, std::chrono::steady_clock::now()});
+                }
+                cache.multiSet(views(names), std::move(entries));
+                previous = groupKeys(group);
+                groups.store(group + 1);
+            }
+        });
+
+        std::atomic<size_t> misses {0};
+        std::thread reader([&] {
+            while (!stop.load()) {
+                for (const std::optional<ValueRef>& value : cache.multiGet(fixed)) {
+                    if (!value) {
+                        misses.fetch_add(1);
+                    }
+                }
+            }
+        });
+
+        for (size_t shards {2}; shards <= MAX_SHARDS; ++shards) {
+            CHECK(cache.reshard(shards));
+            while (cache.resharding()) {
+                std::this_thread::yield();
+            }
+        }
+        stop.store(true);
+        writer.join();
+        reader.join();
+
+        CHECK(misses.load() == 0);
+        CHECK(cache.shardCount() == MAX_SHARDS);
+
+        // The last group was only written once.
+        size_t lost {0};
+        for (size_t group {0}; group + 1 < groups.load(); ++group) {
+            for (const std::string& name : groupKeys(group)) {
+                if (cache.get(name) != "second") {
+                    ++lost;
+                }
+            }
+        }
+        CHECK(lost == 0);
+    }
+}
+
+int main() {
+    batchesSurviveResharding();
+    return check::result();
+}
@@ -0,0 +1,261 @@
+#include "cache.h"
+#include "check.h"
+#include "server.h"
+#include "time_util.h"
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using streamcache::Cache;
+using streamcache::Server;
+using streamcache::ServerConfig;
+
+namespace {
+
+    /*
+    * One RESP reply, as far as these tests need to look into it.
+    */
+    struct Reply {
+        char type {0};
+        std::string text {};
+        int64_t integer {0};
+        bool null {false};
+        std::vector<Reply> elements {};
+    };
+
+    /*
+    * Blocking RESP client over a Unix socket.
+    */
+    class Client {
+        public:
+            explicit Client(const std::string& path) {
+                m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+                sockaddr_un addr {};
+                addr.sun_family = AF_UNIX;
+                path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+                CHECK(connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+            }
+
+            ~Client() { close(m_fd); }
+
+            Reply call(const std::vector<std::string>& args) {
+                send({args});
+                return readReply();
+            }
+
+            /**
+            * Writes the commands in one go without reading any reply; receive()
+            * then takes the replies one at a time.
+            */
+            void send(const std::vector<std::vector<std::string>>& commands) {
+                std::string request {};
+                for (const std::vector<std::string>& args : commands) {
+                    request += "*" + std::to_string(args.size()) + "\r\n";
+                    for (const std::string& arg : args) {
+                        request += "$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+                    }
+                }
+                size_t written {0};
+                while (written < request.size()) {
+                    const ssize_t n {write(m_fd, request.data() + written, request.size() - written)};
+                    CHECK(n > 0);
+                    if (n <= 0) {
+                        return;
+                    }
+                    written += static_cast<size_t>(n);
+                }
+            }
+
+            Reply receive() { return readReply(); }
+
+        private:
+            int m_fd {-1};
+            std::string m_buffer {};
+
+            std::string readLine() {
+                size_t end {};
+                while ((end = m_buffer.find("\r\n")) == std::string::npos) {
+                    fill();
+                }
+                std::string line {m_buffer.substr(0, end)};
+                m_buffer.erase(0, end + 2);
+                return line;
+            }
+
+            void fill() {
+                char chunk[4096];
+                const ssize_t n {read(m_fd, chunk, sizeof(chunk))};
+                CHECK(n > 0);
+                if (n <= 0) {
+                    throw std::runtime_error("connection closed");
+                }
+                m_buffer.append(chunk, static_cast<size_t>(n));
+            }
+
+            Reply readReply() {
+                const std::string line {readLine()};
+                Reply reply {};
+                reply.type = line[0];
+                const std::string rest {line.substr(1)};
+                switch (reply.type) {
+                    case '$':
+                        if (rest == "-1") {
+                            reply.null = true;
+                        } else {
+                            const size_t size {std::stoul(rest)};
+                            while (m_buffer.size() < size + 2) {
+                                fill();
+                            }
+                            reply.text = m_buffer.substr(0, size);
+                            m_buffer.erase(0, size + 2);
+                        }
+                        break;
+                    case '*':
+                        if (rest == "-1") {
+                            reply.null = true;
+                        } else {
+                            for (long i {0}, n {std::stol(rest)}; i < n; ++i) {
+                                reply.elements.push_back(readReply());
+                            }
+                        }
+                        break;
+                    case ':':
+                        reply.integer = std::stoll(rest);
+                        break;
+                    default:
+                        reply.text = rest;
+                        break;
+                }
+                return reply;
+            }
+    };
+
+    /*
+    * Times printed by REPLAY are whole milliseconds; fed back as TO or AS OF
+    * they must cover the whole millisecond, so each one finds the record it
+    * was printed for.
+    */
+    void replayTimesFeedBackIntoUpperBounds(Client& client) {
+        CHECK(client.call({"SET", "k", "old"}).text == "OK");
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        CHECK(client.call({"SET", "k", "new"}).text == "OK");
+        // Usually in the same millisecond as the write before it.
+        CHECK(client.call({"SET", "k", "newest"}).text == "OK");
+
+        const Reply replay {client.call({"REPLAY", "k"})};
+        CHECK(replay.elements.size() == 3);
+        if (replay.elements.size() != 3) {
+            return;
+        }
+        const int64_t oldAt {replay.elements[0].elements[0].integer};
+        const int64_t newestAt {replay.elements[2].elements[0].integer};
+        CHECK(oldAt < newestAt);
+
+        CHECK(client.call({"GET", "k", "AS", "OF", std::to_string(oldAt)}).text == "old");
+        CHECK(client.call({"GET", "k", "AS", "OF", std::to_string(newestAt)}).text == "newest");
+        CHECK(client.call({"GET", "k", "AS", "OF", std::to_string(oldAt - 1)}).null);
+
+        for (const Reply& record : replay.elements) {
+            const std::string at {std::to_string(record.elements[0].integer)};
+            const Reply range {client.call({"REPLAY", "k", "FROM", at, "TO", at})};
+            CHECK(!range.elements.empty());
+            bool found {false};
+            for (const Reply& match : range.elements) {
+                CHECK(match.elements[0].integer == record.elements[0].integer);
+                found = found || match.elements[1].text == record.elements[1].text;
+            }
+            CHECK(found);
+
+            const Reply upTo {client.call({"REPLAY", "k", "TO", at})};
+            CHECK(!upTo.elements.empty() && upTo.elements.back().elements[0].integer == record.elements[0].integer);
+        }
+    }
+
+    /*
+    * A client that pipelines commands without reading the replies does not
+    * get them all executed and buffered: once the replies fill the socket,
+    * the server stops parsing until they are read. Every reply still arrives,
+    * in order, once the client reads.
+    */
+    void pipelineWaitsForUnreadReplies(const std::string& path, Client& client) {
+        constexpr int PIPELINE {2000};
+        const std::string big(16 * 1024, 'x');
+        CHECK(client.call({"SET", "big", big}).text == "OK");
+
+        Client pipelined {path};
+        std::vector<std::vector<std::string>> commands {};
+        for (int i {0}; i < PIPELINE; ++i) {
+            commands.push_back({"GET", "big"});
+            commands.push_back({"INCR", "counter"});
+        }
+        std::thread sender([&pipelined, &commands] { pipelined.send(commands); });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        const Reply executed {client.call({"GET", "counter"})};
+        CHECK(!executed.null && std::stoll(executed.text) < PIPELINE);
+
+        bool intact {true};
+        for (int i {1}; i <= PIPELINE; ++i) {
+            intact = intact && pipelined.receive().text == big;
+            intact = intact && pipelined.receive().integer == i;
+        }
+        CHECK(intact);
+        sender.join();
+    }
+
+    /*
+    * GET and MGET on a sorted set answer WRONGTYPE, like INCR, rather than nil;
+    * a missing key is still nil.
+    */
+    void stringReadsOfSortedSetsAreWrongType(Client& client) {
+        CHECK(client.call({"ZADD", "board", "1", "alice"}).integer == 1);
+        CHECK(client.call({"SET", "plain", "v"}).text == "OK");
+
+        const std::string wrongType {"WRONGTYPE Operation against a key holding the wrong kind of value"};
+        const Reply get {client.call({"GET", "board"})};
+        CHECK(get.type == '-' && get.text == wrongType);
+        const Reply incr {client.call({"INCR", "board"})};
+        CHECK(incr.type == '-' && incr.text == wrongType);
+        const Reply mget {client.call({"MGET", "plain", "board", "missing"})};
+        CHECK(mget.type == '-' && mget.text == wrongType);
+
+        CHECK(client.call({"GET", "missing"}).null);
+        const Reply strings {client.call({"MGET", "plain", "missing"})};
+        CHECK(strings.elements.size() == 2 && strings.elements[0].text == "v" && strings.elements[1].null);
+    }
+
+    void millisecondBoundsRoundTrip() {
+        const auto now {std::chrono::steady_clock::now()};
+        const int64_t millis {util::toEpochMillis(now)};
+        CHECK(util::fromEpochMillis(millis) <= now && now <= util::throughEpochMillis(millis));
+        CHECK(util::toEpochMillis(util::fromEpochMillis(millis)) == millis);
+        CHECK(util::toEpochMillis(util::throughEpochMillis(millis)) == millis);
+        CHECK(util::toEpochMillis(util::throughEpochMillis(millis) + std::chrono::nanoseconds(1)) == millis + 1);
+    }
+}
+
+int main() {
+    millisecondBoundsRoundTrip();
+
+    Cache cache {2};
+    ServerConfig config {};
+    config.port = 0;
+    config.unixSocket = "/tmp/streamcache_server_test_" + std::to_string(getpid()) + ".sock";
+    config.ioThreads = 1;
+    Server server {cache, config};
+    server.start();
+    {
+        Client client {config.unixSocket};
+        replayTimesFeedBackIntoUpperBounds(client);
+        pipelineWaitsForUnreadReplies(config.unixSocket, client);
+        stringReadsOfSortedSetsAreWrongType(client);
+    }
+    server.stop();
+    return check::result();
+}
@@ -0,0 +1,205 @@
+#include "cache.h"
+#include "check.h"
+#include "log_ring.h"
+#include "slab_allocator.h"
+#include "snapshot.h"
+#include "time_util.h"
+#include "value.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <unistd.h>
+#include <vector>
+
+using streamcache::Cache;
+using streamcache::CacheEntry;
+using streamcache::LogRecordView;
+using streamcache::LogRing;
+using streamcache::LogStats;
+using streamcache::ScoredMember;
+using streamcache::SlabAllocator;
+using streamcache::Value;
+
+namespace {
+
+    constexpr size_t SHARDS = 4;
+
+    /*
+    * What a key looks like from outside: its value, its sorted-set members and
+    * its log, with times in epoch microseconds (the on-disk resolution).
+    */
+    struct KeyState {
+        std::string value {};
+        std::vector<std::pair<std::string, double>> members {};
+        std::vector<std::pair<int64_t, std::string>> log {};
+
+        bool operator==(const KeyState& other) const {
+            return value == other.value && members == other.members && log == other.log;
+        }
+    };
+
+    std::map<std::string, KeyState> capture(Cache& cache, const std::vector<std::string>& keys) {
+        std::map<std::string, KeyState> state {};
+        for (const std::string& key : keys) {
+            KeyState& keyState {state[key]};
+            keyState.value = cache.get(key).value_or("");
+            std::vector<ScoredMember> members {};
+            cache.zrange(key, 0, -1, members);
+            for (const ScoredMember& member : members) {
+                keyState.members.emplace_back(member.member, member.score);
+            }
+            if (auto log {cache.getReplay(key)}) {
+                for (const auto& record : *log) {
+                    keyState.log.emplace_back(util::toEpochMicros(record.timestamp), record.value);
+                }
+            }
+        }
+        return state;
+    }
+
+    void set(Cache& cache, const std::string& key, std::string value) {
+        cache.set(key, CacheEntry {std::move(value), std::nullopt, std::chrono::steady_clock::now()});
+    }
+
+    std::filesystem::path freshDir(const char* name) {
+        std::filesystem::path dir {std::filesystem::temp_directory_path()
+            / (std::string(name) + "-" + std::to_string(::getpid()))};
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        return dir;
+    }
+
+    /*
+    * A snapshot larger than one section (so the export runs in many steps and
+    * closes several sections) loads back into exactly what was written.
+    */
+    void largeSnapshotRoundTrips() {
+        const std::filesystem::path dir {freshDir("streamcache-snapshot-test")};
+        const std::string path {(dir / "dump.snap").string()};
+
+        std::vector<std::string> keys {};
+        std::map<std::string, KeyState> before {};
+        {
+            Cache cache {SHARDS};
+            const std::string padding(300, 'p');
+            for (int i = 0; i < 20000; ++i) {
+                keys.push_back("key:" + std::to_string(i));
+                set(cache, keys.back(), padding + std::to_string(i));
+                if (i % 100 == 0) {
+                    set(cache, keys.back(), "second:" + std::to_string(i));
+                }
+            }
+            for (int i = 0; i < 50; ++i) {
+                keys.push_back("zset:" + std::to_string(i));
+                std::vector<ScoredMember> members {};
+                for (int m = 0; m < 20; ++m) {
+                    members.push_back({"m" + std::to_string(m), static_cast<double>(m * i)});
+                }
+                cache.zadd(keys.back(), members);
+            }
+            before = capture(cache, keys);
+            cache.snapshot(path);
+        }
+        CHECK(std::filesystem::file_size(path) > streamcache::SnapshotWriter::SECTION_BYTES);
+
+        Cache restored {SHARDS};
+        CHECK(restored.loadSnapshot(path) == keys.size());
+        CHECK(capture(restored, keys) == before);
+
+        std::filesystem::remove_all(dir);
+    }
+
+    /*
+    * A snapshot taken while writers keep going, plus the AOF written after it,
+    * recovers every key's value and log exactly: writes the export both saw
+    * and the AOF recorded come back once, not twice.
+    */
+    void snapshotUnderWritesRecoversWithAof() {
+        const std::filesystem::path dir {freshDir("streamcache-snapshot-aof-test")};
+        const std::string path {(dir / "dump.snap").string()};
+        constexpr int KEYS {500};
+
+        std::vector<std::string> keys {};
+        for (int i = 0; i < KEYS; ++i) {
+            keys.push_back("key:" + std::to_string(i));
+        }
+        for (int i = 0; i < 20; ++i) {
+            keys.push_back("zset:" + std::to_string(i));
+        }
+
+        std::map<std::string, KeyState> before {};
+        {
+            Cache cache {SHARDS};
+            cache.enableAof({dir.string()});
+            for (int i = 0; i < KEYS; ++i) {
+                set(cache, keys[i], "initial");
+            }
+
+            std::atomic<bool> stop {false};
+            std::thread writer([&cache, &keys, &stop] {
+                for (int n = 0; !stop.load(std::memory_order_relaxed) && n < 200 * KEYS; ++n) {
+                    set(cache, keys[n % KEYS], "write:" + std::to_string(n));
+                    if (n % 10 == 0) {
+                        cache.zadd(keys[KEYS + n % 20], {{"m" + std::to_string(n % 7), static_cast<double>(n)}});
+                    }
+                }
+            });
+            for (int i = 0; i < 3; ++i) {
+                cache.snapshot(path);
+            }
+            stop.store(true);
+            writer.join();
+
+            before = capture(cache, keys);
+        }
+
+        Cache restored {SHARDS};
+        restored.loadSnapshot(path);
+        restored.enableAof({dir.string()});
+        CHECK(capture(restored, keys) == before);
+
+        std::filesystem::remove_all(dir);
+    }
+
+    /*
+    * Re-inserting a record the log already holds (same time, same value) is a
+    * no-op, whether the record is still hot or already sealed; a different
+    * value at the same time is kept.
+    */
+    void duplicateLogRecordsAreDropped() {
+        const auto start {std::chrono::steady_clock::now()};
+        const auto at {[start](int i) { return start + std::chrono::microseconds(i); }};
+        SlabAllocator slab {};
+        LogStats stats {};
+        LogRing ring {slab, stats};
+        constexpr int RECORDS {200};
+        for (int i = 0; i < RECORDS; ++i) {
+            ring.insert({at(i), Value("v" + std::to_string(i), slab)}, LogRing::DEFAULT_MAX_RECORDS);
+        }
+        CHECK(ring.seal() > 0);
+        CHECK(ring.sealedSize() > 0);
+
+        ring.insert({at(3), Value("v3", slab)}, LogRing::DEFAULT_MAX_RECORDS);
+        ring.insert({at(RECORDS - 2), Value("v" + std::to_string(RECORDS - 2), slab)}, LogRing::DEFAULT_MAX_RECORDS);
+        CHECK(ring.size() == RECORDS);
+
+        ring.insert({at(5), Value("other", slab)}, LogRing::DEFAULT_MAX_RECORDS);
+        std::vector<std::string> values {};
+        ring.forEach([&values](const LogRecordView& record) { values.emplace_back(record.value); });
+        CHECK(values.size() == RECORDS + 1);
+        CHECK(values[5] == "v5" && values[6] == "other" && values[7] == "v6");
+        ring.clear();
+    }
+}
+
+int main() {
+    largeSnapshotRoundTrips();
+    snapshotUnderWritesRecoversWithAof();
+    duplicateLogRecordsAreDropped();
+    return check::result();
+}
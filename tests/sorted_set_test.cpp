@@ -0,0 +1,192 @@
+#include "cache.h"
+#include "check.h"
+#include "slab_allocator.h"
+#include "sorted_set.h"
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using streamcache::Cache;
+using streamcache::EvictionPolicy;
+using streamcache::ScoreBound;
+using streamcache::ScoredMember;
+using streamcache::SlabAllocator;
+using streamcache::SortedSet;
+
+namespace {
+
+    using Ordered = std::map<std::pair<double, std::string>, bool>;
+
+    std::vector<std::pair<std::string, double>> byRank(const SortedSet& set, size_t start, size_t stop) {
+        std::vector<std::pair<std::string, double>> members {};
+        set.forEachByRank(start, stop, [&members](std::string_view member, double score) {
+            members.emplace_back(std::string(member), score);
+        });
+        return members;
+    }
+
+    bool inRange(double score, ScoreBound max, ScoreBound min) {
+        return (max.exclusive ? score < max.value : score <= max.value)
+            && (min.exclusive ? score > min.value : score >= min.value);
+    }
+
+    /*
+    * Random adds and score moves against std::map ordered by (score, member).
+    * Few distinct scores make ties common, so the member-bytes order and the
+    * rank spans of equal-score runs are exercised.
+    */
+    void randomOperationsMatchReference() {
+        SlabAllocator slab {};
+        std::atomic<size_t> indexBytes {0};
+        {
+            SortedSet set {slab, indexBytes};
+            Ordered ordered {};
+            std::unordered_map<std::string, double> scores {};
+            std::mt19937_64 random {7};
+
+            const auto randomScore {[&random] {
+                return random() % 4 == 0 ? static_cast<double>(random() % 1000) / 7 : static_cast<double>(random() % 20);
+            }};
+
+            for (size_t step {0}; step < 60000; ++step) {
+                const std::string member {"m" + std::to_string(random() % 3000)};
+                const double score {randomScore()};
+
+                auto found {scores.find(member)};
+                const bool added {found == scores.end()};
+                if (!added) {
+                    ordered.erase({found->second, member});
+                }
+                ordered[{score, member}] = true;
+                scores[member] = score;
+                CHECK(set.set(member, score) == added);
+                CHECK(set.size() == scores.size());
+
+                // Score and rank of some member.
+                const std::string probe {"m" + std::to_string(random() % 3100)};
+                auto expected {scores.find(probe)};
+                const auto rank {set.rank(probe)};
+                if (expected == scores.end()) {
+                    CHECK(!set.score(probe) && !rank);
+                } else {
+                    CHECK(set.score(probe) == expected->second);
+                    const auto position {std::distance(ordered.begin(), ordered.find({expected->second, probe}))};
+                    CHECK(rank && *rank == static_cast<size_t>(position));
+                }
+
+                if (step % 500 == 0) {
+                    // A rank range, including one that runs off the end.
+                    const size_t start {random() % (ordered.size() + 2)};
+                    const size_t stop {start + random() % 50};
+                    auto it {ordered.begin()};
+                    std::advance(it, std::min(start, ordered.size()));
+                    std::vector<std::pair<std::string, double>> want {};
+                    for (size_t i {start}; i <= stop && it != ordered.end(); ++i, ++it) {
+                        want.emplace_back(it->first.second, it->first.first);
+                    }
+                    CHECK(byRank(set, start, stop) == want);
+
+                    // A descending score range with an offset and a count.
+                    ScoreBound max {randomScore(), random() % 2 == 0};
+                    ScoreBound min {randomScore(), random() % 2 == 0};
+                    if (random() % 5 == 0) {
+                        max.value = INFINITY;
+                    }
+                    if (random() % 5 == 0) {
+                        min.value = -INFINITY;
+                    }
+                    const size_t offset {random() % 5};
+                    const size_t count {random() % 40};
+                    want.clear();
+                    size_t skipped {0};
+                    for (auto rit {ordered.rbegin()}; rit != ordered.rend() && want.size() < count; ++rit) {
+                        if (inRange(rit->first.first, max, min) && skipped++ >= offset) {
+                            want.emplace_back(rit->first.second, rit->first.first);
+                        }
+                    }
+                    std::vector<std::pair<std::string, double>> got {};
+                    set.forEachByScoreDescending(max, min, offset, count, [&got](std::string_view member, double score) {
+                        got.emplace_back(std::string(member), score);
+                    });
+                    CHECK(got == want);
+                }
+
+                if (step % 10000 == 0) {
+                    std::vector<std::pair<std::string, double>> all {};
+                    for (const auto& entry : ordered) {
+                        all.emplace_back(entry.first.second, entry.first.first);
+                    }
+                    CHECK(byRank(set, 0, SIZE_MAX) == all);
+                }
+            }
+
+            size_t visited {0};
+            auto it {ordered.begin()};
+            set.forEach([&](std::string_view member, double score) {
+                CHECK(it != ordered.end() && it->first.second == member && it->first.first == score);
+                ++it;
+                ++visited;
+            });
+            CHECK(visited == ordered.size());
+            CHECK(indexBytes.load() >= ordered.size() * (1 + sizeof(void*)));
+        }
+
+        // Every node, header included, went back to the slab, and the index is no longer counted.
+        CHECK(slab.stats().allocated == 0);
+        CHECK(indexBytes.load() == 0);
+    }
+
+    /*
+    * Sorted sets alone are enough to push a shard over maxmemory: older sets
+    * are evicted, and memory stays within the limit plus blocks still waiting
+    * for readers.
+    */
+    void sortedSetsAreEvictedUnderMaxMemory() {
+        constexpr size_t LIMIT {2 * 1024 * 1024};
+        Cache cache {1};
+        cache.setMemoryLimit(LIMIT, EvictionPolicy::LRU);
+
+        std::vector<ScoredMember> members {};
+        for (size_t i {0}; i < 100; ++i) {
+            members.push_back({"player:" + std::to_string(i), static_cast<double>(i)});
+        }
+        for (size_t key {0}; key < 2000; ++key) {
+            cache.zadd("board:" + std::to_string(key), members);
+            CHECK(cache.memoryStats().allocated <= LIMIT + 64 * 1024);
+        }
+
+        CHECK(cache.memoryEvictions() > 0);
+        size_t count {0};
+        cache.zcard("board:1999", count);
+        CHECK(count == members.size());
+    }
+
+    void memberUpdatesRoundTrip() {
+        for (const double score : {0.0, -1.5, 1e-7, 12345678.25, 1e300}) {
+            for (const std::string member : {"", "alice", "two words", "tab\there"}) {
+                std::string_view decodedMember {};
+                double decodedScore {0};
+                const std::string update {streamcache::encodeMemberUpdate(member, score)};
+                CHECK(streamcache::decodeMemberUpdate(update, decodedMember, decodedScore));
+                CHECK(decodedMember == member && decodedScore == score);
+            }
+        }
+        std::string_view member {};
+        double score {0};
+        CHECK(!streamcache::decodeMemberUpdate("nospace", member, score));
+        CHECK(!streamcache::decodeMemberUpdate("abc member", member, score));
+    }
+}
+
+int main() {
+    randomOperationsMatchReference();
+    memberUpdatesRoundTrip();
+    sortedSetsAreEvictedUnderMaxMemory();
+    return check::result();
+}